@@ -0,0 +1,612 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// Boots the 1541 ROM with a D64 mounted and reports how many emulated 1MHz cycles per second each part of the core sustains.
+// Anything below 1000000 cycles/s could not keep up with a real drive; the ns/cycle figure is what is left of the 1us budget in Emulate1541.
+
+#include "HostPlatform.h"
+#include "M6502Ref.h"
+#include "gcr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern u8 read6502(u16 address);
+extern void write6502(u16 address, const u8 value);
+extern int BenchM6502(u32 cycles, void (*report)(const char* name, u32 cycles, u64 ns));
+extern int BenchM6522(u32 cycles, void (*report)(const char* name, u32 cycles, u64 ns));
+extern int BenchM8520(u32 cycles, void (*report)(const char* name, u32 cycles, u64 ns));
+extern int BenchDrive(const char* path, u32 cycles, void (*report)(const char* name, u32 cycles, u64 ns));
+extern int BenchDiskImage();
+extern int BenchGCR();
+extern int BenchCaddy();
+extern int BenchMount(const char* path);
+extern int BenchExtract(const char* corpus);
+extern int BenchGCRCache();
+extern int BenchHash(const char* path);
+extern int ProfileReport(const char* path, const char* symbolsPath);
+extern void ShadowVIAs();
+extern void ShadowVIAsUpdate();
+extern bool ShadowVIAsEnd();
+
+#define D64_35_TRACK_SIZE 174848
+#define D64_ID_OFFSET 0x165A2
+#define RESTORE_PATH "/tmp/pi1541bench-restore.d64"
+#define RESTORE_TRACK 19	// Track 20, well away from the directory the head is on
+#define INDEXED_TRACK 20	// Track 21, which the new mount has found a sector on before the state is loaded
+#define INDEXED_SHIFT 13	// Bits further on than its sectors were, so that where they were found is no longer right
+
+static FILINFO diskFileInfo;
+static DiskImage diskImage;
+static u8 imageBuffer[READBUFFER_SIZE];	// What an image is loaded into to be opened
+
+static void Usage(const char* name)
+{
+	printf("Usage: %s -rom <1541 rom> [-d64 <image>] [-cycles <n>] [-device <8-11>] [-extraram]\r\n", name);
+	printf("       %s -rom <1541 rom> ... [-savestate <file>] [-loadstate <file>] [-idle] [-via]\r\n", name);
+	printf("       %s -cpu [-cycles <n>]\r\n", name);
+	printf("       %s -via [-cycles <n>]\r\n", name);
+	printf("       %s -cia [-cycles <n>]\r\n", name);
+	printf("       %s -drive [-d64 <image>] [-cycles <n>]\r\n", name);
+	printf("       %s -disk\r\n", name);
+	printf("       %s -gcr\r\n", name);
+	printf("       %s -caddy\r\n", name);
+	printf("       %s -mount [-d64 <image>]\r\n", name);
+	printf("       %s -extract [-corpus <directory>]\r\n", name);
+	printf("       %s -gcrcache\r\n", name);
+	printf("       %s -hash [-d64 <image>]\r\n", name);
+	printf("       %s -rom <1541 rom> ... -profile <file> [-symbols <file>]\r\n", name);
+	printf("       %s -report <file> [-symbols <file>]\r\n", name);
+	printf("  Without -d64 a blank 35 track image is mounted.\r\n");
+	printf("  -savestate saves the drive after the emulate phase and checks that reloading it replays the same cycles.\r\n");
+	printf("       Then it checks a state with tracks written to is kept when loaded into the image newly mounted.\r\n");
+	printf("  -loadstate resumes from a saved state (same ROM and image) instead of the boot.\r\n");
+	printf("  -idle runs the emulate phase again skipping idle loop iterations and checks it ends in the same state.\r\n");
+	printf("  -cpu cross checks M6502 against M6502Ref on random code and times both.\r\n");
+	printf("  -via on its own cross checks m6522 against m6522Ref on random accesses and times both.\r\n");
+	printf("       With -rom it checks the VIAs against m6522Ref on every cycle of the emulate phase.\r\n");
+	printf("  -cia cross checks m8520 against m8520Ref on random accesses and times both.\r\n");
+	printf("  -drive checks Drive's rotation, reading, writing and noise against DriveRef on a generated G64 with flux gaps,\r\n");
+	printf("       then reads, writes and steps over an image (D64, G64, NIB or NBZ, or the G64 without -d64) and times both.\r\n");
+	printf("       Before that it checks D64 tracks encoded as they are needed and reports the mount to first byte time.\r\n");
+	printf("  -mount checks that images read a piece at a time as they are converted open as they did read whole and times both,\r\n");
+	printf("       on a generated D64, G64, NIB, NBZ and D81 (and the -d64 image, which can be any of those).\r\n");
+	printf("  -extract checks that NIBs (generated and the .nib and .nbz files in -corpus) have the same tracks when other threads\r\n");
+	printf("       help extract them (as the idle cores of a Pi 2 or 3 do) and times each with 0 to 3 helping.\r\n");
+	printf("  -gcrcache checks that a NIB or NBZ mounted again reads its tracks from the GCR cache (unless the file has changed,\r\n");
+	printf("       the entry is damaged or it has been evicted) with the same tracks as extracted, and times both.\r\n");
+	printf("  -hash checks ImageHash (however an image is split up) and the quirk table and times them; with -d64 it shows the image's\r\n");
+	printf("       hash for quirks.txt.\r\n");
+	printf("  -disk checks that writing back only the sectors of a D64 and a D81 that have changed matches writing them whole.\r\n");
+	printf("  -profile saves a profile of the emulate phase (needs make PROFILE=1) and reports it.\r\n");
+	printf("  -report reports the hottest routines and instructions of a saved profile (eg pi1541.prof from the SD card).\r\n");
+	printf("  -symbols adds \"<hex address> <name>\" lines to the 1541 ROM's entry points.\r\n");
+}
+
+static void Report(const char* name, u32 cycles, u64 ns)
+{
+	double seconds = (double)ns / 1000000000.0;
+	double cyclesPerSecond = seconds > 0 ? (double)cycles / seconds : 0;
+	double nsPerCycle = cycles ? (double)ns / (double)cycles : 0;
+	printf("%-10s %10u cycles %9.3f ms %12.0f cycles/s %8.2f ns/cycle %6.1f%% of 1us\r\n", name, cycles, (double)ns / 1000000.0, cyclesPerSecond, nsPerCycle, nsPerCycle / 10.0);
+}
+
+// Everything a bisect cares about; the CPU registers, the RAM and where the head is.
+static u32 StateHash()
+{
+	u16 pc;
+	u8 sp, a, x, y, status;
+	u32 hash = 2166136261u;
+
+	pi1541.m6502.GetRegs(pc, sp, a, x, y, status);
+	u32 values[] = { pc, sp, a, x, y, status, pi1541.drive.Track(), pi1541.drive.GetHeadBitOffset() };
+	for (u32 index = 0; index < sizeof(values) / sizeof(values[0]); ++index)
+		hash = (hash ^ values[index]) * 16777619;
+	for (u32 index = 0; index < 0x800; ++index)
+		hash = (hash ^ s_u8Memory[index]) * 16777619;
+	return hash;
+}
+
+static u32 RunAndHash(u32 cycles)
+{
+	pi1541.RunCycles(cycles, RUN_READ_BUS | RUN_REFRESH_BUS);
+	return StateHash();
+}
+
+static bool SaveAndCheckState(const char* path, u32 cycles)
+{
+	static u8 buffer[1024 * 1024];
+
+	u64 before = HostNanoSeconds();
+	if (!pi1541.SaveStateToFile(path))
+	{
+		printf("Cannot save state to %s\r\n", path);
+		return false;
+	}
+	u64 saved = HostNanoSeconds();
+	u32 size = pi1541.SaveState(buffer, sizeof(buffer));
+	u32 hash = RunAndHash(cycles);
+
+	u64 beforeLoad = HostNanoSeconds();
+	if (!pi1541.LoadStateFromFile(path))
+	{
+		printf("Cannot load state from %s\r\n", path);
+		return false;
+	}
+	u64 loaded = HostNanoSeconds();
+	u32 replayHash = RunAndHash(cycles);
+	printf("state %u bytes saved in %.3f ms, loaded in %.3f ms, replay of %u cycles %s\r\n", size, (double)(saved - before) / 1000000.0, (double)(loaded - beforeLoad) / 1000000.0,
+		cycles, hash == replayHash ? "matches" : "DIFFERS");
+	return hash == replayHash;
+}
+
+// Writes every sector of the track again (as the drive does, a bit at a time) inverted and INDEXED_SHIFT bits further on.
+static void WriteShiftedTrack(DiskImage& image, unsigned track, u8* sectors)
+{
+	u8 gcr[GCR_SECTOR_LENGTH];
+	unsigned sectorRef = 0;
+
+	for (unsigned previous = 0; previous < track; ++previous)
+		sectorRef += DiskImage::SectorsPerTrack[previous];
+	image.PrepareTrack(track * 2);
+	for (unsigned sector = 0; sector < DiskImage::SectorsPerTrack[track]; ++sector)
+	{
+		u8* data = sectors + sector * 256;
+		for (unsigned byte = 0; byte < 256; ++byte)
+			data[byte] = (u8)~imageBuffer[(sectorRef + sector) * 256 + byte];
+		convert_sector_to_GCR(data, gcr, track + 1, sector, imageBuffer + D64_ID_OFFSET, SECTOR_OK);
+		for (unsigned bitIndex = 0; bitIndex < GCR_SECTOR_LENGTH * 8; ++bitIndex)
+		{
+			unsigned trackBit = (sector * GCR_SECTOR_LENGTH * 8 + INDEXED_SHIFT + bitIndex) % image.BitsInTrack(track * 2);
+			image.SetBit(track * 2, trackBit >> 3, 7 - (trackBit & 7), (gcr[bitIndex >> 3] >> (7 - (bitIndex & 7))) & 1);
+		}
+	}
+}
+
+// A state saved with a sector written to a D64 must bring the write back when it is loaded into the same image newly mounted,
+// where the track has not been encoded yet. Encoding the rest of the tracks (as the drive does while idle) must leave it alone
+// and writing the image back must put the sector in the file. A track the new mount has already found sectors on must have
+// them found again where the state has them.
+static bool CheckRestoreIntoNewMount(const char* path)
+{
+	static u8 shifted[21 * 256];
+	static u8 start[1024 * 1024];
+	static DiskImage written;
+	static DiskImage restored;
+	static FILINFO restoreInfo;
+	u8 gcr[GCR_SECTOR_LENGTH];
+	u8 sector[256];
+	u8 saved[256];
+	unsigned track = RESTORE_TRACK * 2;
+	unsigned sectorRef = 0;
+	FIL fp;
+	u32 bytes;
+
+	for (unsigned previous = 0; previous < RESTORE_TRACK; ++previous)
+		sectorRef += DiskImage::SectorsPerTrack[previous];
+	u32 startSize = pi1541.SaveState(start, sizeof(start));
+
+	// The file the restored image is written back to starts out as the image mounted.
+	strcpy(restoreInfo.fname, RESTORE_PATH);
+	restoreInfo.fsize = diskFileInfo.fsize;
+	if (f_open(&fp, RESTORE_PATH, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return false;
+	f_write(&fp, imageBuffer, diskFileInfo.fsize, &bytes);
+	f_close(&fp);
+
+	// Sector 0 of the track with every byte inverted, written as the drive does (a bit at a time).
+	for (unsigned byte = 0; byte < 256; ++byte)
+		sector[byte] = (u8)~imageBuffer[sectorRef * 256 + byte];
+	convert_sector_to_GCR(sector, gcr, RESTORE_TRACK + 1, 0, imageBuffer + D64_ID_OFFSET, SECTOR_OK);
+	written.OpenD64(&diskFileInfo, imageBuffer, diskFileInfo.fsize);
+	written.SetReadOnly(true);
+	pi1541.drive.Insert(&written);
+	written.PrepareTrack(track);
+	for (unsigned bitIndex = 0; bitIndex < GCR_SECTOR_LENGTH * 8; ++bitIndex)
+		written.SetBit(track, bitIndex >> 3, 7 - (bitIndex & 7), (gcr[bitIndex >> 3] >> (7 - (bitIndex & 7))) & 1);
+	WriteShiftedTrack(written, INDEXED_TRACK, shifted);
+	bool passed = pi1541.SaveStateToFile(path);
+
+	restored.OpenD64(&restoreInfo, imageBuffer, diskFileInfo.fsize);
+	restored.SetReadOnly(false);
+	pi1541.drive.Insert(&restored);
+	restored.GetDecodedSector(INDEXED_TRACK + 1, 0, saved);
+	passed = passed && pi1541.LoadStateFromFile(path);
+	for (unsigned sector = 0; sector < DiskImage::SectorsPerTrack[INDEXED_TRACK] && passed; ++sector)
+		passed = restored.GetDecodedSector(INDEXED_TRACK + 1, sector, saved) && memcmp(saved, shifted + sector * 256, 256) == 0;
+	if (passed)
+	{
+		while (restored.EncodeNearestTrack(track))
+		{
+		}
+		restored.PrepareTrack(track);
+		for (unsigned byte = 0; byte < written.TrackLength(track) && passed; ++byte)
+			passed = restored.GetNextByte(track, byte) == written.GetNextByte(track, byte);
+		passed = passed && restored.WriteD64() && f_open(&fp, RESTORE_PATH, FA_READ) == FR_OK;
+	}
+	if (passed)
+	{
+		f_lseek(&fp, sectorRef * 256);
+		passed = f_read(&fp, saved, 256, &bytes) == FR_OK && bytes == 256 && memcmp(saved, sector, 256) == 0;
+		f_close(&fp);
+	}
+	printf("state with tracks written to restored into a new mount of the image, writes %s\r\n", passed ? "kept" : "LOST");
+
+	restored.SetReadOnly(true);
+	restored.Close();
+	written.Close();
+	f_unlink(RESTORE_PATH);
+	pi1541.drive.Insert(&diskImage);
+	pi1541.LoadState(start, startSize);
+	return passed;
+}
+
+// The realtime loop from Emulate1541 with IdleFastForward on, minus the waiting.
+static void RunSkippingIdleLoops(u32 cycles)
+{
+	u32 index = 0;
+	while (index < cycles)
+	{
+		index += pi1541.RunCycles(cycles - index, RUN_READ_BUS | RUN_REFRESH_BUS | RUN_IDLE_LOOPS);
+		if (pi1541.IsPaused())
+		{
+			u32 iterations = pi1541.IdleLoopIterations(cycles - index - 1);
+			if (iterations)
+			{
+				pi1541.SkipIdleLoop(iterations);
+				index += iterations * pi1541.IdleLoopPeriod();
+			}
+		}
+	}
+}
+
+// Skipping idle loop iterations must end up exactly where emulating every cycle does.
+static bool CheckIdleLoops(u32 cycles)
+{
+	static u8 start[1024 * 1024];
+	static u8 expected[1024 * 1024];
+	static u8 skipped[1024 * 1024];
+
+	u32 startSize = pi1541.SaveState(start, sizeof(start));
+	u64 before = HostNanoSeconds();
+	RunAndHash(cycles);
+	u64 every = HostNanoSeconds() - before;
+	u32 expectedSize = pi1541.SaveState(expected, sizeof(expected));
+
+	pi1541.LoadState(start, startSize);
+	u64 busy = pi1541.GetBusyCycles();
+	u64 idle = pi1541.GetIdleCycles();
+	before = HostNanoSeconds();
+	RunSkippingIdleLoops(cycles);
+	u64 skipping = HostNanoSeconds() - before;
+	u32 skippedSize = pi1541.SaveState(skipped, sizeof(skipped));
+	busy = pi1541.GetBusyCycles() - busy;
+	idle = pi1541.GetIdleCycles() - idle;
+
+	bool same = expectedSize == skippedSize && memcmp(expected, skipped, expectedSize) == 0;
+	Report("every", cycles, every);
+	Report("idle skip", cycles, skipping);
+	printf("idle for %.1f%% of %u cycles (%llu busy, %llu skipped), end state %s\r\n", idle * 100.0 / (idle + busy), cycles,
+		(unsigned long long)busy, (unsigned long long)idle, same ? "matches" : "DIFFERS");
+	return same;
+}
+
+// Runs the emulate phase again with every VIA access also made to m6522Ref then puts the drive back.
+static bool CheckVIAs(u32 cycles)
+{
+	static u8 start[1024 * 1024];
+
+	u32 startSize = pi1541.SaveState(start, sizeof(start));
+	ShadowVIAs();
+	for (u32 index = 0; index < cycles; ++index)
+	{
+		IEC_Bus::ReadEmulationMode1541();
+		pi1541.m6502.Step();
+		IEC_Bus::RefreshOuts1541();
+		pi1541.Update();
+		ShadowVIAsUpdate();
+	}
+	bool same = ShadowVIAsEnd();
+	pi1541.LoadState(start, startSize);
+	return same;
+}
+
+static bool MountDisk(const char* path)
+{
+	u32 size = 0;
+	u8* buffer = imageBuffer;
+
+	if (path)
+	{
+		if (!HostLoadFile(path, buffer, READBUFFER_SIZE, &size))
+		{
+			printf("Cannot open %s\r\n", path);
+			return false;
+		}
+		strncpy(diskFileInfo.fname, path, sizeof(diskFileInfo.fname) - 1);
+	}
+	else
+	{
+		size = D64_35_TRACK_SIZE;
+		memset(buffer, 0, size);
+		strcpy(diskFileInfo.fname, "blank.d64");
+	}
+	diskFileInfo.fsize = size;
+
+	u64 before = HostNanoSeconds();
+	if (!diskImage.OpenD64(&diskFileInfo, buffer, size))
+	{
+		printf("Cannot mount %s\r\n", diskFileInfo.fname);
+		return false;
+	}
+	u64 after = HostNanoSeconds();
+	diskImage.SetReadOnly(true);
+	printf("Mounted %s (%u bytes) in %.3f ms\r\n", diskFileInfo.fname, size, (double)(after - before) / 1000000.0);
+
+	pi1541.drive.Insert(&diskImage);
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* romPath = 0;
+	const char* diskPath = 0;
+	u32 cycles = 10000000;
+	u8 deviceID = 8;
+	bool extraRAM = false;
+	bool cpu = false;
+	bool idle = false;
+	bool via = false;
+	bool cia = false;
+	bool drive = false;
+	bool disk = false;
+	bool gcr = false;
+	bool caddy = false;
+	bool mount = false;
+	bool extract = false;
+	bool gcrCache = false;
+	bool hash = false;
+	const char* corpusPath = 0;
+	const char* saveStatePath = 0;
+	const char* loadStatePath = 0;
+	const char* profilePath = 0;
+	const char* reportPath = 0;
+	const char* symbolsPath = 0;
+	u32 index;
+	u64 before;
+
+	for (int arg = 1; arg < argc; ++arg)
+	{
+		if (strcmp(argv[arg], "-rom") == 0 && arg + 1 < argc)
+			romPath = argv[++arg];
+		else if (strcmp(argv[arg], "-d64") == 0 && arg + 1 < argc)
+			diskPath = argv[++arg];
+		else if (strcmp(argv[arg], "-cycles") == 0 && arg + 1 < argc)
+			cycles = strtoul(argv[++arg], 0, 0);
+		else if (strcmp(argv[arg], "-device") == 0 && arg + 1 < argc)
+			deviceID = (u8)strtoul(argv[++arg], 0, 0);
+		else if (strcmp(argv[arg], "-extraram") == 0)
+			extraRAM = true;
+		else if (strcmp(argv[arg], "-savestate") == 0 && arg + 1 < argc)
+			saveStatePath = argv[++arg];
+		else if (strcmp(argv[arg], "-loadstate") == 0 && arg + 1 < argc)
+			loadStatePath = argv[++arg];
+		else if (strcmp(argv[arg], "-profile") == 0 && arg + 1 < argc)
+			profilePath = argv[++arg];
+		else if (strcmp(argv[arg], "-report") == 0 && arg + 1 < argc)
+			reportPath = argv[++arg];
+		else if (strcmp(argv[arg], "-symbols") == 0 && arg + 1 < argc)
+			symbolsPath = argv[++arg];
+		else if (strcmp(argv[arg], "-cpu") == 0)
+			cpu = true;
+		else if (strcmp(argv[arg], "-idle") == 0)
+			idle = true;
+		else if (strcmp(argv[arg], "-via") == 0)
+			via = true;
+		else if (strcmp(argv[arg], "-cia") == 0)
+			cia = true;
+		else if (strcmp(argv[arg], "-drive") == 0)
+			drive = true;
+		else if (strcmp(argv[arg], "-disk") == 0)
+			disk = true;
+		else if (strcmp(argv[arg], "-gcr") == 0)
+			gcr = true;
+		else if (strcmp(argv[arg], "-caddy") == 0)
+			caddy = true;
+		else if (strcmp(argv[arg], "-mount") == 0)
+			mount = true;
+		else if (strcmp(argv[arg], "-extract") == 0)
+			extract = true;
+		else if (strcmp(argv[arg], "-gcrcache") == 0)
+			gcrCache = true;
+		else if (strcmp(argv[arg], "-hash") == 0)
+			hash = true;
+		else if (strcmp(argv[arg], "-corpus") == 0 && arg + 1 < argc)
+			corpusPath = argv[++arg];
+		else
+		{
+			Usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (cpu)
+		return BenchM6502(cycles, Report);
+	if (via && romPath == 0)
+		return BenchM6522(cycles, Report);
+	if (cia)
+		return BenchM8520(cycles, Report);
+	if (drive)
+		return BenchDrive(diskPath, cycles, Report);
+	if (disk)
+		return BenchDiskImage();
+	if (gcr)
+		return BenchGCR();
+	if (caddy)
+		return BenchCaddy();
+	if (mount)
+		return BenchMount(diskPath);
+	if (extract)
+		return BenchExtract(corpusPath);
+	if (gcrCache)
+		return BenchGCRCache();
+	if (hash)
+		return BenchHash(diskPath);
+	if (reportPath)
+		return ProfileReport(reportPath, symbolsPath);
+#if !defined(PROFILE6502)
+	if (profilePath)
+	{
+		printf("-profile needs the profiler built in (make -C host PROFILE=1)\r\n");
+		return 1;
+	}
+#endif
+
+	if (romPath == 0)
+	{
+		Usage(argv[0]);
+		return 1;
+	}
+
+	u32 romSize = 0;
+	if (!HostLoadFile(romPath, roms.ROMImages[0], ROMs::ROM_SIZE, &romSize) || romSize != ROMs::ROM_SIZE)
+	{
+		printf("%s is not a %d byte 1541 ROM\r\n", romPath, ROMs::ROM_SIZE);
+		return 1;
+	}
+	strcpy(roms.ROMNames[0], romPath);
+	roms.ROMValid[0] = true;
+	roms.currentROMIndex = 0;
+
+	// Same wiring as kernel_main and Emulate1541
+	pi1541.Initialise();
+	pi1541.SetDeviceID(deviceID);
+	pi1541.drive.SetVIA(&pi1541.VIA[1]);
+	pi1541.VIA[0].GetPortB()->SetPortOut(0, IEC_Bus::PortB_OnPortOut);
+
+	if (!MountDisk(diskPath))
+		return 1;
+
+	pi1541.BuildMemoryMap(extraRAM, false);
+	pi1541.m6502.SetBusFunctions(read6502, write6502);
+	IEC_Bus::VIA = &pi1541.VIA[0];
+	IEC_Bus::port = pi1541.VIA[0].GetPortB();
+	pi1541.Reset();
+
+	// The self test run from Emulate1541
+	before = HostNanoSeconds();
+	pi1541.RunCycles(FAST_BOOT_CYCLES, RUN_READ_BUS);
+	u64 coldBoot = HostNanoSeconds() - before;
+	Report("boot", FAST_BOOT_CYCLES, coldBoot);
+
+	// What Emulate1541 does on every later mount with the same ROM and device ID
+	pi1541.SaveBootSnapshot(0, deviceID);
+	before = HostNanoSeconds();
+	pi1541.Reset();
+	bool restored = pi1541.RestoreBootSnapshot(0, deviceID);
+	u64 snapshotBoot = HostNanoSeconds() - before;
+	if (restored)
+		printf("mount to ready %.3f ms cold, %.3f ms from the boot snapshot\r\n", (double)coldBoot / 1000000.0, (double)snapshotBoot / 1000000.0);
+	else
+		printf("boot snapshot was not restored\r\n");
+
+	if (loadStatePath)
+	{
+		before = HostNanoSeconds();
+		if (!pi1541.LoadStateFromFile(loadStatePath))
+		{
+			printf("Cannot load state from %s\r\n", loadStatePath);
+			return 1;
+		}
+		printf("resumed from %s in %.3f ms\r\n", loadStatePath, (double)(HostNanoSeconds() - before) / 1000000.0);
+	}
+
+	// The realtime loop from Emulate1541 minus the UI and the 1MHz sync
+#if defined(PROFILE6502)
+	static Profiler profiler;
+	if (profilePath)
+		pi1541.m6502.SetProfiler(&profiler);
+#endif
+	before = HostNanoSeconds();
+	pi1541.RunCycles(cycles, RUN_READ_BUS | RUN_REFRESH_BUS);
+	Report("emulate", cycles, HostNanoSeconds() - before);
+#if defined(PROFILE6502)
+	pi1541.m6502.SetProfiler(0);
+	if (profilePath && (!profiler.SaveToFile(profilePath) || ProfileReport(profilePath, symbolsPath) != 0))
+		return 1;
+#endif
+
+	if (via && !CheckVIAs(cycles))
+		return 1;
+
+	if (saveStatePath && (!SaveAndCheckState(saveStatePath, 1000000) || !CheckRestoreIntoNewMount(saveStatePath)))
+		return 1;
+
+	if (idle && !CheckIdleLoops(cycles))
+		return 1;
+
+	// Each subsystem on its own from the state the drive is now in
+	before = HostNanoSeconds();
+	for (index = 0; index < cycles; ++index)
+		pi1541.m6502.Step();
+	Report("m6502", cycles, HostNanoSeconds() - before);
+
+	// The old engine on the same bus from reset. It shares the drive's RAM so it goes last of the CPU phases.
+	{
+		static M6502Ref ref;
+		ref.SetBusFunctions(read6502, write6502);
+		before = HostNanoSeconds();
+		for (index = 0; index < cycles; ++index)
+			ref.Step();
+		Report("m6502 ref", cycles, HostNanoSeconds() - before);
+	}
+
+	// Copies disconnected from the scheduler so Execute can be called by hand
+	{
+		static m6522 VIA[2];
+		VIA[0] = pi1541.VIA[0];
+		VIA[1] = pi1541.VIA[1];
+		VIA[0].ConnectScheduler(0, 0);
+		VIA[1].ConnectScheduler(0, 0);
+		before = HostNanoSeconds();
+		for (index = 0; index < cycles; ++index)
+		{
+			VIA[1].Execute();
+			VIA[0].Execute();
+		}
+		Report("m6522 x2", cycles, HostNanoSeconds() - before);
+	}
+
+	before = HostNanoSeconds();
+	for (index = 0; index < cycles; ++index)
+		IEC_Bus::ReadEmulationMode1541();
+	Report("iec_bus", cycles, HostNanoSeconds() - before);
+
+	// Spin the disk with the head on the directory track so the read path is exercised.
+	Drive::OnPortOut(&pi1541.drive, 0x04 | 0x60);
+	before = HostNanoSeconds();
+	for (index = 0; index < cycles; ++index)
+	{
+		if (pi1541.drive.Update())
+			pi1541.m6502.SO();
+	}
+	Report("drive", cycles, HostNanoSeconds() - before);
+
+	diskImage.Close();
+	return 0;
+}
@@ -0,0 +1,496 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// A caddy keeps the disks that are not in the drive compressed with lzfast.c. First LZFast_Compress and LZFast_Uncompress must give back
+// what they were given (D64 data, its GCR, runs, random data and short blocks) and LZFast_Uncompress must refuse data that will not fit.
+// Then a caddy of 10 D64s (made up of crunched, code like, graphics like and text like sectors and unused ones) is swapped through,
+// every sector of the disk swapped to must decode as it was written and a sector written to one disk must survive being compressed and
+// be written back when the caddy is emptied. The memory taken (all expanded, then with only the selected disk or the selected and the next
+// expanded) and how long each swap took, including encoding the tracks of the disk swapped to (against the second Drive's write protect
+// sequence hides a swap behind), are reported.
+// Last a thread stands in for core 0 calling DiskCaddy::Prefetch. Once it has the disks either side of the selected one ready a swap
+// should only hand over an image; then the caddy is swapped through (and written to) as fast as it can be, with no waiting for it.
+
+#include "HostPlatform.h"
+#include "DiskCaddy.h"
+#include "gcr.h"
+#include "lzfast.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define CADDY_DISKS 10
+#define D64_SIZE (BLOCKSONDISK * 257)	// 35 tracks with error info
+#define D64_DATA_SIZE (BLOCKSONDISK * 256)
+#define D64_ID_OFFSET 0x165A2
+#define CADDY_PATH "/tmp/pi1541bench-caddy"
+#define SWAP_ROUNDS 3
+#define SWAP_SEQUENCE_NS 1000000000.0	// The write protect sequence Drive::Insert starts (1000000 cycles at 1MHz)
+#define WRITTEN_DISK 4
+#define WRITTEN_TRACK 16
+#define WRITTEN_SECTOR 3
+#define PREFETCH_WRITTEN_DISK 7
+#define STRESS_SWAPS 200
+
+static u32 seed;
+
+static inline u32 Random()
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static u8 disks[CADDY_DISKS][D64_SIZE];
+static u8 loaded[D64_SIZE];
+static FILINFO fileInfo[CADDY_DISKS];
+static u8 block[D64_SIZE];
+static u8 compressed[LZFAST_BOUND(D64_SIZE)];
+static unsigned work[LZFAST_WORK_SIZE];
+
+// A disk a game might come on; a share of its sectors used (most of it crunched) and the rest left empty.
+static void MakeDisk(u8* disk, unsigned number)
+{
+	unsigned used = BLOCKSONDISK * (40 + number * 6) / 100;
+
+	memset(disk, 0, D64_SIZE);
+	memset(disk + D64_DATA_SIZE, SECTOR_OK, BLOCKSONDISK);
+	for (unsigned sector = 0; sector < used; ++sector)
+	{
+		u8* data = disk + sector * 256;
+		unsigned kind = Random() % 8;
+
+		for (unsigned byte = 0; byte < 256; ++byte)
+		{
+			if (kind < 4)
+				data[byte] = (u8)Random();
+			else if (kind < 6)
+			{
+				// Code; a few common opcodes and operands and now and then something seen before.
+				if (byte >= 8 && Random() % 4 == 0)
+				{
+					unsigned position = sector * 256 + byte;
+					unsigned from = position - 1 - Random() % (position < 4096 ? position : 4096);
+					unsigned length = 3 + Random() % 6;
+					for (unsigned copy = 0; copy < length && byte < 256; ++copy, ++byte)
+						data[byte] = disk[from + copy];
+					--byte;
+				}
+				else
+					data[byte] = (u8)(0x20 + (Random() % 48) * 3);
+			}
+			else if (kind == 6)
+			{
+				u8 value = (u8)(Random() % 4 * 0x55);
+				for (unsigned run = 1 + Random() % 16; run && byte < 256; --run, ++byte)
+					data[byte] = value;
+				--byte;
+			}
+			else
+				data[byte] = (u8)(Random() % 5 == 0 ? ' ' : 'A' + Random() % 26);
+		}
+	}
+	disk[D64_ID_OFFSET] = (u8)('0' + number);
+	disk[D64_ID_OFFSET + 1] = 'X';
+}
+
+static bool CheckRoundTrip(const u8* data, unsigned size, const char* what)
+{
+	int compressedSize = LZFast_Compress(data, compressed, size, work);
+	if (compressedSize < 0 || (unsigned)compressedSize > LZFAST_BOUND(size))
+	{
+		printf("%s of %u bytes compressed to %d bytes\r\n", what, size, compressedSize);
+		return false;
+	}
+	memset(block, 0xaa, size);
+	if (LZFast_Uncompress(compressed, block, compressedSize, size) != (int)size || memcmp(block, data, size) != 0)
+	{
+		printf("%s of %u bytes did not uncompress to what was compressed\r\n", what, size);
+		return false;
+	}
+	if (size && LZFast_Uncompress(compressed, block, compressedSize, size - 1) != -1)
+	{
+		printf("%s of %u bytes uncompressed into %u bytes\r\n", what, size, size - 1);
+		return false;
+	}
+	return true;
+}
+
+static bool CheckCodec()
+{
+	static u8 data[D64_SIZE];
+
+	for (unsigned disk = 0; disk < CADDY_DISKS; ++disk)
+	{
+		if (!CheckRoundTrip(disks[disk], D64_SIZE, "A D64"))
+			return false;
+
+		// And its GCR, a track at a time.
+		u8* gcr = data;
+		for (unsigned sector = 0; sector < DiskImage::SectorsPerTrack[0]; ++sector, gcr += GCR_SECTOR_LENGTH)
+			convert_sector_to_GCR(disks[disk] + sector * 256, gcr, 1, sector, disks[disk] + D64_ID_OFFSET, SECTOR_OK);
+		if (!CheckRoundTrip(data, gcr - data, "A GCR track"))
+			return false;
+	}
+
+	for (unsigned size = 0; size < 80; ++size)
+	{
+		for (unsigned byte = 0; byte < size; ++byte)
+			data[byte] = (u8)(size & 1 ? Random() : Random() % 3);
+		if (!CheckRoundTrip(data, size, "A short block"))
+			return false;
+	}
+	memset(data, 0x55, sizeof(data));
+	if (!CheckRoundTrip(data, sizeof(data), "A run"))
+		return false;
+	for (unsigned byte = 0; byte < sizeof(data); ++byte)
+		data[byte] = (u8)Random();
+	return CheckRoundTrip(data, sizeof(data), "Random data");
+}
+
+static bool CheckDisk(DiskImage* image, unsigned disk)
+{
+	u8 decoded[256];
+	const u8* expected = disks[disk];
+
+	for (unsigned track = 0; track < 35; ++track)
+	{
+		for (unsigned sector = 0; sector < DiskImage::SectorsPerTrack[track]; ++sector, expected += 256)
+		{
+			if (!image->GetDecodedSector(track + 1, sector, decoded) || memcmp(decoded, expected, sizeof(decoded)) != 0)
+			{
+				printf("Disk %u track %u sector %u did not decode as it was written\r\n", disk + 1, track + 1, sector);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Writes a sector as the drive would (a bit at a time) and into disks[] as it should now read.
+static void WriteSector(DiskImage* image, unsigned disk, unsigned track, unsigned sector)
+{
+	u8 gcr[GCR_SECTOR_LENGTH];
+	unsigned sectorRef = sector;
+
+	for (unsigned previous = 0; previous < track; ++previous)
+		sectorRef += DiskImage::SectorsPerTrack[previous];
+	u8* data = disks[disk] + sectorRef * 256;
+	for (unsigned byte = 0; byte < 256; ++byte)
+		data[byte] = (u8)~data[byte];
+
+	convert_sector_to_GCR(data, gcr, track + 1, sector, disks[disk] + D64_ID_OFFSET, SECTOR_OK);
+	image->PrepareTrack(track * 2);
+	for (unsigned bitIndex = 0; bitIndex < GCR_SECTOR_LENGTH * 8; ++bitIndex)
+	{
+		unsigned trackBit = sector * GCR_SECTOR_LENGTH * 8 + bitIndex;
+		image->SetBit(track * 2, trackBit >> 3, 7 - (trackBit & 7), (gcr[bitIndex >> 3] >> (7 - (bitIndex & 7))) & 1);
+	}
+}
+
+// What the caddy is taking now (in the images and their tracks) and what it would if they were all expanded.
+static u32 CaddyBytes(DiskCaddy& caddy, u32* expanded = 0)
+{
+	u32 bytes = 0;
+
+	if (expanded)
+		*expanded = 0;
+	for (unsigned index = 0; index < caddy.GetNumberOfImages(); ++index)
+	{
+		DiskImage* image = caddy.GetImage(index);
+		bytes += sizeof(DiskImage) + (image->IsPacked() ? image->PackedSize() : image->ArenaSize());
+		if (expanded)
+			*expanded += sizeof(DiskImage) + image->ArenaSize();
+	}
+	return bytes;
+}
+
+static bool SwapThrough(DiskCaddy& caddy, bool expandNext)
+{
+	u64 totalNs = 0;
+	u64 longestNs = 0;
+	u32 swaps = 0;
+	u32 peak = 0;
+	u32 steady = 0;
+	u32 bound[CADDY_DISKS];
+	u32 packedSize[CADDY_DISKS];
+	bool wasPacked[CADDY_DISKS];
+
+	caddy.SetExpandNext(expandNext);
+	if (caddy.SelectFirstImage() == 0)
+		return false;
+	for (unsigned round = 0; round < SWAP_ROUNDS * CADDY_DISKS; ++round)
+	{
+		bool back = round >= (SWAP_ROUNDS - 1) * CADDY_DISKS;
+		u32 before = CaddyBytes(caddy);
+		for (unsigned index = 0; index < CADDY_DISKS; ++index)
+		{
+			DiskImage* image = caddy.GetImage(index);
+			wasPacked[index] = image->IsPacked();
+			packedSize[index] = image->PackedSize();
+			bound[index] = LZFAST_BOUND(image->ArenaSize());
+		}
+
+		u64 start = HostNanoSeconds();
+		DiskImage* image = back ? caddy.PrevDisk() : caddy.NextDisk();
+		if (image)
+			image->PrepareAllTracks();	// As Emulate1541 does with the disk it swaps to
+		u64 ns = HostNanoSeconds() - start;
+		if (image == 0)
+		{
+			printf("Disk %u could not be expanded\r\n", caddy.GetSelectedIndex() + 1);
+			return false;
+		}
+		totalNs += ns;
+		if (ns > longestNs)
+			longestNs = ns;
+		++swaps;
+
+		// Compressing holds the image and as much as it could compress to, expanding both the image and what it was compressed to.
+		u32 after = CaddyBytes(caddy);
+		for (unsigned index = 0; index < CADDY_DISKS; ++index)
+		{
+			bool packedNow = caddy.GetImage(index)->IsPacked();
+			if (!wasPacked[index] && packedNow && before + bound[index] > peak)
+				peak = before + bound[index];
+			if (wasPacked[index] && !packedNow && after + packedSize[index] > peak)
+				peak = after + packedSize[index];
+		}
+		if (after > peak)
+			peak = after;
+		if (after > steady)
+			steady = after;
+
+		unsigned selected = caddy.GetSelectedIndex();
+		for (unsigned index = 0; index < CADDY_DISKS; ++index)
+		{
+			bool expected = index != selected && !(expandNext && index == (selected + 1) % CADDY_DISKS);
+			if (caddy.GetImage(index)->IsPacked() != expected)
+			{
+				printf("Disk %u is %s while disk %u is selected\r\n", index + 1, expected ? "expanded" : "compressed", selected + 1);
+				return false;
+			}
+		}
+		if (!CheckDisk(image, selected))
+			return false;
+		if (selected == WRITTEN_DISK && round < CADDY_DISKS && !expandNext)
+			WriteSector(image, selected, WRITTEN_TRACK, WRITTEN_SECTOR);
+	}
+
+	printf("%-26s %6u KB (%6u KB at the peak of a swap)  swap %6.3f ms on average, %6.3f ms at most (%.2f%% of the swap sequence)\r\n",
+		expandNext ? "Selected and next disks" : "Only the selected disk", steady / 1024, peak / 1024,
+		(double)totalNs / swaps / 1000000.0, (double)longestNs / 1000000.0, (double)longestNs * 100.0 / SWAP_SEQUENCE_NS);
+	return true;
+}
+
+static volatile bool stopPrefetching;
+static volatile u32 swapsMade;
+static volatile u32 settledAfter;
+
+// Core 0's part; settledAfter says which swap it has had nothing left to do since.
+static void* PrefetchThread(void* caddy)
+{
+	while (!stopPrefetching)
+	{
+		u32 swap = swapsMade;
+		__sync_synchronize();
+		if (!((DiskCaddy*)caddy)->Prefetch())
+		{
+			settledAfter = swap;
+			sched_yield();
+		}
+	}
+	return 0;
+}
+
+static void WaitForPrefetch()
+{
+	__sync_synchronize();
+	while (settledAfter != swapsMade)
+		sched_yield();
+	__sync_synchronize();
+}
+
+static bool SwapPrefetched(DiskCaddy& caddy)
+{
+	u64 totalNs = 0;
+	u64 longestNs = 0;
+	u32 steady = 0;
+	u32 ready = 0;
+	pthread_t thread;
+
+	caddy.PrefetchOnOtherCore(true);
+	stopPrefetching = false;
+	swapsMade = 0;
+	settledAfter = 0xffffffff;
+	if (caddy.SelectFirstImage() == 0 || pthread_create(&thread, 0, PrefetchThread, &caddy) != 0)
+		return false;
+
+	bool passed = true;
+	for (unsigned round = 0; round < SWAP_ROUNDS * CADDY_DISKS && passed; ++round)
+	{
+		WaitForPrefetch();
+		unsigned selected = caddy.GetSelectedIndex();
+		for (unsigned index = 0; index < CADDY_DISKS; ++index)
+		{
+			bool neighbour = index == (selected + 1) % CADDY_DISKS || index == (selected + CADDY_DISKS - 1) % CADDY_DISKS;
+			if ((neighbour && !caddy.IsReady(index)) || caddy.GetImage(index)->IsPacked() != (index != selected && !neighbour))
+			{
+				printf("Disk %u is %s while disk %u is selected\r\n", index + 1, caddy.IsReady(index) ? "ready" : caddy.GetImage(index)->IsPacked() ? "compressed" : "expanded", selected + 1);
+				passed = false;
+			}
+		}
+		u32 bytes = CaddyBytes(caddy);
+		if (bytes > steady)
+			steady = bytes;
+
+		bool back = round >= (SWAP_ROUNDS - 1) * CADDY_DISKS;
+		u64 start = HostNanoSeconds();
+		DiskImage* image = back ? caddy.PrevDisk() : caddy.NextDisk();
+		if (image)
+			image->PrepareAllTracks();	// As Emulate1541 does with the disk it swaps to
+		u64 ns = HostNanoSeconds() - start;
+		++swapsMade;
+		ready += caddy.IsReady(caddy.GetSelectedIndex());
+		totalNs += ns;
+		if (ns > longestNs)
+			longestNs = ns;
+		if (image == 0 || !CheckDisk(image, caddy.GetSelectedIndex()))
+			passed = false;
+	}
+	if (passed)
+	{
+		printf("%-26s %6u KB  swap %6.3f us on average, %6.3f us at most (%u of %u swaps to a ready disk)\r\n",
+			"Prefetched on a thread", steady / 1024, (double)totalNs / (SWAP_ROUNDS * CADDY_DISKS) / 1000.0, (double)longestNs / 1000.0,
+			ready, SWAP_ROUNDS * CADDY_DISKS);
+	}
+
+	// Now without waiting for the thread, going anywhere in the caddy.
+	totalNs = 0;
+	longestNs = 0;
+	for (unsigned swap = 0; swap < STRESS_SWAPS && passed; ++swap)
+	{
+		unsigned how = Random() % 4;
+		u64 start = HostNanoSeconds();
+		DiskImage* image;
+		if (how == 0)
+			image = caddy.PrevDisk();
+		else if (how == 1)
+			image = caddy.NextDisk();
+		else
+		{
+			image = caddy.SelectImage(Random() % CADDY_DISKS);
+			if (image == 0)
+				image = caddy.GetCurrentDisk();
+		}
+		if (image)
+			image->PrepareAllTracks();
+		u64 ns = HostNanoSeconds() - start;
+		++swapsMade;
+		totalNs += ns;
+		if (ns > longestNs)
+			longestNs = ns;
+
+		unsigned selected = caddy.GetSelectedIndex();
+		if (image == 0 || !CheckDisk(image, selected))
+			passed = false;
+		else if (selected == PREFETCH_WRITTEN_DISK && swap < STRESS_SWAPS / 2)
+		{
+			WriteSector(image, selected, WRITTEN_TRACK + swap % 4, WRITTEN_SECTOR);
+			passed = CheckDisk(image, selected);
+		}
+	}
+	stopPrefetching = true;
+	pthread_join(thread, 0);
+	caddy.PrefetchOnOtherCore(false);
+	if (passed)
+	{
+		printf("%-26s %u swaps without waiting for it, %6.3f ms on average, %6.3f ms at most\r\n",
+			"", STRESS_SWAPS, (double)totalNs / STRESS_SWAPS / 1000000.0, (double)longestNs / 1000000.0);
+	}
+	return passed;
+}
+
+int BenchCaddy()
+{
+	DiskCaddy caddy;
+
+	seed = 0xcadd;
+	for (unsigned disk = 0; disk < CADDY_DISKS; ++disk)
+		MakeDisk(disks[disk], disk);
+	if (!CheckCodec())
+		return 1;
+
+	u64 compressNs = 0;
+	u64 uncompressNs = 0;
+	u32 compressedBytes = 0;
+	for (unsigned disk = 0; disk < CADDY_DISKS; ++disk)
+	{
+		u64 before = HostNanoSeconds();
+		int size = LZFast_Compress(disks[disk], compressed, D64_SIZE, work);
+		compressNs += HostNanoSeconds() - before;
+		before = HostNanoSeconds();
+		LZFast_Uncompress(compressed, block, size, D64_SIZE);
+		uncompressNs += HostNanoSeconds() - before;
+		compressedBytes += size;
+	}
+	double megabytes = (double)CADDY_DISKS * D64_SIZE / 1000000.0;
+	printf("LZFast matches what it was given; D64s compress to %.1f%% at %.1f MB/s and uncompress at %.1f MB/s\r\n",
+		(double)compressedBytes * 100.0 / (CADDY_DISKS * D64_SIZE), megabytes * 1000000000.0 / compressNs, megabytes * 1000000000.0 / uncompressNs);
+
+	for (unsigned disk = 0; disk < CADDY_DISKS; ++disk)
+	{
+		FIL fp;
+		u32 bytesWritten;
+
+		snprintf(fileInfo[disk].fname, sizeof(fileInfo[disk].fname), "%s%u.d64", CADDY_PATH, disk + 1);
+		fileInfo[disk].fsize = D64_SIZE;
+		if (f_open(&fp, fileInfo[disk].fname, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+			return 1;
+		f_write(&fp, disks[disk], D64_SIZE, &bytesWritten);
+		f_close(&fp);
+		if (!caddy.Insert(&fileInfo[disk], false))
+		{
+			printf("Cannot insert %s\r\n", fileInfo[disk].fname);
+			return 1;
+		}
+	}
+
+	u32 expanded;
+	CaddyBytes(caddy, &expanded);
+	printf("%u D64s in a caddy\r\n", CADDY_DISKS);
+	printf("%-26s %6u KB\r\n", "All expanded", expanded / 1024);
+	bool passed = SwapThrough(caddy, false) && SwapThrough(caddy, true) && SwapPrefetched(caddy);
+
+	caddy.Empty();
+	for (unsigned disk = 0; disk < CADDY_DISKS && passed; ++disk)
+	{
+		u32 bytesRead = 0;
+		if (!HostLoadFile(fileInfo[disk].fname, loaded, sizeof(loaded), &bytesRead) || bytesRead != D64_SIZE || memcmp(loaded, disks[disk], D64_DATA_SIZE) != 0)
+		{
+			printf("%s was not written back as it was changed\r\n", fileInfo[disk].fname);
+			passed = false;
+		}
+	}
+	for (unsigned disk = 0; disk < CADDY_DISKS; ++disk)
+		f_unlink(fileInfo[disk].fname);
+	if (!passed)
+		return 1;
+	printf("Every disk swapped to decodes as written and the one written to was written back after being compressed\r\n");
+	return 0;
+}
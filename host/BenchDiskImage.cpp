@@ -0,0 +1,418 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// Writing back a D64 or D81 only writes the sectors that have changed. The same changes are made to two copies of an image;
+// one is written back that way over its file and the other (with no file to write over) is written out whole.
+// Both files must then hold the same sectors and the time each took is reported.
+// Done again with the first copy's changes queued as they are made for a thread standing in for the other core to write behind (see WriteBehind);
+// closing it must then find nothing left to write. A D81 is done again with the file gone while its changes are written behind,
+// so that writing behind fails; closing it must then write what was lost.
+// Before all that every sector of a D64 is decoded through the sector index (twice, the first time building it), sectors written over must decode
+// as what was written, and FindSync (32 bits at a time) must find the same syncs as a scan a bit at a time on a half track of random runs of 1s.
+
+#include "HostPlatform.h"
+#include "DiskImage.h"
+#include "WriteBehind.h"
+#include "gcr.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define D64_SIZE (BLOCKSONDISK * 257)	// 35 tracks with error info
+#define D64_DATA_SIZE (BLOCKSONDISK * 256)
+#define D64_ID_OFFSET 0x165A2
+#define D81_SIZE (D81_TRACK_COUNT * 2 * 10 * D81_SECTOR_LENGTH)
+#define CHANGED_SECTORS 8
+#define CHANGED_D81_BYTES 64
+#define SYNC_SEARCHES 50000
+#define SECTORS_PATH "/tmp/pi1541bench-sectors"
+#define WHOLE_PATH "/tmp/pi1541bench-whole"
+
+static u32 seed;
+
+static inline u32 Random()
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static DiskImage images[2];
+static u8 imageBuffer[READBUFFER_SIZE];	// What an image is loaded into to be opened
+static FILINFO fileInfo[2];
+static u8 original[READBUFFER_SIZE];
+static u8 written[2][READBUFFER_SIZE];
+static WriteBehind writeBehind;
+static volatile bool serving;
+
+static void* Serve(void*)
+{
+	while (serving)
+	{
+		if (!writeBehind.Service())
+			sched_yield();
+	}
+	return 0;
+}
+
+// Queues everything changed so far. QueueUnsavedSector also returns false when the queue is full so only stop once it has had room.
+static void QueueUnsaved(DiskImage& image)
+{
+	for (;;)
+	{
+		u32 free = writeBehind.Free();
+		if (!image.QueueUnsavedSector(writeBehind) && free >= 2)
+			break;
+	}
+}
+
+// Queues as much of what has changed as the queue takes (whole tracks of it) then writes it behind with the file moved away,
+// which fails and drops what was queued.
+static void QueueUnsavedFailing(DiskImage& image)
+{
+	char away[300];
+
+	while (image.QueueUnsavedSector(writeBehind))
+	{
+	}
+	snprintf(away, sizeof(away), "%s.away", image.GetName());
+	rename(image.GetName(), away);
+	while (writeBehind.Service())
+	{
+	}
+	rename(away, image.GetName());
+}
+
+static bool SaveFile(const char* path, const u8* data, u32 size)
+{
+	FIL fp;
+	u32 bytesWritten;
+
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return false;
+	bool saved = f_write(&fp, data, size, &bytesWritten) == FR_OK && bytesWritten == size;
+	f_close(&fp);
+	return saved;
+}
+
+// Opens the image in both copies. Only the first has its file on disk.
+static bool OpenBoth(const char* extension, u32 size)
+{
+	snprintf(fileInfo[0].fname, sizeof(fileInfo[0].fname), "%s.%s", SECTORS_PATH, extension);
+	snprintf(fileInfo[1].fname, sizeof(fileInfo[1].fname), "%s.%s", WHOLE_PATH, extension);
+	f_unlink(fileInfo[1].fname);
+	if (!SaveFile(fileInfo[0].fname, original, size))
+	{
+		printf("Cannot save %s\r\n", fileInfo[0].fname);
+		return false;
+	}
+
+	for (unsigned index = 0; index < 2; ++index)
+	{
+		fileInfo[index].fsize = size;
+		images[index].SetReadOnly(false);
+		memcpy(imageBuffer, original, size);
+		bool opened = strcmp(extension, "d64") == 0 ? images[index].OpenD64(&fileInfo[index], imageBuffer, size) : images[index].OpenD81(&fileInfo[index], imageBuffer, size);
+		if (!opened)
+		{
+			printf("Cannot open %s\r\n", fileInfo[index].fname);
+			return false;
+		}
+	}
+	return true;
+}
+
+// Closes both (so writing them back) and reads back what was written.
+static bool CloseBoth(const char* name, u32 size, bool behind)
+{
+	u64 ns[2];
+
+	if (behind)
+		writeBehind.Drain();
+
+	for (unsigned index = 0; index < 2; ++index)
+	{
+		u32 bytesRead = 0;
+		u64 before = HostNanoSeconds();
+		images[index].Close();
+		ns[index] = HostNanoSeconds() - before;
+		memset(written[index], 0, size);
+		if (!HostLoadFile(fileInfo[index].fname, written[index], size, &bytesRead))
+		{
+			printf("%s was not written\r\n", fileInfo[index].fname);
+			return false;
+		}
+	}
+	printf("%s %s %u bytes in %.3f ms (%.3f ms writing the whole image)\r\n", name, behind ? "written behind then" : "wrote back", images[0].GetLastFlushBytes(), (double)ns[0] / 1000000.0, (double)ns[1] / 1000000.0);
+	if (behind && images[0].GetLastFlushBytes() != 0)
+	{
+		printf("%s was not all written behind\r\n", name);
+		return false;
+	}
+	return true;
+}
+
+// Writes the GCR of a sector over it on the track (or shift bits on from there) as the drive does (a bit at a time).
+static void WriteSector(DiskImage& image, unsigned track, unsigned sector, const u8* data, const u8* id, unsigned shift = 0)
+{
+	u8 gcr[GCR_SECTOR_LENGTH];
+
+	convert_sector_to_GCR((u8*)data, gcr, track + 1, sector, (u8*)id, SECTOR_OK);
+	image.PrepareTrack(track * 2);
+	for (unsigned bitIndex = 0; bitIndex < GCR_SECTOR_LENGTH * 8; ++bitIndex)
+	{
+		unsigned trackBit = sector * GCR_SECTOR_LENGTH * 8 + shift + bitIndex;
+		image.SetBit(track * 2, trackBit >> 3, 7 - (trackBit & 7), (gcr[bitIndex >> 3] >> (7 - (bitIndex & 7))) & 1);
+	}
+}
+
+// How FindSync used to find a sync, a bit at a time (wrapping at the end of the track).
+static int FindSyncRef(DiskImage& image, unsigned track, int bitIndex, int maxBits, int* syncStartIndex)
+{
+	int readShiftRegister = 0;
+	bool prevBitZero = true;
+
+	while (maxBits--)
+	{
+		if (image.GetNextBit(track, bitIndex >> 3, 7 - (bitIndex & 7)))
+		{
+			if (prevBitZero)
+				*syncStartIndex = bitIndex;
+			prevBitZero = false;
+			readShiftRegister = (readShiftRegister << 1) | 1;
+		}
+		else
+		{
+			prevBitZero = true;
+			if (~readShiftRegister & 0x3ff)
+				readShiftRegister <<= 1;
+			else
+				return bitIndex;
+		}
+		if (++bitIndex >= (int)image.BitsInTrack(track))
+			bitIndex = 0;
+	}
+	return -1;
+}
+
+static bool CheckSectorIndex()
+{
+	u8 data[256];
+	u8 decoded[256];
+	u64 ns[2];
+
+	seed = 0x5ec;
+	for (u32 byte = 0; byte < D64_DATA_SIZE; ++byte)
+		original[byte] = (u8)Random();
+	memset(original + D64_DATA_SIZE, SECTOR_OK, BLOCKSONDISK);
+	if (!OpenBoth("d64", D64_SIZE))
+		return false;
+	DiskImage& image = images[0];
+	printf("D64 attached in %u bytes of tracks (the DiskImage itself is %u bytes)\r\n", image.ArenaSize(), (unsigned)sizeof(DiskImage));
+
+	for (unsigned track = 0; track < 35; ++track)
+		image.PrepareTrack(track * 2);
+	for (unsigned pass = 0; pass < 2; ++pass)
+	{
+		u64 before = HostNanoSeconds();
+		const u8* expected = original;
+		for (unsigned track = 0; track < 35; ++track)
+		{
+			for (unsigned sector = 0; sector < DiskImage::SectorsPerTrack[track]; ++sector, expected += 256)
+			{
+				if (!image.GetDecodedSector(track + 1, sector, decoded) || memcmp(decoded, expected, sizeof(decoded)) != 0)
+				{
+					printf("Track %u sector %u did not decode as it was encoded\r\n", track + 1, sector);
+					return false;
+				}
+			}
+		}
+		ns[pass] = HostNanoSeconds() - before;
+	}
+	printf("D64 %u sectors decoded in %.3f ms indexing the tracks, %.3f ms through the index\r\n", BLOCKSONDISK, (double)ns[0] / 1000000.0, (double)ns[1] / 1000000.0);
+
+	// Whole tracks written again a few bits further on so that the index has to be built again to find them.
+	for (unsigned change = 0; change < CHANGED_SECTORS; ++change)
+	{
+		unsigned track = Random() % 35;
+		unsigned shift = 1 + Random() % 60;
+		unsigned sectors = DiskImage::SectorsPerTrack[track];
+		unsigned sector = Random() % sectors;
+		for (unsigned rewrite = 0; rewrite < sectors; ++rewrite)
+		{
+			for (unsigned byte = 0; byte < sizeof(data); ++byte)
+				data[byte] = (u8)(Random() + rewrite);
+			WriteSector(image, track, rewrite, data, original + D64_ID_OFFSET, shift);
+			if (rewrite == sector)
+				memcpy(decoded, data, sizeof(data));
+		}
+		memcpy(data, decoded, sizeof(data));
+		if (!image.GetDecodedSector(track + 1, sector, decoded) || memcmp(decoded, data, sizeof(data)) != 0)
+		{
+			printf("Track %u sector %u did not decode as it was written\r\n", track + 1, sector);
+			return false;
+		}
+	}
+
+	// Runs of 1s of up to twice a sync's length between runs of 0s, on a half track a D64 does not use
+	// (so it starts out as the shared blank track and is given its own when it is first written).
+	unsigned halfTrack = 1;
+	unsigned bits = image.BitsInTrack(halfTrack);
+	unsigned bit = 0;
+	while (bit < bits)
+	{
+		unsigned ones = 1 + Random() % 20;
+		unsigned zeros = 1 + Random() % 3;
+		for (unsigned run = 0; run < ones + zeros && bit < bits; ++run, ++bit)
+			image.SetBit(halfTrack, bit >> 3, 7 - (bit & 7), run < ones);
+	}
+	for (unsigned search = 0; search < SYNC_SEARCHES; ++search)
+	{
+		int bitIndex = Random() % bits;
+		int maxBits = search & 1 ? Random() % 64 : Random() % (bits * 2 + 1);
+		int syncStart = -1;
+		int syncStartRef = -1;
+		int found = image.FindSync(halfTrack, bitIndex, maxBits, &syncStart);
+		int foundRef = FindSyncRef(image, halfTrack, bitIndex, maxBits, &syncStartRef);
+		if (found != foundRef || (found >= 0 && syncStart != syncStartRef))
+		{
+			printf("FindSync from bit %d within %d bits found %d (starting at %d) rather than %d (starting at %d)\r\n", bitIndex, maxBits, found, syncStart, foundRef, syncStartRef);
+			return false;
+		}
+	}
+
+	images[0].Close();
+	images[1].Close();
+	return true;
+}
+
+static bool CheckD64(bool behind)
+{
+	u8 data[256];
+	unsigned firstSector[35];
+	unsigned sectors = 0;
+
+	seed = 0xd64;
+	for (unsigned track = 0; track < 35; ++track)
+	{
+		firstSector[track] = sectors;
+		sectors += DiskImage::SectorsPerTrack[track];
+	}
+	for (u32 byte = 0; byte < D64_DATA_SIZE; ++byte)
+		original[byte] = (u8)Random();
+	for (u32 sector = 0; sector < BLOCKSONDISK; ++sector)
+		original[D64_DATA_SIZE + sector] = (sector % 61) == 7 ? BAD_DATA_CHECKSUM : SECTOR_OK;
+	if (!OpenBoth("d64", D64_SIZE))
+		return false;
+
+	// Some changed, one rewritten as it was and the one with an error rewritten.
+	u32 expected = 0;
+	for (unsigned change = 0; change < CHANGED_SECTORS + 2; ++change)
+	{
+		unsigned track = change < CHANGED_SECTORS ? Random() % 35 : 0;
+		unsigned sector = change < CHANGED_SECTORS ? Random() % DiskImage::SectorsPerTrack[track] : change == CHANGED_SECTORS ? 3 : 7;
+		unsigned offset = (firstSector[track] + sector) * 256;
+		if (change == CHANGED_SECTORS)
+		{
+			memcpy(data, original + offset, sizeof(data));
+		}
+		else
+		{
+			for (unsigned byte = 0; byte < sizeof(data); ++byte)
+				data[byte] = (u8)Random();
+			expected += change == CHANGED_SECTORS + 1 ? 257 : 256;
+		}
+		for (unsigned index = 0; index < 2; ++index)
+			WriteSector(images[index], track, sector, data, original + D64_ID_OFFSET);
+		if (behind && (change == CHANGED_SECTORS / 2 || change == CHANGED_SECTORS + 1))
+			QueueUnsaved(images[0]);
+	}
+	if (!CloseBoth("D64", D64_SIZE, behind))
+		return false;
+
+	if (images[0].GetLastFlushBytes() > expected || memcmp(written[0], written[1], D64_DATA_SIZE) != 0)
+	{
+		printf("The D64 written back a sector at a time differs from it written whole\r\n");
+		return false;
+	}
+	if (written[0][D64_DATA_SIZE + 7] != SECTOR_OK || memcmp(written[0] + D64_DATA_SIZE + 8, original + D64_DATA_SIZE + 8, BLOCKSONDISK - 8) != 0)
+	{
+		printf("The D64's error info was not kept up to date\r\n");
+		return false;
+	}
+	return true;
+}
+
+static bool CheckD81(bool behind, bool failing = false)
+{
+	seed = 0xd81;
+	for (u32 byte = 0; byte < D81_SIZE; ++byte)
+		original[byte] = (u8)Random();
+	if (!OpenBoth("d81", D81_SIZE))
+		return false;
+	if (!behind && !failing)
+		printf("D81 attached in %u bytes of tracks\r\n", images[0].ArenaSize());
+
+	// Anywhere on a track; in the headers and gaps (which are not saved) as well as in the sectors.
+	for (unsigned change = 0; change < CHANGED_D81_BYTES; ++change)
+	{
+		unsigned track = Random() % D81_TRACK_COUNT;
+		unsigned head = Random() & 1;
+		unsigned headPos = Random() % images[0].TrackLength(track);
+		u8 value = (u8)Random();
+		for (unsigned index = 0; index < 2; ++index)
+			images[index].SetD81Byte(track, head, headPos, value);
+		if (behind && (change == CHANGED_D81_BYTES / 2 || change == CHANGED_D81_BYTES - 1))
+			QueueUnsaved(images[0]);
+		if (failing && change == CHANGED_D81_BYTES / 2)
+			QueueUnsavedFailing(images[0]);
+	}
+	if (!CloseBoth(failing ? "D81 (writing behind failed)" : "D81", D81_SIZE, behind))
+		return false;
+
+	if (images[0].GetLastFlushBytes() > CHANGED_D81_BYTES * D81_SECTOR_LENGTH || memcmp(written[0], written[1], D81_SIZE) != 0)
+	{
+		printf("The D81 written back a sector at a time differs from it written whole\r\n");
+		return false;
+	}
+	return true;
+}
+
+int BenchDiskImage()
+{
+	pthread_t server;
+
+	bool passed = CheckSectorIndex() && CheckD64(false) && CheckD81(false) && CheckD81(false, true);
+	serving = true;
+	if (passed && pthread_create(&server, 0, Serve, 0) == 0)
+	{
+		passed = CheckD64(true) && CheckD81(true);
+		serving = false;
+		pthread_join(server, 0);
+	}
+
+	f_unlink(SECTORS_PATH ".d64");
+	f_unlink(WHOLE_PATH ".d64");
+	f_unlink(SECTORS_PATH ".d81");
+	f_unlink(WHOLE_PATH ".d81");
+	if (!passed)
+		return 1;
+	printf("Sectors found through the index and syncs found 32 bits at a time match scanning a bit at a time\r\n");
+	printf("D64 and D81 written back a sector at a time, written behind (and a D81 with writing behind failed) match them written whole\r\n");
+	return 0;
+}
@@ -0,0 +1,777 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// Runs Drive (bit cells timed in whole 16Mhz clocks, noise from its own LCG) and DriveRef (the floating point model with the noise from rand()),
+// each wired to its own VIA and its own copy of a G64 of a blank disk with long flux gaps (where only noise is read), long syncs and random data put on every other track.
+// The noise cannot match so, on a track of each speed zone;-
+//	- a revolution must take exactly 200000 cycles in Drive and DriveRef must be within ROTATION_TOLERANCE of that
+//	- reading GCR (where the gaps are never long enough for noise to get through) both must deliver the same bytes
+//	- the distribution of the distances between the 1s read in a flux gap must agree (chi squared) and differ from one revolution to the next
+//	- both must read back a data block written the way the ROM writes one
+// Then Drive is driven the way the 1541 ROM and loaders drive $1C00 over the image given (or the G64); stepping, density changes, byte ready on and off,
+// bursts of writing and reading the data port, and the flux index must not skip over any 1 that has been written.
+// Before all that a D64 encoded a track at a time (as the head gets to them) must match it encoded all at once, and the mount to first byte time
+// and the longest a single step of the head takes are reported.
+
+#include "HostPlatform.h"
+#include "DriveRef.h"
+#include "Drive.h"
+#include "gcr.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BLOCK_CYCLES 200000
+#define SWAP_CYCLES 1000000			// Until the write protect sensor settles after inserting
+#define LAST_HALF_TRACK 68
+#define REVOLUTION_CYCLES 200000	// 300rpm
+#define ROTATION_REVOLUTIONS 10
+#define ROTATION_TOLERANCE 20		// Cycles over ROTATION_REVOLUTIONS
+#define DECODE_REVOLUTIONS 3
+#define NOISE_REVOLUTIONS 10
+#define DISTANCE_BINS 8
+#define CHI_SQUARED_LIMIT 26.0		// For DISTANCE_BINS - 1 degrees of freedom this is a 1 in 2000 chance of failing when the distributions are the same
+#define WRITE_BYTES 326				// A GCR data block
+#define MAX_BYTES 65536
+#define BYTE_AFTER_SYNC 0x100
+#define RANDOM_D64_SIZE (BLOCKSONDISK * 257)	// 35 tracks with error info
+#define D64_ID_OFFSET 0x165A2
+
+// The register numbers (private to m6522)
+enum { ORB, ORA, DDRB, DDRA, T1CL, T1CH, T1LL, T1LH, T2CL, T2CH, SR, ACR, PCR, IFR, IER, ORA_NH };
+
+#define PCR_READ 0xee
+#define PCR_READ_NO_BYTE_READY 0xec
+#define PCR_WRITE 0xce
+
+static u32 seed;
+
+static inline u32 Random()
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+// What the "ROM" is doing to $1C00.
+struct Stimulus
+{
+	u32 seed;
+	u8 orb;
+	u8 pcr;
+	unsigned halfTrack;
+	u32 writeCycles;
+};
+
+static FILINFO fileInfo[2];
+static u8 imageBuffer[READBUFFER_SIZE];	// What an image is loaded into to be opened
+static DiskImage images[2];
+// The bytes of each half track the G64 has a flux gap, a long sync or data with no GCR coding in.
+static unsigned protectionStart[HALF_TRACK_COUNT];
+static unsigned protectionEnd[HALF_TRACK_COUNT];
+
+// A G64 of a blank disk with the sort of things copy protections put on a track.
+// The blank disk is GCR encoded into image then the G64 is mounted over it.
+static u32 MakeProtectedG64(DiskImage& image, FILINFO* info, u8* buffer)
+{
+	static const u32 G64_HEADER = 12 + HALF_TRACK_COUNT * 8;
+	u8* blank = buffer + READBUFFER_SIZE / 2;
+	u32 size = G64_HEADER;
+
+	memset(blank, 0, 174848);
+	if (!image.OpenD64(info, blank, 174848))
+		return 0;
+
+	memset(buffer, 0, G64_HEADER);
+	memcpy(buffer, "GCR-1541", 8);
+	buffer[9] = HALF_TRACK_COUNT;
+	buffer[10] = G64_MAX_TRACK_LENGTH & 0xff;
+	buffer[11] = G64_MAX_TRACK_LENGTH >> 8;
+	seed = 0x1541;
+	for (unsigned halfTrack = 0; halfTrack <= LAST_HALF_TRACK; ++halfTrack)
+	{
+		unsigned length = image.TrackLength(halfTrack);
+		unsigned start = 0;
+		unsigned end = 0;
+		u8* data = buffer + size + 2;
+
+		image.PrepareTrack(halfTrack);
+		// Every other track is left as it was formatted.
+		if ((halfTrack & 3) == 0)
+		{
+			start = (halfTrack % 8) ? Random() % (length / 2) : length - length / 3;	// Some up to where the track wraps
+			end = start + length / 3;
+		}
+		protectionStart[halfTrack] = start;
+		protectionEnd[halfTrack] = end;
+
+		*(u32*)(buffer + 12 + halfTrack * 4) = size;
+		*(u32*)(buffer + 12 + HALF_TRACK_COUNT * 4 + halfTrack * 4) = halfTrack < 17 * 2 ? 3 : halfTrack < 24 * 2 ? 2 : halfTrack < 30 * 2 ? 1 : 0;
+		buffer[size] = length & 0xff;
+		buffer[size + 1] = length >> 8;
+		for (unsigned byte = 0; byte < length; ++byte)
+		{
+			u8 value = image.GetNextByte(halfTrack, byte);
+			if (byte >= start && byte < end)
+			{
+				switch ((halfTrack / 4) % 3)
+				{
+					case 0: value = 0; break;										// A flux gap
+					case 1: value = byte < start + 40 ? 0xff : (u8)Random(); break;	// A long sync then bits with no GCR coding
+					default: value = (Random() & 0xf) ? 0xff : 0x00; break;		// Syncs broken up by gaps
+				}
+			}
+			data[byte] = value;
+		}
+		size += 2 + G64_MAX_TRACK_LENGTH;
+	}
+	return size;
+}
+
+static bool OpenImage(const char* path, unsigned index)
+{
+	u8* buffer = imageBuffer;
+	u32 size = 0;
+
+	images[index].SetReadOnly(true);	// So that what was written to it is not saved when it is closed
+	DiskImage::DiskType type = path ? DiskImage::GetDiskImageTypeViaExtention(path) : DiskImage::G64;
+
+	if (path)
+	{
+		if (!HostLoadFile(path, buffer, READBUFFER_SIZE, &size))
+		{
+			printf("Cannot open %s\r\n", path);
+			return false;
+		}
+	}
+	else
+	{
+		size = MakeProtectedG64(images[index], &fileInfo[index], buffer);
+	}
+	strncpy(fileInfo[index].fname, path ? path : "protected.g64", sizeof(fileInfo[index].fname) - 1);
+	fileInfo[index].fsize = size;
+
+	bool opened;
+	switch (type)
+	{
+		case DiskImage::G64: opened = images[index].OpenG64(&fileInfo[index], buffer, size); break;
+		case DiskImage::NIB: opened = images[index].OpenNIB(&fileInfo[index], buffer, size); break;
+		case DiskImage::NBZ: opened = images[index].OpenNBZ(&fileInfo[index], buffer, size); break;
+		case DiskImage::D64: opened = images[index].OpenD64(&fileInfo[index], buffer, size); break;
+		default: opened = false; break;
+	}
+	if (!opened)
+	{
+		printf("Cannot mount %s (D64, G64, NIB or NBZ)\r\n", fileInfo[index].fname);
+		return false;
+	}
+	images[index].SetReadOnly(false);
+	return true;
+}
+
+// The flux index must never skip a 1 (after the writes it has been kept up to date through).
+static bool CheckFluxIndex(DiskImage& image)
+{
+	for (unsigned halfTrack = 0; halfTrack < HALF_TRACK_COUNT; ++halfTrack)
+	{
+		unsigned bits = image.BitsInTrack(halfTrack);
+		for (unsigned sample = 0; sample < 256 && bits; ++sample)
+		{
+			unsigned bitOffset = Random() % bits;
+			unsigned distance = image.BitsToFlux(halfTrack, bitOffset);
+			for (unsigned bit = bitOffset + 1; bit < bitOffset + distance; ++bit)
+			{
+				if (image.GetNextBit(halfTrack, bit >> 3, (~bit) & 7))
+				{
+					printf("The flux index skips the 1 at bit %u of half track %u\r\n", bit, halfTrack);
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// A 35 track D64 of random sectors with an error on a few of them.
+static void MakeRandomD64(u8* d64)
+{
+	seed = 0x1541d64;
+	for (u32 byte = 0; byte < BLOCKSONDISK * 256; ++byte)
+		d64[byte] = (u8)Random();
+	for (u32 sector = 0; sector < BLOCKSONDISK; ++sector)
+		d64[BLOCKSONDISK * 256 + sector] = (sector % 61) == 7 ? BAD_DATA_CHECKSUM : SECTOR_OK;
+}
+
+// A D64 is only encoded a track at a time as the tracks are needed. Whatever order they are needed in each must come out as it did
+// when the whole image was encoded as it was opened (done here the way OpenD64 used to do it) and every sector must decode back.
+static bool CheckLazyEncoding(const u8* d64)
+{
+	static u8 expected[MAX_TRACK_LENGTH];
+	static u8 sector[256];
+	DiskImage& image = images[0];
+
+	memcpy(imageBuffer, d64, RANDOM_D64_SIZE);
+	strcpy(fileInfo[0].fname, "random.d64");
+	image.SetReadOnly(true);
+	if (!image.OpenD64(&fileInfo[0], imageBuffer, RANDOM_D64_SIZE))
+		return false;
+	memset(imageBuffer, 0xaa, RANDOM_D64_SIZE);	// As the buffer is reused
+
+	// The directory first (as the browser reads it) then outwards from where the head starts.
+	image.GetDecodedSector(18, 0, sector);
+	while (image.EncodeNearestTrack(18 * 2 + 4))
+		;
+
+	u32 sectorRef = 0;
+	for (unsigned track = 0; track < 35; ++track)
+	{
+		u8* dest = expected;
+		for (unsigned sectorNo = 0; sectorNo < DiskImage::SectorsPerTrack[track]; ++sectorNo, ++sectorRef)
+		{
+			convert_sector_to_GCR((u8*)d64 + sectorRef * 256, dest, track + 1, sectorNo, (u8*)d64 + D64_ID_OFFSET, d64[BLOCKSONDISK * 256 + sectorRef]);
+			dest += GCR_SECTOR_LENGTH;
+		}
+		for (unsigned byte = 0; byte < image.TrackLength(track * 2); ++byte)
+		{
+			if (image.GetNextByte(track * 2, byte) != expected[byte])
+			{
+				printf("Byte %u of track %u encoded as %02x rather than %02x\r\n", byte, track + 1, image.GetNextByte(track * 2, byte), expected[byte]);
+				return false;
+			}
+		}
+	}
+
+	sectorRef = 0;
+	for (unsigned track = 0; track < 35; ++track)
+	{
+		for (unsigned sectorNo = 0; sectorNo < DiskImage::SectorsPerTrack[track]; ++sectorNo, ++sectorRef)
+		{
+			bool decoded = image.GetDecodedSector(track + 1, sectorNo, sector);
+			if (d64[BLOCKSONDISK * 256 + sectorRef] == SECTOR_OK && (!decoded || memcmp(sector, d64 + sectorRef * 256, 256) != 0))
+			{
+				printf("Track %u sector %u does not decode back\r\n", track + 1, sectorNo);
+				return false;
+			}
+		}
+	}
+	return CheckFluxIndex(image);
+}
+
+static void Stimulate(m6522& via, Stimulus& stimulus)
+{
+	seed = stimulus.seed;
+	u32 random = Random();
+
+	if (stimulus.writeCycles)
+	{
+		if (--stimulus.writeCycles == 0)
+		{
+			stimulus.pcr = PCR_READ;
+			via.Write(PCR, stimulus.pcr);
+			via.Write(DDRA, 0);
+		}
+		else if ((random & 0x1f) == 0)
+		{
+			via.Write(ORA, (u8)(random >> 8));
+		}
+	}
+	else if (random % 10000 == 0)
+	{
+		stimulus.writeCycles = 100 + (Random() % 6000);
+		stimulus.pcr = PCR_WRITE;
+		via.Write(DDRA, 0xff);
+		via.Write(PCR, stimulus.pcr);
+	}
+	else if (random % 10000 == 1)
+	{
+		stimulus.pcr = stimulus.pcr == PCR_READ ? PCR_READ_NO_BYTE_READY : PCR_READ;
+		via.Write(PCR, stimulus.pcr);
+	}
+	else if (random % 5000 == 2)
+	{
+		stimulus.orb = (stimulus.orb & 0x9f) | ((Random() & 3) << 5);	// Density
+		via.Write(ORB, stimulus.orb);
+	}
+	else if (random % 20000 == 3 && (stimulus.orb & 4))
+	{
+		// Step in or out a half track (staying on the tracks that have data).
+		bool in = (Random() & 1) ? stimulus.halfTrack < LAST_HALF_TRACK : stimulus.halfTrack == 2;
+		stimulus.halfTrack += in ? 1 : -1;
+		stimulus.orb = (stimulus.orb & ~3) | ((stimulus.orb + (in ? 1 : -1)) & 3);
+		via.Write(ORB, stimulus.orb);
+	}
+	else if (random % 100000 == 4 && (stimulus.orb & 4))
+	{
+		stimulus.orb &= ~4;	// Motor off
+		via.Write(ORB, stimulus.orb);
+	}
+	else if (random % 2000 == 5 && !(stimulus.orb & 4))
+	{
+		stimulus.orb |= 4;
+		via.Write(ORB, stimulus.orb);
+	}
+	else if (random % 30 == 6)
+	{
+		via.Read(ORA);
+	}
+	stimulus.seed = seed;
+}
+
+static void StartVIA(m6522& via, const Stimulus& stimulus)
+{
+	via.Reset();
+	via.Write(DDRB, 0x6f);
+	via.Write(ORB, stimulus.orb);
+	via.Write(PCR, stimulus.pcr);
+}
+
+// A half track of each speed zone left as it was formatted and one with a flux gap on it.
+struct Zone
+{
+	unsigned halfTrack;
+	unsigned gapHalfTrack;
+	u8 density;
+};
+
+static const Zone zones[] = { { 2, 12, 3 }, { 38, 36, 2 }, { 50, 48, 1 }, { 62, 60, 0 } };
+
+// Steps the head (a half track every few cycles) and sets the density as the ROM would. The longest a step took is kept in slowestStep if it is given.
+template <class DRIVE> static void Seek(DRIVE& drive, m6522& via, Stimulus& stimulus, unsigned halfTrack, u8 density, u64* slowestStep = 0)
+{
+	while (stimulus.halfTrack != halfTrack)
+	{
+		bool in = stimulus.halfTrack < halfTrack;
+		stimulus.halfTrack += in ? 1 : -1;
+		stimulus.orb = (stimulus.orb & ~3) | ((stimulus.orb + (in ? 1 : -1)) & 3);
+		u64 before = HostNanoSeconds();
+		via.Write(ORB, stimulus.orb);
+		u64 ns = HostNanoSeconds() - before;
+		if (slowestStep && ns > *slowestStep)
+			*slowestStep = ns;
+		for (unsigned cycle = 0; cycle < 100; ++cycle)
+			drive.Update();
+	}
+	stimulus.orb = (stimulus.orb & 0x9f) | (density << 5);
+	via.Write(ORB, stimulus.orb);
+}
+
+// Cycles from one time the head passes the start of the track to ROTATION_REVOLUTIONS later.
+template <class DRIVE> static u32 MeasureRotation(DRIVE& drive)
+{
+	u32 last = drive.GetHeadBitOffset();
+	u32 first = 0;
+	unsigned passes = 0;
+
+	for (u32 cycle = 0; ; ++cycle)
+	{
+		drive.Update();
+		u32 offset = drive.GetHeadBitOffset();
+		if (offset < last && passes++ == 0)
+			first = cycle;
+		else if (offset < last && passes == ROTATION_REVOLUTIONS + 1)
+			return cycle - first;
+		last = offset;
+	}
+}
+
+// The bytes the drive delivers over a number of cycles (the first after a sync with BYTE_AFTER_SYNC) when the head is between firstBit and lastBit.
+template <class DRIVE> static u32 ReadBytes(DRIVE& drive, m6522& via, u32 cycles, u16* bytes, u32 firstBit, u32 lastBit)
+{
+	u32 count = 0;
+	bool sync = false;
+
+	for (u32 cycle = 0; cycle < cycles; ++cycle)
+	{
+		if (drive.Update())
+		{
+			u32 offset = drive.GetHeadBitOffset();
+			u8 value = via.Read(ORA);
+			if (offset >= firstBit && offset < lastBit && count < MAX_BYTES)
+				bytes[count++] = value | (sync ? BYTE_AFTER_SYNC : 0);
+			sync = false;
+		}
+		if ((via.GetPortB()->GetInput() & 0x80) == 0)
+			sync = true;
+	}
+	return count;
+}
+
+static u32 FirstAfterSync(const u16* bytes, u32 count)
+{
+	u32 index = 0;
+	while (index < count && !(bytes[index] & BYTE_AFTER_SYNC))
+		index++;
+	return index;
+}
+
+// Reading GCR nothing is left to chance so both must deliver the same bytes from the first sync on.
+static bool CheckDecode(Drive& drive, DriveRef& ref, m6522* vias, Stimulus* stimulus, const Zone& zone)
+{
+	static u16 bytes[2][MAX_BYTES];
+	u32 count[2];
+
+	Seek(drive, vias[0], stimulus[0], zone.halfTrack, zone.density);
+	Seek(ref, vias[1], stimulus[1], zone.halfTrack, zone.density);
+	count[0] = ReadBytes(drive, vias[0], DECODE_REVOLUTIONS * REVOLUTION_CYCLES, bytes[0], 0, ~0u);
+	count[1] = ReadBytes(ref, vias[1], DECODE_REVOLUTIONS * REVOLUTION_CYCLES, bytes[1], 0, ~0u);
+
+	u32 start[2] = { FirstAfterSync(bytes[0], count[0]), FirstAfterSync(bytes[1], count[1]) };
+	u32 length = count[0] - start[0] < count[1] - start[1] ? count[0] - start[0] : count[1] - start[1];
+	if (length + 2 < (DECODE_REVOLUTIONS - 1) * images[0].TrackLength(zone.halfTrack))
+	{
+		printf("Drive read %u bytes and DriveRef %u from half track %u\r\n", count[0] - start[0], count[1] - start[1], zone.halfTrack);
+		return false;
+	}
+	for (u32 index = 0; index < length; ++index)
+	{
+		if (bytes[0][start[0] + index] != bytes[1][start[1] + index])
+		{
+			printf("Drive read %03x, DriveRef %03x, as byte %u after the first sync on half track %u\r\n", bytes[0][start[0] + index], bytes[1][start[1] + index], index, zone.halfTrack);
+			return false;
+		}
+	}
+	return true;
+}
+
+// A sync and a data block written a byte each time byte ready is signalled then read back.
+template <class DRIVE> static bool CheckWrite(DRIVE& drive, m6522& via, Stimulus& stimulus, const Zone& zone, const char* name)
+{
+	static const u8 gcr[16] = { 0x0a, 0x0b, 0x12, 0x13, 0x0e, 0x0f, 0x16, 0x17, 0x09, 0x19, 0x1a, 0x1b, 0x0d, 0x1d, 0x1e, 0x15 };
+	static u8 block[WRITE_BYTES];
+	static u16 bytes[MAX_BYTES];
+
+	seed = 0x0b10c + zone.halfTrack;
+	block[0] = 0x55;	// A data block's header byte (07) in GCR
+	u32 bits = 0;
+	unsigned bitCount = 0;
+	for (unsigned index = 1; index < WRITE_BYTES; )
+	{
+		bits = (bits << 5) | gcr[Random() & 0xf];
+		bitCount += 5;
+		for (; bitCount >= 8 && index < WRITE_BYTES; bitCount -= 8)
+			block[index++] = (u8)(bits >> (bitCount - 8));
+	}
+
+	Seek(drive, via, stimulus, zone.halfTrack, zone.density);
+	via.Write(ORA, 0xff);
+	via.Write(DDRA, 0xff);
+	via.Write(PCR, PCR_WRITE);
+	// 5 sync bytes, the block and a gap byte (so that the last byte of the block has been shifted out by the time writing stops).
+	for (unsigned index = 1; index < 5 + WRITE_BYTES + 2; )
+	{
+		if (drive.Update())
+		{
+			via.Write(ORA, index < 5 ? 0xff : index < 5 + WRITE_BYTES ? block[index - 5] : 0x55);
+			index++;
+		}
+	}
+	via.Write(PCR, PCR_READ);
+	via.Write(DDRA, 0);
+
+	u32 count = ReadBytes(drive, via, 2 * REVOLUTION_CYCLES, bytes, 0, ~0u);
+	for (u32 index = 0; index + WRITE_BYTES <= count; ++index)
+	{
+		if (bytes[index] & BYTE_AFTER_SYNC)
+		{
+			unsigned matched = 0;
+			while (matched < WRITE_BYTES && (bytes[index + matched] & 0xff) == block[matched])
+				matched++;
+			if (matched == WRITE_BYTES)
+				return true;
+		}
+	}
+	printf("%s did not read back the block it wrote to half track %u\r\n", name, zone.halfTrack);
+	return false;
+}
+
+struct NoiseStatistics
+{
+	u32 distances[DISTANCE_BINS];	// How many 1s came 1, 2, ... DISTANCE_BINS or more bits after the one before
+	u32 ones;
+	u32 bits;
+	u32 repeated;					// Bytes read the same as in the same place the revolution before
+	u32 compared;
+};
+
+// Reads NOISE_REVOLUTIONS passes over the flux gap on a track.
+template <class DRIVE> static void ReadNoise(DRIVE& drive, m6522& via, Stimulus& stimulus, const Zone& zone, NoiseStatistics& statistics)
+{
+	static u16 bytes[2][MAX_BYTES];
+	// Not the edges where a 1 on the formatted part decides when the noise starts.
+	u32 firstBit = protectionStart[zone.gapHalfTrack] * 8 + 64;
+	u32 lastBit = protectionEnd[zone.gapHalfTrack] * 8 - 64;
+	u32 count[2] = { 0, 0 };
+
+	memset(&statistics, 0, sizeof(statistics));
+	Seek(drive, via, stimulus, zone.gapHalfTrack, zone.density);
+	while (drive.GetHeadBitOffset() >= firstBit && drive.GetHeadBitOffset() < lastBit)
+		drive.Update();
+
+	unsigned distance = 0;
+	for (unsigned revolution = 0; revolution < NOISE_REVOLUTIONS; ++revolution)
+	{
+		u16* read = bytes[revolution & 1];
+		u16* before = bytes[(revolution & 1) ^ 1];
+		count[revolution & 1] = ReadBytes(drive, via, REVOLUTION_CYCLES, read, firstBit, lastBit);
+		for (u32 index = 0; index < count[revolution & 1]; ++index)
+		{
+			u8 value = (u8)read[index];
+			for (u8 mask = 0x80; mask; mask >>= 1)
+			{
+				distance++;
+				if (value & mask)
+				{
+					statistics.distances[(distance < DISTANCE_BINS ? distance : DISTANCE_BINS) - 1]++;
+					statistics.ones++;
+					distance = 0;
+				}
+			}
+			statistics.bits += 8;
+			if (revolution && index < count[(revolution & 1) ^ 1])
+			{
+				statistics.repeated += value == (u8)before[index];
+				statistics.compared++;
+			}
+		}
+	}
+}
+
+// The chi squared statistic of two samples being from the same distribution.
+static double ChiSquared(const u32* a, const u32* b, unsigned bins)
+{
+	double totalA = 0;
+	double totalB = 0;
+	double chiSquared = 0;
+
+	for (unsigned bin = 0; bin < bins; ++bin)
+	{
+		totalA += a[bin];
+		totalB += b[bin];
+	}
+	double scaleA = sqrt(totalB / totalA);
+	double scaleB = sqrt(totalA / totalB);
+	for (unsigned bin = 0; bin < bins; ++bin)
+	{
+		if (a[bin] + b[bin] == 0)
+			continue;
+		double difference = scaleA * a[bin] - scaleB * b[bin];
+		chiSquared += difference * difference / (a[bin] + b[bin]);
+	}
+	return chiSquared;
+}
+
+static bool CheckNoise(Drive& drive, DriveRef& ref, m6522* vias, Stimulus* stimulus, const Zone& zone)
+{
+	NoiseStatistics statistics[2];
+
+	ReadNoise(drive, vias[0], stimulus[0], zone, statistics[0]);
+	ReadNoise(ref, vias[1], stimulus[1], zone, statistics[1]);
+	double chiSquared = ChiSquared(statistics[0].distances, statistics[1].distances, DISTANCE_BINS);
+	printf("  half track %2u noise: 1s in %5.2f%% of %u bits (DriveRef %5.2f%% of %u), %4.1f%% of bytes repeated (DriveRef %4.1f%%), chi squared %5.2f\r\n",
+		zone.gapHalfTrack, statistics[0].ones * 100.0 / statistics[0].bits, statistics[0].bits, statistics[1].ones * 100.0 / statistics[1].bits, statistics[1].bits,
+		statistics[0].repeated * 100.0 / statistics[0].compared, statistics[1].repeated * 100.0 / statistics[1].compared, chiSquared);
+	if (statistics[0].bits < statistics[1].bits / 2 || statistics[0].bits > statistics[1].bits * 2)
+	{
+		printf("Drive read a different number of bits from the flux gap on half track %u\r\n", zone.gapHalfTrack);
+		return false;
+	}
+	if (chiSquared > CHI_SQUARED_LIMIT)
+	{
+		printf("The noise Drive reads on half track %u is not distributed as DriveRef's\r\n", zone.gapHalfTrack);
+		return false;
+	}
+	// Protections like 720 check that a byte read from a gap twice differs.
+	if (statistics[0].repeated * 4 > statistics[0].compared)
+	{
+		printf("Drive reads the same noise every revolution on half track %u\r\n", zone.gapHalfTrack);
+		return false;
+	}
+	return true;
+}
+
+template <class DRIVE> static void Insert(DRIVE& drive, m6522& via, DiskImage& image, Stimulus& stimulus)
+{
+	stimulus.orb = 0x60 | 0x04;
+	stimulus.pcr = PCR_READ;
+	stimulus.halfTrack = 18 * 2;
+	stimulus.writeCycles = 0;
+	drive.SetVIA(&via);
+	drive.Insert(&image);
+	drive.Reset();
+	StartVIA(via, stimulus);	// After the reset so that the drive sees the motor go on
+}
+
+template <class DRIVE> static void Start(DRIVE& drive, m6522& via, DiskImage& image, Stimulus& stimulus)
+{
+	Insert(drive, via, image, stimulus);
+	for (u32 cycle = 0; cycle < SWAP_CYCLES; ++cycle)
+		drive.Update();
+}
+
+enum MountEncoding
+{
+	ENCODE_ON_OPEN,			// The way OpenD64 used to
+	ENCODE_BEFORE_REALTIME,	// The way Emulate1541 does; the track under the head as the disk is inserted, the rest before realtime emulation starts
+	ENCODE_AS_STEPPED		// Each track as the head gets to it
+};
+
+// The time from opening a D64 to Drive reading the first byte off it, apart from the SWAP_CYCLES it waits for the disk to settle
+// (as they take the same real time on a Pi however long the mount took).
+static u64 MountToFirstByte(Drive& drive, m6522& via, Stimulus& stimulus, const u8* d64, MountEncoding encoding)
+{
+	memcpy(imageBuffer, d64, RANDOM_D64_SIZE);
+	u64 before = HostNanoSeconds();
+	images[0].OpenD64(&fileInfo[0], imageBuffer, RANDOM_D64_SIZE);
+	if (encoding == ENCODE_ON_OPEN)
+	{
+		for (unsigned halfTrack = 0; halfTrack < HALF_TRACK_COUNT; ++halfTrack)
+			images[0].PrepareTrack(halfTrack);
+	}
+	Insert(drive, via, images[0], stimulus);
+	if (encoding == ENCODE_BEFORE_REALTIME)
+		images[0].PrepareAllTracks();
+	u64 inserted = HostNanoSeconds();
+
+	for (u32 cycle = 0; cycle < SWAP_CYCLES; ++cycle)
+		drive.Update();
+	u64 settled = HostNanoSeconds();
+	while (!drive.Update())
+		;
+	return (inserted - before) + (HostNanoSeconds() - settled);
+}
+
+// The longest a single step of the head takes sweeping from track 18 in to track 1 and out to track 35 over a D64 that has just been mounted.
+// Every step has to fit in the few cycles Emulate1541 catches up on (MAX_CATCH_UP_CYCLES), so a track that is encoded as the head gets to it drops cycles.
+static bool SlowestStep(Drive& drive, m6522& via, Stimulus& stimulus, const u8* d64, MountEncoding encoding, u64& slowest)
+{
+	memcpy(imageBuffer, d64, RANDOM_D64_SIZE);
+	images[0].OpenD64(&fileInfo[0], imageBuffer, RANDOM_D64_SIZE);
+	Insert(drive, via, images[0], stimulus);
+	if (encoding == ENCODE_BEFORE_REALTIME)
+	{
+		images[0].PrepareAllTracks();
+		if (images[0].EncodeNearestTrack(0))
+		{
+			printf("A D64 still had tracks to encode after they were all prepared\r\n");
+			return false;
+		}
+	}
+	for (u32 cycle = 0; cycle < SWAP_CYCLES; ++cycle)
+		drive.Update();
+
+	u64 ns = 0;
+	Seek(drive, via, stimulus, 0, 3, &ns);
+	Seek(drive, via, stimulus, LAST_HALF_TRACK, 0, &ns);
+	slowest = ns < slowest ? ns : slowest;
+	return true;
+}
+
+int BenchDrive(const char* path, u32 cycles, void (*report)(const char* name, u32 cycles, u64 ns))
+{
+	static Drive drive;
+	static DriveRef ref;
+	static m6522 vias[2];
+	Stimulus stimulus[2];
+	static u8 d64[RANDOM_D64_SIZE];
+	u32 blocks = (cycles + BLOCK_CYCLES - 1) / BLOCK_CYCLES;
+
+	MakeRandomD64(d64);
+	if (!CheckLazyEncoding(d64))
+		return 1;
+	printf("A D64 encoded a track at a time as it is read matches it encoded as it is opened\r\n");
+	u64 mount[3] = { ~0ULL, ~0ULL, ~0ULL };
+	u64 step[2] = { ~0ULL, ~0ULL };	// ENCODE_BEFORE_REALTIME and ENCODE_AS_STEPPED
+	for (unsigned run = 0; run < 5; ++run)
+	{
+		for (unsigned encoding = ENCODE_ON_OPEN; encoding <= ENCODE_AS_STEPPED; ++encoding)
+		{
+			u64 ns = MountToFirstByte(drive, vias[0], stimulus[0], d64, (MountEncoding)encoding);
+			mount[encoding] = ns < mount[encoding] ? ns : mount[encoding];
+		}
+		if (!SlowestStep(drive, vias[0], stimulus[0], d64, ENCODE_BEFORE_REALTIME, step[0]) || !SlowestStep(drive, vias[0], stimulus[0], d64, ENCODE_AS_STEPPED, step[1]))
+			return 1;
+	}
+	printf("D64 mount to first byte %.3f ms encoding every track as it is opened, %.3f ms encoding the rest before realtime emulation, %.3f ms a track at a time\r\n",
+		(double)mount[ENCODE_ON_OPEN] / 1000000.0, (double)mount[ENCODE_BEFORE_REALTIME] / 1000000.0, (double)mount[ENCODE_AS_STEPPED] / 1000000.0);
+	printf("Slowest head step %.2f us with the tracks encoded before realtime emulation, %.2f us encoding a track at a time\r\n",
+		(double)step[0] / 1000.0, (double)step[1] / 1000.0);
+
+	if (!OpenImage(0, 0) || !OpenImage(0, 1))
+		return 1;
+	printf("Checking Drive against DriveRef on %s\r\n", fileInfo[0].fname);
+	srand(1);
+	Start(drive, vias[0], images[0], stimulus[0]);
+	Start(ref, vias[1], images[1], stimulus[1]);
+
+	for (unsigned index = 0; index < sizeof(zones) / sizeof(zones[0]); ++index)
+	{
+		const Zone& zone = zones[index];
+		Seek(drive, vias[0], stimulus[0], zone.halfTrack, zone.density);
+		Seek(ref, vias[1], stimulus[1], zone.halfTrack, zone.density);
+		u32 rotation = MeasureRotation(drive);
+		u32 rotationRef = MeasureRotation(ref);
+		printf("  half track %2u: %u revolutions in %u cycles (DriveRef %u)\r\n", zone.halfTrack, ROTATION_REVOLUTIONS, rotation, rotationRef);
+		if (rotation != ROTATION_REVOLUTIONS * REVOLUTION_CYCLES || rotationRef + ROTATION_TOLERANCE < rotation || rotationRef > rotation + ROTATION_TOLERANCE)
+		{
+			printf("Drive does not spin at 300rpm on half track %u\r\n", zone.halfTrack);
+			return 1;
+		}
+		if (!CheckDecode(drive, ref, vias, stimulus, zone) || !CheckWrite(drive, vias[0], stimulus[0], zone, "Drive") || !CheckWrite(ref, vias[1], stimulus[1], zone, "DriveRef"))
+			return 1;
+		if (!CheckNoise(drive, ref, vias, stimulus, zone))
+			return 1;
+	}
+	printf("Drive matches DriveRef on rotation, reading, writing and noise in every speed zone\r\n");
+
+	if (path && !OpenImage(path, 0))
+		return 1;
+	Start(drive, vias[0], images[0], stimulus[0]);
+	for (u32 block = 0; block < blocks; ++block)
+	{
+		stimulus[0].seed = 0x1c00 + block * 7919;
+		for (u32 cycle = 0; cycle < BLOCK_CYCLES; ++cycle)
+		{
+			Stimulate(vias[0], stimulus[0]);
+			drive.Update();
+		}
+		if (!CheckFluxIndex(images[0]))
+			return 1;
+	}
+	printf("Drive read, wrote and stepped over %s for %u blocks of %u cycles\r\n", fileInfo[0].fname, blocks, BLOCK_CYCLES);
+
+	// Timed just reading (as when the ROM or a loader waits on a sector) with the data port read as each byte comes in.
+	if (!OpenImage(path, 0) || !OpenImage(path, 1))
+		return 1;
+	Start(drive, vias[0], images[0], stimulus[0]);
+	Start(ref, vias[1], images[1], stimulus[1]);
+	u64 before = HostNanoSeconds();
+	for (u32 cycle = 0; cycle < cycles; ++cycle)
+	{
+		if (drive.Update())
+			vias[0].Read(ORA);
+	}
+	report("drive", cycles, HostNanoSeconds() - before);
+
+	before = HostNanoSeconds();
+	for (u32 cycle = 0; cycle < cycles; ++cycle)
+	{
+		if (ref.Update())
+			vias[1].Read(ORA);
+	}
+	report("drive ref", cycles, HostNanoSeconds() - before);
+	return 0;
+}
@@ -0,0 +1,333 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// DiskImage hands the tracks of a NIB (or an NBZ once it is uncompressed) out to be extracted by every core that helps; on a Pi 2 or 3
+// the idle cores, here threads standing in for them. A corpus of NIBs (generated ones plus the .nib and .nbz files in the directory
+// given with -corpus) is mounted with no helpers and with 1 to 3 of them and each must come out with the same tracks every time.
+// The best time of each is reported; the speed up is only what the host's cores allow.
+
+#include "HostPlatform.h"
+#include "DiskImage.h"
+#include "gcr.h"
+#include "lz.h"
+#include <stdio.h>
+#include <string.h>
+#include <glob.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#define EXTRACT_PATH "/tmp/pi1541bench-extract"
+#define EXTRACT_RUNS 5
+#define MAX_HELPERS 3
+#define MAX_CORPUS 64
+#define D64_SIZE (BLOCKSONDISK * 256)
+#define NIB_SIZE(tracks) (0x100 + (tracks) * NIB_TRACK_LENGTH)
+
+static u32 seed;
+
+static inline u32 Random()
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static u8 image[READBUFFER_SIZE];
+static u8 compressed[READBUFFER_SIZE];
+static FILINFO fileInfo[2];
+static DiskImage images[2];
+
+static volatile bool stopHelping;
+
+// What an idle core does.
+static void* HelperThread(void*)
+{
+	while (!stopHelping)
+	{
+		if (!DiskImage::HelpExtractTracks())
+			sched_yield();
+	}
+	return 0;
+}
+
+static bool SaveFile(const char* path, const u8* data, u32 size)
+{
+	FIL fp;
+	u32 bytesWritten;
+
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return false;
+	f_write(&fp, data, size, &bytesWritten);
+	f_close(&fp);
+	return bytesWritten == size;
+}
+
+// The speed zone of each track (as a 1541 writes it).
+static unsigned Density(unsigned track)
+{
+	return track < 17 ? 3 : track < 24 ? 2 : track < 30 ? 1 : 0;
+}
+
+static void AddTrack(u8* nib, unsigned entry, unsigned halfTrack)
+{
+	nib[0x10 + entry * 2] = (u8)(halfTrack + 2);
+	nib[0x11 + entry * 2] = (u8)Density(halfTrack >> 1);
+}
+
+// A revolution and a bit of one of the D64's tracks as a nibbler would read it (from anywhere on the track).
+static void NibbleTrack(DiskImage& d64, unsigned halfTrack, u8* data)
+{
+	unsigned length = d64.TrackLength(halfTrack);
+	unsigned start = Random() % length;
+
+	d64.PrepareTrack(halfTrack);
+	for (unsigned byte = 0; byte < NIB_TRACK_LENGTH; ++byte)
+		data[byte] = d64.GetNextByte(halfTrack, (start + byte) % length);
+}
+
+// A NIB of the D64's 35 tracks, or of 42 tracks and the half tracks between them (the 7 past the D64 and the half tracks
+// unformatted, as a nibbler reads them).
+static u32 MakeDOSNIB(DiskImage& d64, u8* nib, bool halfTracks)
+{
+	unsigned entries = halfTracks ? 84 : 35;
+
+	memset(nib, 0, NIB_SIZE(entries));
+	memcpy(nib, "MNIB-1541-RAW", 13);
+	nib[13] = 3;
+	for (unsigned entry = 0; entry < entries; ++entry)
+	{
+		unsigned halfTrack = halfTracks ? entry : entry * 2;
+		u8* data = nib + 0x100 + entry * NIB_TRACK_LENGTH;
+
+		AddTrack(nib, entry, halfTrack);
+		if ((halfTrack & 1) == 0 && halfTrack < 70)
+			NibbleTrack(d64, halfTrack, data);
+	}
+	return NIB_SIZE(entries);
+}
+
+// A NIB of 35 tracks of GCR with no syncs (as some protections have) so each one's revolution has to be found without them.
+static u32 MakeSynclessNIB(u8* nib)
+{
+	u8 plain[4];
+	u8 cycle[NIB_TRACK_LENGTH];
+
+	memset(nib, 0, NIB_SIZE(35));
+	memcpy(nib, "MNIB-1541-RAW", 13);
+	nib[13] = 3;
+	for (unsigned entry = 0; entry < 35; ++entry)
+	{
+		unsigned density = Density(entry);
+		unsigned length = capacity_min[density] + Random() % (capacity_max[density] - capacity_min[density]);
+		u8* data = nib + 0x100 + entry * NIB_TRACK_LENGTH;
+
+		AddTrack(nib, entry, entry * 2);
+		length -= length % 5;
+		for (unsigned byte = 0; byte < length; byte += 5)
+		{
+			for (unsigned index = 0; index < 4; ++index)
+				plain[index] = (u8)Random();
+			convert_4bytes_to_GCR(plain, cycle + byte);
+		}
+		for (unsigned byte = 0; byte < NIB_TRACK_LENGTH; ++byte)
+			data[byte] = cycle[byte % length];
+	}
+	return NIB_SIZE(35);
+}
+
+static bool Mount(DiskImage& diskImage, FILINFO* info, const char* path)
+{
+	FIL fp;
+
+	if (f_open(&fp, path, FA_READ) != FR_OK)
+		return false;
+	strncpy(info->fname, path, sizeof(info->fname) - 1);
+	info->fsize = f_size(&fp);
+	diskImage.SetReadOnly(true);
+	bool loaded = diskImage.Load(info, &fp, DiskImage::GetDiskImageTypeViaExtention(path));
+	f_close(&fp);
+	return loaded;
+}
+
+static bool SameTracks(DiskImage& alone, DiskImage& helped, const char* name, unsigned helpers)
+{
+	for (unsigned track = 0; track < HALF_TRACK_COUNT; ++track)
+	{
+		unsigned length = alone.TrackLength(track);
+		if (helped.TrackLength(track) != length)
+		{
+			printf("%s track %u is %u bytes extracted alone and %u with %u helping\r\n", name, track, length, helped.TrackLength(track), helpers);
+			return false;
+		}
+		alone.PrepareTrack(track);
+		helped.PrepareTrack(track);
+		for (unsigned byte = 0; byte < length; ++byte)
+		{
+			if (alone.GetNextByte(track, byte) != helped.GetNextByte(track, byte))
+			{
+				printf("%s track %u differs at byte %u with %u helping\r\n", name, track, byte, helpers);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Mounts the image with no helpers and then with each number of them, each the best of EXTRACT_RUNS, into ns.
+static bool TimeExtract(const char* path, const char* name, u64* ns)
+{
+	pthread_t threads[MAX_HELPERS];
+
+	if (!Mount(images[0], &fileInfo[0], path))
+	{
+		printf("Cannot mount %s\r\n", path);
+		return false;
+	}
+	for (unsigned helpers = 0; helpers <= MAX_HELPERS; ++helpers)
+	{
+		stopHelping = false;
+		for (unsigned thread = 0; thread < helpers; ++thread)
+		{
+			if (pthread_create(&threads[thread], 0, HelperThread, 0) != 0)
+			{
+				printf("Cannot start a helper\r\n");
+				return false;
+			}
+		}
+
+		bool same = true;
+		ns[helpers] = ~0ULL;
+		for (unsigned run = 0; run < EXTRACT_RUNS && same; ++run)
+		{
+			images[1].Close();
+			u64 start = HostNanoSeconds();
+			bool mounted = Mount(images[1], &fileInfo[1], path);
+			u64 taken = HostNanoSeconds() - start;
+			if (taken < ns[helpers])
+				ns[helpers] = taken;
+			same = mounted && SameTracks(images[0], images[1], name, helpers);
+		}
+
+		stopHelping = true;
+		for (unsigned thread = 0; thread < helpers; ++thread)
+			pthread_join(threads[thread], 0);
+		if (!same)
+			return false;
+	}
+	images[0].Close();
+	images[1].Close();
+
+	printf("%-24.24s %8.3f ms alone", name, (double)ns[0] / 1000000.0);
+	for (unsigned helpers = 1; helpers <= MAX_HELPERS; ++helpers)
+		printf("  %u helping %8.3f ms (%.2fx)", helpers, (double)ns[helpers] / 1000000.0, (double)ns[0] / ns[helpers]);
+	printf("\r\n");
+	return true;
+}
+
+int BenchExtract(const char* corpus)
+{
+	char paths[MAX_CORPUS][256];
+	const char* names[MAX_CORPUS];
+	unsigned count = 0;
+	unsigned generated = 0;
+	DiskImage d64;
+
+	printf("%ld cores on this host (the helpers can only speed it up as far as that allows)\r\n", sysconf(_SC_NPROCESSORS_ONLN));
+
+	seed = 0x1541;
+	for (u32 byte = 0; byte < D64_SIZE; ++byte)
+		image[byte] = (u8)Random();
+	if (!d64.OpenD64(0, image, D64_SIZE))
+		return 1;
+
+	static const char* generatedNames[] = { "35 tracks", "NBZ of 35 tracks", "42 and half tracks", "35 tracks without syncs" };
+	for (unsigned index = 0; index < 4; ++index)
+	{
+		u32 size;
+		const u8* data = image;
+
+		switch (index)
+		{
+			case 0:
+				size = MakeDOSNIB(d64, image, false);
+				break;
+			case 1:
+				size = LZ_Compress(image, compressed, NIB_SIZE(35));
+				data = compressed;
+				break;
+			case 2:
+				size = MakeDOSNIB(d64, image, true);
+				break;
+			default:
+				size = MakeSynclessNIB(image);
+				break;
+		}
+		sprintf(paths[count], "%s-%u.%s", EXTRACT_PATH, index, index == 1 ? "nbz" : "nib");
+		if (!SaveFile(paths[count], data, size))
+		{
+			printf("Cannot save %s\r\n", paths[count]);
+			return 1;
+		}
+		names[count++] = generatedNames[index];
+	}
+	generated = count;
+
+	if (corpus)
+	{
+		glob_t found;
+		char pattern[256];
+
+		snprintf(pattern, sizeof(pattern), "%s/*.[nN][iI][bB]", corpus);
+		int result = glob(pattern, 0, 0, &found);
+		snprintf(pattern, sizeof(pattern), "%s/*.[nN][bB][zZ]", corpus);
+		result = glob(pattern, result == 0 ? GLOB_APPEND : 0, 0, &found) == 0 ? 0 : result;
+		if (result != 0)
+		{
+			printf("There are no .nib or .nbz files in %s\r\n", corpus);
+			return 1;
+		}
+		for (size_t index = 0; index < found.gl_pathc && count < MAX_CORPUS; ++index)
+		{
+			snprintf(paths[count], sizeof(paths[count]), "%s", found.gl_pathv[index]);
+			names[count] = paths[count] + strlen(corpus) + 1;
+			count++;
+		}
+		globfree(&found);
+	}
+
+	u64 ns[MAX_HELPERS + 1];
+	u64 total[MAX_HELPERS + 1] = { 0 };
+	bool passed = true;
+	for (unsigned index = 0; index < count && passed; ++index)
+	{
+		passed = TimeExtract(paths[index], names[index], ns);
+		for (unsigned helpers = 0; helpers <= MAX_HELPERS && passed; ++helpers)
+			total[helpers] += ns[helpers];
+	}
+	for (unsigned index = 0; index < generated; ++index)
+		f_unlink(paths[index]);
+	if (!passed)
+		return 1;
+
+	printf("%-24.24s %8.3f ms alone", "all of them", (double)total[0] / 1000000.0);
+	for (unsigned helpers = 1; helpers <= MAX_HELPERS; ++helpers)
+		printf("  %u helping %8.3f ms (%.2fx)", helpers, (double)total[helpers] / 1000000.0, (double)total[0] / total[helpers]);
+	printf("\r\n");
+	printf("Every NIB extracted with helpers has the same tracks as extracted alone\r\n");
+	return 0;
+}
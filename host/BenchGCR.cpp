@@ -0,0 +1,173 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// The bulk GCR codec (encode_GCR_block and decode_GCR_block) must give exactly what convert_4bytes_to_GCR and convert_4bytes_from_GCR
+// give a group at a time; on random data, on its GCR and on that GCR with bad codes put in (the count decoded must stop at the first).
+// The scalar and (when built with GCR_NEON) NEON versions are checked and then timed against the group at a time functions in MB/s of sector data.
+// On the host the NEON version runs through host/arm_neon.h so only its results mean anything, not its time.
+
+#include "HostPlatform.h"
+#include "gcr.h"
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK_BLOCKS 20000
+#define MAX_GROUPS 65			// A sector's data block (with its ID, checksum and padding)
+#define TIME_SECTORS 200000
+
+static u32 seed;
+
+static inline u32 Random()
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+struct Codec
+{
+	const char* name;
+	void (*encode)(BYTE* plain, BYTE* gcr, int groups);
+	int (*decode)(BYTE* gcr, BYTE* plain, int groups);
+};
+
+static void EncodeReference(BYTE* plain, BYTE* gcr, int groups)
+{
+	for (int group = 0; group < groups; ++group)
+		convert_4bytes_to_GCR(plain + group * 4, gcr + group * 5);
+}
+
+static int DecodeReference(BYTE* gcr, BYTE* plain, int groups)
+{
+	int converted = -1;
+
+	for (int group = 0; group < groups; ++group)
+	{
+		int good = convert_4bytes_from_GCR(gcr + group * 5, plain + group * 4);
+		if (good < 4 && converted < 0)
+			converted = group * 4 + good;
+	}
+	return converted < 0 ? groups * 4 : converted;
+}
+
+static const Codec codecs[] =
+{
+	{ "reference", EncodeReference, DecodeReference },
+	{ "scalar", encode_GCR_block_scalar, decode_GCR_block_scalar },
+#if defined(GCR_NEON)
+	{ "neon", encode_GCR_block_neon, decode_GCR_block_neon },
+#endif
+};
+#define CODECS (sizeof(codecs) / sizeof(codecs[0]))
+
+static bool Check(const Codec& codec)
+{
+	BYTE plain[MAX_GROUPS * 4];
+	BYTE gcr[MAX_GROUPS * 5];
+	BYTE expected[MAX_GROUPS * 5];
+	BYTE decoded[MAX_GROUPS * 4];
+
+	seed = 0x6c7;
+	for (unsigned block = 0; block < CHECK_BLOCKS; ++block)
+	{
+		int groups = 1 + Random() % MAX_GROUPS;
+		for (int byte = 0; byte < groups * 4; ++byte)
+			plain[byte] = (u8)Random();
+
+		EncodeReference(plain, expected, groups);
+		memset(gcr, 0, sizeof(gcr));
+		codec.encode(plain, gcr, groups);
+		if (memcmp(gcr, expected, groups * 5) != 0)
+		{
+			printf("%s encoded %d groups differently\r\n", codec.name, groups);
+			return false;
+		}
+
+		// Good GCR, then some (or, every so often, all) of it random.
+		unsigned bad = block % 3 == 0 ? 0 : block % 16 == 1 ? groups * 5 : 1 + Random() % 4;
+		for (unsigned change = 0; change < bad; ++change)
+		{
+			unsigned byte = bad == (unsigned)groups * 5 ? change : Random() % (groups * 5);
+			gcr[byte] = (u8)Random();
+		}
+		memcpy(expected, gcr, groups * 5);
+		BYTE reference[MAX_GROUPS * 4];
+		int referenceConverted = DecodeReference(expected, reference, groups);
+		int converted = codec.decode(gcr, decoded, groups);
+		if (converted != referenceConverted || memcmp(decoded, reference, groups * 4) != 0)
+		{
+			printf("%s decoded %d groups differently (%d bytes before a bad code rather than %d)\r\n", codec.name, groups, converted, referenceConverted);
+			return false;
+		}
+		if (memcmp(gcr, expected, groups * 5) != 0)
+		{
+			printf("%s changed the GCR it decoded\r\n", codec.name);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void Time(const Codec& codec)
+{
+	static BYTE plain[MAX_GROUPS * 4];
+	static BYTE gcr[MAX_GROUPS * 5];
+	u32 sum = 0;
+
+	for (unsigned byte = 0; byte < sizeof(plain); ++byte)
+		plain[byte] = (u8)Random();
+
+	u64 before = HostNanoSeconds();
+	for (unsigned sector = 0; sector < TIME_SECTORS; ++sector)
+	{
+		plain[0] = (u8)sector;
+		codec.encode(plain, gcr, MAX_GROUPS);
+		sum += gcr[sector % sizeof(gcr)];
+	}
+	u64 encodeNs = HostNanoSeconds() - before;
+
+	before = HostNanoSeconds();
+	for (unsigned sector = 0; sector < TIME_SECTORS; ++sector)
+	{
+		sum += codec.decode(gcr, plain, MAX_GROUPS);
+		sum += plain[sector % sizeof(plain)];
+	}
+	u64 decodeNs = HostNanoSeconds() - before;
+
+	double megabytes = (double)TIME_SECTORS * sizeof(plain) / 1000000.0;
+	printf("%-10s encode %8.1f MB/s %7.1f ns/sector  decode %8.1f MB/s %7.1f ns/sector (%u)\r\n", codec.name,
+		megabytes * 1000000000.0 / (double)encodeNs, (double)encodeNs / TIME_SECTORS,
+		megabytes * 1000000000.0 / (double)decodeNs, (double)decodeNs / TIME_SECTORS, sum & 0xff);
+}
+
+int BenchGCR()
+{
+	for (unsigned codec = 1; codec < CODECS; ++codec)
+	{
+		if (!Check(codecs[codec]))
+			return 1;
+	}
+	printf("The bulk GCR codec (%s) matches convert_4bytes_to_GCR and convert_4bytes_from_GCR\r\n",
+		CODECS > 2 ? "scalar and NEON" : "scalar");
+
+	for (unsigned codec = 0; codec < CODECS; ++codec)
+		Time(codecs[codec]);
+#if defined(GCR_NEON) && defined(HOST_BUILD) && !defined(__ARM_NEON) && !defined(__ARM_NEON__)
+	printf("(neon is host/arm_neon.h's plain C stand in for the NEON instructions here)\r\n");
+#endif
+	return 0;
+}
@@ -0,0 +1,415 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// The tracks extracted from a NIB (or an NBZ) are kept in a cache on the SD card (see GCRCache), here a directory in /tmp.
+// Generated NIBs are mounted without the cache and then through it; the first mount must write an entry and each one after must
+// read it back (only the file's header is read) with the same tracks and hash. An entry must not be used once the file's size,
+// date or header has changed or it has been written back, a damaged entry or one made by another converter version must be
+// extracted again, a hit must not write the index until it is flushed, and the least recently used entries must go to keep it
+// under its limit. Mounting with and without the cache is timed.
+
+#include "HostPlatform.h"
+#include "DiskImage.h"
+#include "GCRCache.h"
+#include "gcr.h"
+#include "lz.h"
+#include <stdio.h>
+#include <string.h>
+#include <glob.h>
+
+#define CACHE_PATH "/tmp/pi1541bench-gcrcache"
+#define IMAGE_PATH "/tmp/pi1541bench-gcrcache-image"
+#define CACHE_RUNS 5
+#define CACHE_IMAGES 3
+#define D64_SIZE (BLOCKSONDISK * 256)
+#define NIB_SIZE (0x100 + 35 * NIB_TRACK_LENGTH)
+
+static u32 seed;
+
+static inline u32 Random()
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static u8 image[READBUFFER_SIZE];
+static u8 nibs[CACHE_IMAGES][NIB_SIZE];
+static u8 compressed[READBUFFER_SIZE];
+static char paths[CACHE_IMAGES + 1][64];	// The NIBs and then the NBZ of the first
+static FILINFO fileInfo[2];
+static DiskImage images[2];
+static GCRCache cache;
+static bool fromCache;
+
+static bool SaveFile(const char* path, const u8* data, u32 size)
+{
+	FIL fp;
+	u32 bytesWritten;
+
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return false;
+	f_write(&fp, data, size, &bytesWritten);
+	f_close(&fp);
+	return bytesWritten == size;
+}
+
+// Empties the cache's directory (and makes it if it is not there).
+static void ClearCache()
+{
+	glob_t found;
+
+	f_mkdir(CACHE_PATH);
+	if (glob(CACHE_PATH "/*", 0, 0, &found) == 0)
+	{
+		for (size_t index = 0; index < found.gl_pathc; ++index)
+			f_unlink(found.gl_pathv[index]);
+		globfree(&found);
+	}
+}
+
+// A NIB of a D64 of random sectors as a nibbler would read it (a revolution and a bit of each track from anywhere on it).
+static void MakeNIB(u8* nib)
+{
+	DiskImage d64;
+
+	for (u32 byte = 0; byte < D64_SIZE; ++byte)
+		image[byte] = (u8)Random();
+	d64.OpenD64(0, image, D64_SIZE);
+
+	memset(nib, 0, NIB_SIZE);
+	memcpy(nib, "MNIB-1541-RAW", 13);
+	nib[13] = 3;
+	for (unsigned track = 0; track < 35; ++track)
+	{
+		unsigned halfTrack = track * 2;
+		unsigned length = d64.TrackLength(halfTrack);
+		unsigned start = Random() % length;
+		u8* data = nib + 0x100 + track * NIB_TRACK_LENGTH;
+
+		nib[0x10 + track * 2] = (u8)(halfTrack + 2);
+		nib[0x11 + track * 2] = (u8)(track < 17 ? 3 : track < 24 ? 2 : track < 30 ? 1 : 0);
+		d64.PrepareTrack(halfTrack);
+		for (unsigned byte = 0; byte < NIB_TRACK_LENGTH; ++byte)
+			data[byte] = d64.GetNextByte(halfTrack, (start + byte) % length);
+	}
+	d64.Close();
+}
+
+// Only the file's header is read when the tracks come from the cache, so fromCache says whether they did.
+static bool Mount(DiskImage& diskImage, FILINFO* info, const char* path, bool readOnly = true)
+{
+	FIL fp;
+
+	if (f_open(&fp, path, FA_READ) != FR_OK)
+		return false;
+	strncpy(info->fname, path, sizeof(info->fname) - 1);
+	info->fsize = f_size(&fp);
+	diskImage.SetReadOnly(readOnly);
+	bool loaded = diskImage.Load(info, &fp, DiskImage::GetDiskImageTypeViaExtention(path));
+	fromCache = fp.fptr == 0;
+	f_close(&fp);
+	return loaded;
+}
+
+// Mounts the image without the cache into images[0], to check the mounts through it against.
+static bool Reference(const char* path)
+{
+	DiskImage::SetGCRCache(0);
+	bool mounted = Mount(images[0], &fileInfo[0], path);
+	DiskImage::SetGCRCache(&cache);
+	return mounted;
+}
+
+static bool SameTracks(DiskImage& uncached, DiskImage& cached, const char* name)
+{
+	if (uncached.GetHash() != cached.GetHash())
+	{
+		printf("%s hashes to %08x without the cache and %08x with it\r\n", name, uncached.GetHash(), cached.GetHash());
+		return false;
+	}
+	for (unsigned track = 0; track < HALF_TRACK_COUNT; ++track)
+	{
+		unsigned length = uncached.TrackLength(track);
+		if (cached.TrackLength(track) != length)
+		{
+			printf("%s track %u is %u bytes without the cache and %u with it\r\n", name, track, length, cached.TrackLength(track));
+			return false;
+		}
+		for (unsigned byte = 0; byte < length; ++byte)
+		{
+			if (uncached.GetNextByte(track, byte) != cached.GetNextByte(track, byte))
+			{
+				printf("%s track %u differs at byte %u with the cache\r\n", name, track, byte);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Mounts the image through the cache and checks where its tracks came from and that they are the same as images[0]'s.
+static bool Check(const char* path, const char* name, bool expectCached, const char* what)
+{
+	images[1].Close();
+	if (!Mount(images[1], &fileInfo[1], path))
+	{
+		printf("Cannot mount %s %s\r\n", name, what);
+		return false;
+	}
+	if (fromCache != expectCached)
+	{
+		printf("%s %s was %s the cache\r\n", name, what, fromCache ? "read from" : "not read from");
+		return false;
+	}
+	return SameTracks(images[0], images[1], name);
+}
+
+// Mounts the image without the cache into images[0] (to check the others against), then through it, and times each.
+static bool TimeCache(const char* path, const char* name)
+{
+	u64 ns[2] = { ~0ULL, ~0ULL };
+
+	DiskImage::SetGCRCache(0);
+	for (unsigned run = 0; run < CACHE_RUNS; ++run)
+	{
+		images[0].Close();
+		u64 start = HostNanoSeconds();
+		bool mounted = Mount(images[0], &fileInfo[0], path);
+		u64 taken = HostNanoSeconds() - start;
+		if (!mounted)
+		{
+			printf("Cannot mount %s\r\n", path);
+			return false;
+		}
+		if (taken < ns[0])
+			ns[0] = taken;
+	}
+
+	DiskImage::SetGCRCache(&cache);
+	u32 entries = cache.Entries();
+	u32 used = cache.Used();
+	if (!Check(path, name, false, "the first time"))
+		return false;
+	if (cache.Entries() != entries + 1)
+	{
+		printf("%s was not added to the cache\r\n", name);
+		return false;
+	}
+	for (unsigned run = 0; run < CACHE_RUNS; ++run)
+	{
+		images[1].Close();
+		u64 start = HostNanoSeconds();
+		bool mounted = Mount(images[1], &fileInfo[1], path);
+		u64 taken = HostNanoSeconds() - start;
+		if (!mounted || !fromCache)
+		{
+			printf("%s was not read from the cache again\r\n", name);
+			return false;
+		}
+		if (!SameTracks(images[0], images[1], name))
+			return false;
+		if (taken < ns[1])
+			ns[1] = taken;
+	}
+	printf("%-12s %8.3f ms extracted  %8.3f ms from the cache (%.1fx, %u bytes of entry)\r\n", name,
+		(double)ns[0] / 1000000.0, (double)ns[1] / 1000000.0, (double)ns[0] / ns[1], cache.Used() - used);
+	return true;
+}
+
+// The file changing in any way the index looks at must make its entry stale (and the mount after that must use the new entry).
+static bool CheckStale()
+{
+	const char* path = paths[0];
+	u8* nib = nibs[0];
+
+	fileInfo[1].fdate = 1;
+	bool passed = Check(path, "NIB", false, "with a new date") && Check(path, "NIB", true, "again with the new date");
+	fileInfo[1].fdate = 0;
+	passed = passed && Check(path, "NIB", false, "with the old date");
+
+	// Each change needs its own extraction to check against.
+	nib[14] = 1;
+	passed = passed && SaveFile(path, nib, NIB_SIZE) && Reference(path);
+	nib[14] = 0;
+	passed = passed && Check(path, "NIB", false, "with its header changed");
+	passed = passed && SaveFile(path, nib, NIB_SIZE) && Reference(path);
+	passed = passed && Check(path, "NIB", false, "with its header changed back");
+
+	// The same header and date but a byte longer.
+	memcpy(image, nib, NIB_SIZE);
+	image[NIB_SIZE] = 0;
+	passed = passed && SaveFile(path, image, NIB_SIZE + 1) && Reference(path);
+	passed = passed && Check(path, "NIB", false, "a byte longer");
+	passed = passed && SaveFile(path, nib, NIB_SIZE) && Reference(path);
+	passed = passed && Check(path, "NIB", false, "its own length again");
+	if (passed)
+		printf("A NIB whose date, header or size has changed is extracted again\r\n");
+	return passed;
+}
+
+// Writing the image back (here with the same date, size and header, as a Pi1541 would) must remove its entry.
+static bool CheckWriteBack()
+{
+	const char* path = paths[0];
+	u32 entries = cache.Entries();
+
+	images[1].Close();
+	if (!Mount(images[1], &fileInfo[1], path, false) || !fromCache)
+	{
+		printf("Cannot mount the NIB from the cache to write to it\r\n");
+		return false;
+	}
+	for (unsigned byte = 0; byte < 8; ++byte)
+		images[1].SetBit(36, 100 + byte, 0, !images[1].GetNextBit(36, 100 + byte, 0));
+	images[1].Close();
+
+	if (cache.Entries() != entries - 1)
+	{
+		printf("The entry of a NIB written back was kept\r\n");
+		return false;
+	}
+	bool passed = Reference(path) && Check(path, "NIB", false, "written back") && Check(path, "NIB", true, "written back again");
+	if (passed)
+		printf("A NIB written back is extracted again\r\n");
+	return passed && SaveFile(path, nibs[0], NIB_SIZE) && Reference(path) && Check(path, "NIB", false, "put back");
+}
+
+// An entry that is cut short or was made by another version of the converter is not used (and is replaced).
+static bool CheckDamaged()
+{
+	const char* path = paths[0];
+	char entryPath[256];
+	u8* entry = compressed;
+	u32 bytesRead;
+	FIL fp;
+
+	snprintf(entryPath, sizeof(entryPath), "%s/%08X.V%02X", CACHE_PATH, images[0].GetHash(), GCR_CACHE_CONVERTER_VERSION);
+	if (f_open(&fp, entryPath, FA_READ) != FR_OK)
+	{
+		printf("Cannot find the NIB's entry\r\n");
+		return false;
+	}
+	f_read(&fp, entry, READBUFFER_SIZE, &bytesRead);
+	f_close(&fp);
+
+	bool passed = SaveFile(entryPath, entry, bytesRead / 2) && Check(path, "NIB", false, "with its entry cut short")
+		&& Check(path, "NIB", true, "with its entry replaced");
+	entry[4]++;
+	passed = passed && SaveFile(entryPath, entry, bytesRead) && Check(path, "NIB", false, "with an entry from another converter version")
+		&& Check(path, "NIB", true, "with that entry replaced");
+	if (passed)
+		printf("A damaged entry or one from another converter version is extracted again\r\n");
+	return passed;
+}
+
+// A hit must not write the index (only Flush does, if nothing else has since).
+static bool CheckIndexWrites()
+{
+	static u8 before[4096];
+	static u8 after[4096];
+	u32 sizes[2] = { 0, 0 };
+
+	bool passed = HostLoadFile(CACHE_PATH "/INDEX", before, sizeof(before), &sizes[0]) && Check(paths[0], "NIB", true, "before the index is looked at")
+		&& HostLoadFile(CACHE_PATH "/INDEX", after, sizeof(after), &sizes[1]);
+	if (passed && (sizes[0] != sizes[1] || memcmp(before, after, sizes[0]) != 0))
+	{
+		printf("Reading the NIB from the cache wrote the index\r\n");
+		return false;
+	}
+	cache.Flush();
+	passed = passed && HostLoadFile(CACHE_PATH "/INDEX", after, sizeof(after), &sizes[1]);
+	if (passed && sizes[0] == sizes[1] && memcmp(before, after, sizes[0]) == 0)
+	{
+		printf("Flush did not write when the NIB was last used\r\n");
+		return false;
+	}
+	if (passed)
+		printf("Reading from the cache only writes the index when it is flushed\r\n");
+	return passed;
+}
+
+// With room for two entries the least recently used must go for a third.
+static bool CheckEviction()
+{
+	ClearCache();
+	cache.Configure(CACHE_PATH, 0x7fffffff / 1024);
+	if (!Mount(images[0], &fileInfo[0], paths[0]) || fromCache)
+		return false;
+	u32 entrySize = cache.Used();
+	u32 limitKB = (entrySize * 5 / 2 + 1023) / 1024;
+
+	// A new GCRCache must find what the index says.
+	cache.Configure(CACHE_PATH, limitKB);
+	bool passed = cache.Entries() == 1;
+	for (unsigned index = 1; index < CACHE_IMAGES && passed; ++index)
+		passed = Mount(images[0], &fileInfo[0], paths[index]) && !fromCache;
+	passed = passed && cache.Entries() == 2 && cache.Used() <= limitKB * 1024;
+	if (!passed)
+	{
+		printf("The cache went over %u KB (%u entries of %u bytes)\r\n", limitKB, cache.Entries(), cache.Used());
+		return false;
+	}
+	// 0 went for 2; using 1 makes 2 the least recently used so it goes for 0 (after the index has been flushed and read again).
+	passed = Mount(images[0], &fileInfo[0], paths[1]) && fromCache;
+	cache.Configure(CACHE_PATH, limitKB);
+	passed = passed && Mount(images[0], &fileInfo[0], paths[0]) && !fromCache
+		&& Mount(images[0], &fileInfo[0], paths[1]) && fromCache && Mount(images[0], &fileInfo[0], paths[2]) && !fromCache;
+	if (passed)
+		printf("The least recently used entries go to keep the cache under %u KB (%u bytes in %u entries)\r\n", limitKB, cache.Used(), cache.Entries());
+	else
+		printf("The cache did not keep the most recently used entries\r\n");
+	return passed;
+}
+
+int BenchGCRCache()
+{
+	seed = 0x1541;
+	for (unsigned index = 0; index < CACHE_IMAGES; ++index)
+	{
+		MakeNIB(nibs[index]);
+		sprintf(paths[index], "%s-%u.nib", IMAGE_PATH, index);
+		if (!SaveFile(paths[index], nibs[index], NIB_SIZE))
+		{
+			printf("Cannot save %s\r\n", paths[index]);
+			return 1;
+		}
+	}
+	sprintf(paths[CACHE_IMAGES], "%s.nbz", IMAGE_PATH);
+	if (!SaveFile(paths[CACHE_IMAGES], compressed, LZ_Compress(nibs[0], compressed, NIB_SIZE)))
+		return 1;
+
+	ClearCache();
+	cache.Configure(CACHE_PATH, 32768);
+	memset(fileInfo, 0, sizeof(fileInfo));
+
+	bool passed = TimeCache(paths[CACHE_IMAGES], "NBZ") && TimeCache(paths[0], "NIB") && CheckStale() && CheckWriteBack() && CheckDamaged()
+		&& CheckIndexWrites();
+	images[0].Close();
+	images[1].Close();
+	passed = passed && CheckEviction();
+
+	DiskImage::SetGCRCache(0);
+	images[0].Close();
+	for (unsigned index = 0; index <= CACHE_IMAGES; ++index)
+		f_unlink(paths[index]);
+	ClearCache();
+	if (!passed)
+		return 1;
+	printf("Every NIB and NBZ read from the cache has the same tracks and hash as extracted\r\n");
+	return 0;
+}
@@ -0,0 +1,287 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// Images are hashed with ImageHash (xxHash32) as they are read and the quirks of the ones that need the emulation changed
+// are looked up by it in a QuirkTable read from quirks.txt. This checks ImageHash against xxHash32's published values and
+// that it comes out the same however an image is split up, that a G64 mounted with legacy hashing has the FNV-1a the
+// quirks used to be keyed by, and that the quirk table finds every entry (colliding or not) and nothing else.
+// It times ImageHash against HashBuffer and a lookup in the table. With -d64 it shows the hashes of that image.
+
+#include "HostPlatform.h"
+#include "DiskImage.h"
+#include "ImageHash.h"
+#include "gcr.h"
+#include "Quirks.h"
+#include <stdio.h>
+#include <string.h>
+
+#define HASH_PATH "/tmp/pi1541bench-hash"
+#define HASH_SIZE (1024 * 1024)
+#define HASH_RUNS 5
+#define D64_SIZE (BLOCKSONDISK * 256)
+
+static u32 seed;
+
+static inline u32 Random()
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static u8 data[HASH_SIZE];
+static char quirksText[64 * 1024];
+static volatile u32 found;	// So that the lookups being timed are not optimised away
+
+static bool CheckKnownValues()
+{
+	static const struct
+	{
+		const char* text;
+		u32 hash;
+	} known[] =
+	{
+		{ "", 0x02cc5d05 },
+		{ "a", 0x550d7456 },
+		{ "abc", 0x32d153ff },
+		{ "Nobody inspects the spammish repetition", 0xe2293b2f },
+	};
+
+	for (unsigned index = 0; index < sizeof(known) / sizeof(known[0]); ++index)
+	{
+		u32 hash = ImageHash::Of(known[index].text, strlen(known[index].text));
+		if (hash != known[index].hash)
+		{
+			printf("ImageHash of \"%s\" is %08x not %08x\r\n", known[index].text, hash, known[index].hash);
+			return false;
+		}
+	}
+	return true;
+}
+
+// Every length up to 64 and random splits of a long buffer (pieces of any size, from any alignment) against hashing it whole.
+static bool CheckSplits()
+{
+	for (u32 length = 0; length <= 64; ++length)
+	{
+		for (u32 split = 0; split <= length; ++split)
+		{
+			ImageHash hash;
+			hash.Add(data + 1, split);
+			hash.Add(data + 1 + split, length - split);
+			if (hash.Value() != ImageHash::Of(data + 1, length))
+			{
+				printf("ImageHash of %u bytes differs split at %u\r\n", length, split);
+				return false;
+			}
+		}
+	}
+	u32 whole = ImageHash::Of(data, HASH_SIZE);
+	for (unsigned run = 0; run < 100; ++run)
+	{
+		ImageHash hash(true);
+		u32 position = 0;
+		while (position < HASH_SIZE)
+		{
+			u32 piece = Random() % (run < 50 ? 40 : 20000);
+			if (piece > HASH_SIZE - position)
+				piece = HASH_SIZE - position;
+			hash.Add(data + position, piece);
+			position += piece;
+		}
+		if (hash.Value() != whole || hash.LegacyValue() != HashBuffer(data, HASH_SIZE))
+		{
+			printf("ImageHash of the buffer differs split up (run %u)\r\n", run);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool Mount(DiskImage& diskImage, FILINFO* info, const char* path)
+{
+	FIL fp;
+
+	if (f_open(&fp, path, FA_READ) != FR_OK)
+		return false;
+	strncpy(info->fname, path, sizeof(info->fname) - 1);
+	info->fsize = f_size(&fp);
+	diskImage.SetReadOnly(true);
+	bool loaded = diskImage.Load(info, &fp, DiskImage::GetDiskImageTypeViaExtention(path));
+	f_close(&fp);
+	return loaded;
+}
+
+// The hashes of a G64 mounted a track at a time must be those of the file (and only have the legacy one when it is asked for).
+static bool CheckG64(u64& ns, u64& legacyNs)
+{
+	DiskImage d64;
+	DiskImage g64;
+	FILINFO info;
+	u32 bytesRead;
+
+	for (u32 byte = 0; byte < D64_SIZE; ++byte)
+		data[byte] = (u8)Random();
+	if (!d64.OpenD64(0, data, D64_SIZE) || !d64.WriteG64((char*)HASH_PATH ".g64") || !HostLoadFile(HASH_PATH ".g64", data, HASH_SIZE, &bytesRead))
+	{
+		printf("Cannot make a G64\r\n");
+		return false;
+	}
+
+	memset(&info, 0, sizeof(info));
+	bool passed = true;
+	for (unsigned legacy = 0; legacy < 2 && passed; ++legacy)
+	{
+		u64* taken = legacy ? &legacyNs : &ns;
+		*taken = ~0ULL;
+		DiskImage::SetLegacyHashing(legacy != 0);
+		for (unsigned run = 0; run < HASH_RUNS && passed; ++run)
+		{
+			u64 start = HostNanoSeconds();
+			passed = Mount(g64, &info, HASH_PATH ".g64");
+			u64 time = HostNanoSeconds() - start;
+			if (time < *taken)
+				*taken = time;
+		}
+		if (!passed || g64.GetHash() != ImageHash::Of(data, bytesRead) || g64.GetLegacyHash() != (legacy ? HashBuffer(data, bytesRead) : 0))
+		{
+			printf("The G64 hashes to %08x (FNV-1a %08x) mounted with%s legacy hashing, not %08x (%08x)\r\n", g64.GetHash(), g64.GetLegacyHash(),
+				legacy ? "" : "out", ImageHash::Of(data, bytesRead), legacy ? HashBuffer(data, bytesRead) : 0);
+			passed = false;
+		}
+	}
+	DiskImage::SetLegacyHashing(false);
+	g64.Close();
+	f_unlink(HASH_PATH ".g64");
+	return passed;
+}
+
+// Entries with random hashes, in runs of 8 that all start in the same slot, some legacy, one given twice and some that are not right.
+static bool CheckQuirkTable(u64& ns)
+{
+	u32 hashes[QUIRK_TABLE_MAX_ENTRIES];
+	u32 expected[QUIRK_TABLE_MAX_ENTRIES];
+	bool legacy[QUIRK_TABLE_MAX_ENTRIES];
+	QuirkTable* table = new QuirkTable();
+	char* text = quirksText;
+	unsigned count = QUIRK_TABLE_MAX_ENTRIES - 1;
+
+	text += sprintf(text, "// Some quirks\r\n");
+	for (unsigned index = 0; index < count; ++index)
+	{
+		hashes[index] = index % 8 && index ? (hashes[index - 1] & (QUIRK_TABLE_SIZE - 1)) | (Random() << 8) : Random() ^ (Random() << 24);
+		if (hashes[index] == 0)
+			hashes[index] = 1;
+		legacy[index] = index % 5 == 0;
+		expected[index] = index % 3 == 0 ? QUIRK_REFRESH_BUS_EARLY | QUIRK_NO_IDLE_FAST_FORWARD : index % 3 == 1 ? QUIRK_REFRESH_BUS_EARLY : QUIRK_NO_IDLE_FAST_FORWARD;
+		text += sprintf(text, "%s%08x = %s\t// image %u\r\n", legacy[index] ? "FNV:" : "", hashes[index],
+			expected[index] == QUIRK_REFRESH_BUS_EARLY ? "RefreshBusEarly" : expected[index] == QUIRK_NO_IDLE_FAST_FORWARD ? "noidlefastforward" : "RefreshBusEarly,NoIdleFastForward", index);
+	}
+	// The same image again adds to its quirks, the last fills the table and the rest are ignored.
+	text += sprintf(text, "%08x = NoIdleFastForward\r\n", hashes[1]);
+	expected[1] |= QUIRK_NO_IDLE_FAST_FORWARD;
+	text += sprintf(text, "abcdef12 = Nonsense\r\n");
+	text += sprintf(text, "xyz = RefreshBusEarly\r\n0 = RefreshBusEarly\r\n");
+	text += sprintf(text, "12345678 = RefreshBusEarly\r\n87654321 = RefreshBusEarly\r\n");
+	table->Process(quirksText);
+
+	bool passed = table->Entries() == QUIRK_TABLE_MAX_ENTRIES && table->HasLegacyEntries() && table->Find(0x12345678) == QUIRK_REFRESH_BUS_EARLY
+		&& table->Find(0x87654321) == 0 && table->Find(0xabcdef12) == 0;
+	for (unsigned index = 0; index < count && passed; ++index)
+	{
+		passed = table->Find(hashes[index], legacy[index]) == expected[index] && table->Find(hashes[index], !legacy[index]) == 0
+			&& table->Find(hashes[index] ^ 0x100) == 0;
+		if (!passed)
+			printf("The quirks of %s%08x are %x not %x\r\n", legacy[index] ? "FNV:" : "", hashes[index], table->Find(hashes[index], legacy[index]), expected[index]);
+	}
+	if (!passed)
+	{
+		printf("The quirk table has %u entries (%u were added)\r\n", table->Entries(), count + 1);
+		delete table;
+		return false;
+	}
+
+	u64 start = HostNanoSeconds();
+	for (unsigned run = 0; run < 1000; ++run)
+	{
+		for (unsigned index = 0; index < count; ++index)
+			found += table->Find(hashes[index], legacy[index]);
+	}
+	ns = (HostNanoSeconds() - start) / (1000 * count);
+	delete table;
+	return true;
+}
+
+int BenchHash(const char* path)
+{
+	if (path)
+	{
+		DiskImage diskImage;
+		FILINFO info;
+
+		memset(&info, 0, sizeof(info));
+		DiskImage::SetLegacyHashing(true);
+		if (!Mount(diskImage, &info, path))
+		{
+			printf("Cannot mount %s\r\n", path);
+			return 1;
+		}
+		if (diskImage.GetHash() == 0)
+			printf("%s is not hashed (only G64s, NIBs and NBZs are)\r\n", path);
+		else if (diskImage.GetLegacyHash())
+			printf("%08x = \t// %s (was FNV:%08x)\r\n", diskImage.GetHash(), path, diskImage.GetLegacyHash());
+		else
+			printf("%08x = \t// %s\r\n", diskImage.GetHash(), path);
+		return 0;
+	}
+
+	seed = 0x1541;
+	for (u32 byte = 0; byte < HASH_SIZE; ++byte)
+		data[byte] = (u8)Random();
+	if (!CheckKnownValues() || !CheckSplits())
+		return 1;
+	printf("ImageHash gives xxHash32's values and the same value however the image is split up\r\n");
+
+	u64 ns[2] = { ~0ULL, ~0ULL };
+	u32 hashes[2] = { 0, 0 };
+	for (unsigned run = 0; run < HASH_RUNS; ++run)
+	{
+		u64 start = HostNanoSeconds();
+		hashes[0] += HashBuffer(data, HASH_SIZE);
+		u64 middle = HostNanoSeconds();
+		hashes[1] += ImageHash::Of(data, HASH_SIZE);
+		u64 end = HostNanoSeconds();
+		if (middle - start < ns[0])
+			ns[0] = middle - start;
+		if (end - middle < ns[1])
+			ns[1] = end - middle;
+	}
+	printf("HashBuffer (FNV-1a) %8.1f MB/s  ImageHash (xxHash32) %8.1f MB/s (%.1fx)\r\n", HASH_SIZE * 1000.0 / ns[0], HASH_SIZE * 1000.0 / ns[1],
+		(double)ns[0] / ns[1]);
+
+	u64 mountNs;
+	u64 legacyMountNs;
+	if (!CheckG64(mountNs, legacyMountNs))
+		return 1;
+	printf("G64 mounted %8.3f ms, with the FNV-1a as well %8.3f ms\r\n", (double)mountNs / 1000000.0, (double)legacyMountNs / 1000000.0);
+
+	u64 lookupNs;
+	if (!CheckQuirkTable(lookupNs))
+		return 1;
+	printf("The quirk table finds each of its %u entries (%llu ns a lookup) and nothing else\r\n", QUIRK_TABLE_MAX_ENTRIES, (unsigned long long)lookupNs);
+	return 0;
+}
@@ -0,0 +1,168 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// Runs the switch threaded M6502 and the old member function pointer engine (M6502Ref) side by side.
+// Each engine gets its own flat 64K of RAM filled with the same pseudo random bytes so every opcode, decimal mode and
+// the IRQ masking quirks of CLI and taken branches get executed. IRQ is asserted and released pseudo randomly.
+// Every bus access (address, data and direction) is hashed and the hashes, registers and RAM must match after each block.
+
+#include "HostPlatform.h"
+#include "M6502Ref.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BLOCK_CYCLES 20000	// Random code soon hits a JAM so start again from fresh memory this often.
+
+struct BusTrace
+{
+	u8 memory[0x10000];
+	u32 hash;
+};
+
+static BusTrace traces[2];
+
+static inline void Trace(BusTrace& trace, u32 access)
+{
+	trace.hash = (trace.hash ^ access) * 16777619;
+}
+
+template <int engine> static u8 ReadRAM(u16 address)
+{
+	BusTrace& trace = traces[engine];
+	u8 value = trace.memory[address];
+	Trace(trace, (address << 8) | value);
+	return value;
+}
+
+template <int engine> static void WriteRAM(u16 address, const u8 value)
+{
+	BusTrace& trace = traces[engine];
+	trace.memory[address] = value;
+	Trace(trace, 0x80000000 | (address << 8) | value);
+}
+
+template <int engine> static u8 ReadRAMUntraced(u16 address)
+{
+	return traces[engine].memory[address];
+}
+
+template <int engine> static void WriteRAMUntraced(u16 address, const u8 value)
+{
+	traces[engine].memory[address] = value;
+}
+
+static u32 seed;
+
+static inline u32 Random()
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static void FillMemory(u32 block)
+{
+	seed = 0x1541 + block * 7919;
+	for (u32 address = 0; address < 0x10000; ++address)
+		traces[0].memory[address] = (u8)Random();
+	memcpy(traces[1].memory, traces[0].memory, sizeof(traces[1].memory));
+}
+
+static void DumpRegs(const char* name, u16 pc, u8 sp, u8 a, u8 x, u8 y, u8 status)
+{
+	printf("  %-8s PC=%04x SP=%02x A=%02x X=%02x Y=%02x P=%02x\r\n", name, pc, sp, a, x, y, status);
+}
+
+static bool CrossCheck(u32 cycles)
+{
+	M6502 cpu;
+	M6502Ref ref;
+	u32 blocks = (cycles + BLOCK_CYCLES - 1) / BLOCK_CYCLES;
+
+	for (u32 block = 0; block < blocks; ++block)
+	{
+		FillMemory(block);
+		traces[0].hash = traces[1].hash = 2166136261u;
+		cpu.SetBusFunctions(ReadRAM<0>, WriteRAM<0>);
+		ref.SetBusFunctions(ReadRAM<1>, WriteRAM<1>);
+
+		u32 irqSeed = seed;
+		for (u32 cycle = 0; cycle < BLOCK_CYCLES; ++cycle)
+		{
+			// Hold each IRQ level for a few cycles so that it can land on every cycle of CLI and the branches.
+			if ((Random() & 7) == 0)
+			{
+				if (Random() & 1)
+				{
+					cpu.IRQ.Assert();
+					ref.IRQ.Assert();
+				}
+				else
+				{
+					cpu.IRQ.Release();
+					ref.IRQ.Release();
+				}
+			}
+			cpu.Step();
+			ref.Step();
+		}
+
+		u16 pc[2];
+		u8 sp[2], a[2], x[2], y[2], status[2];
+		cpu.GetRegs(pc[0], sp[0], a[0], x[0], y[0], status[0]);
+		ref.GetRegs(pc[1], sp[1], a[1], x[1], y[1], status[1]);
+		if (traces[0].hash != traces[1].hash || pc[0] != pc[1] || sp[0] != sp[1] || a[0] != a[1] || x[0] != x[1] || y[0] != y[1] || status[0] != status[1]
+			|| memcmp(traces[0].memory, traces[1].memory, sizeof(traces[0].memory)) != 0)
+		{
+			printf("M6502 differs from M6502Ref in block %u (seed %08x) bus hash %08x %08x\r\n", block, irqSeed, traces[0].hash, traces[1].hash);
+			DumpRegs("M6502", pc[0], sp[0], a[0], x[0], y[0], status[0]);
+			DumpRegs("M6502Ref", pc[1], sp[1], a[1], x[1], y[1], status[1]);
+			return false;
+		}
+	}
+	printf("M6502 matches M6502Ref over %u blocks of %u cycles\r\n", blocks, BLOCK_CYCLES);
+	return true;
+}
+
+template <class CPU> static u64 Time(CPU& cpu, u32 cycles)
+{
+	FillMemory(0);
+	cpu.SetBusFunctions(ReadRAMUntraced<0>, WriteRAMUntraced<0>);
+
+	u64 before = HostNanoSeconds();
+	for (u32 cycle = 0; cycle < cycles; ++cycle)
+	{
+		if (cycle % BLOCK_CYCLES == 0)
+			cpu.Reset();
+		cpu.Step();
+	}
+	return HostNanoSeconds() - before;
+}
+
+// Cross checks then times both engines on random memory. Returns non zero if the engines disagree.
+int BenchM6502(u32 cycles, void (*report)(const char* name, u32 cycles, u64 ns))
+{
+	M6502 cpu;
+	M6502Ref ref;
+
+	if (!CrossCheck(cycles))
+		return 1;
+
+	report("m6502", cycles, Time(cpu, cycles));
+	report("m6502 ref", cycles, Time(ref, cycles));
+	return 0;
+}
@@ -0,0 +1,341 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// Runs the m6522 (counters brought up to date on access and on timer events) and m6522Ref (Execute every cycle) side by side.
+// BenchM6522 drives both with pseudo random register accesses and input changes weighted towards the timers and interrupt registers.
+// ShadowVIAs does the same with the accesses the 1541 ROM makes while Bench1541's emulate phase runs.
+// In both every read, the IRQ line and the port outputs must match on every cycle and the saved states must match at the end.
+
+#include "HostPlatform.h"
+#include "m6522Ref.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BLOCK_CYCLES 50000
+
+// The register numbers (private to m6522)
+enum { ORB, ORA, DDRB, DDRA, T1CL, T1CH, T1LL, T1LH, T2CL, T2CH, SR, ACR, PCR, IFR, IER, ORA_NH };
+
+static u32 seed;
+
+static inline u32 Random()
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static bool SameState(m6522& via, const m6522Ref& ref)
+{
+	static u8 states[2][256];
+
+	via.Synchronise();
+	SaveStateWriter viaWriter(states[0], sizeof(states[0]));
+	SaveStateWriter refWriter(states[1], sizeof(states[1]));
+	via.SaveState(viaWriter);
+	ref.SaveState(refWriter);
+	return viaWriter.Size() == refWriter.Size() && memcmp(states[0], states[1], viaWriter.Size()) == 0;
+}
+
+static u8 RandomValue(u8 reg)
+{
+	switch (reg)
+	{
+		case T1CH:
+		case T1LH:
+		case T2CH:
+			return Random() & 3;		// Short counts so that the timers time out often
+		case T1CL:
+		case T1LL:
+		case T2CL:
+			return Random() & 0x1f;
+		default:
+			return (u8)Random();
+	}
+}
+
+static u8 RandomRegister()
+{
+	static const u8 registers[] = {
+		ORB, ORA, DDRB, DDRA, ORA_NH,
+		T1CL, T1CH, T1LL, T1LH, T2CL, T2CH,
+		T1CL, T1CH, T2CL, T2CH,
+		ACR, PCR, IFR, IER, IFR, IER, SR
+	};
+	return registers[Random() % sizeof(registers)];
+}
+
+static bool RandomCheck(u32 cycles)
+{
+	static m6522 via;
+	static m6522Ref ref;
+	static Interrupt irqs[2];
+	static Scheduler scheduler;
+	u32 blocks = (cycles + BLOCK_CYCLES - 1) / BLOCK_CYCLES;
+
+	via.ConnectIRQ(&irqs[0]);
+	via.ConnectScheduler(&scheduler, 0);
+	ref.ConnectIRQ(&irqs[1]);
+
+	for (u32 block = 0; block < blocks; ++block)
+	{
+		seed = 0x6522 + block * 7919;
+		u32 blockSeed = seed;
+		irqs[0].Release();
+		irqs[1].Release();
+		via.Reset();
+		ref.Reset();
+		// Every other block lets the shift register and PB6 counting in too.
+		u8 acrMask = (block & 1) ? 0xff : 0xe3;
+
+		for (u32 cycle = 0; cycle < BLOCK_CYCLES; ++cycle)
+		{
+			u32 inputs = Random();
+			if ((inputs & 0xf) == 0)
+			{
+				bool value = (inputs & 0x10) != 0;
+				switch ((inputs >> 5) & 7)
+				{
+					case 0: via.InputCA1(value); ref.InputCA1(value); break;
+					case 1: via.InputCA2(value); ref.InputCA2(value); break;
+					case 2: via.InputCB1(value); ref.InputCB1(value); break;
+					case 3: via.InputCB2(value); ref.InputCB2(value); break;
+					case 4: via.GetPortA()->SetInput((u8)(inputs >> 8)); ref.GetPortA()->SetInput((u8)(inputs >> 8)); break;
+					default: via.GetPortB()->SetInput((u8)(inputs >> 8)); ref.GetPortB()->SetInput((u8)(inputs >> 8)); break;
+				}
+			}
+
+			if ((Random() & 7) == 0)
+			{
+				u8 reg = RandomRegister();
+				if (Random() & 1)
+				{
+					u8 value = RandomValue(reg);
+					if (reg == ACR)
+						value &= acrMask;
+					via.Write(reg, value);
+					ref.Write(reg, value);
+				}
+				else
+				{
+					u8 value = via.Read(reg);
+					u8 expected = ref.Read(reg);
+					if (value != expected)
+					{
+						printf("m6522 read %02x from register %d, m6522Ref %02x, in block %u (seed %08x) cycle %u\r\n", value, reg, expected, block, blockSeed, cycle);
+						return false;
+					}
+				}
+			}
+
+			ref.Execute();
+			scheduler.Tick();
+
+			if (irqs[0].IsAsserted() != irqs[1].IsAsserted() || via.GetPortB()->GetOutput() != ref.GetPortB()->GetOutput()
+				|| via.GetCA2() != ref.GetCA2() || via.GetCB2() != ref.GetCB2())
+			{
+				printf("m6522 IRQ, PB or CA2/CB2 differ from m6522Ref in block %u (seed %08x) cycle %u\r\n", block, blockSeed, cycle);
+				return false;
+			}
+		}
+
+		if (!SameState(via, ref))
+		{
+			printf("m6522 state differs from m6522Ref at the end of block %u (seed %08x)\r\n", block, blockSeed);
+			return false;
+		}
+	}
+	printf("m6522 matches m6522Ref over %u blocks of %u cycles\r\n", blocks, BLOCK_CYCLES);
+	return true;
+}
+
+// The 1541's VIA1 with its T1 free running for the 10ms job loop IRQ and nothing else happening.
+template <class VIA> static void SetupJobTimer(VIA& via)
+{
+	via.Reset();
+	via.Write(ACR, 0x40);
+	via.Write(T1LL, 0x20);
+	via.Write(T1CH, 0x4e);
+	via.Write(IER, 0x80 | 0x40);	// T1
+}
+
+// Cross checks then times both VIAs. Returns non zero if they disagree.
+int BenchM6522(u32 cycles, void (*report)(const char* name, u32 cycles, u64 ns))
+{
+	static m6522 via;
+	static m6522Ref ref;
+	static Interrupt irq;
+	static Scheduler scheduler;
+
+	if (!RandomCheck(cycles))
+		return 1;
+
+	via.ConnectIRQ(&irq);
+	via.ConnectScheduler(&scheduler, 0);
+	ref.ConnectIRQ(&irq);
+
+	SetupJobTimer(via);
+	u64 before = HostNanoSeconds();
+	for (u32 cycle = 0; cycle < cycles; ++cycle)
+	{
+		scheduler.Tick();
+		if (irq.IsAsserted())
+			via.Read(T1CL);
+	}
+	report("m6522", cycles, HostNanoSeconds() - before);
+
+	SetupJobTimer(ref);
+	before = HostNanoSeconds();
+	for (u32 cycle = 0; cycle < cycles; ++cycle)
+	{
+		ref.Execute();
+		if (irq.IsAsserted())
+			ref.Read(T1CL);
+	}
+	report("m6522 ref", cycles, HostNanoSeconds() - before);
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////
+// Shadowing the VIAs of the running drive
+///////////////////////////////////////////////////////////////////////////////////////
+extern u8 read6502(u16 address);
+extern void write6502(u16 address, const u8 value);
+
+static m6522Ref shadow[2];
+static Interrupt shadowIRQ;
+static u32 shadowCycle;
+static u32 shadowMismatches;
+
+// The 74LS42 decode (see Pi1541::BuildMemoryMap)
+static inline int SelectedVIA(u16 address)
+{
+	if (address & 0x8000)
+		return -1;
+	u16 lines = (address & 0x1c00) >> 10;
+	return lines == 6 ? 0 : lines == 7 ? 1 : -1;
+}
+
+// The drive and IEC_Bus set the inputs of the real VIAs directly. Pass them on.
+static void CopyInputs(int index)
+{
+	m6522& via = pi1541.VIA[index];
+	m6522Ref& ref = shadow[index];
+	ref.GetPortA()->SetInput(via.GetPortA()->GetInput());
+	ref.GetPortB()->SetInput(via.GetPortB()->GetInput());
+	if (ref.GetCA1() != via.GetCA1())
+		ref.InputCA1(via.GetCA1());
+}
+
+static void ShadowMismatch(const char* what, int index, u16 address, u8 value, u8 expected)
+{
+	if (shadowMismatches++ < 10)
+		printf("VIA%d %s %04x %02x, m6522Ref %02x, at cycle %u\r\n", index, what, address, value, expected, shadowCycle);
+}
+
+static u8 ShadowRead(u16 address)
+{
+	int index = SelectedVIA(address);
+	if (index < 0)
+		return read6502(address);
+
+	CopyInputs(index);
+	u8 value = read6502(address);
+	u8 expected = shadow[index].Read(address);
+	if (value != expected)
+		ShadowMismatch("read", index, address, value, expected);
+	return value;
+}
+
+static void ShadowWrite(u16 address, const u8 value)
+{
+	int index = SelectedVIA(address);
+	if (index >= 0)
+	{
+		CopyInputs(index);
+		shadow[index].Write(address, value);
+	}
+	write6502(address, value);
+}
+
+// SetBusFunctions resets the CPU so carry its state across.
+static void SwitchBus(DataBusReadFn read, DataBusWriteFn write)
+{
+	static u8 state[256];
+
+	SaveStateWriter writer(state, sizeof(state));
+	pi1541.m6502.SaveState(writer);
+	pi1541.m6502.SetBusFunctions(read, write);
+	SaveStateReader reader(state, writer.Size());
+	pi1541.m6502.LoadState(reader);
+}
+
+// Starts both shadows from the state the drive's VIAs are in now and routes the CPU's bus through them.
+void ShadowVIAs()
+{
+	static u8 state[256];
+
+	for (int index = 0; index < 2; ++index)
+	{
+		pi1541.VIA[index].Synchronise();
+		SaveStateWriter writer(state, sizeof(state));
+		pi1541.VIA[index].SaveState(writer);
+		SaveStateReader reader(state, writer.Size());
+		shadow[index].LoadState(reader);
+		shadow[index].ConnectIRQ(&shadowIRQ);
+	}
+	if (pi1541.m6502.IRQ.IsAsserted())
+		shadowIRQ.Assert();
+	else
+		shadowIRQ.Release();
+	shadowCycle = 0;
+	shadowMismatches = 0;
+	SwitchBus(ShadowRead, ShadowWrite);
+}
+
+// Call after each Pi1541::Update.
+void ShadowVIAsUpdate()
+{
+	CopyInputs(1);
+	shadow[1].Execute();
+	CopyInputs(0);
+	shadow[0].Execute();
+
+	if (shadowIRQ.IsAsserted() != pi1541.m6502.IRQ.IsAsserted())
+		ShadowMismatch("IRQ", 0, 0, pi1541.m6502.IRQ.IsAsserted(), shadowIRQ.IsAsserted());
+	for (int index = 0; index < 2; ++index)
+	{
+		u8 output = pi1541.VIA[index].GetPortB()->GetOutput();
+		u8 expected = shadow[index].GetPortB()->GetOutput();
+		if (output != expected)
+			ShadowMismatch("PB", index, 0, output, expected);
+	}
+	shadowCycle++;
+}
+
+// Puts the CPU's bus back and says whether the shadows agreed with the drive's VIAs throughout.
+bool ShadowVIAsEnd()
+{
+	SwitchBus(read6502, write6502);
+	for (int index = 0; index < 2; ++index)
+	{
+		if (!SameState(pi1541.VIA[index], shadow[index]))
+			ShadowMismatch("state", index, 0, 0, 0);
+	}
+	printf("VIAs %s m6522Ref over %u cycles of the 1541 ROM\r\n", shadowMismatches ? "DIFFER from" : "match", shadowCycle);
+	return shadowMismatches == 0;
+}
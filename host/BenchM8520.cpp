@@ -0,0 +1,195 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// Runs the m8520 (timers brought up to date on access and on underflows) and m8520Ref (Execute every cycle) side by side.
+// Both are driven with pseudo random register accesses weighted towards the timers, control and interrupt registers
+// and random FLAG, CNT, SP and TOD pin changes. Every read, the IRQ line and the SP and CNT pins must match on every cycle
+// and every register must peek the same at the end of each block.
+
+#include "HostPlatform.h"
+#include "m8520Ref.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BLOCK_CYCLES 50000
+
+// The register numbers (private to m8520)
+enum { ORA, ORB, DDRA, DDRB, TALO, TAHI, TBLO, TBHI, EVENT_LSB, EVENT_8_15, EVENT_MSB, NC, SDR, ICR, CRA, CRB };
+
+static u32 seed;
+
+static inline u32 Random()
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static u8 RandomValue(u8 reg)
+{
+	switch (reg)
+	{
+		case TAHI:
+		case TBHI:
+			return Random() & 1;		// Short counts so that the timers underflow often
+		case TALO:
+		case TBLO:
+			return Random() & 0x3f;
+		default:
+			return (u8)Random();
+	}
+}
+
+static u8 RandomRegister()
+{
+	static const u8 registers[] = {
+		ORA, ORB, DDRA, DDRB, TALO, TAHI, TBLO, TBHI, TALO, TAHI, TBLO, TBHI,
+		EVENT_LSB, EVENT_8_15, EVENT_MSB, SDR, ICR, CRA, CRB, ICR, CRA, CRB
+	};
+	return registers[Random() % sizeof(registers)];
+}
+
+static bool RandomCheck(u32 cycles)
+{
+	static m8520 cia;
+	static m8520Ref ref;
+	static Interrupt irqs[2];
+	static Scheduler scheduler;
+	u32 blocks = (cycles + BLOCK_CYCLES - 1) / BLOCK_CYCLES;
+
+	cia.ConnectIRQ(&irqs[0]);
+	cia.ConnectScheduler(&scheduler, 0);
+	ref.ConnectIRQ(&irqs[1]);
+
+	for (u32 block = 0; block < blocks; ++block)
+	{
+		seed = 0x8520 + block * 7919;
+		u32 blockSeed = seed;
+		irqs[0].Release();
+		irqs[1].Release();
+		cia.Reset();
+		ref.Reset();
+
+		for (u32 cycle = 0; cycle < BLOCK_CYCLES; ++cycle)
+		{
+			u32 inputs = Random();
+			if ((inputs & 0xf) == 0)
+			{
+				bool value = (inputs & 0x10) != 0;
+				switch ((inputs >> 5) & 7)
+				{
+					case 0: cia.SetPinFLAG(value); ref.SetPinFLAG(value); break;
+					case 1: cia.SetPinCNT(value); ref.SetPinCNT(value); break;
+					case 2: cia.SetPinSP(value); ref.SetPinSP(value); break;
+					case 3: cia.SetPinTOD(value); ref.SetPinTOD(value); break;
+					case 4: cia.GetPortA()->SetInput((u8)(inputs >> 8)); ref.GetPortA()->SetInput((u8)(inputs >> 8)); break;
+					default: cia.GetPortB()->SetInput((u8)(inputs >> 8)); ref.GetPortB()->SetInput((u8)(inputs >> 8)); break;
+				}
+			}
+
+			if ((Random() & 7) == 0)
+			{
+				u8 reg = RandomRegister();
+				if (Random() & 1)
+				{
+					u8 value = RandomValue(reg);
+					cia.Write(reg, value);
+					ref.Write(reg, value);
+				}
+				else
+				{
+					u8 value = cia.Read(reg);
+					u8 expected = ref.Read(reg);
+					if (value != expected)
+					{
+						printf("m8520 read %02x from register %d, m8520Ref %02x, in block %u (seed %08x) cycle %u\r\n", value, reg, expected, block, blockSeed, cycle);
+						return false;
+					}
+				}
+			}
+
+			ref.Execute();
+			scheduler.Tick();
+
+			if (irqs[0].IsAsserted() != irqs[1].IsAsserted() || cia.GetPinSP() != ref.GetPinSP() || cia.GetPinCNT() != ref.GetPinCNT())
+			{
+				printf("m8520 IRQ, SP or CNT differ from m8520Ref in block %u (seed %08x) cycle %u\r\n", block, blockSeed, cycle);
+				return false;
+			}
+		}
+
+		for (u8 reg = 0; reg < 16; ++reg)
+		{
+			u8 value = cia.Peek(reg);
+			u8 expected = ref.Peek(reg);
+			if (value != expected)
+			{
+				printf("m8520 register %d is %02x, m8520Ref %02x, at the end of block %u (seed %08x)\r\n", reg, value, expected, block, blockSeed);
+				return false;
+			}
+		}
+	}
+	printf("m8520 matches m8520Ref over %u blocks of %u cycles\r\n", blocks, BLOCK_CYCLES);
+	return true;
+}
+
+// Timer A free running as the 1581 ROM's job loop IRQ with nothing else happening.
+template <class CIA> static void SetupJobTimer(CIA& cia)
+{
+	cia.Reset();
+	cia.Write(TALO, 0x20);
+	cia.Write(TAHI, 0x4e);
+	cia.Write(ICR, 0x80 | 0x01);	// TA
+	cia.Write(CRA, 0x11);
+}
+
+// Cross checks then times both CIAs. Returns non zero if they disagree.
+int BenchM8520(u32 cycles, void (*report)(const char* name, u32 cycles, u64 ns))
+{
+	static m8520 cia;
+	static m8520Ref ref;
+	static Interrupt irq;
+	static Scheduler scheduler;
+
+	if (!RandomCheck(cycles))
+		return 1;
+
+	cia.ConnectIRQ(&irq);
+	cia.ConnectScheduler(&scheduler, 0);
+	ref.ConnectIRQ(&irq);
+
+	SetupJobTimer(cia);
+	u64 before = HostNanoSeconds();
+	for (u32 cycle = 0; cycle < cycles; ++cycle)
+	{
+		scheduler.Tick();
+		if (irq.IsAsserted())
+			cia.Read(ICR);
+	}
+	report("m8520", cycles, HostNanoSeconds() - before);
+
+	SetupJobTimer(ref);
+	before = HostNanoSeconds();
+	for (u32 cycle = 0; cycle < cycles; ++cycle)
+	{
+		ref.Execute();
+		if (irq.IsAsserted())
+			ref.Read(ICR);
+	}
+	report("m8520 ref", cycles, HostNanoSeconds() - before);
+	return 0;
+}
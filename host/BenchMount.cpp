@@ -0,0 +1,288 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// DiskCaddy::Insert used to read the whole file into a 1MB buffer and then open it; now DiskImage::Load reads it a piece at a time,
+// converting each piece as it arrives. A D64, a D81, a G64 and a NIB (and NBZ) made from the D64 are generated (plus the image given
+// with -d64) and each is mounted both ways; the tracks (and the G64's hash) must come out the same. The time to mount each is reported.
+// The files come out of the host's file cache so this is the conversion and the copying, not the SD card.
+
+#include "HostPlatform.h"
+#include "DiskImage.h"
+#include "gcr.h"
+#include "lz.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MOUNT_PATH "/tmp/pi1541bench-mount"
+#define D64_SIZE (BLOCKSONDISK * 256)
+#define D81_SIZE (80 * 40 * 256)
+#define NIB_TRACKS 35
+#define MOUNT_RUNS 20
+
+static u32 seed;
+
+static inline u32 Random()
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static u8 image[READBUFFER_SIZE];
+static u8 readBuffer[READBUFFER_SIZE];	// What DiskCaddy::Insert read the file into
+static FILINFO fileInfo[2];
+static DiskImage images[2];
+
+static bool SaveFile(const char* path, const u8* data, u32 size)
+{
+	FIL fp;
+	u32 bytesWritten;
+
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return false;
+	f_write(&fp, data, size, &bytesWritten);
+	f_close(&fp);
+	return bytesWritten == size;
+}
+
+// What the speed zone of each track is (as a 1541 writes it).
+static unsigned Density(unsigned track)
+{
+	return track < 17 ? 3 : track < 24 ? 2 : track < 30 ? 1 : 0;
+}
+
+// A NIB of the D64's tracks as a nibbler would read them; a revolution and a bit of each one.
+static u32 MakeNIB(DiskImage& d64, u8* nib)
+{
+	memset(nib, 0, 0x100 + NIB_TRACKS * NIB_TRACK_LENGTH);
+	memcpy(nib, "MNIB-1541-RAW", 13);
+	nib[13] = 3;
+	for (unsigned track = 0; track < NIB_TRACKS; ++track)
+	{
+		unsigned halfTrack = track * 2;
+		u8* data = nib + 0x100 + track * NIB_TRACK_LENGTH;
+		unsigned length = d64.TrackLength(halfTrack);
+		unsigned start = Random() % length;
+
+		nib[0x10 + track * 2] = (u8)(halfTrack + 2);
+		nib[0x11 + track * 2] = (u8)Density(track);
+		d64.PrepareTrack(halfTrack);
+		for (unsigned byte = 0; byte < NIB_TRACK_LENGTH; ++byte)
+			data[byte] = d64.GetNextByte(halfTrack, (start + byte) % length);
+	}
+	return 0x100 + NIB_TRACKS * NIB_TRACK_LENGTH;
+}
+
+// How DiskCaddy::Insert mounted an image before.
+static bool MountWhole(DiskImage& diskImage, const FILINFO* info, DiskImage::DiskType type)
+{
+	FIL fp;
+	u32 bytesRead;
+
+	if (f_open(&fp, info->fname, FA_READ) != FR_OK)
+		return false;
+	f_read(&fp, readBuffer, READBUFFER_SIZE, &bytesRead);
+	f_close(&fp);
+	switch (type)
+	{
+		case DiskImage::D64:
+			return diskImage.OpenD64(info, readBuffer, bytesRead);
+		case DiskImage::G64:
+			return diskImage.OpenG64(info, readBuffer, bytesRead);
+		case DiskImage::NIB:
+			return diskImage.OpenNIB(info, readBuffer, bytesRead);
+		case DiskImage::NBZ:
+			return diskImage.OpenNBZ(info, readBuffer, bytesRead);
+		case DiskImage::D81:
+			return diskImage.OpenD81(info, readBuffer, bytesRead);
+		default:
+			return false;
+	}
+}
+
+static bool MountStreamed(DiskImage& diskImage, const FILINFO* info, DiskImage::DiskType type)
+{
+	FIL fp;
+
+	if (f_open(&fp, info->fname, FA_READ) != FR_OK)
+		return false;
+	bool loaded = diskImage.Load(info, &fp, type);
+	f_close(&fp);
+	return loaded;
+}
+
+static bool SameTracks(DiskImage& whole, DiskImage& streamed, const char* name)
+{
+	if (whole.GetHash() != streamed.GetHash())
+	{
+		printf("%s hashed to %08x read whole and %08x read a piece at a time\r\n", name, whole.GetHash(), streamed.GetHash());
+		return false;
+	}
+	for (unsigned track = 0; track < HALF_TRACK_COUNT; ++track)
+	{
+		unsigned length = whole.TrackLength(track);
+		if (streamed.TrackLength(track) != length)
+		{
+			printf("%s track %u is %u bytes read whole and %u read a piece at a time\r\n", name, track, length, streamed.TrackLength(track));
+			return false;
+		}
+		if (whole.IsD81())
+		{
+			if (track >= D81_TRACK_COUNT)
+				continue;
+			for (unsigned headIndex = 0; headIndex < 2; ++headIndex)
+			{
+				for (unsigned byte = 0; byte < length; ++byte)
+				{
+					if (whole.GetD81Byte(track, headIndex, byte) != streamed.GetD81Byte(track, headIndex, byte) ||
+						whole.IsD81ByteASync(track, headIndex, byte) != streamed.IsD81ByteASync(track, headIndex, byte))
+					{
+						printf("%s track %u side %u differs at byte %u\r\n", name, track, headIndex, byte);
+						return false;
+					}
+				}
+			}
+			continue;
+		}
+		whole.PrepareTrack(track);
+		streamed.PrepareTrack(track);
+		for (unsigned byte = 0; byte < length; ++byte)
+		{
+			if (whole.GetNextByte(track, byte) != streamed.GetNextByte(track, byte))
+			{
+				printf("%s track %u differs at byte %u\r\n", name, track, byte);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool TimeMount(const char* path, const char* name)
+{
+	DiskImage::DiskType type = DiskImage::GetDiskImageTypeViaExtention(path);
+	u64 wholeNs = ~0ULL;
+	u64 streamedNs = ~0ULL;
+
+	FIL fp;
+
+	if (f_open(&fp, path, FA_READ) != FR_OK)
+	{
+		printf("Cannot open %s\r\n", path);
+		return false;
+	}
+	for (unsigned index = 0; index < 2; ++index)
+	{
+		strncpy(fileInfo[index].fname, path, sizeof(fileInfo[index].fname) - 1);
+		fileInfo[index].fsize = f_size(&fp);
+		images[index].SetReadOnly(true);
+	}
+	f_close(&fp);
+	for (unsigned run = 0; run < MOUNT_RUNS; ++run)
+	{
+		u64 start = HostNanoSeconds();
+		bool mounted = MountWhole(images[0], &fileInfo[0], type);
+		u64 ns = HostNanoSeconds() - start;
+		if (!mounted)
+		{
+			printf("Cannot open %s\r\n", path);
+			return false;
+		}
+		if (ns < wholeNs)
+			wholeNs = ns;
+
+		start = HostNanoSeconds();
+		mounted = MountStreamed(images[1], &fileInfo[1], type);
+		ns = HostNanoSeconds() - start;
+		if (!mounted)
+		{
+			printf("Cannot load %s\r\n", path);
+			return false;
+		}
+		if (ns < streamedNs)
+			streamedNs = ns;
+	}
+
+	bool same = SameTracks(images[0], images[1], name);
+	if (same)
+	{
+		printf("%-12s %7u bytes  read whole then opened %8.3f ms  read a piece at a time %8.3f ms (%+.0f%%)\r\n",
+			name, (u32)fileInfo[0].fsize, (double)wholeNs / 1000000.0, (double)streamedNs / 1000000.0, ((double)streamedNs - wholeNs) * 100.0 / wholeNs);
+	}
+	images[0].Close();
+	images[1].Close();
+	return same;
+}
+
+static bool MakeImage(const char* extension, const u8* data, u32 size, char* path)
+{
+	sprintf(path, "%s.%s", MOUNT_PATH, extension);
+	if (!SaveFile(path, data, size))
+	{
+		printf("Cannot save %s\r\n", path);
+		return false;
+	}
+	return true;
+}
+
+int BenchMount(const char* path)
+{
+	char paths[5][64];
+	static const char* names[5] = { "D64", "G64", "NIB", "NBZ", "D81" };
+	static u8 compressed[READBUFFER_SIZE];
+	DiskImage d64;
+
+	seed = 0x1541;
+	for (u32 byte = 0; byte < D64_SIZE; ++byte)
+		image[byte] = (u8)Random();
+	image[0x165A2] = '4';
+	image[0x165A3] = '2';
+	if (!MakeImage("d64", image, D64_SIZE, paths[0]) || !d64.OpenD64(0, image, D64_SIZE))
+		return 1;
+
+	sprintf(paths[1], "%s.g64", MOUNT_PATH);
+	if (!d64.WriteG64(paths[1]))
+	{
+		printf("Cannot save %s\r\n", paths[1]);
+		return 1;
+	}
+
+	u32 nibSize = MakeNIB(d64, image);
+	if (!MakeImage("nib", image, nibSize, paths[2]))
+		return 1;
+	int nbzSize = LZ_Compress(image, compressed, nibSize);
+	if (!MakeImage("nbz", compressed, nbzSize, paths[3]))
+		return 1;
+
+	for (u32 byte = 0; byte < D81_SIZE; ++byte)
+		image[byte] = (u8)Random();
+	if (!MakeImage("d81", image, D81_SIZE, paths[4]))
+		return 1;
+
+	bool passed = true;
+	for (unsigned index = 0; index < 5 && passed; ++index)
+		passed = TimeMount(paths[index], names[index]);
+	if (passed && path)
+		passed = TimeMount(path, path);
+
+	for (unsigned index = 0; index < 5; ++index)
+		f_unlink(paths[index]);
+	if (!passed)
+		return 1;
+	printf("Every image read a piece at a time has the same tracks as it read whole\r\n");
+	return 0;
+}
@@ -0,0 +1,146 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#include "DriveRef.h"
+
+// See Drive.cpp for how the encoder/decoder works.
+
+#define DISK_SWAP_CYCLES_DISK_EJECTING 400000
+#define DISK_SWAP_CYCLES_NO_DISK 200000
+#define DISK_SWAP_CYCLES_DISK_INSERTING 400000
+
+DriveRef::DriveRef() : diskImage(0), m_pVIA(0)
+{
+	Reset();
+}
+
+void DriveRef::Reset()
+{
+	headTrackPos = 18*2;
+	CLOCK_SEL_AB = 3;
+	UpdateHeadSectorPosition();
+	lastHeadDirection = 0;
+	motor = false;
+	SO = false;
+	readShiftRegister = 0;
+	writeShiftRegister = 0;
+	UE3Counter = 0;
+	ResetEncoderDecoder(18.0f, 22.0f);
+	newDiskImageQueuedCylesRemaining = DISK_SWAP_CYCLES_DISK_EJECTING + DISK_SWAP_CYCLES_NO_DISK + DISK_SWAP_CYCLES_DISK_INSERTING;
+	if (m_pVIA)
+	{
+		m_pVIA->InputCA1(true);
+		m_pVIA->InputCB1(true);
+		m_pVIA->InputCA2(true);
+		m_pVIA->InputCB2(true);
+	}
+}
+
+void DriveRef::Insert(DiskImage* diskImage)
+{
+	this->diskImage = diskImage;
+	newDiskImageQueuedCylesRemaining = DISK_SWAP_CYCLES_DISK_EJECTING + DISK_SWAP_CYCLES_NO_DISK + DISK_SWAP_CYCLES_DISK_INSERTING;
+}
+
+void DriveRef::OnPortOut(void* pThis, unsigned char status)
+{
+	DriveRef* pDrive = (DriveRef*)pThis;
+	if (pDrive->motor)
+		pDrive->MoveHead(status & 3);
+	pDrive->motor = (status & 4) != 0;
+	pDrive->CLOCK_SEL_AB = ((status >> 5) & 3);
+	pDrive->LED = (status & 8) != 0;
+}
+
+bool DriveRef::Update()
+{
+	bool dataReady = false;
+
+	if (newDiskImageQueuedCylesRemaining > 0)
+	{
+		newDiskImageQueuedCylesRemaining--;
+		if (newDiskImageQueuedCylesRemaining == 0) m_pVIA->GetPortB()->SetInput(0x10, !diskImage->GetReadOnly());
+		else if (newDiskImageQueuedCylesRemaining > DISK_SWAP_CYCLES_NO_DISK + DISK_SWAP_CYCLES_DISK_INSERTING) m_pVIA->GetPortB()->SetInput(0x10, false);
+		else if (newDiskImageQueuedCylesRemaining > DISK_SWAP_CYCLES_DISK_INSERTING) m_pVIA->GetPortB()->SetInput(0x10, true);
+		else m_pVIA->GetPortB()->SetInput(0x10, false);
+	}
+	else if (diskImage && motor)
+	{
+		unsigned char FCR = m_pVIA->GetFCR();
+		bool writing = ((FCR & m6522::FCR_CB2_OUTPUT_MODE0) == 0) && ((FCR & m6522::FCR_CB2_IO) != 0);
+
+		if (SO)
+		{
+			dataReady = true;
+			SO = false;
+		}
+		for (int cycles = 0; cycles < 16; ++cycles)
+		{
+			if (!writing)
+			{
+				if (++cyclesForBit >= cyclesPerBit)
+				{
+					cyclesForBit -= cyclesPerBit;
+					if (GetNextBit())
+						ResetEncoderDecoder(18.0f, 20.0f);
+				}
+				randomFluxReversalTime -= 0.0625f;
+				if (randomFluxReversalTime <= 0) ResetEncoderDecoder(2.0f, 25.0f);
+			}
+			if (++UE7Counter == 0x10)
+			{
+				UE7Counter = CLOCK_SEL_AB;
+				++UF4Counter &= 0xf;
+				if ((UF4Counter & 0x3) == 2)
+				{
+					readShiftRegister <<= 1;
+					readShiftRegister |= (UF4Counter == 2);
+					if (writing) SetNextBit((writeShiftRegister & 0x80));
+					writeShiftRegister <<= 1;
+					if (!writing && ((readShiftRegister & 0x3ff) == 0x3ff))
+					{
+						UE3Counter = 0;
+						m_pVIA->GetPortB()->SetInput(0x80, false);
+					}
+					else
+					{
+						if (!writing) m_pVIA->GetPortB()->SetInput(0x80, true);
+						UE3Counter++;
+					}
+				}
+				else if (((UF4Counter & 2) == 0) && (UE3Counter == 8))
+				{
+					UE3Counter = 0;
+					SO = (m_pVIA->GetFCR() & m6522::FCR_CA2_OUTPUT_MODE0) != 0;
+					if (writing)
+					{
+						writeShiftRegister = m_pVIA->GetPortA()->GetOutput();
+					}
+					else
+					{
+						writeShiftRegister = (u8)(readShiftRegister & 0xff);
+						m_pVIA->GetPortA()->SetInput(writeShiftRegister);
+					}
+				}
+			}
+		}
+	}
+	m_pVIA->InputCA1(!SO);
+
+	return dataReady;
+}
@@ -0,0 +1,136 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// The read/write electronics of Drive as they were on the Pi 2/3 before it went to integer clocks;
+// 16 UE7 clocks one at a time every cycle with the bit cells timed in floating point and the noise from rand().
+// Only used by the host build to check the rotation timing and the noise of the current Drive against.
+
+#ifndef DRIVEREF_H
+#define DRIVEREF_H
+
+#include "m6522.h"
+#include "DiskImage.h"
+#include <stdlib.h>
+
+class DriveRef
+{
+public:
+	DriveRef();
+
+	void SetVIA(m6522* pVIA)
+	{
+		m_pVIA = pVIA;
+		pVIA->GetPortB()->SetPortOut(this, OnPortOut);
+	}
+
+	static void OnPortOut(void*, unsigned char status);
+
+	bool Update();
+
+	void Insert(DiskImage* diskImage);
+	void Reset();
+	inline unsigned Track() const { return headTrackPos; }
+	inline unsigned GetHeadBitOffset() const { return headBitOffset; }
+
+private:
+	inline float GenerateRandomFluxReversalTime(float min, float max) { return ((max - min) * ((float)rand() / RAND_MAX)) + min; } // Inputs in micro seconds
+
+	inline void ResetEncoderDecoder(float min, float max)
+	{
+		UE7Counter = CLOCK_SEL_AB;
+		UF4Counter = 0;
+		randomFluxReversalTime = GenerateRandomFluxReversalTime(min, max);
+	}
+
+	inline void UpdateHeadSectorPosition()
+	{
+		static const float CYCLES_16Mhz_PER_ROTATION = 3200000.0f;
+
+		if (diskImage == 0)
+			return;
+
+		diskImage->PrepareTrack(headTrackPos);
+		bitsInTrack = diskImage->BitsInTrack(headTrackPos);
+		headBitOffset %= bitsInTrack;
+		cyclesPerBit = CYCLES_16Mhz_PER_ROTATION / (float)bitsInTrack;
+	}
+
+	inline void MoveHead(unsigned char headDirection)
+	{
+		if (lastHeadDirection != headDirection)
+		{
+			if (((lastHeadDirection - 1) & 3) == headDirection)
+			{
+				if (headTrackPos > 0) headTrackPos--;
+			}
+			else if (((lastHeadDirection + 1) & 3) == headDirection)
+			{
+				if (headTrackPos < HALF_TRACK_COUNT - 1) headTrackPos++;
+			}
+			lastHeadDirection = headDirection;
+			UpdateHeadSectorPosition();
+		}
+	}
+
+	inline u32 AdvanceSectorPositionR(int& byteOffset)
+	{
+		++headBitOffset %= bitsInTrack;
+		byteOffset = headBitOffset >> 3;
+		return (~headBitOffset) & 7;
+	}
+	inline u32 AdvanceSectorPositionW(int& byteOffset)
+	{
+		byteOffset = headBitOffset >> 3;
+		u32 bit = (~headBitOffset) & 7;
+		++headBitOffset %= bitsInTrack;
+		return bit;
+	}
+	inline bool GetNextBit()
+	{
+		int byteOffset;
+		int bit = AdvanceSectorPositionR(byteOffset);
+		return diskImage->GetNextBit(headTrackPos, byteOffset, bit);
+	}
+	inline void SetNextBit(bool value)
+	{
+		int byteOffset;
+		int bit = AdvanceSectorPositionW(byteOffset);
+		diskImage->SetBit(headTrackPos, byteOffset, bit, value);
+	}
+
+	DiskImage* diskImage;
+	u32	newDiskImageQueuedCylesRemaining;
+	m6522* m_pVIA;
+	int UE7Counter;
+	u8 writeShiftRegister;
+	float cyclesForBit;
+	u32 readShiftRegister;
+	unsigned headTrackPos;
+	u32 headBitOffset;
+	float randomFluxReversalTime;
+	int UF4Counter;
+	int UE3Counter;
+	int CLOCK_SEL_AB;
+	bool SO;
+	unsigned char lastHeadDirection;
+	u32 bitsInTrack;
+	float cyclesPerBit;
+	bool motor;
+	bool LED;
+};
+#endif
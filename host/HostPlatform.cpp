@@ -0,0 +1,256 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// Stand in for the bare metal platform when building the emulation core on a Linux host.
+// - GPIO registers are simulated (all IEC lines float high ie released).
+// - The system timer runs off CLOCK_MONOTONIC.
+// - The FatFs file functions used by the core are mapped onto stdio.
+// - The globals main.cpp normally provides live here.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+extern "C"
+{
+#include "rpi-gpio.h"
+}
+#include "HostPlatform.h"
+#include "rpiHardware.h"
+
+u8 s_u8Memory[0xc000];
+ROMs roms;
+Options options;
+Pi1541 pi1541;
+u8 deviceID = 8;
+
+static u32 gpioLevels = 0xffffffff;
+static u32 gpioOutputs = 0;
+static u32 gpioFunctionSelect[6] = { 0 };
+
+u32 HostGetGPIOOutputs()
+{
+	return gpioOutputs;
+}
+
+void HostSetGPIOLevels(u32 levels)
+{
+	gpioLevels = levels;
+}
+
+u64 HostMicroSeconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+u64 HostNanoSeconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+extern "C" u32 HostRead32(unsigned int nAddress)
+{
+	switch (nAddress)
+	{
+		case ARM_GPIO_GPLEV0:
+			return gpioLevels;
+		case ARM_SYSTIMER_CLO:
+			return (u32)HostMicroSeconds();
+		default:
+			if (nAddress >= ARM_GPIO_GPFSEL0 && nAddress < ARM_GPIO_GPFSEL0 + sizeof(gpioFunctionSelect))
+				return gpioFunctionSelect[(nAddress - ARM_GPIO_GPFSEL0) >> 2];
+			break;
+	}
+	return 0;
+}
+
+extern "C" void HostWrite32(unsigned int nAddress, u32 nValue)
+{
+	switch (nAddress)
+	{
+		case ARM_GPIO_GPSET0:
+			gpioOutputs |= nValue;
+			break;
+		case ARM_GPIO_GPCLR0:
+			gpioOutputs &= ~nValue;
+			break;
+		default:
+			if (nAddress >= ARM_GPIO_GPFSEL0 && nAddress < ARM_GPIO_GPFSEL0 + sizeof(gpioFunctionSelect))
+				gpioFunctionSelect[(nAddress - ARM_GPIO_GPFSEL0) >> 2] = nValue;
+			break;
+	}
+}
+
+extern "C" void SetACTLed(int value)
+{
+}
+
+extern "C" void RPI_SetGpioInput(rpi_gpio_pin_t gpio)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////
+// FatFs over stdio
+///////////////////////////////////////////////////////////////////////////////////////
+#define MAX_OPEN_FILES 16
+
+static struct
+{
+	FIL* fp;
+	FILE* file;
+} openFiles[MAX_OPEN_FILES];
+
+static FILE* FindFile(FIL* fp)
+{
+	for (int index = 0; index < MAX_OPEN_FILES; ++index)
+	{
+		if (openFiles[index].fp == fp)
+			return openFiles[index].file;
+	}
+	return 0;
+}
+
+FRESULT f_open(FIL* fp, const TCHAR* path, BYTE mode)
+{
+	FILE* file = 0;
+	int index;
+
+	for (index = 0; index < MAX_OPEN_FILES; ++index)
+	{
+		if (openFiles[index].fp == 0)
+			break;
+	}
+	if (index == MAX_OPEN_FILES)
+		return FR_TOO_MANY_OPEN_FILES;
+
+	if (mode & FA_CREATE_ALWAYS)
+	{
+		file = fopen(path, "w+b");
+	}
+	else if (mode & FA_WRITE)
+	{
+		file = fopen(path, "r+b");
+		if (file == 0 && (mode & (FA_OPEN_ALWAYS | FA_CREATE_NEW)))
+			file = fopen(path, "w+b");
+	}
+	else
+	{
+		file = fopen(path, "rb");
+	}
+	if (file == 0)
+		return FR_NO_FILE;
+
+	memset(fp, 0, sizeof(FIL));
+	fseek(file, 0, SEEK_END);
+	fp->obj.objsize = ftell(file);
+	if ((mode & FA_OPEN_APPEND) == FA_OPEN_APPEND)
+		fp->fptr = fp->obj.objsize;
+	else
+		fseek(file, 0, SEEK_SET);
+
+	openFiles[index].fp = fp;
+	openFiles[index].file = file;
+	return FR_OK;
+}
+
+FRESULT f_close(FIL* fp)
+{
+	for (int index = 0; index < MAX_OPEN_FILES; ++index)
+	{
+		if (openFiles[index].fp == fp)
+		{
+			fclose(openFiles[index].file);
+			openFiles[index].fp = 0;
+			openFiles[index].file = 0;
+			return FR_OK;
+		}
+	}
+	return FR_INVALID_OBJECT;
+}
+
+FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br)
+{
+	FILE* file = FindFile(fp);
+	if (file == 0)
+		return FR_INVALID_OBJECT;
+	*br = fread(buff, 1, btr, file);
+	fp->fptr += *br;
+	return FR_OK;
+}
+
+FRESULT f_write(FIL* fp, const void* buff, UINT btw, UINT* bw)
+{
+	FILE* file = FindFile(fp);
+	if (file == 0)
+		return FR_INVALID_OBJECT;
+	*bw = fwrite(buff, 1, btw, file);
+	fp->fptr += *bw;
+	if (fp->fptr > fp->obj.objsize)
+		fp->obj.objsize = fp->fptr;
+	return *bw == btw ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT f_lseek(FIL* fp, FSIZE_t ofs)
+{
+	FILE* file = FindFile(fp);
+	if (file == 0)
+		return FR_INVALID_OBJECT;
+	if (fseek(file, ofs, SEEK_SET) != 0)
+		return FR_DISK_ERR;
+	fp->fptr = ofs;
+	return FR_OK;
+}
+
+FRESULT f_sync(FIL* fp)
+{
+	FILE* file = FindFile(fp);
+	if (file == 0)
+		return FR_INVALID_OBJECT;
+	fflush(file);
+	return FR_OK;
+}
+
+FRESULT f_unlink(const TCHAR* path)
+{
+	return remove(path) == 0 ? FR_OK : FR_NO_FILE;
+}
+
+FRESULT f_mkdir(const TCHAR* path)
+{
+	return mkdir(path, 0777) == 0 ? FR_OK : FR_EXIST;
+}
+
+FRESULT f_getcwd(TCHAR* buff, UINT len)
+{
+	return getcwd(buff, len) ? FR_OK : FR_NOT_ENOUGH_CORE;
+}
+
+bool HostLoadFile(const char* path, u8* buffer, u32 bufferSize, u32* bytesRead)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == 0)
+		return false;
+	*bytesRead = fread(buffer, 1, bufferSize, file);
+	fclose(file);
+	return true;
+}
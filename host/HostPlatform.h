@@ -0,0 +1,42 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HOSTPLATFORM_H
+#define HOSTPLATFORM_H
+
+#include "types.h"
+#include "ff.h"
+#include "ROMs.h"
+#include "options.h"
+#include "Pi1541.h"
+
+extern u8 s_u8Memory[0xc000];
+extern ROMs roms;
+extern Options options;
+extern Pi1541 pi1541;
+
+u64 HostMicroSeconds();
+u64 HostNanoSeconds();
+
+// Levels seen on GPLEV0 (defaults to all lines high)
+void HostSetGPIOLevels(u32 levels);
+u32 HostGetGPIOOutputs();
+
+bool HostLoadFile(const char* path, u8* buffer, u32 bufferSize, u32* bytesRead);
+
+#endif
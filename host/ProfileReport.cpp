@@ -0,0 +1,210 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// Turns a profile saved by Profiler::SaveToFile (PROFILE6502 builds) into a report of the hottest routines and instructions.
+// A PC is put down to the nearest symbol below it (the 1541 ROM's entry points plus any given in a symbol file)
+// unless that is further away than ROUTINE_MAX_LENGTH, in which case it is put down to its page (eg code a loader has uploaded to RAM).
+
+#include "HostPlatform.h"
+#include "Profiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROUTINE_MAX_LENGTH 0x400
+#define MAX_SYMBOLS 1024
+#define REPORT_ROUTINES 24
+#define REPORT_PCS 24
+#define REPORT_TRACE 32
+
+struct Routine
+{
+	u32 cycles;
+	u16 address;		// Of the symbol or the page
+	u16 hottestPC;
+	const char* name;	// 0 for a page
+};
+
+static Profiler profile;
+static u8 file[4 * 0x10000 + PROFILER_TRACE_LENGTH * 11 + 64];
+static ProfilerSymbol symbols[MAX_SYMBOLS];
+static char symbolNames[MAX_SYMBOLS][32];
+static unsigned symbolCount;
+static Routine routines[MAX_SYMBOLS + 0x100];
+static unsigned routineCount;
+static u16 pcs[0x10000];
+
+static void AddSymbol(u16 address, const char* name)
+{
+	if (symbolCount == MAX_SYMBOLS)
+		return;
+
+	// Kept sorted for Profiler::FindSymbol. A later symbol at the same address replaces the earlier one.
+	unsigned index = 0;
+	while (index < symbolCount && symbols[index].address < address)
+		index++;
+	if (index == symbolCount || symbols[index].address != address)
+	{
+		memmove(&symbols[index + 1], &symbols[index], (symbolCount - index) * sizeof(symbols[0]));
+		symbolCount++;
+	}
+	symbols[index].address = address;
+	symbols[index].name = name;
+}
+
+// Lines of "<hex address> <name>". Anything else is ignored.
+static bool LoadSymbols(const char* path)
+{
+	char line[256];
+	FILE* fp = fopen(path, "r");
+	unsigned loaded = 0;
+
+	if (fp == 0)
+		return false;
+	while (fgets(line, sizeof(line), fp) && loaded < MAX_SYMBOLS)
+	{
+		char* end;
+		const char* text = line;
+		if (*text == '$')
+			text++;
+		unsigned long address = strtoul(text, &end, 16);
+		char name[32];
+		if (end == text || address > 0xffff || sscanf(end, "%31s", name) != 1)
+			continue;
+		strcpy(symbolNames[loaded], name);
+		AddSymbol((u16)address, symbolNames[loaded]);
+		loaded++;
+	}
+	fclose(fp);
+	return true;
+}
+
+static Routine* FindRoutine(u16 address, const char* name)
+{
+	for (unsigned index = 0; index < routineCount; ++index)
+	{
+		if (routines[index].address == address && routines[index].name == name)
+			return &routines[index];
+	}
+	Routine* routine = &routines[routineCount++];
+	routine->cycles = 0;
+	routine->address = address;
+	routine->hottestPC = address;
+	routine->name = name;
+	return routine;
+}
+
+static int CompareRoutines(const void* a, const void* b)
+{
+	u32 left = ((const Routine*)a)->cycles;
+	u32 right = ((const Routine*)b)->cycles;
+	return left > right ? -1 : left < right ? 1 : 0;
+}
+
+static int ComparePCs(const void* a, const void* b)
+{
+	u32 left = profile.Cycles(*(const u16*)a);
+	u32 right = profile.Cycles(*(const u16*)b);
+	return left > right ? -1 : left < right ? 1 : 0;
+}
+
+static void PrintPC(u16 pc)
+{
+	const ProfilerSymbol* symbol = Profiler::FindSymbol(pc, symbols, symbolCount);
+	if (symbol && pc - symbol->address < ROUTINE_MAX_LENGTH)
+		printf("%04x %-10s+%03x", pc, symbol->name, pc - symbol->address);
+	else
+		printf("%04x               ", pc);
+}
+
+static double Percent(u32 cycles)
+{
+	return profile.TotalCycles() ? cycles * 100.0 / profile.TotalCycles() : 0;
+}
+
+int ProfileReport(const char* path, const char* symbolsPath)
+{
+	u32 size = 0;
+	unsigned count;
+	const ProfilerSymbol* romSymbols = Profiler::ROMSymbols(count);
+
+	if (!HostLoadFile(path, file, sizeof(file), &size) || !profile.Load(file, size))
+	{
+		printf("%s is not a profile saved by a PROFILE6502 build\r\n", path);
+		return 1;
+	}
+	for (unsigned index = 0; index < count; ++index)
+		AddSymbol(romSymbols[index].address, romSymbols[index].name);
+	if (symbolsPath && !LoadSymbols(symbolsPath))
+	{
+		printf("Cannot read symbols from %s\r\n", symbolsPath);
+		return 1;
+	}
+
+	unsigned pcCount = 0;
+	for (u32 pc = 0; pc < 0x10000; ++pc)
+	{
+		u32 cycles = profile.Cycles((u16)pc);
+		if (cycles == 0)
+			continue;
+		pcs[pcCount++] = (u16)pc;
+
+		const ProfilerSymbol* symbol = Profiler::FindSymbol((u16)pc, symbols, symbolCount);
+		Routine* routine;
+		if (symbol && pc - symbol->address < ROUTINE_MAX_LENGTH)
+			routine = FindRoutine(symbol->address, symbol->name);
+		else
+			routine = FindRoutine(pc & 0xff00, 0);
+		if (cycles > profile.Cycles(routine->hottestPC) || routine->cycles == 0)
+			routine->hottestPC = (u16)pc;
+		routine->cycles += cycles;
+	}
+	qsort(routines, routineCount, sizeof(routines[0]), CompareRoutines);
+	qsort(pcs, pcCount, sizeof(pcs[0]), ComparePCs);
+
+	printf("%u cycles, %u instructions, %u different PCs\r\n\r\n", profile.TotalCycles(), profile.TotalInstructions(), pcCount);
+
+	printf("routine          cycles       %%   hottest PC\r\n");
+	for (unsigned index = 0; index < routineCount && index < REPORT_ROUTINES; ++index)
+	{
+		const Routine& routine = routines[index];
+		if (routine.name)
+			printf("%04x %-10s", routine.address, routine.name);
+		else
+			printf("%04x page      ", routine.address);
+		printf(" %10u %6.2f%%  %04x\r\n", routine.cycles, Percent(routine.cycles), routine.hottestPC);
+	}
+
+	printf("\r\nPC                      cycles       %%\r\n");
+	for (unsigned index = 0; index < pcCount && index < REPORT_PCS; ++index)
+	{
+		PrintPC(pcs[index]);
+		printf(" %10u %6.2f%%\r\n", profile.Cycles(pcs[index]), Percent(profile.Cycles(pcs[index])));
+	}
+
+	u32 length = profile.TraceLength();
+	printf("\r\nlast %u instructions\r\n", length < REPORT_TRACE ? length : REPORT_TRACE);
+	for (u32 entry = length > REPORT_TRACE ? length - REPORT_TRACE : 0; entry < length; ++entry)
+	{
+		const Profiler::TraceEntry& traced = profile.Trace(entry);
+		printf("%10u ", traced.cycle);
+		PrintPC(traced.pc);
+		printf(" A=%02x X=%02x Y=%02x SP=%02x P=%02x\r\n", traced.a, traced.x, traced.y, traced.sp, traced.status);
+	}
+	return 0;
+}
@@ -0,0 +1,130 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// Plain C versions of the few NEON intrinsics the Pi 2/3 code uses (see gcr.cpp's GCR_NEON path)
+// so that it can be checked on the host against the scalar code. Only the results mean anything, not the speed.
+// Out of range table indices give 0 (vtbl) or leave the lane as it was (vtbx) as on the Pi.
+
+#ifndef HOST_ARM_NEON_H
+#define HOST_ARM_NEON_H
+
+#include <stdint.h>
+
+struct uint8x8_t { uint8_t lane[8]; };
+struct uint8x8x2_t { uint8x8_t val[2]; };
+struct uint8x8x4_t { uint8x8_t val[4]; };
+struct uint64x1_t { uint64_t lane; };
+
+static inline uint8x8_t vld1_u8(const uint8_t* source)
+{
+	uint8x8_t result;
+	for (int lane = 0; lane < 8; ++lane)
+		result.lane[lane] = source[lane];
+	return result;
+}
+
+static inline void vst1_u8(uint8_t* dest, uint8x8_t value)
+{
+	for (int lane = 0; lane < 8; ++lane)
+		dest[lane] = value.lane[lane];
+}
+
+static inline uint8x8x4_t vld4_u8(const uint8_t* source)
+{
+	uint8x8x4_t result;
+	for (int lane = 0; lane < 8; ++lane)
+	{
+		for (int vector = 0; vector < 4; ++vector)
+			result.val[vector].lane[lane] = source[lane * 4 + vector];
+	}
+	return result;
+}
+
+static inline void vst4_u8(uint8_t* dest, uint8x8x4_t value)
+{
+	for (int lane = 0; lane < 8; ++lane)
+	{
+		for (int vector = 0; vector < 4; ++vector)
+			dest[lane * 4 + vector] = value.val[vector].lane[lane];
+	}
+}
+
+static inline uint8x8_t vtbx(uint8x8_t result, const uint8x8_t* table, unsigned vectors, uint8x8_t index)
+{
+	for (int lane = 0; lane < 8; ++lane)
+	{
+		unsigned entry = index.lane[lane];
+		if (entry < vectors * 8)
+			result.lane[lane] = table[entry >> 3].lane[entry & 7];
+	}
+	return result;
+}
+
+static inline uint8x8_t vdup_n_u8(uint8_t value)
+{
+	uint8x8_t result;
+	for (int lane = 0; lane < 8; ++lane)
+		result.lane[lane] = value;
+	return result;
+}
+
+static inline uint8x8_t vtbl2_u8(uint8x8x2_t table, uint8x8_t index) { return vtbx(vdup_n_u8(0), table.val, 2, index); }
+static inline uint8x8_t vtbl4_u8(uint8x8x4_t table, uint8x8_t index) { return vtbx(vdup_n_u8(0), table.val, 4, index); }
+static inline uint8x8_t vtbx1_u8(uint8x8_t result, uint8x8_t table, uint8x8_t index) { return vtbx(result, &table, 1, index); }
+
+#define HOST_NEON_LANEWISE(name, expression) \
+	static inline uint8x8_t name(uint8x8_t a, uint8x8_t b) \
+	{ \
+		uint8x8_t result; \
+		for (int lane = 0; lane < 8; ++lane) \
+			result.lane[lane] = (uint8_t)(expression); \
+		return result; \
+	}
+
+HOST_NEON_LANEWISE(vorr_u8, a.lane[lane] | b.lane[lane])
+HOST_NEON_LANEWISE(vand_u8, a.lane[lane] & b.lane[lane])
+HOST_NEON_LANEWISE(vceq_u8, a.lane[lane] == b.lane[lane] ? 0xff : 0)
+
+static inline uint8x8_t vshl_n_u8(uint8x8_t a, int shift)
+{
+	for (int lane = 0; lane < 8; ++lane)
+		a.lane[lane] = (uint8_t)(a.lane[lane] << shift);
+	return a;
+}
+
+static inline uint8x8_t vshr_n_u8(uint8x8_t a, int shift)
+{
+	for (int lane = 0; lane < 8; ++lane)
+		a.lane[lane] = (uint8_t)(a.lane[lane] >> shift);
+	return a;
+}
+
+static inline uint64x1_t vreinterpret_u64_u8(uint8x8_t a)
+{
+	uint64x1_t result = { 0 };
+	for (int lane = 0; lane < 8; ++lane)
+		result.lane |= (uint64_t)a.lane[lane] << (lane * 8);
+	return result;
+}
+
+static inline uint64_t vget_lane_u64(uint64x1_t a, int lane)
+{
+	return a.lane;
+}
+
+#endif
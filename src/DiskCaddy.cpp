@@ -24,6 +24,7 @@
 extern "C"
 {
 #include "rpi-gpio.h"	// For SetACTLed
+#include "rpiHardware.h"
 }
 
 extern u8 deviceID;
@@ -45,6 +46,8 @@ bool DiskCaddy::Empty()
 	int index;
 	bool anyDirty = false;
 
+	StopPrefetching();
+
 #if not defined(EXPERIMENTALZERO)
 	if (screen)
 		screen->Clear(RGBA(0x40, 0x31, 0x8D, 0xFF));
@@ -113,6 +116,8 @@ bool DiskCaddy::Empty()
 	}
 
 	disks.clear();
+	slotStates.clear();
+	shownStates.clear();
 	selectedIndex = 0;
 	oldCaddyIndex = 0;
 	return anyDirty;
@@ -123,6 +128,7 @@ bool DiskCaddy::Insert(const FILINFO* fileInfo, bool readOnly)
 	int x;
 	int y;
 	bool success;
+	StopPrefetching();
 	FIL fp;
 	FRESULT res = f_open(&fp, fileInfo->fname, FA_READ);
 	if (res == FR_OK)
@@ -155,43 +161,30 @@ bool DiskCaddy::Insert(const FILINFO* fileInfo, bool readOnly)
 			screenLCD->PrintText(false, x, y, buffer, RGBA(0xff, 0xff, 0xff, 0xff), red);
 			screenLCD->SwapBuffers();
 		}
-		u32 bytesRead;
+		// The image is converted a piece at a time as it comes off the SD card.
+		DiskImage::DiskType diskType = DiskImage::GetDiskImageTypeViaExtention(fileInfo->fname);
+		DiskImage* diskImage = new DiskImage();
 		SetACTLed(true);
-		f_read(&fp, DiskImage::readBuffer, READBUFFER_SIZE, &bytesRead);
+		success = diskImage->Load(fileInfo, &fp, diskType);
 		SetACTLed(false);
 		f_close(&fp);
 
-		DiskImage::DiskType diskType = DiskImage::GetDiskImageTypeViaExtention(fileInfo->fname);
-		switch (diskType)
+		if (success)
 		{
-			case DiskImage::D64:
-				success = InsertD64(fileInfo, (unsigned char*)DiskImage::readBuffer, bytesRead, readOnly);
-				break;
-			case DiskImage::G64:
-				success = InsertG64(fileInfo, (unsigned char*)DiskImage::readBuffer, bytesRead, readOnly);
-				break;
-			case DiskImage::NIB:
-				success = InsertNIB(fileInfo, (unsigned char*)DiskImage::readBuffer, bytesRead, readOnly);
-				break;
-			case DiskImage::NBZ:
-				success = InsertNBZ(fileInfo, (unsigned char*)DiskImage::readBuffer, bytesRead, readOnly);
-				break;
-			case DiskImage::D81:
-				success = InsertD81(fileInfo, (unsigned char*)DiskImage::readBuffer, bytesRead, readOnly);
-				break;
-			case DiskImage::T64:
-				success = InsertT64(fileInfo, (unsigned char*)DiskImage::readBuffer, bytesRead, readOnly);
-				break;
-			case DiskImage::PRG:
-				success = InsertPRG(fileInfo, (unsigned char*)DiskImage::readBuffer, bytesRead, readOnly);
-				break;
-			default:
-				success = false;
-				break;
+			// At the moment we cannot write out NIB files.
+			diskImage->SetReadOnly(readOnly || diskType == DiskImage::NIB || diskType == DiskImage::NBZ);
+			disks.push_back(diskImage);
+			selectedIndex = disks.size() - 1;
+
+			DEBUG_LOG("Mounted into caddy %s - %d\r\n", fileInfo->fname, (u32)fileInfo->fsize);
+			slotStates.resize(disks.size(), SLOT_EXPANDED);
+			shownStates.resize(disks.size(), SLOT_EXPANDED);
+			// Core 0 has been stopped so the images can be compressed as they go in.
+			ExpandSelected(false);
 		}
-		if (success)
+		else
 		{
-			DEBUG_LOG("Mounted into caddy %s - %d\r\n", fileInfo->fname, bytesRead);
+			delete diskImage;
 		}
 	}
 	else
@@ -205,105 +198,123 @@ bool DiskCaddy::Insert(const FILINFO* fileInfo, bool readOnly)
 	return success;
 }
 
-bool DiskCaddy::InsertD64(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly)
+// Compresses the images that are not needed first (so that there is the most memory free) then expands the selected one.
+// A D64 expands in a few milliseconds, well within the second Drive takes to swap disks (see DISK_SWAP_CYCLES_DISK_EJECTING).
+DiskImage* DiskCaddy::ExpandSelected(bool useOtherCore)
 {
-	DiskImage* diskImage = new DiskImage();
-	if (diskImage->OpenD64(fileInfo, diskImageData, size))
+	u32 numberOfImages = disks.size();
+	if (selectedIndex >= numberOfImages)
+		return 0;
+
+	if (useOtherCore)
 	{
-		diskImage->SetReadOnly(readOnly);
-		disks.push_back(diskImage);
-		selectedIndex = disks.size() - 1;
-		return true;
+		// The image being left may be written to after it was prepared.
+		u32 leftIndex = wantedIndex;
+		if (leftIndex < numberOfImages && leftIndex != selectedIndex && slotStates[leftIndex] == SLOT_READY)
+			slotStates[leftIndex] = SLOT_EXPANDED;
+
+		// Hand the others to core 0 and wait for it to finish with this one if it had it.
+		wantedIndex = selectedIndex;
+		DataMemBarrier();
+		while (workingIndex == (int)selectedIndex)
+			;
+		DataMemBarrier();
+		if (slotStates[selectedIndex] == SLOT_PACKED)
+		{
+			if (!disks[selectedIndex]->Unpack())
+				return 0;
+			slotStates[selectedIndex] = SLOT_EXPANDED;
+		}
+		return GetCurrentDisk();
 	}
-	delete diskImage;
-	return false;
-}
 
-bool DiskCaddy::InsertG64(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly)
-{
-	DiskImage* diskImage = new DiskImage();
-	if (diskImage->OpenG64(fileInfo, diskImageData, size))
+	u32 nextIndex = expandNext ? (selectedIndex + 1) % numberOfImages : selectedIndex;
+
+	for (u32 index = 0; index < numberOfImages; ++index)
 	{
-		diskImage->SetReadOnly(readOnly);
-		disks.push_back(diskImage);
-		//DEBUG_LOG("Disks size = %d\r\n", disks.size());
-		selectedIndex = disks.size() - 1;
-		return true;
+		if (index != selectedIndex && index != nextIndex && disks[index]->Pack())
+			slotStates[index] = SLOT_PACKED;
 	}
-	delete diskImage;
-	return false;
+	if (!disks[selectedIndex]->Unpack())
+		return 0;
+	if (slotStates[selectedIndex] == SLOT_PACKED)
+		slotStates[selectedIndex] = SLOT_EXPANDED;
+	if (disks[nextIndex]->Unpack() && slotStates[nextIndex] == SLOT_PACKED)
+		slotStates[nextIndex] = SLOT_EXPANDED;
+	return GetCurrentDisk();
 }
 
-bool DiskCaddy::InsertNIB(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly)
+// Runs on core 0. Does one image per call (packing the ones that are not needed before preparing the neighbours, to keep memory down)
+// so that the screen and the SD card get seen to in between. Returns whether there was anything to do.
+bool DiskCaddy::Prefetch()
 {
-	DiskImage* diskImage = new DiskImage();
-	if (diskImage->OpenNIB(fileInfo, diskImageData, size))
+	u32 selected = wantedIndex;
+	if (!prefetchOnOtherCore || selected == NO_SELECTION)
+		return false;
+
+	// Until wantedIndex is seen to be the same after this the caddy may be being filled or emptied.
+	workingIndex = (int)selected;
+	DataMemBarrier();
+	if (wantedIndex != selected)
 	{
-		// At the moment we cannot write out NIB files.
-		diskImage->SetReadOnly(true);// readOnly);
-		disks.push_back(diskImage);
-		selectedIndex = disks.size() - 1;
-		return true;
+		workingIndex = -1;
+		return false;
 	}
-	delete diskImage;
-	return false;
-}
 
-bool DiskCaddy::InsertNBZ(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly)
-{
-	DiskImage* diskImage = new DiskImage();
-	if (diskImage->OpenNBZ(fileInfo, diskImageData, size))
+	u32 numberOfImages = disks.size();
+	u32 nextIndex = (selected + 1) % numberOfImages;
+	u32 prevIndex = (selected + numberOfImages - 1) % numberOfImages;
+	u32 index;
+	for (index = 0; index < numberOfImages; ++index)
 	{
-		// At the moment we cannot write out NIB files.
-		diskImage->SetReadOnly(true);// readOnly);
-		disks.push_back(diskImage);
-		selectedIndex = disks.size() - 1;
-		return true;
+		if (index != selected && index != nextIndex && index != prevIndex && slotStates[index] != SLOT_PACKED)
+			break;
 	}
-	delete diskImage;
-	return false;
-}
-
-bool DiskCaddy::InsertD81(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly)
-{
-	DiskImage* diskImage = new DiskImage();
-	if (diskImage->OpenD81(fileInfo, diskImageData, size))
+	if (index == numberOfImages)
 	{
-		diskImage->SetReadOnly(readOnly);
-		disks.push_back(diskImage);
-		selectedIndex = disks.size() - 1;
-		return true;
+		if (slotStates[nextIndex] != SLOT_READY)
+			index = nextIndex;
+		else if (slotStates[prevIndex] != SLOT_READY)
+			index = prevIndex;
 	}
-	delete diskImage;
-	return false;
-}
 
-bool DiskCaddy::InsertT64(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly)
-{
-	DiskImage* diskImage = new DiskImage();
-	if (diskImage->OpenT64(fileInfo, diskImageData, size))
+	bool worked = false;
+	if (index < numberOfImages && index != selected)
 	{
-		diskImage->SetReadOnly(readOnly);
-		disks.push_back(diskImage);
-		selectedIndex = disks.size() - 1;
-		return true;
+		workingIndex = (int)index;
+		DataMemBarrier();
+		if (wantedIndex == selected)
+		{
+			DiskImage* image = disks[index];
+			if (index == nextIndex || index == prevIndex)
+			{
+				if (image->Unpack())
+				{
+					image->PrepareAllTracks();
+					slotStates[index] = SLOT_READY;
+					worked = true;
+				}
+			}
+			else if (image->Pack())
+			{
+				slotStates[index] = SLOT_PACKED;
+				worked = true;
+			}
+		}
 	}
-	delete diskImage;
-	return false;
+	DataMemBarrier();
+	workingIndex = -1;
+	return worked;
 }
 
-bool DiskCaddy::InsertPRG(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly)
+// Has core 0 leave the images alone while the caddy is being changed.
+void DiskCaddy::StopPrefetching()
 {
-	DiskImage* diskImage = new DiskImage();
-	if (diskImage->OpenPRG(fileInfo, diskImageData, size))
-	{
-		diskImage->SetReadOnly(readOnly);
-		disks.push_back(diskImage);
-		selectedIndex = disks.size() - 1;
-		return true;
-	}
-	delete diskImage;
-	return false;
+	wantedIndex = NO_SELECTION;
+	DataMemBarrier();
+	while (workingIndex >= 0)
+		;
+	DataMemBarrier();
 }
 
 void DiskCaddy::Display()
@@ -325,26 +336,33 @@ void DiskCaddy::Display()
 		y += 16;
 
 		for (caddyIndex = 0; caddyIndex < numberOfImages; ++caddyIndex)
-		{
-			DiskImage* image = GetImage(caddyIndex);
-			if (image)
-			{
-				const char* name = image->GetName();
-				if (name)
-				{
-					snprintf(buffer, 256, "                                                        ");
-					screen->PrintText(false, x, y, buffer, grey, greyDark);
-					snprintf(buffer, 256, "  %d %s", caddyIndex + 1, name);
-					screen->PrintText(false, x, y, buffer, grey, greyDark);
-					y += 16;
-				}
-			}
-		}
+			ShowImage(caddyIndex);
 	}
 #endif
 	ShowSelectedImage(0);
 }
 
+// Shows an image that is not selected; a + marks one that has been prepared for a swap.
+void DiskCaddy::ShowImage(u32 index)
+{
+	DiskImage* image = GetImage(index);
+	const char* name = image->GetName();
+
+	shownStates[index] = slotStates[index];
+#if not defined(EXPERIMENTALZERO)
+	if (screen && name)
+	{
+		u32 x = screen->ScaleX(screenPosXCaddySelections);
+		u32 y = screen->ScaleY(screenPosYCaddySelections) + 16 + 16 * index;
+
+		snprintf(buffer, 256, "                                                        ");
+		screen->PrintText(false, x, y, buffer, grey, greyDark);
+		snprintf(buffer, 256, "%c %d %s", shownStates[index] == SLOT_READY ? '+' : ' ', index + 1, name);
+		screen->PrintText(false, x, y, buffer, grey, greyDark);
+	}
+#endif
+}
+
 void DiskCaddy::ShowSelectedImage(u32 index)
 {
 	DiskImage* image = GetImage(index);
@@ -431,30 +449,18 @@ void DiskCaddy::ShowSelectedImage(u32 index)
 
 bool DiskCaddy::Update()
 {
-	u32 y;
-	u32 x;
 	u32 caddyIndex = GetSelectedIndex();
+
+	for (u32 index = 0; index < shownStates.size(); ++index)
+	{
+		if (index != caddyIndex && index != oldCaddyIndex && shownStates[index] != slotStates[index])
+			ShowImage(index);
+	}
+
 	if (caddyIndex != oldCaddyIndex)
 	{
-#if not defined(EXPERIMENTALZERO)
-		if (screen)
-		{
-			x = screen->ScaleX(screenPosXCaddySelections);
-			y = screen->ScaleY(screenPosYCaddySelections) + 16 + 16 * oldCaddyIndex;
-			DiskImage* image = GetImage(oldCaddyIndex);
-			if (image)
-			{
-				const char* name = image->GetName();
-				if (name)
-				{
-					snprintf(buffer, 256, "                                                        ");
-					screen->PrintText(false, x, y, buffer, grey, greyDark);
-					snprintf(buffer, 256, "  %d %s", oldCaddyIndex + 1, name);
-					screen->PrintText(false, x, y, buffer, grey, greyDark);
-				}
-			}
-		}
-#endif
+		if (oldCaddyIndex < GetNumberOfImages())
+			ShowImage(oldCaddyIndex);
 
 		oldCaddyIndex = caddyIndex;
 		ShowSelectedImage(oldCaddyIndex);
@@ -24,11 +24,17 @@
 #include "Screen.h"
 #include "ROMs.h"
 
+#define NO_SELECTION 0xffffffff
+
 class DiskCaddy
 {
 public:
 	DiskCaddy()
 		: selectedIndex(0)
+		, expandNext(true)
+		, prefetchOnOtherCore(false)
+		, wantedIndex(NO_SELECTION)
+		, workingIndex(-1)
 #if not defined(EXPERIMENTALZERO)
 		, screen(0)
 #endif
@@ -63,7 +69,7 @@ public:
 	DiskImage* NextDisk()
 	{
 		selectedIndex = (selectedIndex + 1) % (u32)disks.size();
-		return GetCurrentDisk();
+		return ExpandSelected(prefetchOnOtherCore);
 	}
 
 	DiskImage* PrevDisk()
@@ -71,7 +77,7 @@ public:
 		--selectedIndex;
 		if ((int)selectedIndex < 0)
 			selectedIndex += (u32)disks.size();
-		return GetCurrentDisk();
+		return ExpandSelected(prefetchOnOtherCore);
 	}
 
 	u32 GetNumberOfImages() const { return disks.size(); }
@@ -83,7 +89,7 @@ public:
 		if (selectedIndex != index && index < disks.size())
 		{
 			selectedIndex = index;
-			return GetCurrentDisk();
+			return ExpandSelected(prefetchOnOtherCore);
 		}
 		return 0;
 	}
@@ -92,27 +98,48 @@ public:
 		if (disks.size())
 		{
 			selectedIndex = 0;
-			return GetCurrentDisk();
+			return ExpandSelected(prefetchOnOtherCore);
 		}
 		return 0;
 	}
 
+	// The images other than the selected one are kept compressed; whether the one after it is kept expanded as well (so that going on to it is quicker).
+	void SetExpandNext(bool expandNext) { this->expandNext = expandNext; }
+
+	// On a Pi 3 core 0 calls Prefetch while the other core emulates, to get the images either side of the selected one expanded and
+	// their tracks encoded and indexed, and to compress the rest. Swapping to one that is ready then only hands the drive another image.
+	// Only the selected image is expanded (if it is not ready) on the core emulating.
+	void PrefetchOnOtherCore(bool enable) { prefetchOnOtherCore = enable; }
+	bool Prefetch();
+	bool IsReady(u32 index) const { return index < slotStates.size() && slotStates[index] == SLOT_READY; }
+
 	void Display();
 	bool Update();
 
 private:
-	bool InsertD64(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly);
-	bool InsertG64(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly);
-	bool InsertNIB(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly);
-	bool InsertNBZ(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly);
-	bool InsertD81(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly);
-	bool InsertT64(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly);
-	bool InsertPRG(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly);
-
 	void ShowSelectedImage(u32 index);
+	void ShowImage(u32 index);
+	DiskImage* ExpandSelected(bool useOtherCore);
+	void StopPrefetching();
+
+	enum SlotState
+	{
+		SLOT_PACKED,
+		SLOT_EXPANDED,
+		SLOT_READY	// Expanded with every track encoded and indexed
+	};
 
 	std::vector<DiskImage*> disks;
 	u32 selectedIndex;
+	bool expandNext;
+	bool prefetchOnOtherCore;
+	// Written only by the core emulating (the image it has selected, NO_SELECTION while the caddy is being filled or emptied)
+	// and only by core 0 (the image Prefetch is working on, -1 if none). Each waits to see the other has finished with an image before it uses it.
+	volatile u32 wantedIndex;
+	volatile int workingIndex;
+	// Each is only changed by the core that the above has given the image to.
+	std::vector<u8> slotStates;
+	std::vector<u8> shownStates;
 	u32 oldCaddyIndex;
 #if not defined(EXPERIMENTALZERO)
 	ScreenBase* screen;
@@ -25,14 +25,19 @@
 #include <string.h>
 #include <ctype.h>
 #include "lz.h"
+#include "lzfast.h"
 #include "Petscii.h"
 #include <malloc.h>
 extern "C"
 {
 #include "rpi-gpio.h"
 }
+#include "rpiHardware.h"
+#include "WriteBehind.h"
+#include "TrackExtractor.h"
+#include "GCRCache.h"
+#include "ImageHash.h"
 
-extern u32 HashBuffer(const void* pBuffer, u32 length);
 
 #define MAX_DIRECTORY_SECTORS 18
 #define DIRECTORY_SIZE 32
@@ -42,6 +47,23 @@ extern u32 HashBuffer(const void* pBuffer, u32 length);
 
 #define DIRECTRY_ENTRY_FILE_TYPE_PRG 0x82
 
+//--------------------------------------------------------------------------------------
+// This is an implementation of FNV-1a
+// (http://www.isthe.com/chongo/tech/comp/fnv/)
+//--------------------------------------------------------------------------------------
+u32 HashBuffer(const void* pBuffer, u32 length, u32 hash)
+{
+	u8*	pu8Buffer = (u8*)pBuffer;
+
+	while (length)
+	{
+		hash ^= *pu8Buffer++;
+		hash *= 16777619U;
+		--length;
+	}
+	return hash;
+}
+
 static u8 blankD64DIRBAM[] =
 {
 	0x12, 0x01, 0x41, 0x00, 0x15, 0xff, 0xff, 0x1f, 0x15, 0xff, 0xff, 0x1f, 0x15, 0xff, 0xff, 0x1f,
@@ -63,19 +85,48 @@ static u8 blankD64DIRBAM[] =
 	//	0x00, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
 
-unsigned char DiskImage::readBuffer[READBUFFER_SIZE];
+// What the tracks that are not in an image read as. Never written to; a track is given storage of its own first (see OwnTrack).
+static unsigned char blankTrack[MAX_TRACK_LENGTH];
+static unsigned char blankFluxIndex[MAX_TRACK_LENGTH / FLUX_INDEX_BLOCK];	// All 0s (there is a 1 in every block)
+static unsigned char blankSyncBits[MAX_TRACK_LENGTH >> 3];
 
 static unsigned char compressionBuffer[HALF_TRACK_COUNT * MAX_TRACK_LENGTH];
 
+// What Load reads a piece of an image into (a D81 track, both sides of it, or what a G64 has between its tracks).
+#define LOAD_BUFFER_SIZE (20 * 512)
+static unsigned char loadBuffer[LOAD_BUFFER_SIZE];
+
+// Extracts the tracks of a NIB on every core that helps (only one image is ever being loaded at a time).
+static TrackExtractor trackExtractor;
+
+static GCRCache* gcrCache = 0;
+
+// Only worked out while the quirk table has entries keyed by it.
+static bool legacyHashing = false;
+
+// An entry in the GCR cache is a header (GCR_CACHE_MAGIC, the converter version, the number of tracks, the image's hash and the
+// size of the arena the tracks need) and then each track listed in the NIB's header (its half track, density and length) and its bytes.
+#define GCR_CACHE_MAGIC 0x31524347	// "GCR1"
+#define GCR_CACHE_HEADER_SIZE 16
+#define GCR_CACHE_TRACK_HEADER_SIZE 4
+
 static const unsigned short SECTOR_LENGTH = 256;
 static const unsigned short SECTOR_LENGTH_WITH_CHECKSUM = 260;
 static const unsigned char GCR_SYNC_BYTE = 0xff;
 static const unsigned char GCR_GAP_BYTE = 0x55;
 static const int SECTOR_HEADER_LENGTH = 8;
 static const unsigned MAX_D64_SIZE = 0x30000;
+static const unsigned D64_ID_OFFSET = 0x165A2;	// Of the disk ID in the BAM (track 18 sector 0)
 static const unsigned MAX_D71_SIZE = 0x55600 + 1366;
 static const unsigned MAX_D81_SIZE = 822400;
 
+// Where the data of each physical sector is in a D81 track (as WriteD81 walks it); 32 bytes before the first sector
+// then for each sector 44 of header, 16 of sync and data mark, the data then 37 of CRC and gap.
+static const unsigned D81PhysicalSectors = 10;
+static const unsigned D81FirstSectorData = 32 + 44 + 16;
+static const unsigned D81SectorStride = 44 + 16 + D81_SECTOR_LENGTH + 37;
+static const unsigned D81TrackLength = 32 + D81PhysicalSectors * D81SectorStride;
+
 // CRC-16-CCITT
 // CRC(x) = x^16 + x^12 + x^5 + x^0
 unsigned short DiskImage::CRC1021[256] =
@@ -139,61 +190,258 @@ DiskImage::DiskImage()
 	, dirty(false)
 	, attachedImageSize(0)
 	, fileInfo(0)
+	, lastFlushBytes(0)
+	, lastFlushMicroseconds(0)
+	, writeBehindFailed(false)
+	, arena(0)
+	, arenaSize(0)
+	, arenaUsed(0)
+	, packed(0)
+	, packedSize(0)
+	, packedArena(0)
+	, unsaved(false)
+	, queueTrack(-1)
+	, queueSector(0)
+	, encodeSource(0)
+	, encodeErrors(0)
+{
+	memset(blankTrack, 0x55, sizeof(blankTrack));
+	memset(ownTracks, 0, sizeof(ownTracks));
+	FreeTracks();
+	memset(trackLengths, 0, sizeof(trackLengths));
+	memset(trackDirty, false, sizeof(trackDirty));
+	memset(trackUnsaved, false, sizeof(trackUnsaved));
+	memset(trackEncoded, true, sizeof(trackEncoded));
+	memset(trackIndexed, false, sizeof(trackIndexed));
+	hash = 0;
+	legacyHash = 0;
+}
+
+DiskImage::~DiskImage()
 {
-	memset(tracks, 0x55, sizeof(tracks));
+	FreeTracks();
 }
 
 void DiskImage::Close()
 {
+	// Its changes cannot be saved if there is not the memory to expand it.
+	if (!Unpack())
+		dirty = false;
+
 	switch (diskType)
 	{
 		case D64:
 			CloseD64();
-			memset(tracks, 0x55, sizeof(tracks));
 		break;
 		case G64:
 			CloseG64();
-			memset(tracks, 0x55, sizeof(tracks));
 		break;
 		case NIB:
 			CloseNIB();
-			memset(tracks, 0x55, sizeof(tracks));
 		break;
 		case NBZ:
 			CloseNBZ();
-			memset(tracks, 0x55, sizeof(tracks));
 		break;
 		case D71:
 			CloseD71();
-			memset(tracksD81, 0x55, sizeof(tracksD81));
 		break;
 		case D81:
 			CloseD81();
-			memset(tracksD81, 0, sizeof(tracksD81));
 		break;
 		case T64:
 			CloseT64();
-			memset(tracks, 0x55, sizeof(tracks));
 		break;
 		default:
-			memset(tracks, 0x55, sizeof(tracks));
 		break;
 	}
+	FreeTracks();
 	memset(trackLengths, 0, sizeof(trackLengths));
+	memset(trackDirty, false, sizeof(trackDirty));
+	memset(trackUnsaved, false, sizeof(trackUnsaved));
+	memset(trackEncoded, true, sizeof(trackEncoded));
+	memset(trackIndexed, false, sizeof(trackIndexed));
+	unsaved = false;
+	queueTrack = -1;
+	writeBehindFailed = false;
+	encodeSource = 0;
+	encodeErrors = 0;
 	diskType = NONE;
 	fileInfo = 0;
 	hash = 0;
+	legacyHash = 0;
+}
+
+bool DiskImage::AllocateArena(unsigned size)
+{
+	arena = (unsigned char*)malloc(size);
+	if (arena == 0)
+	{
+		DEBUG_LOG("Cannot allocate %d bytes for the tracks\r\n", size);
+		return false;
+	}
+	arenaSize = size;
+	arenaUsed = 0;
+	return true;
+}
+
+unsigned char* DiskImage::TakeFromArena(unsigned size)
+{
+	unsigned char* taken = arena + arenaUsed;
+	arenaUsed += size;
+	return taken;
+}
+
+// Gives the track capacity bytes of the arena followed by its flux index (which must be sized with TrackArenaSize).
+void DiskImage::PlaceTrack(unsigned track, unsigned capacity)
+{
+	tracks[track] = TakeFromArena(capacity);
+	fluxIndex[track] = TakeFromArena(TrackArenaSize(capacity) - capacity);
+	trackCapacity[track] = capacity;
+}
+
+// Gives back what was allocated for the arena but not used (when the track lengths were not known until the tracks were in it).
+void DiskImage::ShrinkArena()
+{
+	uintptr_t oldArena = (uintptr_t)arena;
+	unsigned char* newArena = (unsigned char*)realloc(arena, arenaUsed);
+
+	if (newArena == 0)
+		return;
+	arena = newArena;
+	RebaseArena(oldArena);
+	arenaSize = arenaUsed;
+}
+
+// Points whatever pointed into the arena when it was at oldArena at the same place in it now.
+void DiskImage::RebaseArena(uintptr_t oldArena)
+{
+	unsigned char** pointers[] = { tracks, fluxIndex, &tracksD81[0][0], &trackD81SyncBits[0][0], &encodeSource, &encodeErrors };
+	const unsigned counts[] = { HALF_TRACK_COUNT, HALF_TRACK_COUNT, HALF_TRACK_COUNT * 2, HALF_TRACK_COUNT * 2, 1, 1 };
+
+	for (unsigned array = 0; array < sizeof(counts) / sizeof(counts[0]); ++array)
+	{
+		for (unsigned index = 0; index < counts[array]; ++index)
+		{
+			uintptr_t offset = (uintptr_t)pointers[array][index] - oldArena;
+			if (offset < arenaSize)
+				pointers[array][index] = arena + offset;
+		}
+	}
+}
+
+bool DiskImage::Pack()
+{
+	static unsigned work[LZFAST_WORK_SIZE];
+
+	if (packed || arena == 0)
+		return true;
+
+	// What a D64 track that has not been written to holds can always be encoded again from encodeSource.
+	if (diskType == D64)
+	{
+		for (unsigned track = 0; track < HALF_TRACK_COUNT; track += 2)
+		{
+			if (trackCapacity[track] && ownTracks[track] == 0 && !trackDirty[track])
+			{
+				memset(tracks[track], 0, TrackArenaSize(trackCapacity[track]));
+				trackEncoded[track] = false;
+				trackIndexed[track] = false;
+			}
+		}
+	}
+
+	unsigned char* compressed = (unsigned char*)malloc(LZFAST_BOUND(arenaUsed));
+	if (compressed == 0)
+	{
+		DEBUG_LOG("Cannot allocate %d bytes to compress %s\r\n", LZFAST_BOUND(arenaUsed), GetName());
+		return false;
+	}
+	packedSize = LZFast_Compress(arena, compressed, arenaUsed, work);
+	packed = (unsigned char*)realloc(compressed, packedSize);
+	if (packed == 0)
+		packed = compressed;
+	packedArena = (uintptr_t)arena;
+	free(arena);
+	arena = 0;
+	return true;
+}
+
+bool DiskImage::Unpack()
+{
+	if (packed == 0)
+		return true;
+
+	unsigned char* expanded = (unsigned char*)malloc(arenaSize);
+	if (expanded == 0)
+	{
+		DEBUG_LOG("Cannot allocate %d bytes to expand %s\r\n", arenaSize, GetName());
+		return false;
+	}
+	if (LZFast_Uncompress(packed, expanded, packedSize, arenaSize) != (int)arenaUsed)
+	{
+		DEBUG_LOG("%s did not expand to what was compressed\r\n", GetName());
+		free(expanded);
+		return false;
+	}
+	arena = expanded;
+	RebaseArena(packedArena);
+	free(packed);
+	packed = 0;
+	packedSize = 0;
+	return true;
+}
+
+// A track not in the image (or too small for a save state's) is being written to so it needs storage of its own.
+bool DiskImage::OwnTrack(unsigned track)
+{
+	unsigned char* storage = (unsigned char*)malloc(TrackArenaSize(MAX_TRACK_LENGTH));
+
+	if (storage == 0)
+	{
+		DEBUG_LOG("Cannot allocate track %d\r\n", track);
+		return false;
+	}
+	memset(storage, 0x55, MAX_TRACK_LENGTH);
+	memcpy(storage, tracks[track], trackCapacity[track] ? trackCapacity[track] : MAX_TRACK_LENGTH);
+	free(ownTracks[track]);
+	ownTracks[track] = storage;
+	tracks[track] = storage;
+	fluxIndex[track] = storage + MAX_TRACK_LENGTH;
+	trackCapacity[track] = MAX_TRACK_LENGTH;
+	BuildFluxIndex(track);
+	return true;
+}
+
+void DiskImage::FreeTracks()
+{
+	for (unsigned track = 0; track < HALF_TRACK_COUNT; ++track)
+	{
+		free(ownTracks[track]);
+		ownTracks[track] = 0;
+		tracks[track] = blankTrack;
+		fluxIndex[track] = blankFluxIndex;
+		trackCapacity[track] = 0;
+		for (unsigned headIndex = 0; headIndex < 2; ++headIndex)
+		{
+			tracksD81[track][headIndex] = blankTrack;
+			trackD81SyncBits[track][headIndex] = blankSyncBits;
+		}
+	}
+	free(arena);
+	arena = 0;
+	arenaSize = 0;
+	arenaUsed = 0;
+	free(packed);
+	packed = 0;
+	packedSize = 0;
 }
 
 void DiskImage::DumpTrack(unsigned track)
 {
 
-#if defined(EXPERIMENTALZERO)
-	unsigned char* src = &tracks[track << 13];
-#else
 	unsigned char* src = tracks[track];
-#endif
 	unsigned trackLength = trackLengths[track];
+	PrepareTrack(track);
 	DEBUG_LOG("track = %d trackLength = %d\r\n", track, trackLength);
 	for (unsigned index = 0; index < trackLength; ++index)
 	{
@@ -201,13 +449,88 @@ void DiskImage::DumpTrack(unsigned track)
 	}
 }
 
+bool DiskImage::Load(const FILINFO* fileInfo, FIL* fp, DiskType diskType)
+{
+	switch (diskType)
+	{
+		case D64:
+			return LoadD64(fileInfo, fp);
+		case G64:
+			return LoadG64(fileInfo, fp);
+		case NIB:
+		case NBZ:
+			return LoadCachedNIB(fileInfo, fp, diskType);
+		case D81:
+			return LoadD81(fileInfo, fp);
+		case T64:
+		case PRG:
+			return LoadWhole(fileInfo, fp, diskType);
+		default:
+			return false;
+	}
+}
+
+// An NBZ is compressed as a whole and T64 and PRG files are made into a D64, so these are read whole first.
+bool DiskImage::LoadWhole(const FILINFO* fileInfo, FIL* fp, DiskType diskType)
+{
+	unsigned size = f_size(fp);
+	u32 bytesRead;
+	bool success = false;
+
+	if (size > READBUFFER_SIZE)
+		size = READBUFFER_SIZE;
+	unsigned char* diskImage = (unsigned char*)malloc(size);
+	if (diskImage == 0)
+		return false;
+
+	if (f_read(fp, diskImage, size, &bytesRead) == FR_OK)
+	{
+		switch (diskType)
+		{
+			case G64:
+				success = OpenG64(fileInfo, diskImage, bytesRead);
+				break;
+			case NBZ:
+				success = OpenNBZ(fileInfo, diskImage, bytesRead);
+				break;
+			case T64:
+				success = OpenT64(fileInfo, diskImage, bytesRead);
+				break;
+			case PRG:
+				success = OpenPRG(fileInfo, diskImage, bytesRead);
+				break;
+			default:
+				break;
+		}
+	}
+	free(diskImage);
+	return success;
+}
+
 bool DiskImage::OpenD64(const FILINFO* fileInfo, unsigned char* diskImage, unsigned size)
 {
-	unsigned char errorinfo[MAXBLOCKSONDISK];
-	unsigned last_track = MAXBLOCKSONDISK;
-	unsigned sector_ref;
-	unsigned char error;
+	if (!PlaceD64(fileInfo, size))
+		return false;
+
+	// The image is read into a buffer that is reused (eg for a new disk) so the tracks are encoded from a copy.
+	memcpy(encodeSource, diskImage, attachedImageSize);
+	return true;
+}
+
+bool DiskImage::LoadD64(const FILINFO* fileInfo, FIL* fp)
+{
+	u32 bytesRead;
 
+	if (!PlaceD64(fileInfo, f_size(fp)))
+		return false;
+
+	// Straight into the copy the tracks are encoded from (each only when it is first needed).
+	return f_read(fp, encodeSource, attachedImageSize, &bytesRead) == FR_OK && bytesRead == attachedImageSize;
+}
+
+// Lays a D64 of size bytes out in the arena, leaving its data to be put in encodeSource.
+bool DiskImage::PlaceD64(const FILINFO* fileInfo, unsigned size)
+{
 	Close();
 
 	this->fileInfo = fileInfo;
@@ -219,19 +542,19 @@ bool DiskImage::OpenD64(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 
 	attachedImageSize = size;
 
-	memset(errorinfo, SECTOR_OK, sizeof(errorinfo));
-
+	unsigned last_track;
+	unsigned errorsOffset = 0;
 	switch (size)
 	{
 		case (BLOCKSONDISK * 257):		// 35 track image with errorinfo
-			memcpy(errorinfo, diskImage + (BLOCKSONDISK * 256), BLOCKSONDISK);
+			errorsOffset = BLOCKSONDISK * 256;
 			/* FALLTHROUGH */
 		case (BLOCKSONDISK * 256):		// 35 track image w/o errorinfo
 			last_track = 35;
 			break;
 
 		case (MAXBLOCKSONDISK * 257):	// 40 track image with errorinfo
-			memcpy(errorinfo, diskImage + (MAXBLOCKSONDISK * 256), MAXBLOCKSONDISK);
+			errorsOffset = MAXBLOCKSONDISK * 256;
 			/* FALLTHROUGH */
 		case (MAXBLOCKSONDISK * 256):	// 40 track image w/o errorinfo
 			last_track = 40;
@@ -242,15 +565,23 @@ bool DiskImage::OpenD64(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 			break;
 	}
 
-	sector_ref = 0;
+	// Room for the tracks the image has data for, then the copy they are encoded from (which must reach the ID in the BAM and the end of the last track's sectors).
+	unsigned tracksSize = 0;
+	unsigned sourceSize = size > D64_ID_OFFSET + 2 ? size : D64_ID_OFFSET + 2;
+	for (unsigned track = 0; track < last_track && offset < size; ++track)
+	{
+		tracksSize += TrackArenaSize(SectorsPerTrack[track] * GCR_SECTOR_LENGTH);
+		offset += SectorsPerTrack[track] * SECTOR_LENGTH;
+	}
+	if (offset > sourceSize)
+		sourceSize = offset;
+	if (!AllocateArena(tracksSize + sourceSize))
+		return false;
+	offset = 0;
+
 	for (unsigned halfTrackIndex = 0; halfTrackIndex < last_track * 2; ++halfTrackIndex)
 	{
 		unsigned char track = (halfTrackIndex >> 1);
-#if defined(EXPERIMENTALZERO)
-		unsigned char* dest = &tracks[halfTrackIndex << 13];
-#else
-		unsigned char* dest = tracks[halfTrackIndex];
-#endif
 
 		trackLengths[halfTrackIndex] = SectorsPerTrack[track] * GCR_SECTOR_LENGTH;
 
@@ -259,16 +590,9 @@ bool DiskImage::OpenD64(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 			if (offset < size)	// This will allow for >35 tracks.
 			{
 				trackUsed[halfTrackIndex] = true;
-				//DEBUG_LOG("Track %d used\r\n", halfTrackIndex);
-				for (unsigned sectorNo = 0; sectorNo < SectorsPerTrack[track]; ++sectorNo)
-				{
-					error = errorinfo[sector_ref++];
-
-					convert_sector_to_GCR(diskImage + offset, dest, track + 1, sectorNo, diskImage + 0x165A2, error);
-					dest += 361;
-
-					offset += SECTOR_LENGTH;
-				}
+				trackEncoded[halfTrackIndex] = false;
+				PlaceTrack(halfTrackIndex, trackLengths[halfTrackIndex]);
+				offset += SectorsPerTrack[track] * SECTOR_LENGTH;
 			}
 			else
 			{
@@ -283,15 +607,300 @@ bool DiskImage::OpenD64(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 		}
 	}
 
+	encodeSource = TakeFromArena(sourceSize);
+	memset(encodeSource + size, 0, sourceSize - size);
+	if (errorsOffset)
+		encodeErrors = encodeSource + errorsOffset;
+
+	BuildFluxIndex();
 	diskType = D64;
 	return true;
 }
 
+void DiskImage::EncodeTrack(unsigned track)
+{
+	unsigned sectorRef = 0;
+
+	// Only whole tracks are ever encoded (track is even).
+	for (unsigned previous = 0; previous < (track >> 1); ++previous)
+		sectorRef += SectorsPerTrack[previous];
+	trackEncoded[track] = true;
+	trackIndexed[track] = false;
+
+	if (diskType == D71)
+	{
+		for (unsigned headIndex = 0; headIndex < 2; ++headIndex)
+		{
+			unsigned offset = (headIndex * BLOCKSONDISK + sectorRef) * SECTOR_LENGTH;
+			unsigned char* dest = tracksD81[track][headIndex];
+
+			if (offset >= attachedImageSize)
+				continue;
+			for (unsigned sectorNo = 0; sectorNo < SectorsPerTrack[track >> 1]; ++sectorNo)
+			{
+				convert_sector_to_GCR(encodeSource + offset, dest, (track >> 1) + 1, sectorNo, encodeSource + D64_ID_OFFSET, 0);
+				dest += 361;
+				offset += SECTOR_LENGTH;
+			}
+		}
+	}
+	else
+	{
+		unsigned offset = sectorRef * SECTOR_LENGTH;
+		unsigned char* dest = tracks[track];
+
+		for (unsigned sectorNo = 0; sectorNo < SectorsPerTrack[track >> 1]; ++sectorNo)
+		{
+			unsigned char error = encodeErrors ? encodeErrors[sectorRef++] : SECTOR_OK;
+
+			convert_sector_to_GCR(encodeSource + offset, dest, (track >> 1) + 1, sectorNo, encodeSource + D64_ID_OFFSET, error);
+			dest += 361;
+			offset += SECTOR_LENGTH;
+		}
+	}
+	BuildFluxIndex(track);
+}
+
+bool DiskImage::EncodeNearestTrack(unsigned track)
+{
+	for (unsigned distance = 0; distance < HALF_TRACK_COUNT; ++distance)
+	{
+		if (track >= distance && !trackEncoded[track - distance])
+		{
+			EncodeTrack(track - distance);
+			return true;
+		}
+		if (track + distance < HALF_TRACK_COUNT && !trackEncoded[track + distance])
+		{
+			EncodeTrack(track + distance);
+			return true;
+		}
+	}
+	return false;
+}
+
+void DiskImage::PrepareAllTracks()
+{
+	for (unsigned track = 0; track < HALF_TRACK_COUNT; ++track)
+	{
+		if (!trackUsed[track])
+			continue;
+		PrepareTrack(track);
+		if (!trackIndexed[track] && diskType != D71 && diskType != D81)
+			IndexSectors(track);
+	}
+}
+
+void DiskImage::SaveDirtyTracks(SaveStateWriter& writer) const
+{
+	writer.Write32(hash);
+	for (unsigned track = 0; track < HALF_TRACK_COUNT; ++track)
+	{
+		if (!trackDirty[track] || diskType == D81)
+			continue;
+		writer.Write8(track);
+		writer.Write8(trackDensity[track]);
+		writer.Write16(trackLengths[track]);
+		writer.WriteBytes(tracks[track], trackLengths[track]);
+	}
+}
+
+bool DiskImage::LoadDirtyTracks(SaveStateReader& reader)
+{
+	if (reader.Read32() != hash)
+	{
+		DEBUG_LOG("Save state is for a different disk\r\n");
+		return false;
+	}
+	while (!reader.AtEnd())
+	{
+		unsigned track = reader.Read8();
+		unsigned char density = reader.Read8();
+		unsigned length = reader.Read16();
+		if (reader.Failed() || track >= HALF_TRACK_COUNT || length > MAX_TRACK_LENGTH)
+			return false;
+		if (length > trackCapacity[track] && !OwnTrack(track))
+			return false;
+		reader.ReadBytes(tracks[track], length);
+		trackDensity[track] = density;
+		trackLengths[track] = length;
+		trackEncoded[track] = true;	// So that a D64 track is not encoded from encodeSource over it
+		trackIndexed[track] = false;
+		trackDirty[track] = true;
+		trackUnsaved[track] = true;
+		trackUsed[track] = true;
+		dirty = true;
+		unsaved = true;
+		BuildFluxIndex(track);
+	}
+	return !reader.Failed();
+}
+
+void DiskImage::BuildFluxIndex()
+{
+	for (unsigned track = 0; track < HALF_TRACK_COUNT; ++track)
+	{
+		if (trackEncoded[track])
+			BuildFluxIndex(track);
+		else
+			memset(fluxIndex[track], 0, TrackArenaSize(trackCapacity[track]) - trackCapacity[track]);	// Until it is encoded
+	}
+}
+
+void DiskImage::BuildFluxIndex(unsigned track)
+{
+	const unsigned char* data = tracks[track];
+	unsigned length = trackLengths[track];
+	unsigned zeroBlocks = 0;
+
+	if (trackCapacity[track] == 0)
+		return;	// The blank track's index is all 0s
+
+	// Backwards so that each block knows how long the gap after it is.
+	for (int block = (length + FLUX_INDEX_BLOCK - 1) / FLUX_INDEX_BLOCK - 1; block >= 0; --block)
+	{
+		unsigned end = (block + 1) * FLUX_INDEX_BLOCK;
+		unsigned char bits = 0;
+		for (unsigned byte = block * FLUX_INDEX_BLOCK; byte < end && byte < length; ++byte)
+			bits |= data[byte];
+		if (bits)
+			zeroBlocks = 0;
+		else if (zeroBlocks < 255)
+			zeroBlocks++;
+		fluxIndex[track][block] = zeroBlocks;
+	}
+}
+
+// A 1 has been written into a block that had none so the gaps leading up to it are now shorter.
+void DiskImage::MarkFlux(unsigned track, unsigned byte)
+{
+	int block = byte / FLUX_INDEX_BLOCK;
+
+	for (unsigned gap = 0; block >= 0 && fluxIndex[track][block] > gap; --block, ++gap)
+		fluxIndex[track][block] = gap;
+}
+
+unsigned DiskImage::BitsToFlux(unsigned track, unsigned bitOffset) const
+{
+	const unsigned char* data = tracks[track];
+	unsigned length = trackLengths[track];
+	unsigned next = bitOffset + 1;
+
+	if (next >= (length << 3))
+		return 1;	// The next bit is the first of the track
+
+	unsigned byte = next >> 3;
+	unsigned char bits = data[byte] & (0xff >> (next & 7));	// Bits are read from the MSB
+	while (bits == 0)
+	{
+		if ((++byte & (FLUX_INDEX_BLOCK - 1)) == 0)
+			byte += fluxIndex[track][byte / FLUX_INDEX_BLOCK] * FLUX_INDEX_BLOCK;
+		if (byte >= length)
+			return (length << 3) - bitOffset;	// Nothing more this revolution so look again at the first bit
+		bits = data[byte];
+	}
+	return (byte << 3) + __builtin_clz(bits) - 24 - bitOffset;
+}
+
+static FRESULT WriteAt(FIL* fp, unsigned offset, const unsigned char* data, unsigned length)
+{
+	u32 bytesWritten;
+	FRESULT res = f_lseek(fp, offset);
+
+	if (res == FR_OK)
+		res = f_write(fp, data, length, &bytesWritten);
+	if (res == FR_OK && bytesWritten != length)
+		res = FR_DISK_ERR;
+	return res;
+}
+
+// Decodes a sector of a D64 track and brings encodeSource up to date with it. Returns false if it has not changed.
+// clearError is set if it was opened with an error that it no longer has (its error info is brought up to date as well).
+bool DiskImage::UpdateD64Sector(unsigned track, unsigned sector, unsigned sectorRef, bool& clearError)
+{
+	unsigned char data[SECTOR_LENGTH];
+	unsigned char* original = encodeSource + (sectorRef + sector) * SECTOR_LENGTH;
+
+	// A sector whose header cannot be found is left as it was.
+	memcpy(data, original, SECTOR_LENGTH);
+	bool good = ConvertSector(track, sector, data);
+	if (memcmp(data, original, SECTOR_LENGTH) == 0)
+		return false;
+
+	memcpy(original, data, SECTOR_LENGTH);
+	clearError = good && encodeErrors && encodeErrors[sectorRef + sector] != SECTOR_OK;
+	if (clearError)
+		encodeErrors[sectorRef + sector] = SECTOR_OK;
+	return true;
+}
+
+// Writes only the sectors of the tracks written to that now differ from the image as it was opened (or last written back).
+// Returns false if it cannot be written back that way (eg a track has been written to that the file does not have).
+bool DiskImage::WriteD64Sectors()
+{
+	unsigned dataSize = D64DataSize();
+	unsigned sectorRef = 0;
+	unsigned bytesWritten = 0;
+	FRESULT res = FR_OK;
+	FIL fp;
+
+	if (fileInfo == 0 || encodeSource == 0)
+		return false;
+	for (unsigned track = 0; track < HALF_TRACK_COUNT; track += 2)
+	{
+		sectorRef += SectorsPerTrack[track >> 1];
+		if (trackDirty[track] && sectorRef * SECTOR_LENGTH > dataSize)
+			return false;
+	}
+
+	u32 start = read32(ARM_SYSTIMER_CLO);
+	if (f_open(&fp, fileInfo->fname, FA_WRITE) != FR_OK)
+		return false;
+
+	SetACTLed(true);
+	sectorRef = 0;
+	for (unsigned track = 0; track < HALF_TRACK_COUNT && res == FR_OK; sectorRef += SectorsPerTrack[track >> 1], track += 2)
+	{
+		if (!trackDirty[track] || IsWrittenBehind(track))
+			continue;
+
+		for (unsigned sector = 0; sector < SectorsPerTrack[track >> 1] && res == FR_OK; ++sector)
+		{
+			unsigned offset = (sectorRef + sector) * SECTOR_LENGTH;
+			bool clearError;
+
+			if (!UpdateD64Sector(track, sector, sectorRef, clearError))
+				continue;
+
+			res = WriteAt(&fp, offset, encodeSource + offset, SECTOR_LENGTH);
+			bytesWritten += SECTOR_LENGTH;
+
+			// Rewritten so it no longer has the error it was opened with.
+			if (res == FR_OK && clearError)
+			{
+				res = WriteAt(&fp, dataSize + sectorRef + sector, &encodeErrors[sectorRef + sector], 1);
+				bytesWritten++;
+			}
+		}
+	}
+	f_close(&fp);
+	SetACTLed(false);
+
+	lastFlushBytes = bytesWritten;
+	lastFlushMicroseconds = read32(ARM_SYSTIMER_CLO) - start;
+	DEBUG_LOG("Wrote %d bytes back to %s in %dus\r\n", bytesWritten, fileInfo->fname, lastFlushMicroseconds);
+	return res == FR_OK;
+}
+
 bool DiskImage::WriteD64(char* name)
 {
 	if (readOnly)
 		return true;
 
+	// Once something written behind has been lost encodeSource no longer matches the file.
+	if (name == 0 && !writeBehindFailed && WriteD64Sectors())
+		return true;
+
 	FIL fp;
 	FRESULT res = f_open(&fp, fileInfo ? fileInfo->fname : name, FA_CREATE_ALWAYS | FA_WRITE);
 	if (res == FR_OK)
@@ -371,19 +980,33 @@ bool DiskImage::OpenD71(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 
 	this->fileInfo = fileInfo;
 
-	unsigned offset = 0;
-
 	if (size > MAX_D71_SIZE)
 		size = MAX_D71_SIZE;
 
+	// Both sides of each track then the copy they are encoded from.
+	unsigned tracksSize = 0;
+	for (unsigned track = 0; track < D71_HALF_TRACK_COUNT / 2; ++track)
+		tracksSize += 2 * SectorsPerTrack[track] * GCR_SECTOR_LENGTH;
+	if (!AllocateArena(tracksSize + MAX_D71_SIZE))
+		return false;
+	for (unsigned halfTrackIndex = 0; halfTrackIndex < D71_HALF_TRACK_COUNT; halfTrackIndex += 2)
+	{
+		for (unsigned headIndex = 0; headIndex < 2; ++headIndex)
+			tracksD81[halfTrackIndex][headIndex] = TakeFromArena(SectorsPerTrack[halfTrackIndex >> 1] * GCR_SECTOR_LENGTH);
+	}
+	encodeSource = TakeFromArena(MAX_D71_SIZE);
+	memcpy(encodeSource, diskImage, size);
+	memset(encodeSource + size, 0, MAX_D71_SIZE - size);
+
 	attachedImageSize = size;
 
 	for (unsigned headIndex = 0; headIndex < 2; ++headIndex)
 	{
+		unsigned offset = headIndex * BLOCKSONDISK * SECTOR_LENGTH;
+
 		for (unsigned halfTrackIndex = 0; halfTrackIndex < D71_HALF_TRACK_COUNT; ++halfTrackIndex)
 		{
 			unsigned char track = (halfTrackIndex >> 1);
-			unsigned char* dest = tracksD81[halfTrackIndex][headIndex];
 
 			trackLengths[halfTrackIndex] = SectorsPerTrack[track] * GCR_SECTOR_LENGTH;
 
@@ -392,14 +1015,8 @@ bool DiskImage::OpenD71(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 				if (offset < size)	// This will allow for >35 tracks.
 				{
 					trackUsed[halfTrackIndex] = true;
-					//DEBUG_LOG("Track %d used\r\n", halfTrackIndex);
-					for (unsigned sectorNo = 0; sectorNo < SectorsPerTrack[track]; ++sectorNo)
-					{
-						convert_sector_to_GCR(diskImage + offset, dest, track + 1, sectorNo, diskImage + 0x165A2, 0);
-						dest += 361;
-
-						offset += SECTOR_LENGTH;
-					}
+					trackEncoded[halfTrackIndex] = false;
+					offset += SectorsPerTrack[track] * SECTOR_LENGTH;
 				}
 				else
 				{
@@ -415,6 +1032,7 @@ bool DiskImage::OpenD71(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 		}
 	}
 
+	BuildFluxIndex();
 	diskType = D71;
 	return true;
 }
@@ -500,31 +1118,70 @@ void DiskImage::CloseD71()
 
 bool DiskImage::OpenD81(const FILINFO* fileInfo, unsigned char* diskImage, unsigned size)
 {
-	const unsigned physicalSectors = 10;
-	unsigned char headIndex;
-	unsigned headPos;
+	if (!PlaceD81(fileInfo, size))
+		return false;
+
+	unsigned char* src = diskImage;
+	for (unsigned trackIndex = 0; trackIndex < D81_TRACK_COUNT; ++trackIndex)
+		ConvertD81Track(trackIndex, src);
+
+	diskType = D81;
+	return true;
+}
+
+bool DiskImage::LoadD81(const FILINFO* fileInfo, FIL* fp)
+{
+	u32 bytesRead;
+
+	if (!PlaceD81(fileInfo, f_size(fp)))
+		return false;
 
+	// A track at a time, each converted as soon as it has been read (past the end of the file reads as 0s).
+	for (unsigned trackIndex = 0; trackIndex < D81_TRACK_COUNT; ++trackIndex)
+	{
+		if (f_read(fp, loadBuffer, 2 * D81PhysicalSectors * D81_SECTOR_LENGTH, &bytesRead) != FR_OK)
+			return false;
+		memset(loadBuffer + bytesRead, 0, 2 * D81PhysicalSectors * D81_SECTOR_LENGTH - bytesRead);
+
+		unsigned char* src = loadBuffer;
+		ConvertD81Track(trackIndex, src);
+	}
+
+	diskType = D81;
+	return true;
+}
+
+// Each side of each track and its sync bits.
+bool DiskImage::PlaceD81(const FILINFO* fileInfo, unsigned size)
+{
 	Close();
 
 	this->fileInfo = fileInfo;
 
-	unsigned offsetSource = 0;
-
 	if (size > MAX_D81_SIZE)
 		size = MAX_D81_SIZE;
 
 	attachedImageSize = size;
 
-	unsigned char* src = diskImage;
+	return AllocateArena(D81_TRACK_COUNT * 2 * (D81TrackLength + ((D81TrackLength + 7) >> 3)));
+}
 
-	for (unsigned trackIndex = 0; trackIndex < D81_TRACK_COUNT; ++trackIndex)
-	{
-		unsigned offsetDest = 0;
-		unsigned index;
+// Builds both sides of a track from the 20 sectors at src (and moves src past them).
+void DiskImage::ConvertD81Track(unsigned trackIndex, unsigned char*& src)
+{
+	const unsigned physicalSectors = 10;
+	const unsigned syncBitsLength = (D81TrackLength + 7) >> 3;
+	unsigned char headIndex;
+	unsigned headPos;
+	unsigned index;
 
-		trackUsed[trackIndex] = true;
-		memset(trackD81SyncBits[trackIndex][0], 0, MAX_TRACK_LENGTH >> 3);
-		memset(trackD81SyncBits[trackIndex][1], 0, MAX_TRACK_LENGTH >> 3);
+	trackUsed[trackIndex] = true;
+	for (headIndex = 0; headIndex < 2; ++headIndex)
+	{
+		tracksD81[trackIndex][headIndex] = TakeFromArena(D81TrackLength);
+		trackD81SyncBits[trackIndex][headIndex] = TakeFromArena(syncBitsLength);
+		memset(trackD81SyncBits[trackIndex][headIndex], 0, syncBitsLength);
+	}
 //32x	4e
 // For 10 sectors
 //		12x	00	// SYNC
@@ -625,70 +1282,193 @@ bool DiskImage::OpenD81(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 // 54f00 21 00		- 22 39d
 // 55000 23 01
 
-		unsigned int physicalSectorIndex;
+	unsigned int physicalSectorIndex;
+
+	// (sectors 20 - 39 are on physical side 2)
+	for (headIndex = 0; headIndex < 2; ++headIndex)
+	{
+		unsigned char* dest = tracksD81[trackIndex][headIndex];
+		memset(dest, 0x4e, 32); dest += 32;
+		for (physicalSectorIndex = 0; physicalSectorIndex < physicalSectors; ++physicalSectorIndex)
+		{
+			// If a sequence of zeros followed by a sequence of three Sync Bytes is found, then the PLL(phase locked loop) and data separator are synchronized and data bytes can be read.
+
+			memset(dest, 0, 12); dest += 12;	// SYNC - This sequence provides to the DPLL enough time to adjust the frequency and center the inspection window.
+
+			headPos = dest - tracksD81[trackIndex][headIndex];
+			SetD81SyncBit(trackIndex, headIndex, headPos++, true);
+			SetD81SyncBit(trackIndex, headIndex, headPos++, true);
+			SetD81SyncBit(trackIndex, headIndex, headPos++, true);
+
+			// The CRC includes all information starting with the address mark and up to the CRC characters.
+			// The CRC Register is preset to ones.
+			crc = 0xffff;
+
+			OutputD81HeaderByte(dest, 0xa1);	// Special bytes are encoded that violates the MFM encoding rules with a missing clock in one of the sequential zero bits.
+			OutputD81HeaderByte(dest, 0xa1);
+			OutputD81HeaderByte(dest, 0xa1);
+			OutputD81HeaderByte(dest, 0xfe);	// Header ID
+			OutputD81HeaderByte(dest, (unsigned char)trackIndex);	// 0 indexed
+			OutputD81HeaderByte(dest, headIndex);
+			OutputD81HeaderByte(dest, (unsigned char)physicalSectorIndex + 1);	// 1 indexed
+			OutputD81HeaderByte(dest, 2);		// sector length code (0=128, 1=256, 2=512, 3=1024)
+			*dest++ = (unsigned char)(crc >> 8);
+			*dest++ = (unsigned char)(crc & 0xff);
+			memset(dest, 0x4e, 22); dest += 22;
+
+			memset(dest, 0, 12); dest += 12;	// SYNC
+
+			headPos = dest - tracksD81[trackIndex][headIndex];
+			SetD81SyncBit(trackIndex, headIndex, headPos++, true);
+			SetD81SyncBit(trackIndex, headIndex, headPos++, true);
+			SetD81SyncBit(trackIndex, headIndex, headPos++, true);
+
+			// The CRC Register is preset to ones.
+			crc = 0xffff;
+			OutputD81HeaderByte(dest, 0xa1);
+			OutputD81HeaderByte(dest, 0xa1);
+			OutputD81HeaderByte(dest, 0xa1);
+			OutputD81HeaderByte(dest, 0xfb);		// Data ID
+
+			for (index = 0; index < D81_SECTOR_LENGTH; ++index)
+			{
+				OutputD81DataByte(src, dest);
+			}
+
+			*dest++ = (unsigned char)(crc >> 8);
+			*dest++ = (unsigned char)(crc & 0xff);
+
+			memset(dest, 0x4e, 35); dest += 35;
+		}
+
+		trackLengths[trackIndex] = dest - tracksD81[trackIndex][headIndex];
+	}
+}
+
+// Writes only the sectors of the tracks written to that differ from those in the file.
+bool DiskImage::WriteD81Sectors()
+{
+	const unsigned physicalSectors = D81PhysicalSectors;
+	unsigned char original[D81_SECTOR_LENGTH];
+	unsigned bytesWritten = 0;
+	FRESULT res = FR_OK;
+	FIL fp;
+
+	if (fileInfo == 0)
+		return false;
+
+	u32 start = read32(ARM_SYSTIMER_CLO);
+	if (f_open(&fp, fileInfo->fname, FA_READ | FA_WRITE) != FR_OK)
+		return false;
+
+	SetACTLed(true);
+	for (unsigned trackIndex = 0; trackIndex < D81_TRACK_COUNT && res == FR_OK; ++trackIndex)
+	{
+		// Once something written behind has been lost a track that was queued may not have reached the file (only sectors that differ are written).
+		if (!trackDirty[trackIndex] || trackLengths[trackIndex] == 0 || (!writeBehindFailed && IsWrittenBehind(trackIndex)))
+			continue;
+
+		// (sectors 20 - 39 are on physical side 2)
+		for (unsigned headIndex = 0; headIndex < 2 && res == FR_OK; ++headIndex)
+		{
+			for (unsigned physicalSectorIndex = 0; physicalSectorIndex < physicalSectors && res == FR_OK; ++physicalSectorIndex)
+			{
+				const unsigned char* data = tracksD81[trackIndex][headIndex] + D81FirstSectorData + physicalSectorIndex * D81SectorStride;
+				unsigned offset = ((trackIndex * 2 + headIndex) * physicalSectors + physicalSectorIndex) * D81_SECTOR_LENGTH;
+				u32 bytesRead = 0;
+
+				res = f_lseek(&fp, offset);
+				if (res == FR_OK)
+					res = f_read(&fp, original, D81_SECTOR_LENGTH, &bytesRead);
+				if (res != FR_OK || (bytesRead == D81_SECTOR_LENGTH && memcmp(data, original, D81_SECTOR_LENGTH) == 0))
+					continue;
+
+				res = WriteAt(&fp, offset, data, D81_SECTOR_LENGTH);
+				bytesWritten += D81_SECTOR_LENGTH;
+			}
+		}
+	}
+	f_close(&fp);
+	SetACTLed(false);
+
+	lastFlushBytes = bytesWritten;
+	lastFlushMicroseconds = read32(ARM_SYSTIMER_CLO) - start;
+	DEBUG_LOG("Wrote %d bytes back to %s in %dus\r\n", bytesWritten, fileInfo->fname, lastFlushMicroseconds);
+	return res == FR_OK;
+}
+
+bool DiskImage::QueueUnsavedSector(WriteBehind& writeBehind)
+{
+	if (readOnly || fileInfo == 0 || writeBehindFailed || (diskType != D64 && diskType != D81))
+		return false;
+
+	if (queueTrack < 0)
+	{
+		for (unsigned track = 0; track < HALF_TRACK_COUNT && unsaved && queueTrack < 0; ++track)
+		{
+			if (trackUnsaved[track])
+			{
+				// Anything written to the track from now on has it looked at again.
+				trackUnsaved[track] = false;
+				queueTrack = track;
+				queueSector = 0;
+			}
+		}
+		if (queueTrack < 0)
+		{
+			unsaved = false;
+			return false;
+		}
+	}
 
-		// (sectors 20 - 39 are on physical side 2)
-		for (headIndex = 0; headIndex < 2; ++headIndex)
+	unsigned track = queueTrack;
+	unsigned sectors;
+	if (diskType == D81)
+	{
+		sectors = D81PhysicalSectors * 2;
+		if (track < D81_TRACK_COUNT && trackLengths[track] != 0)
 		{
-			unsigned char* dest = tracksD81[trackIndex][headIndex];
-			memset(dest, 0x4e, 32); dest += 32;
-			for (physicalSectorIndex = 0; physicalSectorIndex < physicalSectors; ++physicalSectorIndex)
-			{
-				// If a sequence of zeros followed by a sequence of three Sync Bytes is found, then the PLL(phase locked loop) and data separator are synchronized and data bytes can be read.
-
-				memset(dest, 0, 12); dest += 12;	// SYNC - This sequence provides to the DPLL enough time to adjust the frequency and center the inspection window.
-
-				headPos = dest - tracksD81[trackIndex][headIndex];
-				SetD81SyncBit(trackIndex, headIndex, headPos++, true);
-				SetD81SyncBit(trackIndex, headIndex, headPos++, true);
-				SetD81SyncBit(trackIndex, headIndex, headPos++, true);
-
-				// The CRC includes all information starting with the address mark and up to the CRC characters.
-				// The CRC Register is preset to ones.
-				crc = 0xffff;
-
-				OutputD81HeaderByte(dest, 0xa1);	// Special bytes are encoded that violates the MFM encoding rules with a missing clock in one of the sequential zero bits.
-				OutputD81HeaderByte(dest, 0xa1);
-				OutputD81HeaderByte(dest, 0xa1);
-				OutputD81HeaderByte(dest, 0xfe);	// Header ID
-				OutputD81HeaderByte(dest, (unsigned char)trackIndex);	// 0 indexed
-				OutputD81HeaderByte(dest, headIndex);
-				OutputD81HeaderByte(dest, (unsigned char)physicalSectorIndex + 1);	// 1 indexed
-				OutputD81HeaderByte(dest, 2);		// sector length code (0=128, 1=256, 2=512, 3=1024)
-				*dest++ = (unsigned char)(crc >> 8);
-				*dest++ = (unsigned char)(crc & 0xff);
-				memset(dest, 0x4e, 22); dest += 22;
-
-				memset(dest, 0, 12); dest += 12;	// SYNC
-
-				headPos = dest - tracksD81[trackIndex][headIndex];
-				SetD81SyncBit(trackIndex, headIndex, headPos++, true);
-				SetD81SyncBit(trackIndex, headIndex, headPos++, true);
-				SetD81SyncBit(trackIndex, headIndex, headPos++, true);
-
-				// The CRC Register is preset to ones.
-				crc = 0xffff;
-				OutputD81HeaderByte(dest, 0xa1);
-				OutputD81HeaderByte(dest, 0xa1);
-				OutputD81HeaderByte(dest, 0xa1);
-				OutputD81HeaderByte(dest, 0xfb);		// Data ID
-
-				for (index = 0; index < D81_SECTOR_LENGTH; ++index)
-				{
-					OutputD81DataByte(src, dest);
-				}
+			unsigned headIndex = queueSector / D81PhysicalSectors;
+			unsigned physicalSectorIndex = queueSector % D81PhysicalSectors;
+			unsigned offset = ((track * 2 + headIndex) * D81PhysicalSectors + physicalSectorIndex) * D81_SECTOR_LENGTH;
+			if (!writeBehind.Queue(this, offset, tracksD81[track][headIndex] + D81FirstSectorData + physicalSectorIndex * D81SectorStride, D81_SECTOR_LENGTH))
+				return false;
+		}
+		else
+		{
+			queueSector = sectors;
+		}
+	}
+	else
+	{
+		unsigned sectorRef = 0;
+		for (unsigned trackIndex = 0; trackIndex < track >> 1; ++trackIndex)
+			sectorRef += SectorsPerTrack[trackIndex];
+		sectors = SectorsPerTrack[track >> 1];
 
-				*dest++ = (unsigned char)(crc >> 8);
-				*dest++ = (unsigned char)(crc & 0xff);
+		// Half tracks and tracks the file does not have are left for when it is closed.
+		if ((track & 1) == 0 && (sectorRef + sectors) * SECTOR_LENGTH <= D64DataSize())
+		{
+			unsigned offset = (sectorRef + queueSector) * SECTOR_LENGTH;
+			bool clearError;
 
-				memset(dest, 0x4e, 35); dest += 35;
+			if (writeBehind.Free() < 2)
+				return false;
+			if (UpdateD64Sector(track, queueSector, sectorRef, clearError))
+			{
+				writeBehind.Queue(this, offset, encodeSource + offset, SECTOR_LENGTH);
+				if (clearError)
+					writeBehind.Queue(this, D64DataSize() + sectorRef + queueSector, &encodeErrors[sectorRef + queueSector], 1);
 			}
-
-			trackLengths[trackIndex] = dest - tracksD81[trackIndex][headIndex];
+		}
+		else
+		{
+			queueSector = sectors;
 		}
 	}
 
-	diskType = D81;
+	if (++queueSector >= sectors)
+		queueTrack = -1;
 	return true;
 }
 
@@ -699,6 +1479,9 @@ bool DiskImage::WriteD81()
 	if (readOnly)
 		return true;
 
+	if (WriteD81Sectors())
+		return true;
+
 	FIL fp;
 	FRESULT res = f_open(&fp, fileInfo->fname, FA_CREATE_ALWAYS | FA_WRITE);
 	if (res == FR_OK)
@@ -810,7 +1593,10 @@ bool DiskImage::OpenG64(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 
 	if (memcmp(diskImage, "GCR-1541", 8) == 0)
 	{
-		hash = HashBuffer(diskImage, size);
+		ImageHash fileHash(legacyHashing);
+		fileHash.Add(diskImage, size);
+		hash = fileHash.Value();
+		legacyHash = fileHash.LegacyValue();
 
 		//DEBUG_LOG("Is G64 %08x\r\n", hash);
 
@@ -823,6 +1609,20 @@ bool DiskImage::OpenG64(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 
 		unsigned track;
 
+		// Room for the tracks that are in the image.
+		unsigned tracksSize = 0;
+		for (track = 0; track < numTracks; ++track)
+		{
+			unsigned offset = *(unsigned*)(data + track * 4);
+			if (offset != 0)
+			{
+				trackLength = *(unsigned short*)(diskImage + offset);
+				tracksSize += TrackArenaSize(trackLength > MAX_TRACK_LENGTH ? MAX_TRACK_LENGTH : trackLength);
+			}
+		}
+		if (!AllocateArena(tracksSize))
+			return false;
+
 		for (track = 0; track < numTracks; ++track)
 		{
 			unsigned offset = *(unsigned*)data;
@@ -844,23 +1644,138 @@ bool DiskImage::OpenG64(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 				trackLength = *(unsigned short*)(trackData);
 				//DEBUG_LOG("trackLength = %d offset = %d\r\n", trackLength, offset);
 				trackData += 2;
+				if (trackLength > MAX_TRACK_LENGTH)
+					trackLength = MAX_TRACK_LENGTH;
 				trackLengths[track] = trackLength;
-#if defined(EXPERIMENTALZERO)
-				memcpy(&tracks[track << 13], trackData, trackLength);
-#else
+				PlaceTrack(track, trackLength);
 				memcpy(tracks[track], trackData, trackLength);
-#endif
 				trackUsed[track] = true;
 				//DEBUG_LOG("%d has data\r\n", track);
 			}
 		}
 
+		BuildFluxIndex();
 		diskType = G64;
 		return true;
 	}
 	return false;
 }
 
+// Reads through length bytes of the file that are not wanted, only hashing them.
+static bool SkipHashing(FIL* fp, unsigned length, ImageHash& hash)
+{
+	u32 bytesRead;
+
+	while (length)
+	{
+		unsigned chunk = length < LOAD_BUFFER_SIZE ? length : LOAD_BUFFER_SIZE;
+		if (f_read(fp, loadBuffer, chunk, &bytesRead) != FR_OK || bytesRead != chunk)
+			return false;
+		hash.Add(loadBuffer, chunk);
+		length -= chunk;
+	}
+	return true;
+}
+
+// Reads each track straight into the arena in the order they are in the file (hashing all of the file on the way).
+// Tracks that overlap (or run past the end of the file) have it read whole instead.
+bool DiskImage::LoadG64(const FILINFO* fileInfo, FIL* fp)
+{
+	const unsigned speedZones = 0x15c;
+	u32 headerWords[(speedZones + HALF_TRACK_COUNT * 4) / 4];
+	unsigned char* header = (unsigned char*)headerWords;
+	unsigned offsets[HALF_TRACK_COUNT];
+	unsigned char order[HALF_TRACK_COUNT];
+	unsigned short capacities[HALF_TRACK_COUNT];
+	unsigned size = f_size(fp);
+	unsigned tracksInImage = 0;
+	unsigned index;
+	unsigned track;
+	u32 bytesRead;
+
+	Close();
+
+	this->fileInfo = fileInfo;
+
+	attachedImageSize = size;
+
+	memset(headerWords, 0, sizeof(headerWords));
+	if (f_read(fp, header, 12, &bytesRead) != FR_OK || memcmp(header, "GCR-1541", 8) != 0)
+		return false;
+	unsigned numTracks = header[9] < HALF_TRACK_COUNT ? header[9] : HALF_TRACK_COUNT;
+	unsigned headerSize = speedZones + numTracks * 4;
+	if (f_read(fp, header + 12, headerSize - 12, &bytesRead) != FR_OK)
+		return false;
+	ImageHash fileHash(legacyHashing);
+	fileHash.Add(header, 12 + bytesRead);
+
+	for (track = 0; track < numTracks; ++track)
+	{
+		unsigned offset = headerWords[3 + track];
+
+		trackDensity[track] = headerWords[speedZones / 4 + track];
+		if (offset == 0)
+		{
+			trackLengths[track] = capacity_max[trackDensity[track]];
+			trackUsed[track] = false;
+			continue;
+		}
+		for (index = tracksInImage++; index && offsets[index - 1] > offset; --index)
+		{
+			offsets[index] = offsets[index - 1];
+			order[index] = order[index - 1];
+		}
+		offsets[index] = offset;
+		order[index] = track;
+	}
+
+	// Each track can have no more room than there is up to the next.
+	unsigned tracksSize = 0;
+	for (index = 0; index < tracksInImage; ++index)
+	{
+		unsigned end = index + 1 < tracksInImage ? offsets[index + 1] : size;
+		if (offsets[index] < headerSize || end < offsets[index] + 2)
+			return f_lseek(fp, 0) == FR_OK && LoadWhole(fileInfo, fp, G64);
+		unsigned capacity = end - offsets[index] - 2;
+		capacities[index] = capacity > MAX_TRACK_LENGTH ? MAX_TRACK_LENGTH : capacity;
+		tracksSize += TrackArenaSize(capacities[index]);
+	}
+	if (!AllocateArena(tracksSize))
+		return false;
+
+	unsigned position = headerSize;
+	for (index = 0; index < tracksInImage; ++index)
+	{
+		unsigned short trackLength;
+
+		track = order[index];
+		if (!SkipHashing(fp, offsets[index] - position, fileHash) || f_read(fp, &trackLength, 2, &bytesRead) != FR_OK || bytesRead != 2)
+			return false;
+		fileHash.Add(&trackLength, 2);
+		if (trackLength > MAX_TRACK_LENGTH)
+			trackLength = MAX_TRACK_LENGTH;
+		if (trackLength > capacities[index])
+			return f_lseek(fp, 0) == FR_OK && LoadWhole(fileInfo, fp, G64);
+
+		trackLengths[track] = trackLength;
+		PlaceTrack(track, trackLength);
+		if (f_read(fp, tracks[track], trackLength, &bytesRead) != FR_OK || bytesRead != trackLength)
+			return false;
+		fileHash.Add(tracks[track], trackLength);
+		trackUsed[track] = true;
+		position = offsets[index] + 2 + trackLength;
+	}
+	if (!SkipHashing(fp, size - position, fileHash))
+		return false;
+	hash = fileHash.Value();
+	legacyHash = fileHash.LegacyValue();
+
+	ShrinkArena();
+	BuildFluxIndex();
+	diskType = G64;
+	return true;
+}
+
 static bool WriteDwords(FIL* fp, u32* values, u32 amount)
 {
 	u32 index;
@@ -948,11 +1863,7 @@ bool DiskImage::WriteG64(char* name)
 
 			gcr_track[0] = (BYTE)(track_len % 256);
 			gcr_track[1] = (BYTE)(track_len / 256);
-#if defined(EXPERIMENTALZERO)
-			memcpy(buffer, &tracks[track << 13], track_len);
-#else
 			memcpy(buffer, tracks[track], track_len);
-#endif
 
 			memcpy(gcr_track + 2, buffer, track_len);
 			bytesToWrite = G64_TRACK_MAXLEN + 2;
@@ -992,7 +1903,7 @@ void DiskImage::CloseG64()
 
 bool DiskImage::OpenNIB(const FILINFO* fileInfo, unsigned char* diskImage, unsigned size)
 {
-	int track, t_index = 0, h_index = 0;
+	int t_index = 0, h_index = 0;
 	Close();
 
 	this->fileInfo = fileInfo;
@@ -1001,51 +1912,295 @@ bool DiskImage::OpenNIB(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 
 	if (memcmp(diskImage, "MNIB-1541-RAW", 13) == 0)
 	{
+		if (!PlaceNIB(diskImage))
+			return false;
+		hash = ImageHash::Of(diskImage, size);
 
-		for (track = 0; track < (MAX_TRACKS_1541 * 2); ++track)
-		{
-			trackLengths[track] = capacity_max[trackDensity[track]];
-			trackUsed[track] = false;
-		}
-
+		trackExtractor.Begin();
 		while (diskImage[0x10 + h_index])
 		{
-			track = diskImage[0x10 + h_index] - 2;
-			unsigned char v = diskImage[0x11 + h_index];
-			trackDensity[track] = (v & 0x03);
-
-			DEBUG_LOG("Converting NIB track %d (%d.%d)\r\n", track, track >> 1, track & 1 ? 5 : 0);
-
 			unsigned char* nibdata = diskImage + (t_index * NIB_TRACK_LENGTH) + 0x100;
-			int align;
-#if defined(EXPERIMENTALZERO)
-			trackLengths[track] = extract_GCR_track(&tracks[track << 13], nibdata, &align
-				//, ALIGN_GAP
-				, ALIGN_NONE
-				, capacity_min[trackDensity[track]],
-				capacity_max[trackDensity[track]]);
-#else
-			trackLengths[track] = extract_GCR_track(tracks[track], nibdata, &align
-				//, ALIGN_GAP
-				, ALIGN_NONE
-				, capacity_min[trackDensity[track]],
-				capacity_max[trackDensity[track]]);
-#endif
-
-			trackUsed[track] = true;
+			QueueNIBTrack(diskImage + 0x10 + h_index, nibdata, t_index);
 
 			h_index += 2;
 			t_index++;
 		}
-
+		PlaceNIBTracks(diskImage);
 
 		DEBUG_LOG("Successfully parsed NIB data for %d tracks\n", t_index);
+		ShrinkArena();
+		BuildFluxIndex();
 		diskType = NIB;
 		return true;
 	}
 	return false;
 }
 
+bool DiskImage::LoadNIB(const FILINFO* fileInfo, FIL* fp)
+{
+	unsigned char header[0x100];
+	u32 bytesRead;
+	int t_index = 0;
+
+	Close();
+
+	this->fileInfo = fileInfo;
+
+	attachedImageSize = f_size(fp);
+
+	memset(header, 0, sizeof(header));
+	if (f_read(fp, header, sizeof(header), &bytesRead) != FR_OK || memcmp(header, "MNIB-1541-RAW", 13) != 0)
+		return false;
+	ImageHash fileHash;
+	fileHash.Add(header, bytesRead);
+	unsigned position = bytesRead;
+	header[sizeof(header) - 2] = 0;	// The list of tracks ends in the header
+	if (!PlaceNIB(header))
+		return false;
+
+	// Each track is read straight into its slot and handed over to be extracted (in place) while the next is read.
+	trackExtractor.Begin();
+	for (unsigned h_index = 0; header[0x10 + h_index]; h_index += 2)
+	{
+		unsigned char* nibdata = NIBTrackSlot(t_index);
+		if (f_read(fp, nibdata, NIB_TRACK_LENGTH, &bytesRead) != FR_OK)
+		{
+			trackExtractor.Finish();	// Nothing can still be extracting when the arena is freed
+			return false;
+		}
+		fileHash.Add(nibdata, bytesRead);
+		position += bytesRead;
+		memset(nibdata + bytesRead, 0, TrackArenaSize(NIB_TRACK_LENGTH) - bytesRead);
+		QueueNIBTrack(header + 0x10 + h_index, nibdata, t_index);
+		t_index++;
+	}
+	PlaceNIBTracks(header);
+	if (position < attachedImageSize && !SkipHashing(fp, attachedImageSize - position, fileHash))
+		return false;
+	hash = fileHash.Value();
+
+	DEBUG_LOG("Successfully parsed NIB data for %d tracks\n", t_index);
+	ShrinkArena();
+	BuildFluxIndex();
+	diskType = NIB;
+	return true;
+}
+
+// The tracks that are not in a NIB are as long as the longest track of their density (and are not written back).
+void DiskImage::ResetNIBTracks()
+{
+	for (int track = 0; track < (MAX_TRACKS_1541 * 2); ++track)
+	{
+		trackLengths[track] = capacity_max[trackDensity[track]];
+		trackUsed[track] = false;
+	}
+}
+
+// The header lists the tracks in the image, 2 bytes each (the half track + 2 and its density) until a 0.
+bool DiskImage::PlaceNIB(const unsigned char* header)
+{
+	ResetNIBTracks();
+
+	// A track's length is only known once it has been extracted so each is given a slot big enough for the longest.
+	unsigned tracksInImage = 0;
+	while (header[0x10 + tracksInImage * 2])
+	{
+		unsigned track = header[0x10 + tracksInImage * 2] - 2;
+		if (track >= HALF_TRACK_COUNT || tracksInImage == HALF_TRACK_COUNT)
+			return false;
+		tracksInImage++;
+	}
+	return AllocateArena(tracksInImage * TrackArenaSize(NIB_TRACK_LENGTH));
+}
+
+// Where the index'th track listed in the header is extracted to (the arena is compacted once they all have been).
+unsigned char* DiskImage::NIBTrackSlot(unsigned index) const
+{
+	return arena + index * TrackArenaSize(NIB_TRACK_LENGTH);
+}
+
+// Hands the track listed at entry (in the header) over to be extracted from the NIB_TRACK_LENGTH bytes read from it at nibdata.
+void DiskImage::QueueNIBTrack(const unsigned char* entry, unsigned char* nibdata, unsigned index)
+{
+	int track = entry[0] - 2;
+	unsigned char v = entry[1];
+	trackDensity[track] = (v & 0x03);
+
+	trackExtractor.Add(nibdata, NIBTrackSlot(index), capacity_min[trackDensity[track]], capacity_max[trackDensity[track]]);
+}
+
+// Waits for the tracks to be extracted and moves each down the arena to follow the one before.
+void DiskImage::PlaceNIBTracks(const unsigned char* header)
+{
+	const TrackExtractor::Track* extracted = trackExtractor.Finish();
+
+	for (unsigned index = 0; header[0x10 + index * 2]; ++index)
+	{
+		int track = header[0x10 + index * 2] - 2;
+
+		DEBUG_LOG("Converted NIB track %d (%d.%d)\r\n", track, track >> 1, track & 1 ? 5 : 0);
+
+		trackLengths[track] = extracted[index].length;
+		if (trackLengths[track])
+		{
+			memmove(arena + arenaUsed, extracted[index].destination, trackLengths[track]);
+			PlaceTrack(track, trackLengths[track]);
+		}
+
+		trackUsed[track] = true;
+	}
+}
+
+bool DiskImage::HelpExtractTracks()
+{
+	return trackExtractor.Help();
+}
+
+void DiskImage::SetGCRCache(GCRCache* cache)
+{
+	gcrCache = cache;
+}
+
+void DiskImage::SetLegacyHashing(bool legacy)
+{
+	legacyHashing = legacy;
+}
+
+// The tracks extracted from a NIB (or an NBZ) are kept in the GCR cache so the next time the file is mounted they are read straight into the arena.
+bool DiskImage::LoadCachedNIB(const FILINFO* fileInfo, FIL* fp, DiskType diskType)
+{
+	bool cached = gcrCache && gcrCache->IsEnabled() && fileInfo;
+	u32 headerHash = 0;
+
+	if (cached)
+	{
+		unsigned char header[0x100];
+		u32 bytesRead;
+		u32 imageHash;
+		FIL entry;
+
+		if (f_read(fp, header, sizeof(header), &bytesRead) != FR_OK || f_lseek(fp, 0) != FR_OK)
+			return false;
+		headerHash = HashBuffer(header, bytesRead);
+		if (gcrCache->Open(fileInfo, headerHash, &entry, imageHash))
+		{
+			bool read = ReadGCRCacheEntry(fileInfo, fp, &entry, imageHash);
+			f_close(&entry);
+			if (read)
+				return true;
+
+			DEBUG_LOG("The cached tracks of %s cannot be read\r\n", fileInfo->fname);
+			Close();
+			gcrCache->Forget(fileInfo);
+		}
+	}
+
+	if (!(diskType == NIB ? LoadNIB(fileInfo, fp) : LoadWhole(fileInfo, fp, diskType)))
+		return false;
+	if (cached)
+		WriteGCRCacheEntry(fileInfo, headerHash);
+	return true;
+}
+
+bool DiskImage::ReadGCRCacheEntry(const FILINFO* fileInfo, FIL* fp, FIL* entry, u32 imageHash)
+{
+	unsigned char header[GCR_CACHE_HEADER_SIZE];
+	u32 bytesRead;
+
+	if (f_read(entry, header, sizeof(header), &bytesRead) != FR_OK)
+		return false;
+	SaveStateReader reader(header, bytesRead);
+	u32 magic = reader.Read32();
+	u32 version = reader.Read16();
+	u32 count = reader.Read16();
+	u32 entryHash = reader.Read32();
+	u32 size = reader.Read32();
+	if (reader.Failed() || magic != GCR_CACHE_MAGIC || version != GCR_CACHE_CONVERTER_VERSION || entryHash != imageHash
+		|| count > HALF_TRACK_COUNT || size > HALF_TRACK_COUNT * TrackArenaSize(MAX_TRACK_LENGTH))
+		return false;
+
+	Close();
+	this->fileInfo = fileInfo;
+	attachedImageSize = f_size(fp);
+	ResetNIBTracks();
+	if (size && !AllocateArena(size))
+		return false;
+
+	for (unsigned index = 0; index < count; ++index)
+	{
+		unsigned char trackHeader[GCR_CACHE_TRACK_HEADER_SIZE];
+		if (f_read(entry, trackHeader, sizeof(trackHeader), &bytesRead) != FR_OK || bytesRead != sizeof(trackHeader))
+			return false;
+		unsigned track = trackHeader[0];
+		unsigned length = trackHeader[2] | (trackHeader[3] << 8);
+		if (track >= HALF_TRACK_COUNT || length > MAX_TRACK_LENGTH || arenaUsed + TrackArenaSize(length) > arenaSize)
+			return false;
+
+		trackDensity[track] = trackHeader[1] & 3;
+		trackLengths[track] = length;
+		trackUsed[track] = true;
+		if (length)
+		{
+			PlaceTrack(track, length);
+			if (f_read(entry, tracks[track], length, &bytesRead) != FR_OK || bytesRead != length)
+				return false;
+		}
+	}
+	if (arenaUsed != arenaSize)
+		return false;
+
+	DEBUG_LOG("Read the cached tracks of %s\r\n", fileInfo->fname);
+	BuildFluxIndex();
+	hash = imageHash;
+	diskType = NIB;
+	return true;
+}
+
+// Failing to write the entry only means the tracks will be extracted again the next time.
+void DiskImage::WriteGCRCacheEntry(const FILINFO* fileInfo, u32 headerHash)
+{
+	unsigned char header[GCR_CACHE_HEADER_SIZE];
+	unsigned count = 0;
+	unsigned size = GCR_CACHE_HEADER_SIZE;
+	FIL entry;
+	u32 bytesWritten;
+
+	for (unsigned track = 0; track < HALF_TRACK_COUNT; ++track)
+	{
+		if (trackUsed[track])
+		{
+			count++;
+			size += GCR_CACHE_TRACK_HEADER_SIZE + trackLengths[track];
+		}
+	}
+	if (!gcrCache->Create(hash, size, &entry))
+		return;
+
+	SaveStateWriter writer(header, sizeof(header));
+	writer.Write32(GCR_CACHE_MAGIC);
+	writer.Write16(GCR_CACHE_CONVERTER_VERSION);
+	writer.Write16(count);
+	writer.Write32(hash);
+	writer.Write32(arenaUsed);
+	bool written = f_write(&entry, header, sizeof(header), &bytesWritten) == FR_OK && bytesWritten == sizeof(header);
+	for (unsigned track = 0; track < HALF_TRACK_COUNT && written; ++track)
+	{
+		if (trackUsed[track])
+		{
+			unsigned length = trackLengths[track];
+			unsigned char trackHeader[GCR_CACHE_TRACK_HEADER_SIZE] = { (unsigned char)track, trackDensity[track], (unsigned char)length, (unsigned char)(length >> 8) };
+			written = f_write(&entry, trackHeader, sizeof(trackHeader), &bytesWritten) == FR_OK && bytesWritten == sizeof(trackHeader)
+				&& (length == 0 || (f_write(&entry, tracks[track], length, &bytesWritten) == FR_OK && bytesWritten == length));
+		}
+	}
+	f_close(&entry);
+
+	if (written)
+		gcrCache->Added(fileInfo, headerHash, hash, size);
+	else
+		gcrCache->Discard(hash);
+}
+
 bool DiskImage::WriteNIB()
 {
 	if (readOnly)
@@ -1060,6 +2215,10 @@ bool DiskImage::WriteNIB()
 
 		int track;
 		char header[0x100];
+
+		// The tracks cached when it was mounted are no longer what the file has (and its date may not change, see get_fattime).
+		if (gcrCache)
+			gcrCache->Forget(fileInfo);
 		int header_entry = 0;
 
 		DEBUG_LOG("Converting to NIB format...\n");
@@ -1092,11 +2251,11 @@ bool DiskImage::WriteNIB()
 			{
 				if (trackUsed[track])
 				{
-#if defined(EXPERIMENTALZERO)
-					if (f_write(&fp, &tracks[track << 13], bytesToWrite, &bytesWritten) != FR_OK || bytesToWrite != bytesWritten)
-#else
-					if (f_write(&fp, tracks[track], bytesToWrite, &bytesWritten) != FR_OK || bytesToWrite != bytesWritten)
-#endif
+					// A NIB has 8K for each track; the track is only as long as it is so the rest is padded (as the tracks' buffers used to be).
+					unsigned length = trackLengths[track] < bytesToWrite ? trackLengths[track] : bytesToWrite;
+					u32 paddingWritten;
+					if (f_write(&fp, tracks[track], length, &bytesWritten) != FR_OK || length != bytesWritten
+						|| f_write(&fp, blankTrack, bytesToWrite - length, &paddingWritten) != FR_OK || bytesToWrite - length != paddingWritten)
 					{
 						DEBUG_LOG("Cannot write track data.\r\n");
 					}
@@ -1133,10 +2292,13 @@ bool DiskImage::OpenNBZ(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 {
 	Close();
 
+	unsigned compressedSize = size;
+
 	if ((size = LZ_Uncompress(diskImage, compressionBuffer, size)))
 	{
 		if (OpenNIB(fileInfo, compressionBuffer, size))
 		{
+			hash = ImageHash::Of(diskImage, compressedSize);	// Of the file as it is
 			diskType = NIB;
 			return true;
 		}
@@ -1158,11 +2320,16 @@ bool DiskImage::WriteNBZ()
 		FRESULT res = f_open(&fp, fileInfo->fname, FA_READ);
 		if (res == FR_OK)
 		{
-			u32 bytesRead;
-			f_read(&fp, readBuffer, READBUFFER_SIZE, &bytesRead);
+			u32 bytesRead = 0;
+			unsigned char* nib = (unsigned char*)malloc(f_size(&fp));
+			if (nib)
+			{
+				f_read(&fp, nib, f_size(&fp), &bytesRead);
+				DEBUG_LOG("Reloaded %s - %d for compression\r\n", fileInfo->fname, bytesRead);
+				bytesRead = LZ_Compress(nib, compressionBuffer, bytesRead);
+				free(nib);
+			}
 			f_close(&fp);
-			DEBUG_LOG("Reloaded %s - %d for compression\r\n", fileInfo->fname, bytesRead);
-			bytesRead = LZ_Compress(readBuffer, compressionBuffer, bytesRead);
 
 			if (bytesRead)
 			{
@@ -1336,7 +2503,7 @@ bool DiskImage::GetDecodedSector(u32 track, u32 sector, u8* buffer)
 	{
 		track = (track - 1) * 2;
 		if (trackUsed[track])
-			return ConvertSector(track, sector, buffer);
+			return ConvertSector(track, sector, buffer);	// Which encodes the track if it has not been yet
 	}
 
 	return false;
@@ -1420,11 +2587,7 @@ bool DiskImage::ConvertSector(unsigned track, unsigned sector, unsigned char* da
 	int index;
 	int bitIndex;
 
-	bitIndex = FindSectorHeader(track, sector, 0);
-	if (bitIndex < 0)
-		return false;
-
-	bitIndex = FindSync(track, bitIndex, (SECTOR_LENGTH_WITH_CHECKSUM * 2) * 8);
+	bitIndex = FindSectorData(track, sector);
 	if (bitIndex < 0)
 		return false;
 
@@ -1445,98 +2608,138 @@ bool DiskImage::ConvertSector(unsigned track, unsigned sector, unsigned char* da
 
 void DiskImage::DecodeBlock(unsigned track, int bitIndex, unsigned char* buf, int num)
 {
-	int shift, i, j;
-	unsigned char gcr[5];
+	int shift, i;
+	unsigned char gcr[GCR_SECTOR_DATA_LENGTH];
 	unsigned char byte;
 	unsigned char* offset;
-#if defined(EXPERIMENTALZERO)
-	unsigned char* end = &tracks[track << 13] + trackLengths[track];
-#else
 	unsigned char* end = tracks[track] + trackLengths[track];
-#endif
+
+	if (num * 5 > GCR_SECTOR_DATA_LENGTH)
+		num = GCR_SECTOR_DATA_LENGTH / 5;
 
 	shift = bitIndex & 7;
-#if defined(EXPERIMENTALZERO)
-	offset = &tracks[track << 13] + (bitIndex >> 3);
-#else
 	offset = tracks[track] + (bitIndex >> 3);
-#endif
 
+	// Line the GCR up on byte boundaries (wrapping around the end of the track) then decode it all at once.
 	byte = offset[0] << shift;
-	for (i = 0; i < num; i++, buf += 4)
+	for (i = 0; i < num * 5; i++)
 	{
-		for (j = 0; j < 5; j++)
+		offset++;
+		if (offset >= end)
+			offset = tracks[track];
+
+		if (shift)
 		{
-			offset++;
-			if (offset >= end)
-#if defined(EXPERIMENTALZERO)
-				offset = &tracks[track << 13];
-#else
-				offset = tracks[track];
-#endif
-		
-			if (shift)
-			{
-				gcr[j] = byte | ((offset[0] << shift) >> 8);
-				byte = offset[0] << shift;
-			}
-			else 
-			{
-				gcr[j] = byte;
-				byte = offset[0];
-			}
+			gcr[i] = byte | ((offset[0] << shift) >> 8);
+			byte = offset[0] << shift;
+		}
+		else
+		{
+			gcr[i] = byte;
+			byte = offset[0];
 		}
-		convert_4bytes_from_GCR(gcr, buf);
 	}
+	decode_GCR_block(gcr, buf, num);
 }
 
-int DiskImage::FindSync(unsigned track, int bitIndex, int maxBits, int* syncStartIndex)
+// The 64 bits of the track from bitIndex on (wrapping around its end), first bit in the MSB.
+static inline u64 TrackBits(const unsigned char* data, unsigned length, unsigned bitIndex)
 {
-	int readShiftRegister = 0;
-#if defined(EXPERIMENTALZERO)
-	unsigned char byte = tracks[(track << 13) + (bitIndex >> 3)] << (bitIndex & 7);
-#else
-	unsigned char byte = tracks[track][bitIndex >> 3] << (bitIndex & 7);
-#endif
-	bool prevBitZero = true;
+	unsigned byte = bitIndex >> 3;
+	u64 bits = 0;
+	unsigned index;
 
-	while (maxBits--)
+	if (byte + 8 <= length)
 	{
-		if (byte & 0x80)
-		{
-			if (syncStartIndex && prevBitZero)
-				*syncStartIndex = bitIndex;
+		for (index = 0; index < 8; ++index)
+			bits = (bits << 8) | data[byte + index];
+	}
+	else
+	{
+		for (index = 0; index < 8; ++index)
+			bits = (bits << 8) | data[(byte + index) % length];
+	}
+	// Only the top 57 bits are needed so the bits of a 9th byte are left as 0s.
+	return bits << (bitIndex & 7);
+}
 
-			prevBitZero = false;
-			readShiftRegister = (readShiftRegister << 1) | 1;
-		}
-		else
-		{
-			prevBitZero = true;
+int DiskImage::FindSync(unsigned track, int bitIndex, int maxBits, int* syncStartIndex) const
+{
+	const unsigned char* data = tracks[track];
+	const unsigned length = trackLengths[track];
+	const unsigned bits = length << 3;
 
-			if (~readShiftRegister & 0x3ff)
-				readShiftRegister <<= 1;
-			else
-				return bitIndex;
-		}
-		if (~bitIndex & 7)
+	if (length == 0)
+		return -1;
+	bitIndex %= bits;
+
+	// 32 bits at a time. A sync ends at the 0 after 10 1s that all come at or after bitIndex (so the 0 is at least 10 bits on from it).
+	unsigned position = bitIndex;
+	for (int offset = 0; offset + 10 < maxBits; offset += 32)
+	{
+		u64 window = TrackBits(data, length, position);
+		// A bit is left set where it and the ones after it are all 1s; 2, 4, 8 then 10 of them.
+		u64 ones = window & (window << 1);
+		ones &= ones << 2;
+		ones &= ones << 4;
+		ones &= ones << 2;
+		// Where 10 1s then a 0 start, for the 32 starts in this block that end (with the 0) within maxBits.
+		u64 syncs = ones & ~(window << 10) & 0xffffffff00000000ULL;
+		int last = maxBits - 11 - offset;
+		if (last < 31)
+			syncs &= ~(0x7fffffffffffffffULL >> last);
+		if (syncs)
 		{
-			bitIndex++;
-			byte <<= 1;
+			int zero = offset + __builtin_clzll(syncs) + 10;
+			if (syncStartIndex)
+			{
+				// Back to the first 1 of the sync (or bitIndex if it started before).
+				int start = zero - 10;
+				unsigned previous;
+				while (start > 0 && (previous = (bitIndex + start - 1) % bits, data[previous >> 3] & (0x80 >> (previous & 7))))
+					start--;
+				*syncStartIndex = (bitIndex + start) % bits;
+			}
+			return (bitIndex + zero) % bits;
 		}
-		else
+		position += 32;
+		if (position >= bits)
+			position -= bits;
+	}
+	return -1;
+}
+
+// Goes through the syncs of the track once noting where each sector's header and data block are.
+// The first header found for each sector from the start of the track is the one used (as a scan from the start would find it).
+void DiskImage::IndexSectors(unsigned track)
+{
+	unsigned char header[10];
+	int bitIndex;
+	int bitIndexFirst;
+
+	memset(sectorHeaderBits[track], 0xff, sizeof(sectorHeaderBits[track]));
+	memset(sectorDataBits[track], 0xff, sizeof(sectorDataBits[track]));
+
+	bitIndex = FindSync(track, 0, NIB_TRACK_LENGTH * 8);
+	bitIndexFirst = bitIndex;
+	while (bitIndex >= 0)
+	{
+		DecodeBlock(track, bitIndex, header, 2);
+
+		unsigned sector = header[2];
+		if (header[0] == 0x08 && sector < SECTOR_INDEX_SIZE && sectorHeaderBits[track][sector] < 0)
 		{
-			bitIndex++;
-			if (bitIndex >= MAX_TRACK_LENGTH * 8)
-				bitIndex = 0;
-#if defined(EXPERIMENTALZERO)
-			byte = tracks[(track << 13)+(bitIndex >> 3)];
-#else
-			byte = tracks[track][bitIndex >> 3];
-#endif
+			sectorHeaderBits[track][sector] = bitIndex;
+			sectorDataBits[track][sector] = FindSync(track, bitIndex, (SECTOR_LENGTH_WITH_CHECKSUM * 2) * 8);
+			sectorIDs[track][sector][0] = header[5];
+			sectorIDs[track][sector][1] = header[4];
 		}
+
+		bitIndex = FindSync(track, bitIndex, NIB_TRACK_LENGTH * 8);
+		if (bitIndex == bitIndexFirst)
+			break;
 	}
-	return -1;
+	trackIndexed[track] = true;
 }
 
 int DiskImage::FindSectorHeader(unsigned track, unsigned sector, unsigned char* id)
@@ -1545,12 +2748,26 @@ int DiskImage::FindSectorHeader(unsigned track, unsigned sector, unsigned char*
 	int bitIndex;
 	int bitIndexPrev;
 
+	PrepareTrack(track);
+	if (sector < SECTOR_INDEX_SIZE)
+	{
+		if (!trackIndexed[track])
+			IndexSectors(track);
+		bitIndex = sectorHeaderBits[track][sector];
+		if (bitIndex >= 0 && id)
+		{
+			id[0] = sectorIDs[track][sector][0];
+			id[1] = sectorIDs[track][sector][1];
+		}
+		return bitIndex;
+	}
+
 	bitIndex = 0;
 	bitIndexPrev = -1;
 	for (;;)
 	{
 		bitIndex = FindSync(track, bitIndex, NIB_TRACK_LENGTH * 8);
-		if (bitIndexPrev == bitIndex)
+		if (bitIndexPrev == bitIndex || bitIndex < 0)
 			break;
 		if (bitIndexPrev < 0)
 			bitIndexPrev = bitIndex;
@@ -1569,6 +2786,18 @@ int DiskImage::FindSectorHeader(unsigned track, unsigned sector, unsigned char*
 	return -1;
 }
 
+// The bit after the sync of the sector's data block (which must be within 2 blocks' worth of its header).
+int DiskImage::FindSectorData(unsigned track, unsigned sector)
+{
+	int bitIndex = FindSectorHeader(track, sector, 0);
+
+	if (bitIndex < 0)
+		return -1;
+	if (sector < SECTOR_INDEX_SIZE)
+		return sectorDataBits[track][sector];
+	return FindSync(track, bitIndex, (SECTOR_LENGTH_WITH_CHECKSUM * 2) * 8);
+}
+
 unsigned DiskImage::GetID(unsigned track, unsigned char* id)
 {
 	if (FindSectorHeader(track, 0, id) >= 0)
@@ -1601,9 +2830,6 @@ unsigned DiskImage::CreateNewDiskInRAM(const char* filenameNew, const char* ID,
 	u32 bytes;
 	u32 blocks;
 
-	if (destBuffer == 0)
-		destBuffer = DiskImage::readBuffer;
-
 	dest = destBuffer;
 
 	memset(buffer, 0, sizeof(buffer));
@@ -18,12 +18,18 @@
 
 #ifndef DISKIMAGE_H
 #define DISKIMAGE_H
+#include <stdint.h>
 #include "types.h"
 #include "ff.h"
+#include "SaveState.h"
 
-#define READBUFFER_SIZE 1024 * 512 * 2 // Now need over 800K for D81s
+#define READBUFFER_SIZE 1024 * 512 * 2 // The most of a file that is read whole (see LoadWhole); over 800K for D81s
 
 #define MAX_TRACK_LENGTH 0x2000
+// Each entry of the flux index covers this many bytes of a track.
+#define FLUX_INDEX_BLOCK 8
+// Sectors numbered at least this are still found by scanning the track rather than through its sector index.
+#define SECTOR_INDEX_SIZE 21
 #define NIB_TRACK_LENGTH 0x2000
 
 #define BAM_OFFSET 4
@@ -49,6 +55,12 @@ static const unsigned short G64_MAX_TRACK_LENGTH = 7928;
 
 static const unsigned short D81_SECTOR_LENGTH = 512;
 
+class WriteBehind;
+class GCRCache;
+
+// FNV-1a (hash can be what a previous call returned, to carry on from there).
+u32 HashBuffer(const void* pBuffer, u32 length, u32 hash = 0x811c9dc5U);
+
 class DiskImage
 {
 public:
@@ -68,8 +80,12 @@ public:
 	};
 
 	DiskImage();
+	~DiskImage();
 
-	static unsigned CreateNewDiskInRAM(const char* filenameNew, const char* ID, unsigned char* destBuffer = 0);
+	static unsigned CreateNewDiskInRAM(const char* filenameNew, const char* ID, unsigned char* destBuffer);
+
+	// Reads the image from fp a piece at a time, converting each piece as it arrives rather than reading the file whole first.
+	bool Load(const FILINFO* fileInfo, FIL* fp, DiskType diskType);
 
 	bool OpenD64(const FILINFO* fileInfo, unsigned char* diskImage, unsigned size);
 	bool OpenG64(const FILINFO* fileInfo, unsigned char* diskImage, unsigned size);
@@ -84,13 +100,21 @@ public:
 
 	bool GetDecodedSector(u32 track, u32 sector, u8* buffer);
 
+	// The tracks of a D64 or D71 are only encoded into GCR the first time they are needed (a sector is decoded from one or the disk is inserted
+	// under it) or when PrepareAllTracks is called before realtime emulation starts. Anything that reads a track's bytes must call this first.
+	inline void PrepareTrack(unsigned track)
+	{
+		if (!trackEncoded[track])
+			EncodeTrack(track);
+	}
+	// Encodes the track nearest to track that has not been yet. Returns false if there were none left.
+	bool EncodeNearestTrack(unsigned track);
+	// Encodes every track and indexes the sectors of the GCR ones so that nothing is left to do once the image is in the drive.
+	void PrepareAllTracks();
+
 	inline unsigned char GetNextByte(u32 track, u32 byte)
 	{
-#if defined(EXPERIMENTALZERO)
-		return tracks[(track << 13) + byte];
-#else
 		return tracks[track][byte];
-#endif
 	}
 
 
@@ -99,11 +123,7 @@ public:
 		//if (attachedImageSize == 0)
 		//	return 0;
 
-#if defined(EXPERIMENTALZERO)
-		return ((tracks[(track << 13) + byte] >> bit) & 1) != 0;
-#else
 		return ((tracks[track][byte] >> bit) & 1) != 0;
-#endif
 	}
 
 
@@ -111,34 +131,23 @@ public:
 	{
 		if (attachedImageSize == 0)
 			return;
+		if (trackCapacity[track] == 0 && !OwnTrack(track))
+			return;
 
-#if defined(EXPERIMENTALZERO)
-		u8 dataOld = tracks[(track << 13) + byte];
-		u8 bitMask = 1 << bit;
-		if (value)
-		{
-			TestDirty(track, (dataOld & bitMask) == 0);
-			tracks[(track << 13) + byte] |= bitMask;
-		}
-		else
-		{
-			TestDirty(track, (dataOld & bitMask) != 0);
-			tracks[(track << 13) + byte] &= ~bitMask;
-		}
-#else
 		u8 dataOld = tracks[track][byte];
 		u8 bitMask = 1 << bit;
 		if (value)
 		{
 			TestDirty(track, (dataOld & bitMask) == 0);
 			tracks[track][byte] |= bitMask;
+			if (fluxIndex[track][byte / FLUX_INDEX_BLOCK])
+				MarkFlux(track, byte);
 		}
 		else
 		{
 			TestDirty(track, (dataOld & bitMask) != 0);
 			tracks[track][byte] &= ~bitMask;
 		}
-#endif
 	}
 
 	static const unsigned char SectorsPerTrack[42];
@@ -148,7 +157,20 @@ public:
 	const char* GetName() { return fileInfo->fname; }
 
 	inline unsigned BitsInTrack(unsigned track) const { return trackLengths[track] << 3; }
+	// How many bits on from bitOffset the next 1 (ie flux reversal) could be. The bits in between are known to be 0.
+	// Only a lower bound; at the end of the track or of a long gap the bit there needs to be looked at and this asked again.
+	unsigned BitsToFlux(unsigned track, unsigned bitOffset) const;
 	inline unsigned TrackLength(unsigned track) const { return trackLengths[track]; }
+	// Bytes held for the tracks (and what they are encoded from) while the image is attached, besides the DiskImage itself.
+	inline unsigned ArenaSize() const { return arenaSize; }
+	// A caddy keeps the images that are not in the drive compressed (D64 tracks that have not been written to are dropped, to be encoded again when needed).
+	// A packed image must be unpacked before anything looks at its tracks; only Close does that itself.
+	bool Pack();
+	bool Unpack();
+	inline bool IsPacked() const { return packed != 0; }
+	inline unsigned PackedSize() const { return packedSize; }
+	// The bit after the next sync (ten or more 1s then a 0) that starts at or after bitIndex and ends within maxBits of it, or -1 if there is none.
+	int FindSync(unsigned track, int bitIndex, int maxBits, int* syncStartIndex = 0) const;
 
 	inline bool IsD81() const { return diskType == D81; }
 	inline bool IsD71() const { return diskType == D71; }
@@ -159,6 +181,8 @@ public:
 		{
 			tracksD81[track][headIndex][headPos] = data;
 			trackDirty[track] = true;
+			trackUnsaved[track] = true;
+			unsaved = true;
 			trackUsed[track] = true;
 			dirty = true;
 		}
@@ -190,26 +214,57 @@ public:
 
 	bool IsDirty() const { return dirty; }
 
-	static unsigned char readBuffer[READBUFFER_SIZE];
-
 	static void CRC(unsigned short& runningCRC, unsigned char data);
 
-	union
-	{
-#if defined(EXPERIMENTALZERO)
-		unsigned char tracks[HALF_TRACK_COUNT * MAX_TRACK_LENGTH];
-#else
-		unsigned char tracks[HALF_TRACK_COUNT][MAX_TRACK_LENGTH];
-#endif
-		unsigned char tracksD81[HALF_TRACK_COUNT][2][MAX_TRACK_LENGTH];
-	};
-
 	bool WriteD64(char* name = 0);
 	bool WriteG64(char* name = 0);
 
+	// Of the image file (see ImageHash). Only G64s, NIBs and NBZs are hashed; 0 for the others.
 	unsigned GetHash() const { return hash; }
+	// The FNV-1a of a G64 (see HashBuffer), which quirks used to be keyed by. Only worked out after SetLegacyHashing(true).
+	unsigned GetLegacyHash() const { return legacyHash; }
+	static void SetLegacyHashing(bool legacy);
+
+	// What the last write back of a D64 or D81 cost (only the sectors that had changed are written).
+	unsigned GetLastFlushBytes() const { return lastFlushBytes; }
+	unsigned GetLastFlushMicroseconds() const { return lastFlushMicroseconds; }
+
+	// Saves a D64 or D81 in the background while it is being emulated (see WriteBehind).
+	// Each call looks at the next sector of the tracks written to since they were last looked at and queues it if it differs from the file.
+	// Returns false if there was nothing to look at (or no room to queue it).
+	bool QueueUnsavedSector(WriteBehind& writeBehind);
+	// Something queued could not be written so the image must be written back whole when it is closed.
+	void SetWriteBehindFailed() { writeBehindFailed = true; }
+
+	// The idle cores (threads on the host) call this to help extract the tracks of a NIB as it is loaded (see TrackExtractor).
+	// Returns false if there was nothing to extract.
+	static bool HelpExtractTracks();
+
+	// Where the tracks extracted from NIBs (and NBZs) are kept between mounts (see GCRCache). 0 for none.
+	static void SetGCRCache(GCRCache* cache);
+
+	// Only the GCR tracks that have been written to since the image was opened. Loading requires the same image to be inserted.
+	void SaveDirtyTracks(SaveStateWriter& writer) const;
+	bool LoadDirtyTracks(SaveStateReader& reader);
 
 private:
+	bool LoadD64(const FILINFO* fileInfo, FIL* fp);
+	bool LoadG64(const FILINFO* fileInfo, FIL* fp);
+	bool LoadNIB(const FILINFO* fileInfo, FIL* fp);
+	bool LoadCachedNIB(const FILINFO* fileInfo, FIL* fp, DiskType diskType);
+	bool ReadGCRCacheEntry(const FILINFO* fileInfo, FIL* fp, FIL* entry, u32 imageHash);
+	void WriteGCRCacheEntry(const FILINFO* fileInfo, u32 headerHash);
+	bool LoadD81(const FILINFO* fileInfo, FIL* fp);
+	bool LoadWhole(const FILINFO* fileInfo, FIL* fp, DiskType diskType);
+	bool PlaceD64(const FILINFO* fileInfo, unsigned size);
+	bool PlaceD81(const FILINFO* fileInfo, unsigned size);
+	void ConvertD81Track(unsigned trackIndex, unsigned char*& src);
+	void ResetNIBTracks();
+	bool PlaceNIB(const unsigned char* header);
+	unsigned char* NIBTrackSlot(unsigned index) const;
+	void QueueNIBTrack(const unsigned char* entry, unsigned char* nibdata, unsigned index);
+	void PlaceNIBTracks(const unsigned char* header);
+
 	void CloseD64();
 	void CloseG64();
 	void CloseNIB();
@@ -218,6 +273,12 @@ private:
 	void CloseD81();
 	void CloseT64();
 
+	inline unsigned D64DataSize() const { return encodeErrors ? encodeErrors - encodeSource : attachedImageSize; }
+	bool UpdateD64Sector(unsigned track, unsigned sector, unsigned sectorRef, bool& clearError);
+	// All of the track has been queued by QueueUnsavedSector since it was last written to.
+	inline bool IsWrittenBehind(unsigned track) const { return !trackUnsaved[track] && (int)track != queueTrack; }
+	bool WriteD64Sectors();
+	bool WriteD81Sectors();
 	bool WriteNIB();
 	bool WriteNBZ();
 	bool WriteD71();
@@ -229,16 +290,35 @@ private:
 		if (isDirty)
 		{
 			trackDirty[track] = true;
+			trackUnsaved[track] = true;
+			unsaved = true;
 			trackUsed[track] = true;
+			trackIndexed[track] = false;
 			dirty = true;
 		}
 	}
 
+	void EncodeTrack(unsigned track);
+
+	bool AllocateArena(unsigned size);
+	unsigned char* TakeFromArena(unsigned size);
+	static inline unsigned TrackArenaSize(unsigned capacity) { return capacity + (capacity + FLUX_INDEX_BLOCK - 1) / FLUX_INDEX_BLOCK; }
+	void PlaceTrack(unsigned track, unsigned capacity);
+	void ShrinkArena();
+	void RebaseArena(uintptr_t oldArena);
+	bool OwnTrack(unsigned track);
+	void FreeTracks();
+
+	void BuildFluxIndex();
+	void BuildFluxIndex(unsigned track);
+	void MarkFlux(unsigned track, unsigned byte);
+
 	bool ConvertSector(unsigned track, unsigned sector, unsigned char* buffer);
 	void DecodeBlock(unsigned track, int bitIndex, unsigned char* buf, int num);
 	unsigned GetID(unsigned track, unsigned char* id);
 	int FindSectorHeader(unsigned track, unsigned sector, unsigned char* id);
-	int FindSync(unsigned track, int bitIndex, int maxBits, int* syncStartIndex = 0);
+	int FindSectorData(unsigned track, unsigned sector);
+	void IndexSectors(unsigned track);
 
 	void OutputD81HeaderByte(unsigned char*& dest, unsigned char byte);
 	void OutputD81DataByte(unsigned char*& src, unsigned char*& dest);
@@ -257,15 +337,49 @@ private:
 	DiskType diskType;
 	const FILINFO* fileInfo;
 	unsigned hash;
+	unsigned legacyHash;
+	unsigned lastFlushBytes;
+	unsigned lastFlushMicroseconds;
+	bool writeBehindFailed;
 
 	unsigned short trackLengths[HALF_TRACK_COUNT];
-	union
-	{
-		unsigned char trackDensity[HALF_TRACK_COUNT];
-		unsigned char trackD81SyncBits[HALF_TRACK_COUNT][2][MAX_TRACK_LENGTH >> 3];
-	};
+	unsigned char trackDensity[HALF_TRACK_COUNT];
+	// The tracks (for a D71 or D81 each side of them) are kept in an arena allocated when the image is opened, each given only as much as it needs.
+	// Those not in the image all point at one blank track (and flux index) with a capacity of 0 until they are written to (see OwnTrack).
+	unsigned char* arena;
+	unsigned arenaSize;
+	unsigned arenaUsed;
+	// The arena compressed by Pack (0 if it is not) and where it was, so that the tracks can be pointed into it again once it is unpacked.
+	unsigned char* packed;
+	unsigned packedSize;
+	uintptr_t packedArena;
+	unsigned char* tracks[HALF_TRACK_COUNT];
+	unsigned char* tracksD81[HALF_TRACK_COUNT][2];
+	unsigned char* trackD81SyncBits[HALF_TRACK_COUNT][2];
+	unsigned short trackCapacity[HALF_TRACK_COUNT];
+	// The tracks given storage of their own outside the arena by OwnTrack.
+	unsigned char* ownTracks[HALF_TRACK_COUNT];
 	bool trackDirty[HALF_TRACK_COUNT];
 	bool trackUsed[HALF_TRACK_COUNT];
+	bool trackEncoded[HALF_TRACK_COUNT];
+	// Written to since QueueUnsavedSector last looked at them. The track it is going through a sector at a time is queueTrack (-1 if none).
+	bool trackUnsaved[HALF_TRACK_COUNT];
+	bool unsaved;
+	int queueTrack;
+	unsigned queueSector;
+	// The D64 or D71 the tracks are encoded from and its error info (0 if there is none). Kept in the arena after the tracks.
+	unsigned char* encodeSource;
+	unsigned char* encodeErrors;
+	// A run length index of the gaps between the 1 bits of each track so that Drive can count down to the next flux reversal rather than look at every bit.
+	// Each entry is how many blocks of FLUX_INDEX_BLOCK bytes from that one on have no 1 bits in them (saturating at 255).
+	// Built when an image is opened and kept up to date as bits are written (SetBit) so that it never overstates a gap. Kept with each track in the arena.
+	unsigned char* fluxIndex[HALF_TRACK_COUNT];
+	// Where the header and data block of each sector of a track are (the bit after their syncs, -1 if there is none) and the ID in the header.
+	// Built by IndexSectors the first time a sector of the track is looked for and thrown away when the track is written to (TestDirty) or encoded.
+	bool trackIndexed[HALF_TRACK_COUNT];
+	int sectorHeaderBits[HALF_TRACK_COUNT][SECTOR_INDEX_SIZE];
+	int sectorDataBits[HALF_TRACK_COUNT][SECTOR_INDEX_SIZE];
+	unsigned char sectorIDs[HALF_TRACK_COUNT][SECTOR_INDEX_SIZE][2];
 
 	unsigned short crc;
 	static unsigned short CRC1021[256];
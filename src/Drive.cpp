@@ -344,22 +344,16 @@ extern "C"
 #define DISK_SWAP_CYCLES_NO_DISK 200000
 #define DISK_SWAP_CYCLES_DISK_INSERTING 400000
 
-Drive::Drive() : m_pVIA(0)
+Drive::Drive() : diskImage(0), m_pVIA(0), noiseSeed(0x811c9dc5U)
 {
-	srand(0x811c9dc5U);
-#if defined(EXPERIMENTALZERO)
-	localSeed = 0x811c9dc5U;
-#endif
 	Reset();
 }
 
 void Drive::Reset()
 {
-#if defined(EXPERIMENTALZERO)
 	LED = false;
-	cyclesForBit = 0;
-	UE7Counter = 16;
-#endif
+	bitError = 0;
+	bitClocksLeft = 1;
 	headTrackPos = 18*2;		// Start with the head over track 19 (Very later Vorpal ie Cakifornia Games) need to have had the last head movement -ve
 	CLOCK_SEL_AB = 3;		// Track 18 will use speed zone 3 (encoder/decoder (ie UE7Counter) clocked at 1.2307Mhz)
 	UpdateHeadSectorPosition();
@@ -369,23 +363,77 @@ void Drive::Reset()
 	readShiftRegister = 0;
 	writeShiftRegister = 0;
 	UE3Counter = 0;
-#if defined(EXPERIMENTALZERO)
-	ResetEncoderDecoder(18 * 16, 4 * 16);
-	cyclesLeftForBit = ceil(cyclesPerBit - cyclesForBit);
-#else
-	ResetEncoderDecoder(18.0f, 22.0f);
-#endif
+	ResetEncoderDecoder(18 * 16 + 1, 4 * 16);	// 18us-22us
 	newDiskImageQueuedCylesRemaining = DISK_SWAP_CYCLES_DISK_EJECTING + DISK_SWAP_CYCLES_NO_DISK + DISK_SWAP_CYCLES_DISK_INSERTING;
-	m_pVIA->InputCA1(true);	// Reset in read mode
-	m_pVIA->InputCB1(true);
-	m_pVIA->InputCA2(true);
-	m_pVIA->InputCB2(true);
+	if (m_pVIA)
+	{
+		m_pVIA->InputCA1(true);	// Reset in read mode
+		m_pVIA->InputCB1(true);
+		m_pVIA->InputCA2(true);
+		m_pVIA->InputCB2(true);
+	}
+}
+
+void Drive::RestoreSnapshot(const Drive& snapshot)
+{
+	DiskImage* insertedDiskImage = diskImage;
+	*this = snapshot;
+	diskImage = insertedDiskImage;
+	UpdateHeadSectorPosition();	// The inserted disk may have a different number of bits on this track
+}
+
+void Drive::SaveState(SaveStateWriter& writer) const
+{
+	writer.Write32(newDiskImageQueuedCylesRemaining);
+	writer.Write32(UE7Counter);
+	writer.Write8(writeShiftRegister);
+	writer.Write32(readShiftRegister);
+	writer.Write32(headTrackPos);
+	writer.Write32(headBitOffset);
+	writer.Write32(bitClocksLeft);
+	writer.Write32(bitError);
+	writer.Write32(noiseClocksLeft);
+	writer.Write32(noiseSeed);
+	writer.Write32(UF4Counter);
+	writer.Write32(UE3Counter);
+	writer.Write32(CLOCK_SEL_AB);
+	writer.WriteBool(SO);
+	writer.Write8(lastHeadDirection);
+	writer.WriteBool(motor);
+	writer.WriteBool(LED);
+}
+
+bool Drive::LoadState(SaveStateReader& reader)
+{
+	newDiskImageQueuedCylesRemaining = reader.Read32();
+	UE7Counter = reader.Read32();
+	writeShiftRegister = reader.Read8();
+	readShiftRegister = reader.Read32();
+	headTrackPos = reader.Read32();
+	headBitOffset = reader.Read32();
+	bitClocksLeft = reader.Read32();
+	bitError = reader.Read32();
+	noiseClocksLeft = reader.Read32();
+	noiseSeed = reader.Read32();
+	UF4Counter = reader.Read32();
+	UE3Counter = reader.Read32();
+	CLOCK_SEL_AB = reader.Read32();
+	SO = reader.ReadBool();
+	lastHeadDirection = reader.Read8();
+	motor = reader.ReadBool();
+	LED = reader.ReadBool();
+	if (reader.Failed() || headTrackPos >= HALF_TRACK_COUNT || bitClocksLeft == 0 || noiseClocksLeft == 0)
+		return false;
+
+	UpdateHeadSectorPosition();
+	return true;
 }
 
 void Drive::Insert(DiskImage* diskImage)
 {
 	Eject();
 	this->diskImage = diskImage;
+	UpdateHeadSectorPosition();	// This disk may have a different number of bits on this track and it may not have been encoded yet
 	newDiskImageQueuedCylesRemaining = DISK_SWAP_CYCLES_DISK_EJECTING + DISK_SWAP_CYCLES_NO_DISK + DISK_SWAP_CYCLES_DISK_INSERTING;
 }
 
@@ -410,6 +458,75 @@ void Drive::OnPortOut(void* pThis, unsigned char status)
 	pDrive->LED = (status & 8) != 0;
 }
 
+// Called each time UE7's count carries (bit 4) and clocks UF4.
+inline void Drive::ClockEncoderDecoder(bool writing)
+{
+	// The decoder consists of UF4 and UE5A. The ecoder has two outputs, Pin 1 of UE5A is the serial data output and pin 2 of UF4 (output B) is the serial clock output.
+	++UF4Counter &= 0xf; // Clock and clamp UF4.
+	// The UD2 read shift register is clocked by serial clock (the rising edge of encoder/decoder's UF4 B output (serial clock))
+	//	- ie on counts 2, 6, 10 and 14 (2 is the only count that outputs a 1 into readShiftRegister as the MSB bits of the count NORed together for other values are 0)
+	if ((UF4Counter & 0x3) == 2)
+	{
+		// A bit cell is four encoder/decoder clock pulses wide, as the 2nd bit of UF4 controls the serial clock (and takes 4 cycles to loop a two bit counter).
+		// If a flux reversal (or pulse into the decoder) occurs at the beginning of a cell, that cell is a 1 else that cell is a 0.
+		// If a flux reversal occurs, UF4's counter is cleared and the timing circuit is reset to start the encoder/decoder clock at the beginning of the VIA's current density setting.
+		// Pins 6 (output C) and 7 (output D) of UF4 are low, causing the output of UE5A, the serial data line, to go high.
+		// 2 encoder/decoder clock pulses later, the serial clock(pin 2 of UF4) goes high. When the serial clock line is high, the serial data line is valid and the shift register will shift in the data.
+		// The serial clock line remains high for another clock cycle.
+		// After four encoder/decoder clocks a bit cell is now complete.
+		// At this time, pins 2 (output A) and 3 (output B) of UF4 will again be low but as the count is counting up pin 6 (output C) will now be high.
+		// The high on pin 6 (output C) of UF4 causes the serial data line (pin 1 of UE5A) to go low as this is NORed with the low on pin 7 (output D).
+		// If a flux reversal occurs at the beginning of the next cell then everything resets and again we see a 1 on the serial data line 2 encoder/decoder cycles into that cell.
+		// If no flux reversal occurs at the beginning of the next cell, the serial data line will remain low when the serial clock line goes high again (two encoder/decoder clock cycles into the new cell).
+		// If there are no flux reversals for 2 cells then we see 0 on pin 6 (output C) and 1 on pin 7 (output D) of UF4 and this causes the serial data line (pin 1 of UE5A) to remain at 0.
+		// If there are no flux reversals for 3 cells then we see 1 on pin 6 (output C) and 1 on pin 7 (output D) of UF4 and this causes the serial data line (pin 1 of UE5A) to also remain at 0, after all, UE5A is a NOR gate.
+		// After 4 cells the counter inside UF4 loops back to 0 and we again see 0 on pin 6 (output C) and 0 on pin 7 (output C), causing the output of UE5A, the serial data line, to go to a 1, regardless of a true flux reversal!
+		readShiftRegister <<= 1;
+		readShiftRegister |= (UF4Counter == 2); // Emulate UE5A and only shift in a 1 when pins 6 (output C) and 7 (output D) (bits 2 and 3 of UF4Counter are 0. ie the first count of the bit cell)
+		if (writing) SetNextBit((writeShiftRegister & 0x80));
+		writeShiftRegister <<= 1;
+		// Note: SYNC can only trigger during reading as R/!W line is one of UC2's inputs.
+		if (!writing && ((readShiftRegister & 0x3ff) == 0x3ff))	// if the last 10 bits are 1s then SYNC
+		{
+			UE3Counter = 0;	// Phase lock on to byte boundary
+			m_pVIA->GetPortB()->SetInput(0x80, false);			// PB7 active low SYNC
+		}
+		else
+		{
+			if (!writing) m_pVIA->GetPortB()->SetInput(0x80, true); // SYNC not asserted if not following the SYNC bits
+			UE3Counter++;
+		}
+	}
+	// UC5B (NOR used to invert UF4's output B serial clock) output high when UF4 counts 0,1,4,5,8,9,12 and 13
+	else if (((UF4Counter & 2) == 0) && (UE3Counter == 8))	// Phase locked on to byte boundary
+	{
+		UE3Counter = 0;
+		SO = (m_pVIA->GetFCR() & m6522::FCR_CA2_OUTPUT_MODE0) != 0;	// bit 2 of the FCR indicates "Byte Ready Active" turned on or not.
+		if (writing) 
+		{
+			writeShiftRegister = m_pVIA->GetPortA()->GetOutput();
+		}
+		else
+		{
+			writeShiftRegister = (u8)(readShiftRegister & 0xff);
+			m_pVIA->GetPortA()->SetInput(writeShiftRegister);
+		}
+	}
+}
+
+// UE7 (a 74ls193 4bit counter) counts up on the falling edge of the 16Mhz clock and its count carry (bit 4) clocks UF4.
+// Nothing else can happen over these clocks so the counter is taken from carry to carry.
+inline void Drive::ClockUE7(u32 clocks, bool writing)
+{
+	while (clocks >= (u32)(0x10 - UE7Counter))
+	{
+		clocks -= 0x10 - UE7Counter;
+		UE7Counter = CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6) ie preload the encoder/decoder clock for the current density settings.
+		ClockEncoderDecoder(writing);
+	}
+	UE7Counter += clocks;
+}
+
 bool Drive::Update()
 {
 #if defined(PROFILE)
@@ -468,109 +585,55 @@ bool Drive::Update()
 		}
 		// UE6 provides the CPU's clock by dividing the 16Mhz clock by 16.
 		// UE7 (a 74ls193 4bit counter) counts up on the falling edge of the 16Mhz clock. UE7 drives the Encoder/Decoder clock.
-		// So we need to simulate 16 cycles for every 1 CPU cycle
-#if defined(EXPERIMENTALZERO)
+		// So we need to simulate 16 cycles for every 1 CPU cycle. While reading they are done a run at a time up to the next clock that resets the encoder/decoder
+		// (the end of a bit cell with a 1 in it or a noise pulse) and in most CPU cycles there is no such clock.
 		if (writing)
-			DriveLoopWrite();
-		else
 		{
-			if (fluxReversalCyclesLeft > 16 && cyclesLeftForBit > 16)
-			{
-				DriveLoopReadNoFluxNoCycles();
-			}
-			else if (fluxReversalCyclesLeft > 16)
-			{
-				DriveLoopReadNoFlux();
-			}
-			else if (cyclesLeftForBit > 16)
-			{
-				DriveLoopReadNoCycles();
-			}
-			else
-			{
-				DriveLoopRead();
-			}
+			ClockUE7(16, true);
 		}
-#else
-		for (int cycles = 0; cycles < 16; ++cycles)
+		else
 		{
-			if (!writing)
+			u32 clocks = 16;
+			while (true)
 			{
-				if (++cyclesForBit >= cyclesPerBit)
+				u32 next = bitClocksLeft < noiseClocksLeft ? bitClocksLeft : noiseClocksLeft;
+				if (next > clocks)
 				{
-					cyclesForBit -= cyclesPerBit;
+					bitClocksLeft -= clocks;
+					noiseClocksLeft -= clocks;
+					ClockUE7(clocks, false);
+					break;
+				}
+				ClockUE7(next - 1, false);
+				clocks -= next;
+				bitClocksLeft -= next;
+				noiseClocksLeft -= next;
+				if (bitClocksLeft == 0)
+				{
+					bitError += bitClocksRemainder;
+					bitClocksLeft = bitClocks;
+					if (bitError >= bitsInTrack)
+					{
+						bitError -= bitsInTrack;
+						bitClocksLeft++;
+					}
 					// Any 1 bit coming from the disk will come in the form of a flux reversal. (Non return to zero inverted emulation.)
 					if (GetNextBit())
 					{
 						// We have a genuine flux reversal.
 						// Pin 12 of UE5D is the BIT SYNC Input. When a positive pulse is applied to pin 12, the output of UE5D(pin 13) is applied to the load line (of UE7),
 						// causing the encoder/decoder clock to terminate the current cycle early and begin a new one.
-						ResetEncoderDecoder(18.0f, 20.0f); // Start seeing random flux reversals 18us-20us from now (ie since the last real flux reversal).
+						ResetEncoderDecoder(18 * 16, 2 * 16); // Start seeing random flux reversals 18us-20us from now (ie since the last real flux reversal, counting this clock).
 					}
 				}
 				// The video amplifiers will often oscillate with no data in, but these oscillations are high enough in frequency that they "seldom" get past the valid pulse detector.
 				// Some do and some copy protections rely on this random behaviour so we need to emultate it.
 				// For example, 720 will read a byte from the disk multiple times and check that the values read each time were infact different. It does not matter what the values are just that they are different.
-				randomFluxReversalTime -= 0.0625f;	// One 16th of a micro second.
-				if (randomFluxReversalTime <= 0) ResetEncoderDecoder(2.0f, 25.0f); // Trigger a random noise generated zero crossing and start seeing more anywhere between 2us and 25us after this one.
-			}
-			if (++UE7Counter == 0x10) // The count carry (bit 4) clocks UF4.
-			{
-				UE7Counter = CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6) ie preload the encoder/decoder clock for the current density settings.
-				// The decoder consists of UF4 and UE5A. The ecoder has two outputs, Pin 1 of UE5A is the serial data output and pin 2 of UF4 (output B) is the serial clock output.
-				++UF4Counter &= 0xf; // Clock and clamp UF4.
-				// The UD2 read shift register is clocked by serial clock (the rising edge of encoder/decoder's UF4 B output (serial clock))
-				//	- ie on counts 2, 6, 10 and 14 (2 is the only count that outputs a 1 into readShiftRegister as the MSB bits of the count NORed together for other values are 0)
-				if ((UF4Counter & 0x3) == 2)
-				{
-					// A bit cell is four encoder/decoder clock pulses wide, as the 2nd bit of UF4 controls the serial clock (and takes 4 cycles to loop a two bit counter).
-					// If a flux reversal (or pulse into the decoder) occurs at the beginning of a cell, that cell is a 1 else that cell is a 0.
-					// If a flux reversal occurs, UF4's counter is cleared and the timing circuit is reset to start the encoder/decoder clock at the beginning of the VIA's current density setting.
-					// Pins 6 (output C) and 7 (output D) of UF4 are low, causing the output of UE5A, the serial data line, to go high.
-					// 2 encoder/decoder clock pulses later, the serial clock(pin 2 of UF4) goes high. When the serial clock line is high, the serial data line is valid and the shift register will shift in the data.
-					// The serial clock line remains high for another clock cycle.
-					// After four encoder/decoder clocks a bit cell is now complete.
-					// At this time, pins 2 (output A) and 3 (output B) of UF4 will again be low but as the count is counting up pin 6 (output C) will now be high.
-					// The high on pin 6 (output C) of UF4 causes the serial data line (pin 1 of UE5A) to go low as this is NORed with the low on pin 7 (output D).
-					// If a flux reversal occurs at the beginning of the next cell then everything resets and again we see a 1 on the serial data line 2 encoder/decoder cycles into that cell.
-					// If no flux reversal occurs at the beginning of the next cell, the serial data line will remain low when the serial clock line goes high again (two encoder/decoder clock cycles into the new cell).
-					// If there are no flux reversals for 2 cells then we see 0 on pin 6 (output C) and 1 on pin 7 (output D) of UF4 and this causes the serial data line (pin 1 of UE5A) to remain at 0.
-					// If there are no flux reversals for 3 cells then we see 1 on pin 6 (output C) and 1 on pin 7 (output D) of UF4 and this causes the serial data line (pin 1 of UE5A) to also remain at 0, after all, UE5A is a NOR gate.
-					// After 4 cells the counter inside UF4 loops back to 0 and we again see 0 on pin 6 (output C) and 0 on pin 7 (output C), causing the output of UE5A, the serial data line, to go to a 1, regardless of a true flux reversal!
-					readShiftRegister <<= 1;
-					readShiftRegister |= (UF4Counter == 2); // Emulate UE5A and only shift in a 1 when pins 6 (output C) and 7 (output D) (bits 2 and 3 of UF4Counter are 0. ie the first count of the bit cell)
-					if (writing) SetNextBit((writeShiftRegister & 0x80));
-					writeShiftRegister <<= 1;
-					// Note: SYNC can only trigger during reading as R/!W line is one of UC2's inputs.
-					if (!writing && ((readShiftRegister & 0x3ff) == 0x3ff))	// if the last 10 bits are 1s then SYNC
-					{
-						UE3Counter = 0;	// Phase lock on to byte boundary
-						m_pVIA->GetPortB()->SetInput(0x80, false);			// PB7 active low SYNC
-					}
-					else
-					{
-						if (!writing) m_pVIA->GetPortB()->SetInput(0x80, true); // SYNC not asserted if not following the SYNC bits
-						UE3Counter++;
-					}
-				}
-				// UC5B (NOR used to invert UF4's output B serial clock) output high when UF4 counts 0,1,4,5,8,9,12 and 13
-				else if (((UF4Counter & 2) == 0) && (UE3Counter == 8))	// Phase locked on to byte boundary
-				{
-					UE3Counter = 0;
-					SO = (m_pVIA->GetFCR() & m6522::FCR_CA2_OUTPUT_MODE0) != 0;	// bit 2 of the FCR indicates "Byte Ready Active" turned on or not.
-					if (writing) 
-					{
-						writeShiftRegister = m_pVIA->GetPortA()->GetOutput();
-					}
-					else
-					{
-						writeShiftRegister = (u8)(readShiftRegister & 0xff);
-						m_pVIA->GetPortA()->SetInput(writeShiftRegister);
-					}
-				}
+				if (noiseClocksLeft == 0)
+					ResetEncoderDecoder(2 * 16 + 1, 23 * 16); // Trigger a random noise generated zero crossing and start seeing more anywhere between 2us and 25us after this one.
+				ClockUE7(1, false);
 			}
 		}
-#endif
 	}
 	m_pVIA->InputCA1(!SO);
 
@@ -581,285 +644,3 @@ bool Drive::Update()
 
 	return dataReady;
 }
-
-
-#if defined(EXPERIMENTALZERO)
-#define min(a,b) (((a) < (b)) ? (a) : (b))
-#define max(a,b) (((a) > (b)) ? (a) : (b))
-
-void Drive::DriveLoopReadNoFluxNoCycles()
-{
-	unsigned int cycles = 16;
-	fluxReversalCyclesLeft -= 16;
-	cyclesLeftForBit -= 16;
-	while (true)
-	{
-		if (cycles < UE7Counter)
-		{
-			UE7Counter -= cycles;
-			cycles = 0;
-			return;
-		}
-		cycles -= UE7Counter;
-
-		UE7Counter = 16 - CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6) ie preload the encoder/decoder clock for the current density settings.
-									// The decoder consists of UF4 and UE5A. The ecoder has two outputs, Pin 1 of UE5A is the serial data output and pin 2 of UF4 (output B) is the serial clock output.
-		++UF4Counter &= 0xf; // Clock and clamp UF4.
-								// The UD2 read shift register is clocked by serial clock (the rising edge of encoder/decoder's UF4 B output (serial clock))
-								//	- ie on counts 2, 6, 10 and 14 (2 is the only count that outputs a 1 into readShiftRegister as the MSB bits of the count NORed together for other values are 0)
-		if ((UF4Counter & 0x3) == 2)
-		{
-			readShiftRegister <<= 1;
-			readShiftRegister |= (UF4Counter == 2); 
-
-			//writeShiftRegister <<= 1;
-			
-			bool resetTime = ((readShiftRegister & 0x3ff) == 0x3ff);
-			m_pVIA->GetPortB()->SetInput(0x80, !resetTime);
-			if (resetTime)	// if the last 10 bits are 1s then SYNC
-				UE3Counter = 0;	// Phase lock on to byte boundary
-			else
-				UE3Counter++;
-		}
-		// UC5B (NOR used to invert UF4's output B serial clock) output high when UF4 counts 0,1,4,5,8,9,12 and 13
-		else if (((UF4Counter & 2) == 0) && (UE3Counter == 8))	// Phase locked on to byte boundary
-		{
-			UE3Counter = 0;
-			SO = (m_pVIA->GetFCR() & m6522::FCR_CA2_OUTPUT_MODE0) != 0;	// bit 2 of the FCR indicates "Byte Ready Active" turned on or not.
-//			writeShiftRegister = readShiftRegister;
-			m_pVIA->GetPortA()->SetInput(readShiftRegister & 0xff);
-		}
-	};
-}
-
-void Drive::DriveLoopReadNoFlux()
-{
-	unsigned int minCycles;
-	unsigned int cycles = 16;
-
-	fluxReversalCyclesLeft -= 16;
-
-	while (true)
-	{
-		minCycles = min(min(cyclesLeftForBit, cycles), UE7Counter);
-		cyclesLeftForBit -= minCycles;
-		cycles -= minCycles;
-		UE7Counter -= minCycles;
-
-		if (cycles == 0)
-			return;
-
-		if (cyclesLeftForBit == 0)
-		{
-			cyclesForBitErrorCounter -= cyclesPerBitErrorConstant;
-			cyclesLeftForBit = cyclesPerBitInt + (cyclesForBitErrorCounter < cyclesPerBitErrorConstant);
-
-			//cyclesForBit -= cyclesPerBit;
-			//cyclesLeftForBit = ceil(cyclesPerBit - cyclesForBit);
-			//cyclesForBit += cyclesLeftForBit;
-
-			if (GetNextBit())
-			{
-				ResetEncoderDecoder(18 * 16, /*20 * 16*/ 2 * 16);
-			}
-			if (cycles < UE7Counter)
-			{
-				UE7Counter -= cycles;
-				cyclesLeftForBit -= cycles;
-				return;
-			}
-			cyclesLeftForBit -= UE7Counter;
-			cycles -= UE7Counter;
-		}
-
-		//if (UE7Counter == 0x0) // The count carry (bit 4) clocks UF4.
-		{
-			UE7Counter = 16 - CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6) ie preload the encoder/decoder clock for the current density settings.
-										// The decoder consists of UF4 and UE5A. The ecoder has two outputs, Pin 1 of UE5A is the serial data output and pin 2 of UF4 (output B) is the serial clock output.
-			++UF4Counter &= 0xf; // Clock and clamp UF4.
-								 // The UD2 read shift register is clocked by serial clock (the rising edge of encoder/decoder's UF4 B output (serial clock))
-								 //	- ie on counts 2, 6, 10 and 14 (2 is the only count that outputs a 1 into readShiftRegister as the MSB bits of the count NORed together for other values are 0)
-			if ((UF4Counter & 0x3) == 2)
-			{
-				readShiftRegister <<= 1;
-				readShiftRegister |= (UF4Counter == 2);
-
-				//writeShiftRegister <<= 1;
-
-				bool resetTime = ((readShiftRegister & 0x3ff) == 0x3ff);
-				m_pVIA->GetPortB()->SetInput(0x80, !resetTime);
-				if (resetTime)	// if the last 10 bits are 1s then SYNC
-					UE3Counter = 0;	// Phase lock on to byte boundary
-				else
-					UE3Counter++;
-			}
-			// UC5B (NOR used to invert UF4's output B serial clock) output high when UF4 counts 0,1,4,5,8,9,12 and 13
-			else if (((UF4Counter & 2) == 0) && (UE3Counter == 8))	// Phase locked on to byte boundary
-			{
-				UE3Counter = 0;
-				SO = (m_pVIA->GetFCR() & m6522::FCR_CA2_OUTPUT_MODE0) != 0;	// bit 2 of the FCR indicates "Byte Ready Active" turned on or not.
-	//			writeShiftRegister = readShiftRegister;
-				m_pVIA->GetPortA()->SetInput(readShiftRegister & 0xff);
-			}
-		}
-	};
-}
-void Drive::DriveLoopReadNoCycles()
-{
-	unsigned int minCycles;
-	unsigned int cycles = 16;
-
-	cyclesLeftForBit -= 16;
-	while (true)
-	{
-		minCycles = min(cycles, min(UE7Counter, fluxReversalCyclesLeft));
-		fluxReversalCyclesLeft -= minCycles;
-		cycles -= minCycles;
-		UE7Counter -= minCycles;
-
-		if (cycles == 0)
-			return;
-
-		if (fluxReversalCyclesLeft == 0)//Not entirely right, a flux reversal will be skipped if a bit read was going to happen
-		{
-			ResetEncoderDecoder(2 * 16, /*25 * 16*/23 * 16); // Trigger a random noise generated zero crossing and start seeing more anywhere between 2us and 25us after this one.
-		}
-
-		if (UE7Counter == 0x0) // The count carry (bit 4) clocks UF4.
-		{
-			UE7Counter = 16 - CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6) ie preload the encoder/decoder clock for the current density settings.
-										// The decoder consists of UF4 and UE5A. The ecoder has two outputs, Pin 1 of UE5A is the serial data output and pin 2 of UF4 (output B) is the serial clock output.
-			++UF4Counter &= 0xf; // Clock and clamp UF4.
-								 // The UD2 read shift register is clocked by serial clock (the rising edge of encoder/decoder's UF4 B output (serial clock))
-								 //	- ie on counts 2, 6, 10 and 14 (2 is the only count that outputs a 1 into readShiftRegister as the MSB bits of the count NORed together for other values are 0)
-			if ((UF4Counter & 0x3) == 2)
-			{
-				readShiftRegister <<= 1;
-				readShiftRegister |= (UF4Counter == 2);
-
-				//writeShiftRegister <<= 1;
-
-				bool resetTime = ((readShiftRegister & 0x3ff) == 0x3ff);
-				m_pVIA->GetPortB()->SetInput(0x80, !resetTime);
-				if (resetTime)	// if the last 10 bits are 1s then SYNC
-					UE3Counter = 0;	// Phase lock on to byte boundary
-				else
-					UE3Counter++;
-			}
-			// UC5B (NOR used to invert UF4's output B serial clock) output high when UF4 counts 0,1,4,5,8,9,12 and 13
-			else if (((UF4Counter & 2) == 0) && (UE3Counter == 8))	// Phase locked on to byte boundary
-			{
-				UE3Counter = 0;
-				SO = (m_pVIA->GetFCR() & m6522::FCR_CA2_OUTPUT_MODE0) != 0;	// bit 2 of the FCR indicates "Byte Ready Active" turned on or not.
-	//			writeShiftRegister = readShiftRegister;
-				m_pVIA->GetPortA()->SetInput(readShiftRegister & 0xff);
-			}
-		}
-	};
-}
-
-void Drive::DriveLoopRead()
-{
-	unsigned int minCycles;
-	unsigned int cycles = 16;
-
-	while (true)
-	{
-		minCycles = min(min(cyclesLeftForBit, cycles), min(UE7Counter, fluxReversalCyclesLeft));
-		cyclesLeftForBit -= minCycles;
-		fluxReversalCyclesLeft -= minCycles;
-		cycles -= minCycles;
-		UE7Counter -= minCycles;
-
-		if (cycles == 0)
-			return;
-
-		if (cyclesLeftForBit == 0)
-		{
-			cyclesForBitErrorCounter -= cyclesPerBitErrorConstant;
-			cyclesLeftForBit = cyclesPerBitInt + (cyclesForBitErrorCounter < cyclesPerBitErrorConstant);
-
-			if (GetNextBit())
-			{
-				ResetEncoderDecoder(18 * 16, /*20 * 16*/ 2 * 16);
-			}
-		}
-
-		if (fluxReversalCyclesLeft == 0)//Not entirely right, a flux reversal will be skipped if a bit read was going to happen
-		{
-			ResetEncoderDecoder(2 * 16, /*25 * 16*/23 * 16); // Trigger a random noise generated zero crossing and start seeing more anywhere between 2us and 25us after this one.
-		}
-
-		if (UE7Counter == 0x0) // The count carry (bit 4) clocks UF4.
-		{
-			UE7Counter = 16-CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6) ie preload the encoder/decoder clock for the current density settings.
-										// The decoder consists of UF4 and UE5A. The ecoder has two outputs, Pin 1 of UE5A is the serial data output and pin 2 of UF4 (output B) is the serial clock output.
-			++UF4Counter &= 0xf; // Clock and clamp UF4.
-								 // The UD2 read shift register is clocked by serial clock (the rising edge of encoder/decoder's UF4 B output (serial clock))
-								 //	- ie on counts 2, 6, 10 and 14 (2 is the only count that outputs a 1 into readShiftRegister as the MSB bits of the count NORed together for other values are 0)
-			if ((UF4Counter & 0x3) == 2)
-			{
-				readShiftRegister <<= 1;
-				readShiftRegister |= (UF4Counter == 2);
-
-				//writeShiftRegister <<= 1;
-
-				bool resetTime = ((readShiftRegister & 0x3ff) == 0x3ff);
-				m_pVIA->GetPortB()->SetInput(0x80, !resetTime);
-				if (resetTime)	// if the last 10 bits are 1s then SYNC
-					UE3Counter = 0;	// Phase lock on to byte boundary
-				else
-					UE3Counter++;
-			}
-			// UC5B (NOR used to invert UF4's output B serial clock) output high when UF4 counts 0,1,4,5,8,9,12 and 13
-			else if (((UF4Counter & 2) == 0) && (UE3Counter == 8))	// Phase locked on to byte boundary
-			{
-				UE3Counter = 0;
-				SO = (m_pVIA->GetFCR() & m6522::FCR_CA2_OUTPUT_MODE0) != 0;	// bit 2 of the FCR indicates "Byte Ready Active" turned on or not.
-	//			writeShiftRegister = readShiftRegister;
-				m_pVIA->GetPortA()->SetInput(readShiftRegister & 0xff);
-			}
-		}
-	};
-}
-
-void Drive::DriveLoopWrite()
-{
-	unsigned int cycles = 16;
-	while(true)
-	{
-		if (cycles < UE7Counter)
-		{
-			UE7Counter -= cycles;
-			cycles = 0;
-			return;
-		}
-		
-		cycles -= UE7Counter;
-
-		UE7Counter = 16 - CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6) ie preload the encoder/decoder clock for the current density settings.
-									// The decoder consists of UF4 and UE5A. The ecoder has two outputs, Pin 1 of UE5A is the serial data output and pin 2 of UF4 (output B) is the serial clock output.
-		++UF4Counter &= 0xf; // Clock and clamp UF4.
-								// The UD2 read shift register is clocked by serial clock (the rising edge of encoder/decoder's UF4 B output (serial clock))
-								//	- ie on counts 2, 6, 10 and 14 (2 is the only count that outputs a 1 into readShiftRegister as the MSB bits of the count NORed together for other values are 0)
-		if ((UF4Counter & 0x3) == 2)
-		{
-			readShiftRegister <<= 1;
-			readShiftRegister |= (UF4Counter == 2); // Emulate UE5A and only shift in a 1 when pins 6 (output C) and 7 (output D) (bits 2 and 3 of UF4Counter are 0. ie the first count of the bit cell)
-
-			SetNextBit((writeShiftRegister & 0x80));
-
-			writeShiftRegister <<= 1;
-			// Note: SYNC can only trigger during reading as R/!W line is one of UC2's inputs.
-			UE3Counter++;
-		}
-		// UC5B (NOR used to invert UF4's output B serial clock) output high when UF4 counts 0,1,4,5,8,9,12 and 13
-		else if (((UF4Counter & 2) == 0) && (UE3Counter == 8))	// Phase locked on to byte boundary
-		{
-			UE3Counter = 0;
-			SO = (m_pVIA->GetFCR() & m6522::FCR_CA2_OUTPUT_MODE0) != 0;	// bit 2 of the FCR indicates "Byte Ready Active" turned on or not.
-			writeShiftRegister = m_pVIA->GetPortA()->GetOutput();
-		}
-	}
-}
-#endif
\ No newline at end of file
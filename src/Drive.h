@@ -21,18 +21,9 @@
 
 #include "m6522.h"
 #include "DiskImage.h"
+#include "SaveState.h"
 #include <stdlib.h>
 
-#if defined(EXPERIMENTALZERO)
-inline int ceil(float num) {
-	int inum = (int)num;
-	if (num == (float)inum) {
-		return inum;
-	}
-	return inum + 1;
-}
-#endif
-
 
 class Drive
 {
@@ -48,60 +39,54 @@ public:
 	static void OnPortOut(void*, unsigned char status);
 
 	bool Update();
-#if defined(EXPERIMENTALZERO)
-	void DriveLoopWrite();
-	void DriveLoopRead();
-	void DriveLoopReadNoFluxNoCycles();
-	void DriveLoopReadNoFlux();
-	void DriveLoopReadNoCycles();
-#endif
 
 	void Insert(DiskImage* diskImage);
 	inline const DiskImage* GetDiskImage() const { return diskImage; }
+	inline DiskImage* GetDiskImage() { return diskImage; }
 	void Eject();
 	void Reset();
+	// Takes on the mechanical and encoder/decoder state of another drive but keeps the disk that is inserted in this one.
+	void RestoreSnapshot(const Drive& snapshot);
+	// Head, motor and the encoder/decoder state. The disk itself is saved by the DiskImage.
+	void SaveState(SaveStateWriter& writer) const;
+	bool LoadState(SaveStateReader& reader);
 	inline unsigned Track() const { return headTrackPos; }
 	inline unsigned SectorPos() const { return headBitOffset >> 3; }
 	inline unsigned GetHeadBitOffset() const { return headBitOffset; }
 	inline bool IsMotorOn() const { return motor; }
+	// Update will not change anything until the motor is turned on or another disk is inserted.
+	inline bool IsIdle() const { return !motor && newDiskImageQueuedCylesRemaining == 0; }
 	inline bool IsLEDOn() const { return LED; }
 
 	inline unsigned char GetLastHeadDirection() const { return lastHeadDirection; } // For simulated head movement sounds
 private:
-#if defined(EXPERIMENTALZERO)
-	int32_t localSeed;
-	inline void ResetEncoderDecoder(unsigned int min, unsigned int /*max*/span)
-	{
-		UE7Counter = 16 - CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6)
-		UF4Counter = 0;
-		localSeed = ((localSeed * 1103515245) + 12345) & 0x7fffffff;
-		fluxReversalCyclesLeft = (span) * (localSeed >> 11) + min;
-	}
-#else
-	inline float GenerateRandomFluxReversalTime(float min, float max) { return ((max - min) * ((float)rand() / RAND_MAX)) + min; } // Inputs in micro seconds
-
-	inline void ResetEncoderDecoder(float min, float max)
+	// The next noise pulse will get past the valid pulse detector between minClocks and minClocks + spanClocks - 1 16Mhz clocks after the current one.
+	// The noise is from a LCG of the drive's own so it is the same on every Pi and replays the same from a save state.
+	inline void ResetEncoderDecoder(u32 minClocks, u32 spanClocks)
 	{
 		UE7Counter = CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6)
 		UF4Counter = 0;
-		randomFluxReversalTime = GenerateRandomFluxReversalTime(min, max);
+		noiseSeed = noiseSeed * 1103515245 + 12345;
+		noiseClocksLeft = minClocks + (((noiseSeed >> 16) * spanClocks) >> 16);
 	}
-#endif
+	void ClockEncoderDecoder(bool writing);
+	void ClockUE7(u32 clocks, bool writing);
 	inline void UpdateHeadSectorPosition()
 	{
 		// Disk spins at 300rpm = 5rps so to calculate how many 16Mhz cycles one rotation takes;-
 		// 16000000 / 5 = 3200000;
-		static const float CYCLES_16Mhz_PER_ROTATION = 3200000.0f;
+		static const u32 CYCLES_16Mhz_PER_ROTATION = 3200000;
 
+		bitsToFlux = 1;
+		if (diskImage == 0)
+			return;	// Constructed before any disk is inserted. Reset will be called again once one is.
+
+		diskImage->PrepareTrack(headTrackPos);
 		bitsInTrack = diskImage->BitsInTrack(headTrackPos);
 		headBitOffset %= bitsInTrack;
-		cyclesPerBit = CYCLES_16Mhz_PER_ROTATION / (float)bitsInTrack;
-#if defined(EXPERIMENTALZERO)
-		cyclesPerBitInt = cyclesPerBit;
-		cyclesPerBitErrorConstant = (unsigned int)((cyclesPerBit - ((float)cyclesPerBitInt)) * static_cast<float>(0xffffffff));
-		cyclesForBitErrorCounter = (unsigned int)(((cyclesForBit)-(int)(cyclesForBit)) * static_cast<float>(0xffffffff));
-#endif
-
+		bitClocks = CYCLES_16Mhz_PER_ROTATION / bitsInTrack;
+		bitClocksRemainder = CYCLES_16Mhz_PER_ROTATION % bitsInTrack;
+		bitError %= bitsInTrack;
 	}
 
 	inline void MoveHead(unsigned char headDirection)
@@ -124,23 +109,6 @@ private:
 
 	void DumpTrack(unsigned track); // Used for debugging disk images.
 
-#if defined(EXPERIMENTALZERO)
-	inline u32 AdvanceSectorPositionR(int& byteOffset)
-	{
-		if (++headBitOffset == bitsInTrack)
-			headBitOffset = 0;
-		byteOffset = headBitOffset >> 3;
-		return (~headBitOffset) & 7;
-	}
-#else
-	// No reason why I seperate these into individual read and write versions. I was just trying to get the bit stream to line up when rewriting over existing data.
-	inline u32 AdvanceSectorPositionR(int& byteOffset)
-	{
-		++headBitOffset %= bitsInTrack;
-		byteOffset = headBitOffset >> 3;
-		return (~headBitOffset) & 7;
-	}
-#endif
 	inline u32 AdvanceSectorPositionW(int& byteOffset)
 	{
 		byteOffset = headBitOffset >> 3;
@@ -148,24 +116,17 @@ private:
 		++headBitOffset %= bitsInTrack;
 		return bit;
 	}
-	unsigned cachedheadTrackPos = -1;
-	int cachedbyteOffset = -1;
-	unsigned char cachedByte = 0;
+	// Counts down the bits to the next one that could be a 1 (from the disk's flux index) so the 0s in between are not looked at.
+	// 1 means look at the next bit (ie after stepping, writing or inserting another disk).
+	u32 bitsToFlux = 1;
 	inline bool GetNextBit()
 	{
-		int byteOffset;
-		int bit = AdvanceSectorPositionR(byteOffset);
-
-		//Why is it faster to check both conditions here than to update the cache when moving the head?
-		if (byteOffset != cachedbyteOffset || cachedheadTrackPos != headTrackPos)
-		{
-			cachedByte = diskImage->GetNextByte(headTrackPos, byteOffset);
-			cachedbyteOffset = byteOffset;
-			cachedheadTrackPos = headTrackPos;
-			
-		}
-		return ((cachedByte >> bit) & 1) != 0;
-		//return diskImage->GetNextBit(headTrackPos, byteOffset, bit);
+		if (++headBitOffset >= bitsInTrack)
+			headBitOffset = 0;
+		if (--bitsToFlux)
+			return false;
+		bitsToFlux = diskImage->BitsToFlux(headTrackPos, headBitOffset);
+		return diskImage->GetNextBit(headTrackPos, headBitOffset >> 3, (~headBitOffset) & 7);
 	}
 
 	inline void SetNextBit(bool value)
@@ -173,6 +134,7 @@ private:
 		int byteOffset;
 		int bit = AdvanceSectorPositionW(byteOffset);
 		diskImage->SetBit(headTrackPos, byteOffset, bit, value);
+		bitsToFlux = 1;
 	}
 
 	DiskImage* diskImage;
@@ -189,30 +151,25 @@ private:
 	// CB2 (output)
 	//	- R/!W
 	m6522* m_pVIA;
-#if defined(EXPERIMENTALZERO)
-	unsigned int cyclesLeftForBit;
-	unsigned int fluxReversalCyclesLeft;
-	unsigned int UE7Counter;
-	u32 writeShiftRegister;
-	unsigned int cyclesForBitErrorCounter;
-	unsigned int cyclesPerBitErrorConstant;
-	unsigned int cyclesPerBitInt;
-#else
 	int UE7Counter;
 	u8 writeShiftRegister;
-#endif
-	float cyclesForBit;
 	u32 readShiftRegister;
 	unsigned headTrackPos;
 	u32 headBitOffset;
-	float randomFluxReversalTime;
+	// The bit cells in 16Mhz clocks. A cell is bitClocks long, or one more when bitError carries, so that a revolution is exactly 3200000 clocks.
+	u32 bitClocksLeft;
+	u32 bitError;
+	u32 bitClocks;
+	u32 bitClocksRemainder;
+	// 16Mhz clocks until a noise pulse gets through.
+	u32 noiseClocksLeft;
+	u32 noiseSeed;
 	int UF4Counter;
 	int UE3Counter;
 	int CLOCK_SEL_AB;
 	bool SO;
 	unsigned char lastHeadDirection;
 	u32 bitsInTrack;
-	float cyclesPerBit;
 	bool motor;
 	bool LED;
 };
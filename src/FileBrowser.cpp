@@ -1515,6 +1515,8 @@ void FileBrowser::DisplayDiskInfo(DiskImage* diskImage, const char* filenameForI
 			unsigned length = diskImage->TrackLength(track);
 			unsigned countSync = 0;
 
+			diskImage->PrepareTrack(track);
+
 			u8 shiftReg = 0;
 			for (index = 0; index < length / 8; ++index)
 			{
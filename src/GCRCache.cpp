@@ -0,0 +1,340 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#include "GCRCache.h"
+#include "DiskImage.h"
+#include "SaveState.h"
+#include "debug.h"
+#include <stdio.h>
+#include <string.h>
+
+// The index is a header (GCR_CACHE_INDEX_MAGIC, its version, the number of records and the clock) and then the records, little endian.
+#define GCR_CACHE_INDEX_MAGIC 0x58444947	// "GIDX"
+#define GCR_CACHE_INDEX_VERSION 1
+#define GCR_CACHE_RECORD_SIZE 32
+#define GCR_CACHE_INDEX_SIZE (12 + GCR_CACHE_ENTRIES * GCR_CACHE_RECORD_SIZE)
+
+GCRCache::GCRCache()
+	: limit(0)
+	, indexLoaded(false)
+	, count(0)
+	, clock(0)
+	, lastUsedChanged(false)
+{
+	directory[0] = 0;
+}
+
+void GCRCache::Configure(const char* directory, u32 limitKB)
+{
+	Flush();
+	strncpy(this->directory, directory, sizeof(this->directory) - 1);
+	this->directory[sizeof(this->directory) - 1] = 0;
+	limit = limitKB * 1024;
+	indexLoaded = false;
+	if (limit)
+		f_mkdir(directory);	// Fails if it is already there
+}
+
+// An index that cannot be read starts the cache afresh (the entries it had are written over as the images are mounted again).
+void GCRCache::LoadIndex()
+{
+	u8 buffer[GCR_CACHE_INDEX_SIZE];
+	char name[80];
+	FIL fp;
+	u32 bytesRead;
+
+	if (indexLoaded)
+		return;
+	indexLoaded = true;
+	lastUsedChanged = false;
+	count = 0;
+	clock = 0;
+
+	snprintf(name, sizeof(name), "%s/INDEX", directory);
+	if (f_open(&fp, name, FA_READ) != FR_OK)
+		return;
+	FRESULT res = f_read(&fp, buffer, sizeof(buffer), &bytesRead);
+	f_close(&fp);
+	if (res != FR_OK)
+		return;
+
+	SaveStateReader reader(buffer, bytesRead);
+	if (reader.Read32() != GCR_CACHE_INDEX_MAGIC || reader.Read16() != GCR_CACHE_INDEX_VERSION)
+		return;
+	u32 records = reader.Read16();
+	u32 indexClock = reader.Read32();
+	if (records > GCR_CACHE_ENTRIES)
+		return;
+	for (u32 index = 0; index < records; ++index)
+	{
+		Record& record = this->records[index];
+		record.pathHash = reader.Read32();
+		record.imageSize = reader.Read32();
+		record.imageDate = reader.Read16();
+		record.imageTime = reader.Read16();
+		record.headerHash = reader.Read32();
+		record.imageHash = reader.Read32();
+		record.version = reader.Read32();
+		record.size = reader.Read32();
+		record.lastUsed = reader.Read32();
+	}
+	if (reader.Failed())
+		return;
+	count = records;
+	clock = indexClock;
+}
+
+void GCRCache::SaveIndex()
+{
+	u8 buffer[GCR_CACHE_INDEX_SIZE];
+	char name[80];
+	FIL fp;
+	u32 bytesWritten;
+
+	SaveStateWriter writer(buffer, sizeof(buffer));
+	writer.Write32(GCR_CACHE_INDEX_MAGIC);
+	writer.Write16(GCR_CACHE_INDEX_VERSION);
+	writer.Write16(count);
+	writer.Write32(clock);
+	for (u32 index = 0; index < count; ++index)
+	{
+		const Record& record = records[index];
+		writer.Write32(record.pathHash);
+		writer.Write32(record.imageSize);
+		writer.Write16(record.imageDate);
+		writer.Write16(record.imageTime);
+		writer.Write32(record.headerHash);
+		writer.Write32(record.imageHash);
+		writer.Write32(record.version);
+		writer.Write32(record.size);
+		writer.Write32(record.lastUsed);
+	}
+
+	snprintf(name, sizeof(name), "%s/INDEX", directory);
+	if (f_open(&fp, name, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+	{
+		DEBUG_LOG("Cannot write %s\r\n", name);
+		return;
+	}
+	f_write(&fp, buffer, writer.Size(), &bytesWritten);
+	f_close(&fp);
+	lastUsedChanged = false;
+}
+
+void GCRCache::Flush()
+{
+	if (indexLoaded && lastUsedChanged)
+		SaveIndex();
+}
+
+// Images are opened relative to the current directory so that is part of what says which file an entry is for.
+u32 GCRCache::PathHash(const FILINFO* fileInfo) const
+{
+	char path[256];
+
+	if (f_getcwd(path, sizeof(path)) != FR_OK)
+		path[0] = 0;
+	u32 hash = HashBuffer(path, strlen(path));
+	hash = HashBuffer("/", 1, hash);
+	return HashBuffer(fileInfo->fname, strlen(fileInfo->fname), hash);
+}
+
+void GCRCache::EntryName(char* name, u32 imageHash, u32 version) const
+{
+	sprintf(name, "%s/%08X.V%02X", directory, (unsigned)imageHash, (unsigned)version);
+}
+
+int GCRCache::Find(u32 pathHash) const
+{
+	for (u32 index = 0; index < count; ++index)
+	{
+		if (records[index].pathHash == pathHash)
+			return index;
+	}
+	return -1;
+}
+
+// Removes the record and its entry (unless another image file has the same contents and so the same entry).
+void GCRCache::Remove(int index)
+{
+	char name[80];
+	u32 imageHash = records[index].imageHash;
+	u32 version = records[index].version;
+
+	records[index] = records[--count];
+	for (u32 other = 0; other < count; ++other)
+	{
+		if (records[other].imageHash == imageHash && records[other].version == version)
+			return;
+	}
+	EntryName(name, imageHash, version);
+	f_unlink(name);
+}
+
+u32 GCRCache::Used()
+{
+	u32 used = 0;
+
+	LoadIndex();
+	for (u32 index = 0; index < count; ++index)
+	{
+		u32 other;
+		for (other = 0; other < index; ++other)
+		{
+			if (records[other].imageHash == records[index].imageHash && records[other].version == records[index].version)
+				break;
+		}
+		if (other == index)
+			used += records[index].size;
+	}
+	return used;
+}
+
+bool GCRCache::Open(const FILINFO* fileInfo, u32 headerHash, FIL* entry, u32& imageHash)
+{
+	char name[80];
+
+	if (!IsEnabled())
+		return false;
+	LoadIndex();
+
+	int index = Find(PathHash(fileInfo));
+	if (index < 0)
+		return false;
+
+	Record& record = records[index];
+	if (record.imageSize != (u32)fileInfo->fsize || record.imageDate != fileInfo->fdate || record.imageTime != fileInfo->ftime
+		|| record.headerHash != headerHash || record.version != GCR_CACHE_CONVERTER_VERSION)
+	{
+		DEBUG_LOG("The cached tracks of %s are stale\r\n", fileInfo->fname);
+		Remove(index);
+		SaveIndex();
+		return false;
+	}
+
+	EntryName(name, record.imageHash, record.version);
+	if (f_open(entry, name, FA_READ) != FR_OK)
+	{
+		Remove(index);
+		SaveIndex();
+		return false;
+	}
+	imageHash = record.imageHash;
+	record.lastUsed = clock++;
+	lastUsedChanged = true;
+	return true;
+}
+
+bool GCRCache::Create(u32 imageHash, u32 size, FIL* entry)
+{
+	char name[80];
+
+	if (!IsEnabled() || size > limit)
+		return false;
+	LoadIndex();
+
+	// The least recently used go until there is room (an entry that is already there for another file with the same contents is written over).
+	bool evicted = false;
+	for (;;)
+	{
+		bool shared = false;
+		for (u32 index = 0; index < count; ++index)
+			shared |= records[index].imageHash == imageHash && records[index].version == GCR_CACHE_CONVERTER_VERSION;
+		if (count < GCR_CACHE_ENTRIES && (shared || Used() + size <= limit))
+			break;
+
+		u32 oldest = 0;
+		for (u32 index = 1; index < count; ++index)
+		{
+			if (records[index].lastUsed < records[oldest].lastUsed)
+				oldest = index;
+		}
+		DEBUG_LOG("Removing the cached tracks %08x (%d bytes)\r\n", records[oldest].imageHash, records[oldest].size);
+		Remove(oldest);
+		evicted = true;
+	}
+	if (evicted)
+		SaveIndex();
+
+	EntryName(name, imageHash, GCR_CACHE_CONVERTER_VERSION);
+	return f_open(entry, name, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK;
+}
+
+void GCRCache::Added(const FILINFO* fileInfo, u32 headerHash, u32 imageHash, u32 size)
+{
+	u32 pathHash = PathHash(fileInfo);
+	int index = Find(pathHash);
+
+	if (index >= 0)
+	{
+		// The file's old entry goes unless it is the one just written.
+		if (records[index].imageHash != imageHash || records[index].version != GCR_CACHE_CONVERTER_VERSION)
+		{
+			Remove(index);
+			index = -1;
+		}
+	}
+	if (index < 0)
+	{
+		if (count == GCR_CACHE_ENTRIES)
+			return;
+		index = count++;
+	}
+
+	Record& record = records[index];
+	record.pathHash = pathHash;
+	record.imageSize = (u32)fileInfo->fsize;
+	record.imageDate = fileInfo->fdate;
+	record.imageTime = fileInfo->ftime;
+	record.headerHash = headerHash;
+	record.imageHash = imageHash;
+	record.version = GCR_CACHE_CONVERTER_VERSION;
+	record.size = size;
+	record.lastUsed = clock++;
+	SaveIndex();
+}
+
+void GCRCache::Discard(u32 imageHash)
+{
+	char name[80];
+
+	for (u32 index = 0; index < count; )
+	{
+		if (records[index].imageHash == imageHash && records[index].version == GCR_CACHE_CONVERTER_VERSION)
+			records[index] = records[--count];
+		else
+			++index;
+	}
+	SaveIndex();
+	EntryName(name, imageHash, GCR_CACHE_CONVERTER_VERSION);
+	f_unlink(name);
+}
+
+void GCRCache::Forget(const FILINFO* fileInfo)
+{
+	if (!IsEnabled())
+		return;
+	LoadIndex();
+
+	int index = Find(PathHash(fileInfo));
+	if (index >= 0)
+	{
+		Remove(index);
+		SaveIndex();
+	}
+}
@@ -0,0 +1,94 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef GCRCACHE_H
+#define GCRCACHE_H
+
+#include "types.h"
+#include "ff.h"
+
+// Where the cache is kept on the SD card (outside of /1541 so that the browser does not list it).
+#define GCR_CACHE_DIRECTORY "/GCRCACHE"
+// Bump whenever the tracks extracted from a NIB would come out differently (eg extract_GCR_track or its alignment changes)
+// or the image's hash is worked out differently. Entries made by another version are never used
+// (each goes when its image is next mounted).
+#define GCR_CACHE_CONVERTER_VERSION 2
+#define GCR_CACHE_ENTRIES 64
+
+// Keeps the tracks extracted from NIBs (and NBZs) on the SD card so that mounting one again is a straight read of its tracks.
+// Each entry is a file named after the image's hash (see DiskImage::GetHash) and the converter version, written and read by DiskImage.
+// The index says which image file each entry is for; the path, size, date and time of the file and a hash of its first bytes.
+// If any of those have changed (or the image has been written back, see Forget) the entry is stale and the image is extracted again.
+// The least recently used entries are removed to keep the cache under its size limit.
+class GCRCache
+{
+public:
+	GCRCache();
+
+	// A limit of 0 turns the cache off.
+	void Configure(const char* directory, u32 limitKB);
+	inline bool IsEnabled() const { return limit != 0; }
+
+	// Looks for an entry for the image file (in the current directory) as it is now and opens it into entry.
+	bool Open(const FILINFO* fileInfo, u32 headerHash, FIL* entry, u32& imageHash);
+	// Makes room for an entry of size bytes and creates it; Added must be called once it has been written.
+	bool Create(u32 imageHash, u32 size, FIL* entry);
+	void Added(const FILINFO* fileInfo, u32 headerHash, u32 imageHash, u32 size);
+	// The entry created could not be written.
+	void Discard(u32 imageHash);
+	// The image file has changed (or its entry could not be read) so its entry must not be used again.
+	void Forget(const FILINFO* fileInfo);
+	// A hit only changes when an entry was last used, which is kept in memory rather than rewriting the index on every mount.
+	// This writes it out if that is all that has changed (eg when leaving emulation); anything else writes the index straight away.
+	void Flush();
+
+	// For the bench.
+	inline u32 Entries() { LoadIndex(); return count; }
+	u32 Used();
+
+private:
+	struct Record
+	{
+		u32 pathHash;
+		u32 imageSize;
+		u16 imageDate;
+		u16 imageTime;
+		u32 headerHash;
+		u32 imageHash;
+		u32 version;
+		u32 size;
+		u32 lastUsed;
+	};
+
+	void LoadIndex();
+	void SaveIndex();
+	u32 PathHash(const FILINFO* fileInfo) const;
+	void EntryName(char* name, u32 imageHash, u32 version) const;
+	int Find(u32 pathHash) const;
+	void Remove(int index);
+
+	char directory[64];
+	u32 limit;
+	bool indexLoaded;
+	Record records[GCR_CACHE_ENTRIES];
+	u32 count;
+	u32 clock;		// What the next record used gets for lastUsed
+	bool lastUsedChanged;	// Since the index was last written
+};
+
+#endif
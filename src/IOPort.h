@@ -19,6 +19,7 @@
 #ifndef IOPort_H
 #define IOPort_H
 #include <assert.h>
+#include "SaveState.h"
 
 typedef void(*PortOutFn)(void*, unsigned char status);
 
@@ -32,13 +33,17 @@ public:
 		if (state) stateIn |= pin;
 		else stateIn &= ~pin;
 	}
-	inline unsigned char GetInput() { return stateIn; }
+	inline unsigned char GetInput() const { return stateIn; }
 	inline void SetInput(unsigned char value) { stateIn = value; }
-	inline unsigned char GetOutput() { return stateOut; }
+	inline unsigned char GetOutput() const { return stateOut; }
 	inline void SetOutput(unsigned char value) { stateOut = value; if (portOutFn) (portOutFn)(portOutFnThis, stateOut & direction); }
-	inline unsigned char GetDirection() { return direction; }
+	inline unsigned char GetDirection() const { return direction; }
 	inline void SetDirection(unsigned char value) { direction = value; if (portOutFn) (portOutFn)(portOutFnThis, stateOut & direction); }
 	inline void SetPortOut(void* data, PortOutFn fn) { portOutFnThis = data; portOutFn = fn; }
+
+	// The port out function is not called when loading. The owner decides which connected devices need to be told.
+	void SaveState(SaveStateWriter& writer) const { writer.Write8(stateOut); writer.Write8(stateIn); writer.Write8(direction); }
+	void LoadState(SaveStateReader& reader) { stateOut = reader.Read8(); stateIn = reader.Read8(); direction = reader.Read8(); }
 private:
 	unsigned char stateOut;
 	unsigned char stateIn;
@@ -0,0 +1,132 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#include "ImageHash.h"
+#include "DiskImage.h"
+#include <string.h>
+
+#define PRIME1 2654435761U
+#define PRIME2 2246822519U
+#define PRIME3 3266489917U
+#define PRIME4 668265263U
+#define PRIME5 374761393U
+
+static inline u32 RotateLeft(u32 value, unsigned bits)
+{
+	return (value << bits) | (value >> (32 - bits));
+}
+
+// Little endian, and the image's pieces need not be word aligned.
+static inline u32 Read32(const u8* bytes)
+{
+	u32 value;
+	memcpy(&value, bytes, 4);
+	return value;
+}
+
+static inline u32 Round(u32 lane, u32 input)
+{
+	return RotateLeft(lane + input * PRIME2, 13) * PRIME1;
+}
+
+ImageHash::ImageHash(bool legacy)
+	: pendingSize(0)
+	, total(0)
+	, legacy(legacy)
+	, legacyHash(0x811c9dc5U)
+{
+	lanes[0] = PRIME1 + PRIME2;
+	lanes[1] = PRIME2;
+	lanes[2] = 0;
+	lanes[3] = 0 - PRIME1;
+}
+
+void ImageHash::Add(const void* data, u32 length)
+{
+	const u8* bytes = (const u8*)data;
+
+	if (legacy)
+		legacyHash = HashBuffer(data, length, legacyHash);
+	total += length;
+
+	if (pendingSize)
+	{
+		u32 fill = 16 - pendingSize < length ? 16 - pendingSize : length;
+		memcpy(pending + pendingSize, bytes, fill);
+		pendingSize += fill;
+		bytes += fill;
+		length -= fill;
+		if (pendingSize < 16)
+			return;
+		for (unsigned lane = 0; lane < 4; ++lane)
+			lanes[lane] = Round(lanes[lane], Read32(pending + lane * 4));
+		pendingSize = 0;
+	}
+
+	u32 lane0 = lanes[0];
+	u32 lane1 = lanes[1];
+	u32 lane2 = lanes[2];
+	u32 lane3 = lanes[3];
+	while (length >= 16)
+	{
+		lane0 = Round(lane0, Read32(bytes));
+		lane1 = Round(lane1, Read32(bytes + 4));
+		lane2 = Round(lane2, Read32(bytes + 8));
+		lane3 = Round(lane3, Read32(bytes + 12));
+		bytes += 16;
+		length -= 16;
+	}
+	lanes[0] = lane0;
+	lanes[1] = lane1;
+	lanes[2] = lane2;
+	lanes[3] = lane3;
+
+	memcpy(pending, bytes, length);
+	pendingSize = length;
+}
+
+u32 ImageHash::Value() const
+{
+	u32 hash;
+
+	if (total >= 16)
+		hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+	else
+		hash = lanes[2] + PRIME5;	// The seed
+	hash += total;
+
+	u32 index = 0;
+	for (; index + 4 <= pendingSize; index += 4)
+		hash = RotateLeft(hash + Read32(pending + index) * PRIME3, 17) * PRIME4;
+	for (; index < pendingSize; ++index)
+		hash = RotateLeft(hash + pending[index] * PRIME5, 11) * PRIME1;
+
+	hash ^= hash >> 15;
+	hash *= PRIME2;
+	hash ^= hash >> 13;
+	hash *= PRIME3;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+u32 ImageHash::Of(const void* data, u32 length)
+{
+	ImageHash hash;
+	hash.Add(data, length);
+	return hash.Value();
+}
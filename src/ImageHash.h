@@ -0,0 +1,49 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef IMAGEHASH_H
+#define IMAGEHASH_H
+
+#include "types.h"
+
+// Hashes an image as it is read, a piece at a time (the value does not depend on how it is split up).
+// This is xxHash32 (https://github.com/Cyan4973/xxHash) with a seed of 0; it works on 16 bytes at a time in 4 independent lanes,
+// where HashBuffer (FNV-1a) has to go a byte at a time, each waiting on a multiply of the one before.
+// It can work out the FNV-1a of the image as well for looking up the quirks that are still keyed by it (see QuirkTable).
+class ImageHash
+{
+public:
+	ImageHash(bool legacy = false);
+
+	void Add(const void* data, u32 length);
+	u32 Value() const;
+	// The FNV-1a of what was added (0 unless it was asked for).
+	inline u32 LegacyValue() const { return legacy ? legacyHash : 0; }
+
+	static u32 Of(const void* data, u32 length);
+
+private:
+	u32 lanes[4];
+	u8 pending[16];		// What has been added since the last 16 bytes were
+	u32 pendingSize;
+	u32 total;
+	bool legacy;
+	u32 legacyHash;
+};
+
+#endif
@@ -0,0 +1,56 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+// 
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#include "MemoryMap.h"
+
+void MemoryMap::Clear()
+{
+	MapIO(0, 0x10000, ReadEmptyBus, WriteIgnored);
+}
+
+void MemoryMap::MapRAM(u16 address, u32 size, u8* memory, u16 mask)
+{
+	for (u32 page = address >> 8; page < (address + size) >> 8; ++page)
+	{
+		readPages[page] = writePages[page] = memory + ((page << 8) & mask);
+		readHandlers[page] = ReadEmptyBus;
+		writeHandlers[page] = WriteIgnored;
+	}
+}
+
+void MemoryMap::MapROM(u16 address, u32 size, const u8* memory, u16 mask)
+{
+	for (u32 page = address >> 8; page < (address + size) >> 8; ++page)
+	{
+		readPages[page] = memory + ((page << 8) & mask);
+		writePages[page] = 0;
+		readHandlers[page] = ReadEmptyBus;
+		writeHandlers[page] = WriteIgnored;
+	}
+}
+
+void MemoryMap::MapIO(u16 address, u32 size, PageReadFn read, PageWriteFn write)
+{
+	for (u32 page = address >> 8; page < (address + size) >> 8; ++page)
+	{
+		readPages[page] = 0;
+		writePages[page] = 0;
+		readHandlers[page] = read;
+		writeHandlers[page] = write;
+	}
+}
@@ -0,0 +1,74 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+// 
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef MEMORYMAP_H
+#define MEMORYMAP_H
+
+#include "types.h"
+
+typedef u8(*PageReadFn)(u16 address);
+typedef void(*PageWriteFn)(u16 address, const u8 value);
+
+// The 6502's 64K address space as 256 pages of 256 bytes.
+// A page backed by RAM or ROM holds a pointer straight to the memory so an access is a single indexed load or store.
+// Any other page (I/O chips, unconnected or a write to ROM) has a null pointer and calls the page's handler instead.
+// The map is built once when emulation starts so the bus functions never need to decode an address.
+class MemoryMap
+{
+public:
+	MemoryMap() { Clear(); }
+
+	// Every page becomes an empty bus (reads return the high byte of the address, writes are ignored).
+	void Clear();
+
+	// Maps size bytes from address onto memory. Address bits outside mask are ignored (so mask 0x7ff mirrors 2K across the range).
+	void MapRAM(u16 address, u32 size, u8* memory, u16 mask);
+	// As MapRAM but writes are ignored.
+	void MapROM(u16 address, u32 size, const u8* memory, u16 mask);
+	void MapIO(u16 address, u32 size, PageReadFn read, PageWriteFn write);
+
+	inline u8 Read(u16 address)
+	{
+		u32 page = address >> 8;
+		const u8* memory = readPages[page];
+		if (memory)
+			return memory[address & 0xff];
+		return readHandlers[page](address);
+	}
+
+	inline void Write(u16 address, const u8 value)
+	{
+		u32 page = address >> 8;
+		u8* memory = writePages[page];
+		if (memory)
+			memory[address & 0xff] = value;
+		else
+			writeHandlers[page](address, value);
+	}
+
+	static u8 ReadEmptyBus(u16 address) { return address >> 8; }
+	static void WriteIgnored(u16 address, const u8 value) {}
+
+private:
+	const u8* readPages[256];
+	u8* writePages[256];
+	PageReadFn readHandlers[256];
+	PageWriteFn writeHandlers[256];
+};
+
+#endif
@@ -18,10 +18,11 @@
 
 #include "Pi1541.h"
 #include "debug.h"
-#include "options.h"
 #include "ROMs.h"
+#include "ff.h"
+#include <stdlib.h>
+#include <string.h>
 
-extern Options options;
 extern Pi1541 pi1541;
 extern u8 s_u8Memory[0xc000];
 extern ROMs roms;
@@ -30,66 +31,15 @@ extern ROMs roms;
 // 6502 Address bus functions.
 // Move here out of Pi1541 to increase performance.
 ///////////////////////////////////////////////////////////////////////////////////////
-// In a 1541 address decoding and chip selects are performed by a 74LS42 ONE-OF-TEN DECODER
-// 74LS42 Ouputs a low to the !CS based on the four inputs provided by address bits 10-13
-// 1800 !cs2 on pin 9
-// 1c00 !cs2 on pin 7
+// The address decoding is done once by Pi1541::BuildMemoryMap so these are the whole bus.
 u8 read6502(u16 address)
 {
-	u8 value = 0;
-	if (address & 0x8000)
-	{
-		switch (address & 0xe000) // keep bits 15,14,13
-		{
-			case 0x8000: // 0x8000-0x9fff
-				if (options.GetRAMBOard()) {
-					value = s_u8Memory[address]; // 74LS42 outputs low on pin 1 or pin 2
-					break;
-				}
-			case 0xa000: // 0xa000-0xbfff
-			case 0xc000: // 0xc000-0xdfff
-			case 0xe000: // 0xe000-0xffff
-				value = roms.Read(address);
-				break;
-		}
-	}
-	else
-	{
-		// Address lines 15, 12, 11 and 10 are fed into a 74LS42 for decoding
-		u16 addressLines12_11_10 = (address & 0x1c00) >> 10;
-		switch (addressLines12_11_10)
-		{
-			case 0:
-			case 1:
-				value = s_u8Memory[address & 0x7ff]; // 74LS42 outputs low on pin 1 or pin 2
-				break;
-			case 6:
-				value = pi1541.VIA[0].Read(address);	// 74LS42 outputs low on pin 7
-				break;
-			case 7:
-				value = pi1541.VIA[1].Read(address);	// 74LS42 outputs low on pin 9
-				break;
-			default:
-				value = address >> 8;	// Empty address bus
-				break;
-		}
-	}
-	return value;
+	return pi1541.memoryMap.Read(address);
 }
 
-// Allows a mode where we have RAM at all addresses other than the ROM and the VIAs. (Maybe useful to someone?)
-u8 read6502ExtraRAM(u16 address)
+void write6502(u16 address, const u8 value)
 {
-	if (address & 0x8000)
-	{
-		return roms.Read(address);
-	}
-	else
-	{
-		u16 addressLines11And12 = address & 0x1800;
-		if (addressLines11And12 == 0x1800) return pi1541.VIA[(address & 0x400) != 0].Read(address);	// address line 10 indicates what VIA to index
-		return s_u8Memory[address & 0x7fff];
-	}
+	pi1541.memoryMap.Write(address, value);
 }
 
 // Use for debugging (Reads VIA registers without the regular VIA read side effects)
@@ -113,63 +63,87 @@ u8 peek6502(u16 address)
 	return value;
 }
 
-void write6502(u16 address, const u8 value)
+static u8 ReadVIA0(u16 address)
+{
+	pi1541.IdleLoopVIARead(address);
+	return pi1541.VIA[0].Read(address);
+}
+
+static void WriteVIA0(u16 address, const u8 value)
+{
+	pi1541.IdleLoopVIAWrite(address);
+	pi1541.VIA[0].Write(address, value);
+}
+
+static u8 ReadVIA1(u16 address)
+{
+	pi1541.IdleLoopVIARead(address);
+	return pi1541.VIA[1].Read(address);
+}
+
+static void WriteVIA1(u16 address, const u8 value)
+{
+	pi1541.IdleLoopVIAWrite(address);
+	pi1541.VIA[1].Write(address, value);
+}
+
+// In a 1541 address decoding and chip selects are performed by a 74LS42 ONE-OF-TEN DECODER
+// 74LS42 Ouputs a low to the !CS based on the four inputs provided by address bits 10-13
+// 1800 !cs2 on pin 9
+// 1c00 !cs2 on pin 7
+// Address line 15 selects the ROM. Below that lines 13 and 14 are not decoded so the RAM and VIAs repeat every 8K.
+// extraRAM allows a mode where we have RAM at all addresses other than the ROM and the VIAs. (Maybe useful to someone?)
+// RAMBoard puts RAM at 0x8000-0x9fff in place of the first mirror of the ROM.
+void Pi1541::BuildMemoryMap(bool extraRAM, bool RAMBoard)
 {
-	if (address & 0x8000)
+	this->extraRAM = extraRAM;
+	this->RAMBoard = RAMBoard;
+
+	memoryMap.Clear();
+	for (u32 address = 0; address < 0x8000; address += 0x2000)
 	{
-		switch (address & 0xe000) // keep bits 15,14,13
+		if (extraRAM)
 		{
-			case 0x8000: // 0x8000-0x9fff
-				if (options.GetRAMBOard()) {
-					s_u8Memory[address] = value; // 74LS42 outputs low on pin 1 or pin 2
-					break;
-				}
-			case 0xa000: // 0xa000-0xbfff
-			case 0xc000: // 0xc000-0xdfff
-			case 0xe000: // 0xe000-0xffff
-				return;
+			memoryMap.MapRAM(address, 0x800, s_u8Memory, 0x7fff);
+			memoryMap.MapROM(address + 0x800, 0x1000, s_u8Memory, 0x7fff);	// Can be read but writes are ignored
 		}
-	}
-	else
-	{
-		// Address lines 15, 12, 11 and 10 are fed into a 74LS42 for decoding
-		u16 addressLines12_11_10 = (address & 0x1c00) >> 10;
-		switch (addressLines12_11_10)
+		else
 		{
-			case 0:
-			case 1:
-				s_u8Memory[address & 0x7ff] = value; // 74LS42 outputs low on pin 1 or pin 2
-				break;
-			case 6:
-				pi1541.VIA[0].Write(address, value);	// 74LS42 outputs low on pin 7
-				break;
-			case 7:
-				pi1541.VIA[1].Write(address, value);	// 74LS42 outputs low on pin 9
-				break;
-			default:
-				break;
+			memoryMap.MapRAM(address, 0x800, s_u8Memory, 0x7ff);	// 74LS42 outputs low on pin 1 or pin 2
 		}
+		memoryMap.MapIO(address + 0x1800, 0x400, ReadVIA0, WriteVIA0);	// 74LS42 outputs low on pin 7
+		memoryMap.MapIO(address + 0x1c00, 0x400, ReadVIA1, WriteVIA1);	// 74LS42 outputs low on pin 9
 	}
+	memoryMap.MapROM(0x8000, 0x8000, roms.ROMImages[roms.currentROMIndex], 0x3fff);
+	if (RAMBoard && !extraRAM)
+		memoryMap.MapRAM(0x8000, 0x2000, s_u8Memory, 0xffff);
 }
 
-void write6502ExtraRAM(u16 address, const u8 value)
-{
-	if (address & 0x8000) return; // address line 15 selects the ROM
-	u16 addressLines11And12 = address & 0x1800;
-	if (addressLines11And12 == 0) s_u8Memory[address & 0x7fff] = value;
-	else if (addressLines11And12 == 0x1800) pi1541.VIA[(address & 0x400) != 0].Write(address, value);	// address line 10 indicates what VIA to index
-}
-
-Pi1541::Pi1541()
+Pi1541::Pi1541() : extraRAM(false), RAMBoard(false), paused(false), busyCycles(0), idleCycles(0)
 {
+	memset(breakpoints, 0, sizeof(breakpoints));
+	idleLoop.head = 0;
+	idleLoop.lastPC = 0;
+	idleLoop.headCycle = 0;
+	idleLoop.period = 0;
+	idleLoop.misses = 0;
+	idleLoop.confirmed = false;
+	idleLoop.disturbed = true;
+	idleLoop.RAMCopied = false;
 	VIA[0].ConnectIRQ(&m6502.IRQ);
 	VIA[1].ConnectIRQ(&m6502.IRQ);
+	// VIA1 (the drive's) has always been executed before VIA0 (the bus's) and the slot order keeps it that way.
+	VIA[1].ConnectScheduler(&scheduler, 0);
+	VIA[0].ConnectScheduler(&scheduler, 1);
 }
 
 void Pi1541::Initialise()
 {
 	VIA[0].ConnectIRQ(&m6502.IRQ);
 	VIA[1].ConnectIRQ(&m6502.IRQ);
+	// VIA1 (the drive's) has always been executed before VIA0 (the bus's) and the slot order keeps it that way.
+	VIA[1].ConnectScheduler(&scheduler, 0);
+	VIA[0].ConnectScheduler(&scheduler, 1);
 }
 
 //void Pi1541::ConfigureOfExtraRAM(bool extraRAM)
@@ -182,15 +156,87 @@ void Pi1541::Initialise()
 
 void Pi1541::Update()
 {
-	if (drive.Update())
+	// With the motor off and no disk swap pending Drive::Update only repeats what it did last time.
+	if (!drive.IsIdle() && drive.Update())
 	{
 		//This pin sets the overflow flag on a negative transition from TTL one to TTL zero.
 		// SO is sampled at the trailing edge of P1, the cpu V flag is updated at next P1.
 		m6502.SO();
 	}
 
-	VIA[1].Execute();
-	VIA[0].Execute();
+	// Rather than executing both VIAs every cycle the scheduler only brings them up to date on the cycle one of them has something to do.
+	scheduler.Tick();
+	busyCycles++;
+}
+
+// The IEC bus has to be read and driven on every cycle so a run can never jump ahead to the next VIA event.
+// What it saves is the hand written loop (and its per cycle checks) in each caller.
+u32 Pi1541::RunCycles(u32 cycles, u32 flags)
+{
+	bool resuming = paused;
+	u32 run;
+
+	paused = false;
+	for (run = 0; run < cycles; ++run)
+	{
+		if (flags & RUN_REFRESH_BUS_EARLY)
+		{
+			IEC_Bus::ReadEmulationMode1541();
+			IEC_Bus::RefreshOuts1541();
+			IEC_Bus::OutputLED = drive.IsLEDOn();
+		}
+		else if (flags & RUN_READ_BUS)
+		{
+			IEC_Bus::ReadEmulationMode1541();
+		}
+
+		if (resuming)
+		{
+			resuming = false;	// Already looked at this instruction before pausing
+		}
+		else if ((flags & (RUN_BREAKPOINTS | RUN_IDLE_LOOPS)) && m6502.SYNC())	// About to start a new instruction.
+		{
+			u16 pc = m6502.GetPC();
+
+			if (flags & RUN_BREAKPOINTS)
+			{
+				for (unsigned index = 0; index < RUN_MAX_BREAKPOINTS; ++index)
+				{
+					if (pc && breakpoints[index] == pc)
+						paused = true;
+				}
+			}
+			if (flags & RUN_IDLE_LOOPS)
+			{
+				IdleLoopSync(pc);
+				if (IdleLoopIterations(IDLE_LOOP_MAX_WAIT))
+					paused = true;
+			}
+			if (paused)
+				break;
+		}
+
+		m6502.Step();	// If the CPU reads or writes to the VIA then clk and data can change
+
+		//To artificialy delay the outputs later into the phi2's cycle (do this on future Pis that will be faster and perhaps too fast)
+		//read32(ARM_SYSTIMER_CLO);	//Each one of these is > 100ns
+
+		if (flags & RUN_REFRESH_BUS)
+		{
+			IEC_Bus::RefreshOuts1541();	// Now output all outputs.
+			IEC_Bus::OutputLED = drive.IsLEDOn();
+		}
+
+		// We have now output so HERE is where the next phi2 cycle starts.
+		Update();
+	}
+	return run;
+}
+
+void Pi1541::SetBreakpoints(const u16* addresses, unsigned count)
+{
+	for (unsigned index = 0; index < RUN_MAX_BREAKPOINTS; ++index)
+		breakpoints[index] = index < count ? addresses[index] : 0;
 }
 
 void Pi1541::Reset()
@@ -214,5 +260,326 @@ void Pi1541::Reset()
 	VIABortB->SetInput(VIAPORTPINS_DATAOUT, true);
 	VIABortB->SetInput(VIAPORTPINS_CLOCKOUT, true);
 	VIABortB->SetInput(VIAPORTPINS_ATNAOUT, true);
+
+	busyCycles = 0;
+	idleCycles = 0;
+	paused = false;
+	idleLoop.confirmed = false;
+	idleLoop.disturbed = true;
+	idleLoop.RAMCopied = false;
 }
 
+struct BootSnapshot
+{
+	bool valid;
+	u8 deviceID;
+	bool extraRAM;
+	bool RAMBoard;
+	M6502 m6502;
+	m6522 VIA[2];
+	Drive drive;
+	u8 memory[0xa000];
+};
+
+static BootSnapshot bootSnapshots[ROMs::MAX_ROMS];
+
+static u32 RAMSize(bool extraRAM, bool RAMBoard)
+{
+	if (extraRAM)
+		return 0x8000;
+	if (RAMBoard)
+		return 0xa000;
+	return 0x800;
+}
+
+static u8 idleLoopRAM[0xa000];
+
+// Called at the start of an instruction that is either the loop head or the target of a backwards jump or return.
+void Pi1541::IdleLoopCheck(u16 pc)
+{
+	u32 now = scheduler.Now();
+
+	if (pc < IDLE_LOOP_MIN_HEAD)
+		return;
+
+	if (pc != idleLoop.head)
+	{
+		// Give the current head a chance to come round again (and repeat) before trying this one.
+		if (idleLoop.misses < IDLE_LOOP_MAX_MISSES && now - idleLoop.headCycle < IDLE_LOOP_MAX_PERIOD)
+			return;
+		idleLoop.head = pc;
+		idleLoop.misses = 0;
+		idleLoop.confirmed = false;
+		idleLoop.RAMCopied = false;
+		IdleLoopBegin(now);
+		return;
+	}
+
+	if (now == idleLoop.headCycle)
+		return;	// Still on the same cycle (ie just after SkipIdleLoop)
+
+	idleLoop.confirmed = false;
+	VIA[0].Synchronise();
+	VIA[1].Synchronise();
+	bool same = !idleLoop.disturbed && drive.IsIdle()
+		&& m6502.IsSameState(idleLoop.cpu) && VIA[0].IsSameState(idleLoop.VIA[0]) && VIA[1].IsSameState(idleLoop.VIA[1]);
+	u32 size = RAMSize(extraRAM, RAMBoard);
+
+	if (same && idleLoop.RAMCopied && memcmp(idleLoopRAM, s_u8Memory, size) == 0)
+	{
+		idleLoop.period = now - idleLoop.headCycle;
+		idleLoop.confirmed = true;
+		idleLoop.misses = 0;
+		idleLoop.headCycle = now;
+		idleLoop.disturbed = false;
+		return;
+	}
+
+	// Copying the RAM is the expensive part so only do it once the CPU and VIAs have come round the same.
+	idleLoop.misses++;
+	idleLoop.RAMCopied = same;
+	if (same)
+		memcpy(idleLoopRAM, s_u8Memory, size);
+	IdleLoopBegin(now);
+}
+
+void Pi1541::IdleLoopBegin(u32 now)
+{
+	idleLoop.cpu = m6502;
+	idleLoop.VIA[0] = VIA[0];
+	idleLoop.VIA[1] = VIA[1];
+	idleLoop.headCycle = now;
+	idleLoop.disturbed = false;
+}
+
+// Only valid straight after IdleLoopSync at the loop head.
+u32 Pi1541::IdleLoopIterations(u32 maxCycles) const
+{
+	if (!idleLoop.confirmed || idleLoop.headCycle != scheduler.Now() || !m6502.SYNC() || m6502.GetPC() != idleLoop.head)
+		return 0;
+
+	// Skipping must stop short of the cycle either VIA has its next event on.
+	u32 cycles = scheduler.QuietCycles();
+	if (maxCycles < cycles)
+		cycles = maxCycles;
+	return cycles / idleLoop.period;
+}
+
+// The CPU and RAM are already in the state every iteration ends in. Only the VIA counters move on and they catch up by themselves.
+void Pi1541::SkipIdleLoop(u32 iterations)
+{
+	u32 cycles = iterations * idleLoop.period;
+
+	scheduler.Advance(cycles);
+	idleCycles += cycles;
+	idleLoop.headCycle = scheduler.Now();
+
+	// The next iteration has to be seen to repeat again before skipping more.
+	idleLoop.confirmed = false;
+}
+
+void Pi1541::SaveBootSnapshot(unsigned romIndex, u8 deviceID)
+{
+	if (romIndex >= ROMs::MAX_ROMS)
+		return;
+
+	// If the computer was talking on the bus during the self test then the VIA's inputs will not match what IEC_Bus::Reset assumes.
+	if (IEC_Bus::IsAtnAsserted())
+		return;
+
+	VIA[0].Synchronise();
+	VIA[1].Synchronise();
+
+	BootSnapshot& snapshot = bootSnapshots[romIndex];
+	snapshot.deviceID = deviceID;
+	snapshot.extraRAM = extraRAM;
+	snapshot.RAMBoard = RAMBoard;
+	snapshot.m6502 = m6502;
+	snapshot.VIA[0] = VIA[0];
+	snapshot.VIA[1] = VIA[1];
+	snapshot.drive = drive;
+	memcpy(snapshot.memory, s_u8Memory, RAMSize(extraRAM, RAMBoard));
+	snapshot.valid = true;
+}
+
+bool Pi1541::RestoreBootSnapshot(unsigned romIndex, u8 deviceID)
+{
+	if (romIndex >= ROMs::MAX_ROMS)
+		return false;
+
+	const BootSnapshot& snapshot = bootSnapshots[romIndex];
+	if (!snapshot.valid || snapshot.deviceID != deviceID || snapshot.extraRAM != extraRAM || snapshot.RAMBoard != RAMBoard)
+		return false;
+
+	m6502 = snapshot.m6502;
+	VIA[0] = snapshot.VIA[0];
+	VIA[1] = snapshot.VIA[1];
+	VIA[0].Rebase();
+	VIA[1].Rebase();
+	drive.RestoreSnapshot(snapshot.drive);
+	memcpy(s_u8Memory, snapshot.memory, RAMSize(extraRAM, RAMBoard));
+
+	// Reset has just put IEC_Bus into its released state (as the snapshot was taken in). Bring its outputs in line with what the restored VIA is driving.
+	IOPort* VIAPortB = VIA[0].GetPortB();
+	VIAPortB->SetOutput(VIAPortB->GetOutput());
+	return true;
+}
+
+// The most a state can take (with every track dirty). The buffer it goes through is only allocated while a file is saved or loaded.
+#define SAVESTATE_MAX_SIZE (0xa000 + HALF_TRACK_COUNT * (MAX_TRACK_LENGTH + 4) + 1024)
+
+u32 Pi1541::SaveState(u8* buffer, u32 size)
+{
+	SaveStateWriter writer(buffer, size);
+
+	VIA[0].Synchronise();
+	VIA[1].Synchronise();
+
+	writer.Write32(SAVESTATE_MAGIC);
+	writer.Write16(SAVESTATE_VERSION);
+	writer.Write16(0);
+
+	writer.BeginSection(SAVESTATE_TAG('C', 'P', 'U', ' '));
+	m6502.SaveState(writer);
+	writer.EndSection();
+
+	writer.BeginSection(SAVESTATE_TAG('V', 'I', 'A', '0'));
+	VIA[0].SaveState(writer);
+	writer.EndSection();
+
+	writer.BeginSection(SAVESTATE_TAG('V', 'I', 'A', '1'));
+	VIA[1].SaveState(writer);
+	writer.EndSection();
+
+	writer.BeginSection(SAVESTATE_TAG('D', 'R', 'I', 'V'));
+	drive.SaveState(writer);
+	writer.EndSection();
+
+	writer.BeginSection(SAVESTATE_TAG('R', 'A', 'M', ' '));
+	writer.WriteBytes(s_u8Memory, RAMSize(extraRAM, RAMBoard));
+	writer.EndSection();
+
+	if (drive.GetDiskImage())
+	{
+		writer.BeginSection(SAVESTATE_TAG('D', 'I', 'S', 'K'));
+		drive.GetDiskImage()->SaveDirtyTracks(writer);
+		writer.EndSection();
+	}
+
+	if (writer.Overflowed())
+		return 0;
+	return writer.Size();
+}
+
+bool Pi1541::LoadState(const u8* buffer, u32 size)
+{
+	SaveStateReader reader(buffer, size);
+	SaveStateReader section(0, 0);
+	u32 tag;
+	unsigned loaded = 0;
+	bool ok = true;
+
+	if (reader.Read32() != SAVESTATE_MAGIC || reader.Read16() != SAVESTATE_VERSION)
+	{
+		DEBUG_LOG("Not a version %d save state\r\n", SAVESTATE_VERSION);
+		return false;
+	}
+	reader.Read16();
+
+	while (ok && reader.NextSection(tag, section))
+	{
+		switch (tag)
+		{
+			case SAVESTATE_TAG('C', 'P', 'U', ' '):
+				ok = m6502.LoadState(section);
+				loaded |= 1;
+			break;
+			case SAVESTATE_TAG('V', 'I', 'A', '0'):
+				ok = VIA[0].LoadState(section);
+				loaded |= 2;
+			break;
+			case SAVESTATE_TAG('V', 'I', 'A', '1'):
+				ok = VIA[1].LoadState(section);
+				loaded |= 4;
+			break;
+			case SAVESTATE_TAG('D', 'R', 'I', 'V'):
+				ok = drive.LoadState(section);
+				loaded |= 8;
+			break;
+			case SAVESTATE_TAG('R', 'A', 'M', ' '):
+				section.ReadBytes(s_u8Memory, RAMSize(extraRAM, RAMBoard));
+				ok = !section.Failed() && section.AtEnd();
+				loaded |= 16;
+			break;
+			case SAVESTATE_TAG('D', 'I', 'S', 'K'):
+				ok = drive.GetDiskImage() && drive.GetDiskImage()->LoadDirtyTracks(section);
+			break;
+			default:	// From a later version of the same major format
+			break;
+		}
+	}
+
+	if (!ok || reader.Failed() || loaded != 31)
+	{
+		DEBUG_LOG("Save state is damaged or for another memory layout\r\n");
+		Reset();
+		return false;
+	}
+
+	idleLoop.confirmed = false;
+	idleLoop.disturbed = true;
+	idleLoop.RAMCopied = false;
+
+	// Tell IEC_Bus what the restored VIA is driving.
+	IOPort* VIAPortB = VIA[0].GetPortB();
+	VIAPortB->SetOutput(VIAPortB->GetOutput());
+	return true;
+}
+
+bool Pi1541::SaveStateToFile(const char* fileName)
+{
+	FIL fp;
+	u32 bytesWritten;
+	u8* buffer = (u8*)malloc(SAVESTATE_MAX_SIZE);
+
+	if (buffer == 0)
+	{
+		DEBUG_LOG("Cannot allocate %d bytes to save state\r\n", SAVESTATE_MAX_SIZE);
+		return false;
+	}
+	u32 size = SaveState(buffer, SAVESTATE_MAX_SIZE);
+	if (size == 0 || f_open(&fp, fileName, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+	{
+		DEBUG_LOG("Cannot save state to %s\r\n", fileName);
+		free(buffer);
+		return false;
+	}
+	FRESULT res = f_write(&fp, buffer, size, &bytesWritten);
+	f_close(&fp);
+	free(buffer);
+	return res == FR_OK && bytesWritten == size;
+}
+
+bool Pi1541::LoadStateFromFile(const char* fileName)
+{
+	FIL fp;
+	u32 bytesRead;
+
+	if (f_open(&fp, fileName, FA_READ) != FR_OK)
+	{
+		DEBUG_LOG("Cannot open save state %s\r\n", fileName);
+		return false;
+	}
+	u8* buffer = (u8*)malloc(SAVESTATE_MAX_SIZE);
+	if (buffer == 0)
+	{
+		DEBUG_LOG("Cannot allocate %d bytes to load state\r\n", SAVESTATE_MAX_SIZE);
+		f_close(&fp);
+		return false;
+	}
+	FRESULT res = f_read(&fp, buffer, SAVESTATE_MAX_SIZE, &bytesRead);
+	f_close(&fp);
+	bool loaded = res == FR_OK && LoadState(buffer, bytesRead);
+	free(buffer);
+	return loaded;
+}
@@ -22,6 +22,23 @@
 #include "Drive.h"
 #include "m6502.h"
 #include "iec_bus.h"
+#include "MemoryMap.h"
+#include "Scheduler.h"
+
+// When the emulated CPU starts we execute the first million odd cycles in non-real-time (ie as fast as possible so the emulated 1541 becomes responsive to CBM-Browser asap)
+// During these cycles the CPU is executing the ROM self test routines (these do not need to be cycle accurate)
+// ***1581*** Skip to AFCA (how many cycles is this?)
+#define FAST_BOOT_CYCLES 1003061
+
+// A loop head that has not come round again within this many cycles is given up on for the next backwards jump.
+#define IDLE_LOOP_MAX_PERIOD 4096
+// As is one that has come round this many times without repeating. It takes three times round to confirm a loop (see IdleLoopCheck).
+#define IDLE_LOOP_MAX_MISSES 3
+// Upper bound on how long the buttons and keyboard go unchecked while the 1541 is idle.
+#define IDLE_LOOP_MAX_WAIT 2000
+// Only loops in the ROM are fast-forwarded. Drive code loaded into RAM (eg a fastloader) can poll the bus in a loop that
+// looks just as idle but counts cycles once it sees an edge, and the edge is only seen some microseconds late while waiting.
+#define IDLE_LOOP_MIN_HEAD 0xc000
 
 class Pi1541
 {
@@ -33,8 +50,62 @@ public:
 
 	void Update();
 
+	// Runs up to cycles cycles of the whole drive (see the RUN_ flags) and returns how many were run.
+	// Returns early, paused at the start of an instruction, for a breakpoint or a skippable idle loop so the caller can look at the CPU
+	// (and call SkipIdleLoop). The next call carries on from there without pausing again on the same instruction.
+	u32 RunCycles(u32 cycles, u32 flags);
+	inline bool IsPaused() const { return paused; }
+	// Replaces the breakpoints. Zero entries are ignored.
+	void SetBreakpoints(const u16* addresses, unsigned count);
+
 	void Reset();
 
+	// Lays out RAM, ROM and the VIAs for read6502/write6502. Call before each emulation start as the ROM selection may have changed.
+	void BuildMemoryMap(bool extraRAM, bool RAMBoard);
+
+	// The self test the ROM runs after reset always ends in the same state for a given ROM, device ID and memory layout.
+	// The first time through it is saved and later resets can restore it instead of executing FAST_BOOT_CYCLES.
+	void SaveBootSnapshot(unsigned romIndex, u8 deviceID);
+	bool RestoreBootSnapshot(unsigned romIndex, u8 deviceID);
+
+	// Serialises the running drive (see SaveState.h for the format). SaveState returns the number of bytes used or 0 if size is too small.
+	// The same disk image must be inserted when loading as only its dirty tracks are saved.
+	u32 SaveState(u8* buffer, u32 size);
+	bool LoadState(const u8* buffer, u32 size);
+	bool SaveStateToFile(const char* fileName);
+	bool LoadStateFromFile(const char* fileName);
+
+	// Idle loop fast forward.
+	// With the motor off and nothing on the bus the ROM goes round and round a loop waiting for ATN or the next timer IRQ.
+	// Loops with their head below IDLE_LOOP_MIN_HEAD are never taken for one.
+	// IdleLoopSync is called at the start of every instruction. Once an iteration of a loop is seen to start and end in exactly the same state
+	// (CPU, RAM and VIAs other than their counters) without reading the counters, taking an IRQ or the drive or bus doing anything,
+	// every following iteration will be the same until a VIA counter times out.
+	// IdleLoopIterations then says how many of them can be skipped and SkipIdleLoop skips them by advancing only the cycle counter.
+	inline void IdleLoopSync(u16 pc)
+	{
+		if (m6502.IRQ.IsAsserted() || VIA[0].GetPortB()->GetInput() != idleLoop.VIA[0].GetPortB()->GetInput())
+			idleLoop.disturbed = true;
+		if (pc == idleLoop.head || pc < idleLoop.lastPC)
+			IdleLoopCheck(pc);
+		idleLoop.lastPC = pc;
+	}
+	u32 IdleLoopIterations(u32 maxCycles) const;
+	inline u32 IdleLoopPeriod() const { return idleLoop.period; }
+	void SkipIdleLoop(u32 iterations);
+
+	// Loop iterations that can only be told apart by when they read these VIA registers (the counters and shift register).
+	inline void IdleLoopVIARead(u16 address) { if ((1 << (address & 0xf)) & 0x0730) idleLoop.disturbed = true; }
+	// Writing the ports and data direction registers has no effect beyond what IsSameState compares. Anything else does.
+	inline void IdleLoopVIAWrite(u16 address) { if (((1 << (address & 0xf)) & 0x800d) == 0) idleLoop.disturbed = true; }
+
+	// Counts every emulated cycle. The VIAs only bring their counters up to it when accessed or when one of their events is due.
+	inline u32 GetCycle() const { return scheduler.Now(); }
+
+	// Cycles emulated one at a time and cycles skipped by SkipIdleLoop since the last Reset.
+	inline u64 GetBusyCycles() const { return busyCycles; }
+	inline u64 GetIdleCycles() const { return idleCycles; }
+
 	//void ConfigureOfExtraRAM(bool extraRAM);
 
 	Drive drive;
@@ -42,6 +113,8 @@ public:
 
 	M6502 m6502;
 
+	MemoryMap memoryMap;
+
 	enum PortPins
 	{
 		VIAPORTPINS_DEVSEL0 = 0x20,	//pb5
@@ -55,6 +128,32 @@ public:
 	}
 
 private:
+	void IdleLoopCheck(u16 pc);
+	void IdleLoopBegin(u32 now);
+
+	bool extraRAM;
+	bool RAMBoard;
+	bool paused;
+	u16 breakpoints[RUN_MAX_BREAKPOINTS];
+
+	struct IdleLoop
+	{
+		u16 head;			// PC of the loop being checked
+		u16 lastPC;
+		u32 headCycle;		// cycle when the CPU was last at head
+		u32 period;			// Cycles in one iteration once confirmed
+		u32 misses;			// Times round since the last confirmed iteration
+		bool confirmed;		// The iteration that just ended at head left everything as it found it
+		bool disturbed;		// Something in this iteration makes it unsafe to repeat
+		bool RAMCopied;		// idleLoopRAM holds the RAM as it was at headCycle
+		M6502 cpu;
+		m6522 VIA[2];
+	} idleLoop;
+
+	Scheduler scheduler;
+	u64 busyCycles;
+	u64 idleCycles;
+
 	//u8 Memory[0xc000];
 
 	//static u8 Read6502(u16 address, void* data);
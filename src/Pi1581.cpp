@@ -22,6 +22,7 @@
 #include "options.h"
 #include "ROMs.h"
 #include "debug.h"
+#include <string.h>
 
 extern Pi1581 pi1581;
 extern u8 s_u8Memory[0xc000];
@@ -93,32 +94,11 @@ extern u16 pc;
 
 u8 read6502_1581(u16 address)
 {
-	u8 value = 0;
 #if defined(PI1581SUPPORT)
-	if (address & 0x8000)
-	{
-		value = roms.Read1581(address);
-	}
-	else if (address >= 0x6000)
-	{
-		value = pi1581.wd177x.Read(address);
-		//DEBUG_LOG("177x r %04x %02x %04x\r\n", address, value, pc);
-	}
-	else if (address >= 0x4000)
-	{
-		value = pi1581.CIA.Read(address);
-		//DEBUG_LOG("CIA r %04x %02x %04x\r\n", address, value, pc);
-	}
-	else if (address < 0x2000)
-	{
-		value = s_u8Memory[address & 0x1fff];
-	}
-	else
-	{
-		value = address >> 8;	// Empty address bus
-	}
+	return pi1581.memoryMap.Read(address);
+#else
+	return 0;
 #endif
-	return value;
 }
 
 // Use for debugging (Reads VIA registers without the regular VIA read side effects)
@@ -131,24 +111,40 @@ u8 peek6502_1581(u16 address)
 void write6502_1581(u16 address, const u8 value)
 {
 #if defined(PI1581SUPPORT)
-	if (address & 0x8000)
-	{
-		return;
-	}
-	else if (address >= 0x6000)
-	{
-		//DEBUG_LOG("177x w %04x %02x %04x\r\n", address, value, pc);
-		pi1581.wd177x.Write(address, value);
-	}
-	else if (address >= 0x4000)
-	{
-		//DEBUG_LOG("CIA w %04x %02x %04x\r\n", address, value, pc);
-		pi1581.CIA.Write(address, value);
-	}
-	else if (address < 0x2000)
-	{
-		s_u8Memory[address & 0x1fff] = value;
-	}
+	pi1581.memoryMap.Write(address, value);
+#endif
+}
+
+#if defined(PI1581SUPPORT)
+static u8 ReadWD177x(u16 address)
+{
+	return pi1581.wd177x.Read(address);
+}
+
+static void WriteWD177x(u16 address, const u8 value)
+{
+	pi1581.wd177x.Write(address, value);
+}
+
+static u8 ReadCIA(u16 address)
+{
+	return pi1581.CIA.Read(address);
+}
+
+static void WriteCIA(u16 address, const u8 value)
+{
+	pi1581.CIA.Write(address, value);
+}
+#endif
+
+void Pi1581::BuildMemoryMap()
+{
+#if defined(PI1581SUPPORT)
+	memoryMap.Clear();
+	memoryMap.MapRAM(0, 0x2000, s_u8Memory, 0x1fff);
+	memoryMap.MapIO(0x4000, 0x2000, ReadCIA, WriteCIA);
+	memoryMap.MapIO(0x6000, 0x2000, ReadWD177x, WriteWD177x);
+	memoryMap.MapROM(0x8000, 0x8000, roms.ROMImage1581, 0x7fff);
 #endif
 }
 
@@ -199,8 +195,9 @@ static void CIAPortB_OnPortOut(void* pUserData, unsigned char status)
 	IEC_Bus::PortB_OnPortOut(0, status);
 }
 
-Pi1581::Pi1581()
+Pi1581::Pi1581() : paused(false)
 {
+	memset(breakpoints, 0, sizeof(breakpoints));
 	Initialise();
 }
 
@@ -209,6 +206,7 @@ void Pi1581::Initialise()
 	LED = false;
 
 	CIA.ConnectIRQ(&m6502.IRQ);
+	CIA.ConnectScheduler(&scheduler, 0);
 	// IRQ is not connected on a 1581
 	//wd177x.ConnectIRQ(&m6502.IRQ);
 
@@ -238,7 +236,8 @@ void Pi1581::Update()
 		}
 	}
 
-	CIA.Execute();
+	// The CIA only needs bringing up to date on the cycles its timers underflow (and when it is accessed).
+	scheduler.Tick();
 
 	// SRQ is pulled high by the c128
 
@@ -274,8 +273,57 @@ void Pi1581::Update()
 	}
 }
 
+u32 Pi1581::RunCycles(u32 cycles, u32 flags)
+{
+	bool resuming = paused;
+	u32 run;
+
+	paused = false;
+	for (run = 0; run < cycles; ++run)
+	{
+		bool secondHalf = (scheduler.Now() & 1) != 0;
+
+		if (!secondHalf && (flags & RUN_READ_BUS))
+			IEC_Bus::ReadEmulationMode1581();
+
+		if (resuming)
+		{
+			resuming = false;	// Already looked at this instruction before pausing
+		}
+		else if ((flags & RUN_BREAKPOINTS) && m6502.SYNC())	// About to start a new instruction.
+		{
+			u16 pc = m6502.GetPC();
+
+			for (unsigned index = 0; index < RUN_MAX_BREAKPOINTS; ++index)
+			{
+				if (pc && breakpoints[index] == pc)
+					paused = true;
+			}
+			if (paused)
+				break;
+		}
+
+		m6502.Step();
+		Update();
+
+		if (secondHalf && (flags & RUN_REFRESH_BUS))
+		{
+			IEC_Bus::RefreshOuts1581();	// Now output all outputs.
+			IEC_Bus::OutputLED = LED;
+		}
+	}
+	return run;
+}
+
+void Pi1581::SetBreakpoints(const u16* addresses, unsigned count)
+{
+	for (unsigned index = 0; index < RUN_MAX_BREAKPOINTS; ++index)
+		breakpoints[index] = index < count ? addresses[index] : 0;
+}
+
 void Pi1581::Reset()
 {
+	paused = false;
 	IOPort* CIABPortB;
 
 	fastSerialDirection = FAST_SERIAL_DIR_IN;
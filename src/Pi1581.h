@@ -24,6 +24,8 @@
 #include "iec_bus.h"
 #include "wd177x.h"
 #include "m8520.h"
+#include "MemoryMap.h"
+#include "Scheduler.h"
 
 class Pi1581
 {
@@ -35,13 +37,23 @@ public:
 
 	void Update();
 
+	// As Pi1541::RunCycles but counts the CPU's 2MHz cycles. The bus is read before even cycles and driven after odd ones
+	// (ie once per 1MHz cycle). RUN_REFRESH_BUS_EARLY and RUN_IDLE_LOOPS are not supported.
+	u32 RunCycles(u32 cycles, u32 flags);
+	inline bool IsPaused() const { return paused; }
+	void SetBreakpoints(const u16* addresses, unsigned count);
+
 	void Reset();
 
+	// Lays out RAM, ROM, the CIA and the WD177x for read6502_1581/write6502_1581.
+	void BuildMemoryMap();
+
 	void SetDeviceID(u8 id);
 
 	void Insert(DiskImage* diskImage);
 
 	inline const DiskImage* GetDiskImage() const { return diskImage; }
+	inline DiskImage* GetDiskImage() { return diskImage; }
 
 	inline bool IsLEDOn() const { return LED; }
 	inline bool IsMotorOn() const { return wd177x.IsExternalMotorAsserted(); }
@@ -52,12 +64,20 @@ public:
 
 	M6502 m6502;
 
+	MemoryMap memoryMap;
+
 	unsigned fastSerialDirection;
 	unsigned int RDYDelayCount;
 
+	// Counts every emulated cycle. The CIA only brings its timers up to it when accessed or when one of its events is due.
+	inline u32 GetCycle() const { return scheduler.Now(); }
+
 private:
 	DiskImage* diskImage;
 	bool LED;
+	bool paused;
+	u16 breakpoints[RUN_MAX_BREAKPOINTS];
+	Scheduler scheduler;
 
 	//u8 Memory[0xc000];
 
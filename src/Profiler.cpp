@@ -0,0 +1,199 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Profiler.h"
+#include "SaveState.h"
+#include "debug.h"
+#include "ff.h"
+#include <string.h>
+
+#define PROFILER_LOG_MAX 32
+
+// Names from the commented 1541 ROM disassembly. Fast loaders call several of these from RAM.
+static const ProfilerSymbol symbols1541[] =
+{
+	{ 0xC100, "SETLDA" },	// LED on
+	{ 0xC146, "PARSXQ" },	// Parse and execute a command
+	{ 0xE853, "ATNIRQ" },	// ATN interrupt
+	{ 0xE85B, "ATNSRV" },	// Serve ATN
+	{ 0xE909, "TALK" },
+	{ 0xE9C9, "ACPTR" },	// Receive a byte from the bus
+	{ 0xEAA0, "DSKINT" },	// Reset
+	{ 0xF2B0, "LCC" },		// Disk controller job loop
+	{ 0xF50A, "DSTRT" },	// Find the start of a data block
+	{ 0xF556, "SYNC" },		// Wait for SYNC
+	{ 0xF8E0, "DECODE" },	// GCR decode a block
+	{ 0xF969, "ERRR" },		// Job error exit
+	{ 0xF99C, "END" },		// Motor and stepper control at the end of the job loop
+	{ 0xFE67, "SYSIRQ" },	// IRQ
+};
+
+void Profiler::Reset()
+{
+	memset(cycles, 0, sizeof(cycles));
+	memset(trace, 0, sizeof(trace));
+	instructions = 0;
+	cycle = 0;
+	currentPC = 0;
+}
+
+const ProfilerSymbol* Profiler::ROMSymbols(unsigned& count)
+{
+	count = sizeof(symbols1541) / sizeof(symbols1541[0]);
+	return symbols1541;
+}
+
+const ProfilerSymbol* Profiler::FindSymbol(u16 address, const ProfilerSymbol* symbols, unsigned count)
+{
+	const ProfilerSymbol* found = 0;
+
+	for (unsigned index = 0; index < count && symbols[index].address <= address; ++index)
+		found = &symbols[index];
+	return found;
+}
+
+// The histogram alone is 256K so the file is written a chunk at a time.
+bool Profiler::SaveToFile(const char* fileName) const
+{
+	static u8 buffer[4096];
+	FIL fp;
+	u32 bytesWritten;
+	FRESULT res;
+	u32 index;
+
+	if (f_open(&fp, fileName, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+	{
+		DEBUG_LOG("Cannot save profile to %s\r\n", fileName);
+		return false;
+	}
+
+	u32 length = TraceLength();
+	SaveStateWriter header(buffer, sizeof(buffer));
+	header.Write32(PROFILER_MAGIC);
+	header.Write16(PROFILER_VERSION);
+	header.Write16((u16)length);
+	header.Write32(cycle);
+	header.Write32(instructions);
+	res = f_write(&fp, buffer, header.Size(), &bytesWritten);
+
+	for (index = 0; index < 0x10000 && res == FR_OK; index += sizeof(buffer) / 4)
+	{
+		SaveStateWriter writer(buffer, sizeof(buffer));
+		for (u32 pc = index; pc < index + sizeof(buffer) / 4; ++pc)
+			writer.Write32(cycles[pc]);
+		res = f_write(&fp, buffer, writer.Size(), &bytesWritten);
+	}
+
+	const u32 entrySize = 11;
+	const u32 entriesPerChunk = sizeof(buffer) / entrySize;
+	for (index = 0; index < length && res == FR_OK; index += entriesPerChunk)
+	{
+		SaveStateWriter writer(buffer, sizeof(buffer));
+		for (u32 entry = index; entry < length && entry < index + entriesPerChunk; ++entry)
+		{
+			const TraceEntry& traced = Trace(entry);
+			writer.Write32(traced.cycle);
+			writer.Write16(traced.pc);
+			writer.Write8(traced.a);
+			writer.Write8(traced.x);
+			writer.Write8(traced.y);
+			writer.Write8(traced.sp);
+			writer.Write8(traced.status);
+		}
+		res = f_write(&fp, buffer, writer.Size(), &bytesWritten);
+	}
+	f_close(&fp);
+	if (res != FR_OK)
+		DEBUG_LOG("Cannot save profile to %s\r\n", fileName);
+	return res == FR_OK;
+}
+
+bool Profiler::Load(const u8* buffer, u32 size)
+{
+	SaveStateReader reader(buffer, size);
+
+	if (reader.Read32() != PROFILER_MAGIC || reader.Read16() != PROFILER_VERSION)
+		return false;
+	u32 length = reader.Read16();
+	if (length > PROFILER_TRACE_LENGTH)
+		return false;
+
+	Reset();
+	cycle = reader.Read32();
+	u32 total = reader.Read32();
+	for (u32 pc = 0; pc < 0x10000; ++pc)
+		cycles[pc] = reader.Read32();
+	// Put the trace back so that it ends where the saved one did.
+	instructions = total - length;
+	for (u32 entry = 0; entry < length; ++entry)
+	{
+		TraceEntry& traced = trace[instructions++ & (PROFILER_TRACE_LENGTH - 1)];
+		traced.cycle = reader.Read32();
+		traced.pc = reader.Read16();
+		traced.a = reader.Read8();
+		traced.x = reader.Read8();
+		traced.y = reader.Read8();
+		traced.sp = reader.Read8();
+		traced.status = reader.Read8();
+	}
+	return !reader.Failed();
+}
+
+void Profiler::Log(unsigned hottest, unsigned last) const
+{
+	unsigned count;
+	const ProfilerSymbol* symbols = ROMSymbols(count);
+	u16 top[PROFILER_LOG_MAX];
+	unsigned found = 0;
+
+	if (hottest > PROFILER_LOG_MAX)
+		hottest = PROFILER_LOG_MAX;
+
+	// An insertion sort of the few hottest rather than sorting all 64K.
+	for (u32 pc = 0; pc < 0x10000 && hottest; ++pc)
+	{
+		u32 value = cycles[pc];
+		if (value == 0 || (found == hottest && value <= cycles[top[found - 1]]))
+			continue;
+		unsigned slot = found < hottest ? found++ : hottest - 1;
+		while (slot > 0 && cycles[top[slot - 1]] < value)
+		{
+			top[slot] = top[slot - 1];
+			slot--;
+		}
+		top[slot] = (u16)pc;
+	}
+
+	DEBUG_LOG("6502 profile of %d cycles, %d instructions\r\n", cycle, instructions);
+	for (unsigned rank = 0; rank < found; ++rank)
+	{
+		u16 pc = top[rank];
+		const ProfilerSymbol* symbol = FindSymbol(pc, symbols, count);
+		if (symbol)
+			DEBUG_LOG("%04x %-8s+%03x %10d\r\n", pc, symbol->name, pc - symbol->address, cycles[pc]);
+		else
+			DEBUG_LOG("%04x              %10d\r\n", pc, cycles[pc]);
+	}
+
+	u32 length = TraceLength();
+	for (u32 entry = length > last ? length - last : 0; entry < length; ++entry)
+	{
+		const TraceEntry& traced = Trace(entry);
+		DEBUG_LOG("%10d %04x A=%02x X=%02x Y=%02x SP=%02x P=%02x\r\n", traced.cycle, traced.pc, traced.a, traced.x, traced.y, traced.sp, traced.status);
+	}
+}
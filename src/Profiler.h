@@ -0,0 +1,106 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "types.h"
+
+// Where the emulated CPU spends its cycles.
+// Only hooked into M6502::Step when built with PROFILE6502 (make PROFILE=1) so a normal build pays nothing for it.
+// Every emulated cycle is counted against the PC of the instruction it belongs to (an IRQ's cycles go to the instruction it interrupted)
+// and the last PROFILER_TRACE_LENGTH instructions are kept with their registers.
+// Cycles skipped by the idle loop fast forward are not emulated so are not counted.
+
+// Must be a power of 2.
+#define PROFILER_TRACE_LENGTH 1024
+
+// A profile file is a small header followed by the histogram then the trace (oldest first);-
+//   u32 PROFILER_MAGIC, u16 PROFILER_VERSION, u16 trace entries, u32 cycles, u32 instructions
+//   u32 cycles[0x10000]
+//   entries of u32 cycle, u16 pc, u8 a, x, y, sp, status
+// All values are little endian.
+#define PROFILER_MAGIC 0x46525050	// "PPRF"
+#define PROFILER_VERSION 1
+#define PROFILER_FILE "/pi1541.prof"
+
+struct ProfilerSymbol
+{
+	u16 address;
+	const char* name;
+};
+
+class Profiler
+{
+public:
+	struct TraceEntry
+	{
+		u32 cycle;
+		u16 pc;
+		u8 a, x, y, sp, status;
+	};
+
+	Profiler() { Reset(); }
+
+	void Reset();
+
+	// Called by M6502::Step at the start of every instruction then on every cycle.
+	inline void Instruction(u16 pc, u8 a, u8 x, u8 y, u8 sp, u8 status)
+	{
+		TraceEntry& entry = trace[instructions++ & (PROFILER_TRACE_LENGTH - 1)];
+		entry.cycle = cycle;
+		entry.pc = pc;
+		entry.a = a;
+		entry.x = x;
+		entry.y = y;
+		entry.sp = sp;
+		entry.status = status;
+		currentPC = pc;
+	}
+	inline void Cycle()
+	{
+		cycles[currentPC]++;
+		cycle++;
+	}
+
+	inline u32 Cycles(u16 pc) const { return cycles[pc]; }
+	inline u32 TotalCycles() const { return cycle; }
+	inline u32 TotalInstructions() const { return instructions; }
+	// The number of instructions in the trace and the index'th oldest of them.
+	inline u32 TraceLength() const { return instructions < PROFILER_TRACE_LENGTH ? instructions : PROFILER_TRACE_LENGTH; }
+	inline const TraceEntry& Trace(u32 index) const { return trace[(instructions - TraceLength() + index) & (PROFILER_TRACE_LENGTH - 1)]; }
+
+	bool SaveToFile(const char* fileName) const;
+	bool Load(const u8* buffer, u32 size);
+	// The hottest PCs and the last few instructions to the debug UART.
+	void Log(unsigned hottest, unsigned last) const;
+
+	// Known entry points of the stock 1541 ROM (DOS 2.6) sorted by address.
+	static const ProfilerSymbol* ROMSymbols(unsigned& count);
+	// The symbol at or below address in a sorted table (0 if there is none).
+	static const ProfilerSymbol* FindSymbol(u16 address, const ProfilerSymbol* symbols, unsigned count);
+
+private:
+	u32 cycles[0x10000];
+	TraceEntry trace[PROFILER_TRACE_LENGTH];
+	u32 instructions;
+	u32 cycle;
+	u16 currentPC;
+};
+
+#endif
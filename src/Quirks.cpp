@@ -0,0 +1,123 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Quirks.h"
+#include "debug.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const struct
+{
+	const char* name;
+	u32 quirk;
+} quirkNames[] =
+{
+	{ "RefreshBusEarly", QUIRK_REFRESH_BUS_EARLY },
+	{ "NoIdleFastForward", QUIRK_NO_IDLE_FAST_FORWARD },
+};
+
+QuirkTable::QuirkTable()
+	: entries(0)
+	, legacyEntries(0)
+{
+	memset(table, 0, sizeof(table));
+}
+
+void QuirkTable::Process(char* buffer)
+{
+	SetData(buffer);
+
+	char* pHash;
+	while ((pHash = GetToken()) != 0)
+	{
+		/*char* equals = */GetToken();
+		char* pQuirks = GetToken();
+		if (pQuirks == 0)
+			break;
+
+		bool legacy = strncasecmp(pHash, "FNV:", 4) == 0;
+		if (legacy)
+			pHash += 4;
+		char* end;
+		u32 hash = strtoul(pHash, &end, 16);
+		u32 quirks = ParseQuirks(pQuirks);
+		if (*end != 0 || hash == 0 || quirks == 0 || !Add(hash, legacy, quirks))
+			DEBUG_LOG("Ignoring the quirks of %s\r\n", pHash);
+	}
+}
+
+u32 QuirkTable::ParseQuirks(char* names)
+{
+	u32 quirks = 0;
+
+	for (char* name = strtok(names, ","); name; name = strtok(0, ","))
+	{
+		unsigned index;
+		for (index = 0; index < sizeof(quirkNames) / sizeof(quirkNames[0]); ++index)
+		{
+			if (strcasecmp(name, quirkNames[index].name) == 0)
+				break;
+		}
+		if (index == sizeof(quirkNames) / sizeof(quirkNames[0]))
+			return 0;
+		quirks |= quirkNames[index].quirk;
+	}
+	return quirks;
+}
+
+bool QuirkTable::Add(u32 hash, bool legacy, u32 quirks)
+{
+	u32 slot = hash & (QUIRK_TABLE_SIZE - 1);
+
+	while (table[slot].used)
+	{
+		// A hash given again has the quirks of both.
+		if (table[slot].hash == hash && table[slot].legacy == legacy)
+		{
+			table[slot].quirks |= quirks;
+			return true;
+		}
+		slot = (slot + 1) & (QUIRK_TABLE_SIZE - 1);
+	}
+	if (entries == QUIRK_TABLE_MAX_ENTRIES)
+		return false;
+
+	table[slot].hash = hash;
+	table[slot].used = true;
+	table[slot].legacy = legacy;
+	table[slot].quirks = quirks;
+	entries++;
+	if (legacy)
+		legacyEntries++;
+	return true;
+}
+
+u32 QuirkTable::Find(u32 hash, bool legacy) const
+{
+	if (hash == 0)
+		return 0;
+
+	// There is always a free slot to stop at (the table is never more than 3/4 full).
+	for (u32 slot = hash & (QUIRK_TABLE_SIZE - 1); table[slot].used; slot = (slot + 1) & (QUIRK_TABLE_SIZE - 1))
+	{
+		if (table[slot].hash == hash && table[slot].legacy == legacy)
+			return table[slot].quirks;
+	}
+	return 0;
+}
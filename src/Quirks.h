@@ -0,0 +1,66 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef QUIRKS_H
+#define QUIRKS_H
+
+#include "types.h"
+#include "options.h"
+
+// What can be changed about the emulation for an image.
+#define QUIRK_REFRESH_BUS_EARLY		0x01	// Read and drive the IEC bus at the start of the cycle (see RUN_REFRESH_BUS_EARLY)
+#define QUIRK_NO_IDLE_FAST_FORWARD	0x02	// Emulate every cycle of the ROM's idle loop (as if IdleFastForward = 0)
+
+#define QUIRK_TABLE_SIZE 256	// A power of 2
+#define QUIRK_TABLE_MAX_ENTRIES (QUIRK_TABLE_SIZE * 3 / 4)
+
+// The quirks of the images that need them, read from quirks.txt on the SD card. Each line is an image's hash
+// (see DiskImage::GetHash), =, and its quirks separated by commas, eg
+//   1a2b3c4d = RefreshBusEarly,NoIdleFastForward	// title.g64
+// A hash written FNV:1a2b3c4d is the FNV-1a of a G64 that quirks used to be keyed by (see DiskImage::GetLegacyHash).
+// The hashes are already well mixed so the low bits of one pick its slot (the next free slot if that is taken).
+class QuirkTable : public TextParser
+{
+public:
+	QuirkTable();
+
+	void Process(char* buffer);
+
+	// The quirks of the image with that hash (0 if it has none or is not hashed).
+	u32 Find(u32 hash, bool legacy = false) const;
+	inline bool HasLegacyEntries() const { return legacyEntries != 0; }
+	inline u32 Entries() const { return entries; }
+
+private:
+	struct Entry
+	{
+		u32 hash;
+		u8 used;
+		u8 legacy;
+		u16 quirks;
+	};
+
+	bool Add(u32 hash, bool legacy, u32 quirks);
+	static u32 ParseQuirks(char* names);
+
+	Entry table[QUIRK_TABLE_SIZE];
+	u32 entries;
+	u32 legacyEntries;
+};
+
+#endif
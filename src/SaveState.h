@@ -0,0 +1,134 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include "types.h"
+#include <string.h>
+
+// A save state is a small header followed by tagged sections;-
+//   u32 SAVESTATE_MAGIC, u16 SAVESTATE_VERSION, u16 flags
+//   then for each section u32 tag, u32 length, length bytes of payload
+// All values are little endian and every field is written explicitly so the format does not depend on how the compiler lays out a class.
+// Bump SAVESTATE_VERSION whenever a section's payload changes.
+#define SAVESTATE_MAGIC 0x53313431	// "1415" ie Pi1541 State
+#define SAVESTATE_VERSION 2
+
+#define SAVESTATE_TAG(a, b, c, d) ((u32)(a) | ((u32)(b) << 8) | ((u32)(c) << 16) | ((u32)(d) << 24))
+
+class SaveStateWriter
+{
+public:
+	SaveStateWriter(u8* buffer, u32 size) : buffer(buffer), size(size), position(0), overflowed(false), sectionStart(0) {}
+
+	inline void WriteBytes(const void* data, u32 length)
+	{
+		if (position + length > size)
+		{
+			overflowed = true;
+			return;
+		}
+		memcpy(buffer + position, data, length);
+		position += length;
+	}
+	inline void Write8(u8 value) { WriteBytes(&value, 1); }
+	inline void Write16(u16 value) { Write8((u8)value); Write8((u8)(value >> 8)); }
+	inline void Write32(u32 value) { Write16((u16)value); Write16((u16)(value >> 16)); }
+	inline void WriteBool(bool value) { Write8(value ? 1 : 0); }
+	inline void WriteFloat(float value) { u32 bits; memcpy(&bits, &value, 4); Write32(bits); }
+
+	// The length of a section is patched in when it ends.
+	void BeginSection(u32 tag)
+	{
+		Write32(tag);
+		sectionStart = position;
+		Write32(0);
+	}
+	void EndSection()
+	{
+		if (overflowed)
+			return;
+		u32 length = position - sectionStart - 4;
+		buffer[sectionStart] = (u8)length;
+		buffer[sectionStart + 1] = (u8)(length >> 8);
+		buffer[sectionStart + 2] = (u8)(length >> 16);
+		buffer[sectionStart + 3] = (u8)(length >> 24);
+	}
+
+	inline bool Overflowed() const { return overflowed; }
+	inline u32 Size() const { return position; }
+
+private:
+	u8* buffer;
+	u32 size;
+	u32 position;
+	bool overflowed;
+	u32 sectionStart;
+};
+
+class SaveStateReader
+{
+public:
+	SaveStateReader(const u8* buffer, u32 size) : buffer(buffer), size(size), position(0), failed(false) {}
+
+	inline void ReadBytes(void* data, u32 length)
+	{
+		if (position + length > size)
+		{
+			failed = true;
+			memset(data, 0, length);
+			return;
+		}
+		memcpy(data, buffer + position, length);
+		position += length;
+	}
+	inline u8 Read8() { u8 value; ReadBytes(&value, 1); return value; }
+	inline u16 Read16() { u16 value = Read8(); return value | (Read8() << 8); }
+	inline u32 Read32() { u32 value = Read16(); return value | ((u32)Read16() << 16); }
+	inline bool ReadBool() { return Read8() != 0; }
+	inline float ReadFloat() { u32 bits = Read32(); float value; memcpy(&value, &bits, 4); return value; }
+
+	// Returns a reader over the payload of the next section and moves past it.
+	bool NextSection(u32& tag, SaveStateReader& section)
+	{
+		if (position == size)
+			return false;
+		tag = Read32();
+		u32 length = Read32();
+		if (failed || length > size - position)
+		{
+			failed = true;
+			return false;
+		}
+		section = SaveStateReader(buffer + position, length);
+		position += length;
+		return true;
+	}
+
+	inline bool Failed() const { return failed; }
+	inline bool AtEnd() const { return position == size; }
+
+private:
+	const u8* buffer;
+	u32 size;
+	u32 position;
+	bool failed;
+};
+
+#endif
@@ -0,0 +1,110 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "types.h"
+
+#define SCHEDULER_MAX_SOURCES 4
+
+// What Pi1541::RunCycles and Pi1581::RunCycles do around each cycle besides stepping the CPU and the drive.
+#define RUN_READ_BUS			0x01	// Read the IEC bus at the start of the cycle
+#define RUN_REFRESH_BUS			0x02	// Drive the IEC bus (and the LED) after the CPU has stepped
+#define RUN_REFRESH_BUS_EARLY	0x04	// Read and drive the IEC bus at the start of the cycle instead (some loaders need the outputs a cycle late)
+#define RUN_BREAKPOINTS			0x08	// Pause at the start of an instruction at one of the breakpoints
+#define RUN_IDLE_LOOPS			0x10	// Watch for idle loops and pause at the head of one that can be skipped
+
+#define RUN_MAX_BREAKPOINTS 4
+
+// Owns the emulated cycle counter for a drive.
+// The chips that bring themselves up to date lazily (the VIAs and the CIA) each have a slot where they post the cycle their next event is due on.
+// Tick moves the counter on one cycle and, on the cycle the soonest event is due, calls back every chip whose event has come round (in slot order).
+// Everything that has to run every cycle (the CPU, the drive's read/write electronics and the WD177x) is stepped by the owner's RunCycles instead.
+class Scheduler
+{
+public:
+	typedef void (*EventFn)(void* context);
+
+	Scheduler() : cycle(0), next(0x7fffffff), count(0) {}
+
+	void Connect(unsigned slot, EventFn fn, void* context)
+	{
+		sources[slot].fn = fn;
+		sources[slot].context = context;
+		sources[slot].when = cycle + 0x7fffffff;
+		if (slot >= count)
+			count = slot + 1;
+	}
+
+	// Times are compared as signed differences so an event can be no more than 0x7fffffff cycles away.
+	inline void Post(unsigned slot, u32 when)
+	{
+		sources[slot].when = when;
+		if ((s32)(when - next) < 0)
+			next = when;
+	}
+
+	inline u32 Now() const { return cycle; }
+	inline u32 NextEvent() const { return next; }
+	// Cycles that can pass before anything is due (ie how far Advance can go).
+	inline u32 QuietCycles() const { return next - cycle - 1; }
+
+	inline void Tick()
+	{
+		cycle++;
+		if ((s32)(cycle - next) >= 0)
+			Dispatch();
+	}
+
+	// Moves the counter on without calling anything back. Must be no more than QuietCycles.
+	inline void Advance(u32 cycles) { cycle += cycles; }
+
+private:
+	void Dispatch()
+	{
+		unsigned slot;
+
+		for (slot = 0; slot < count; ++slot)
+		{
+			if ((s32)(cycle - sources[slot].when) >= 0)
+				sources[slot].fn(sources[slot].context);
+		}
+
+		next = cycle + 0x7fffffff;
+		for (slot = 0; slot < count; ++slot)
+		{
+			if ((s32)(sources[slot].when - next) < 0)
+				next = sources[slot].when;
+		}
+	}
+
+	struct Source
+	{
+		u32 when;
+		EventFn fn;
+		void* context;
+	};
+
+	u32 cycle;
+	u32 next;
+	unsigned count;
+	Source sources[SCHEDULER_MAX_SOURCES];
+};
+
+#endif
@@ -0,0 +1,128 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#include "TrackExtractor.h"
+#include "defs.h"
+
+extern "C"
+{
+#include "rpiHardware.h"
+}
+
+// Only a Pi 2 or 3 (or the host) has anything else helping; on a single core plain updates will do.
+#if defined(HAS_MULTICORE) || defined(HOST_BUILD)
+#define CLAIM(counter, value) __sync_bool_compare_and_swap(&counter, value, value + 1)
+#define ATOMIC_ADD(counter, value) __sync_fetch_and_add(&counter, value)
+#else
+#define CLAIM(counter, value) (counter = value + 1, true)
+#define ATOMIC_ADD(counter, value) (counter += value)
+#endif
+
+TrackExtractor::TrackExtractor()
+	: added(0)
+	, claimed(0)
+	, extracted(0)
+	, helping(0)
+	, active(false)
+{
+}
+
+void TrackExtractor::Begin()
+{
+	added = 0;
+	claimed = 0;
+	extracted = 0;
+	DataMemBarrier();	// Nothing can be claimed until the counters have been seen to be reset
+	active = true;
+}
+
+bool TrackExtractor::Add(u8* source, u8* destination, unsigned capacityMin, unsigned capacityMax)
+{
+	if (added == MAX_HALFTRACKS_1541)
+		return false;
+
+	Track& track = tracks[added];
+	track.source = source;
+	track.destination = destination;
+	track.capacityMin = capacityMin;
+	track.capacityMax = capacityMax;
+	track.length = 0;
+	DataMemBarrier();	// The track must be seen before it is handed over
+	added = added + 1;
+#if defined(HAS_MULTICORE) && !defined(HOST_BUILD)
+	asm volatile ("dsb\n" "sev\n" ::: "memory");	// Wake the helpers
+#endif
+	return true;
+}
+
+const TrackExtractor::Track* TrackExtractor::Finish()
+{
+	while (ExtractOne())
+	{
+	}
+	while (extracted != added)
+	{
+	}
+
+	// Each side changes its own flag then looks at the other's so a helper either sees this or is waited for.
+	active = false;
+	DataMemBarrier();
+	while (helping)
+	{
+	}
+	DataMemBarrier();
+	return tracks;
+}
+
+bool TrackExtractor::Help()
+{
+	bool helped = false;
+
+	if (!active)
+		return false;
+	ATOMIC_ADD(helping, 1);
+	DataMemBarrier();
+	if (active)
+	{
+		while (ExtractOne())
+			helped = true;
+	}
+	ATOMIC_ADD(helping, -1);
+	return helped;
+}
+
+bool TrackExtractor::ExtractOne()
+{
+	u32 index;
+
+	do
+	{
+		index = claimed;
+		if (index == added)
+			return false;
+	}
+	while (!CLAIM(claimed, index));
+	DataMemBarrier();	// Only look at the track once it has been claimed
+
+	Track& track = tracks[index];
+	int align;
+	track.length = extract_GCR_track(track.destination, track.source, &align, ALIGN_NONE, track.capacityMin, track.capacityMax);
+	DataMemBarrier();	// The track must be seen before it is counted
+	ATOMIC_ADD(extracted, 1);
+	return true;
+}
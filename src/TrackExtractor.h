@@ -0,0 +1,63 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TRACKEXTRACTOR_H
+#define TRACKEXTRACTOR_H
+
+#include "types.h"
+#include "gcr.h"
+
+// Extracts a revolution of each track of a NIB (see extract_GCR_track) on every core that will help.
+// The core loading the image (the only producer) hands the tracks over as they are read (Begin, Add and then Finish, which helps too)
+// and the helpers (the idle cores on a Pi 2 or 3, threads on the host) call Help, which claims them one at a time until none are left.
+// Each track is extracted into its own slot so the only things shared are the counters; claimed and extracted are only changed atomically.
+class TrackExtractor
+{
+public:
+	struct Track
+	{
+		u8* source;			// The NIB_TRACK_LENGTH bytes read from the image (can be destination)
+		u8* destination;	// Must hold NIB_TRACK_LENGTH bytes
+		u16 capacityMin;
+		u16 capacityMax;
+		int length;			// What extract_GCR_track gave (0 if the track is not formatted)
+	};
+
+	TrackExtractor();
+
+	// The producer's side. The source and destination must not be touched until Finish returns.
+	void Begin();
+	bool Add(u8* source, u8* destination, unsigned capacityMin, unsigned capacityMax);
+	// Extracts what is left, waits for the helpers to be done and returns the tracks in the order they were added.
+	const Track* Finish();
+
+	// The helpers' side. Returns false if there was nothing to extract.
+	bool Help();
+
+private:
+	bool ExtractOne();
+
+	Track tracks[MAX_HALFTRACKS_1541];
+	volatile u32 added;
+	volatile u32 claimed;
+	volatile u32 extracted;
+	volatile u32 helping;
+	volatile bool active;
+};
+
+#endif
@@ -0,0 +1,109 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#include "WriteBehind.h"
+#include "debug.h"
+#include "ff.h"
+#include <string.h>
+
+extern "C"
+{
+#include "rpiHardware.h"
+}
+
+WriteBehind::WriteBehind()
+	: head(0)
+	, tail(0)
+	, lastLag(0)
+{
+}
+
+bool WriteBehind::Queue(DiskImage* image, u32 offset, const u8* data, u32 length)
+{
+	if (Free() == 0 || length > D81_SECTOR_LENGTH)
+		return false;
+
+	Block& block = blocks[head & (WRITE_BEHIND_SLOTS - 1)];
+	block.image = image;
+	block.offset = offset;
+	block.length = length;
+	block.queued = read32(ARM_SYSTIMER_CLO);
+	memcpy(block.data, data, length);
+	DataMemBarrier();	// The block must be seen before it is handed over
+	head = head + 1;
+	return true;
+}
+
+void WriteBehind::Drain() const
+{
+	while (head != tail)
+	{
+	}
+	DataMemBarrier();
+}
+
+bool WriteBehind::Service()
+{
+	u32 first = tail;
+	u32 last = head;
+	u32 index;
+	FRESULT res;
+	FIL fp;
+
+	if (first == last)
+		return false;
+	DataMemBarrier();	// Only look at the blocks once they have been handed over
+
+	DiskImage* image = blocks[first & (WRITE_BEHIND_SLOTS - 1)].image;
+	res = f_open(&fp, image->GetName(), FA_WRITE);
+	bool opened = res == FR_OK;
+	for (index = first; index != last && blocks[index & (WRITE_BEHIND_SLOTS - 1)].image == image; ++index)
+	{
+		const Block& block = blocks[index & (WRITE_BEHIND_SLOTS - 1)];
+		u32 bytesWritten;
+
+		if (res == FR_OK)
+			res = f_lseek(&fp, block.offset);
+		if (res == FR_OK)
+			res = f_write(&fp, block.data, block.length, &bytesWritten);
+		if (res == FR_OK && bytesWritten != block.length)
+			res = FR_DISK_ERR;
+	}
+	if (opened && f_close(&fp) != FR_OK)
+		res = FR_DISK_ERR;
+	if (res != FR_OK)
+	{
+		// The image will be written back whole when it is closed instead.
+		DEBUG_LOG("Cannot write behind to %s\r\n", image->GetName());
+		image->SetWriteBehindFailed();
+	}
+
+	lastLag = read32(ARM_SYSTIMER_CLO) - blocks[first & (WRITE_BEHIND_SLOTS - 1)].queued;
+	DataMemBarrier();	// Finished with the blocks before they are handed back
+	tail = index;
+	return true;
+}
+
+u32 WriteBehind::Lag() const
+{
+	u32 first = tail;
+
+	if (first == head)
+		return lastLag;
+	return read32(ARM_SYSTIMER_CLO) - blocks[first & (WRITE_BEHIND_SLOTS - 1)].queued;
+}
@@ -0,0 +1,68 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef WRITEBEHIND_H
+#define WRITEBEHIND_H
+
+#include "types.h"
+#include "DiskImage.h"
+
+// Must be a power of 2. Each slot holds at most a D81 sector.
+#define WRITE_BEHIND_SLOTS 64
+
+// Saves the sectors written to while emulating without waiting for the emulation to be exited.
+// The emulation core (the only producer) copies the sectors into the queue as they are found to have changed (see DiskImage::QueueUnsavedSector)
+// and the other core (the only consumer) writes them to the SD card in the background.
+// Neither side ever waits for the other; head is only written by the producer and tail only by the consumer.
+// The consumer only hands a slot back once the file has been closed so an empty queue means the file system is not in use by it.
+class WriteBehind
+{
+public:
+	struct Block
+	{
+		DiskImage* image;
+		u32 offset;
+		u32 length;
+		u32 queued;		// When it was queued (system timer)
+		u8 data[D81_SECTOR_LENGTH];
+	};
+
+	WriteBehind();
+
+	// The producer's side. Returns false if the queue is full.
+	bool Queue(DiskImage* image, u32 offset, const u8* data, u32 length);
+	inline u32 Free() const { return WRITE_BEHIND_SLOTS - (head - tail); }
+	// Waits for the consumer to have written everything queued.
+	void Drain() const;
+
+	// The consumer's side. Writes the blocks at the front of the queue that are for the same image. Returns false if there were none.
+	bool Service();
+
+	// For the status bar.
+	inline u32 Depth() const { return head - tail; }
+	// How long (in us) the oldest block has been waiting to be written or, if there are none, how long the last ones written waited.
+	u32 Lag() const;
+
+private:
+	Block blocks[WRITE_BEHIND_SLOTS];
+	volatile u32 head;
+	volatile u32 tail;
+	volatile u32 lastLag;
+};
+
+#endif
@@ -65,6 +65,9 @@ extern int errno;
 /* Prototype for the UART write function */
 #include "rpi-aux.h"
 
+/* For USE_MULTICORE */
+#include "defs.h"
+
 /* A pointer to a list of environment variables and their values. For a minimal
  environment, this empty list is adequate: */
 char *__env[1] =
@@ -207,6 +210,46 @@ caddr_t _sbrk(int incr)
   return (caddr_t) prev_heap_end;
 }
 
+#if defined(USE_MULTICORE)
+struct _reent;
+
+/* newlib calls these around every malloc and free. Out of the box they do
+ nothing as there is only meant to be one thread; when core 0 prepares the
+ caddy's disks (see DiskCaddy::Prefetch) both cores allocate. The lock is
+ recursive (malloc calls itself through realloc) so it records which core holds
+ it (from MPIDR) and how many times. */
+static volatile int mallocLockOwner = -1;
+static unsigned mallocLockDepth = 0;
+
+static int CoreID(void)
+{
+  unsigned mpidr;
+  asm volatile ("mrc p15, 0, %0, c0, c0, 5" : "=r" (mpidr));
+  return mpidr & 3;
+}
+
+void __malloc_lock(struct _reent *reent)
+{
+  int core = CoreID();
+
+  if (mallocLockOwner != core)
+  {
+    while (!__sync_bool_compare_and_swap(&mallocLockOwner, -1, core))
+      ;
+  }
+  ++mallocLockDepth;
+}
+
+void __malloc_unlock(struct _reent *reent)
+{
+  if (--mallocLockDepth == 0)
+  {
+    __sync_synchronize();
+    mallocLockOwner = -1;
+  }
+}
+#endif
+
 /* Status of a file (by name). Minimal implementation: */
 int stat(const char *file, struct stat *st)
 {
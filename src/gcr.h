@@ -114,6 +114,11 @@ speed zone divisors are 13, 14, 15, 16 for densities 3, 2, 1, 0 respectively
 #define GCR_MASK_BAD_FIRST 0
 #define GCR_MASK_BAD_LAST 1
 
+/* The bulk codec has a NEON path on a Pi 2/3 (the host build defines GCR_NEON to check it against host/arm_neon.h) */
+#if !defined(GCR_NEON) && (defined(__ARM_NEON__) || defined(__ARM_NEON))
+#define GCR_NEON
+#endif
+
 /* global variables */
 extern char sector_map_1541[];
 extern BYTE speed_map_1541[];
@@ -126,6 +131,15 @@ extern int gap_match_length;
 int find_sync(BYTE ** gcr_pptr, BYTE * gcr_end);
 void convert_4bytes_to_GCR(BYTE * buffer, BYTE * ptr);
 int convert_4bytes_from_GCR(BYTE * gcr, BYTE * plain);
+/* Bulk versions of the above for groups of 4 bytes <-> 5 GCR bytes. Decoding returns how many bytes were converted before the first bad GCR code (groups * 4 if there were none). */
+void encode_GCR_block(BYTE * plain, BYTE * gcr, int groups);
+int decode_GCR_block(BYTE * gcr, BYTE * plain, int groups);
+void encode_GCR_block_scalar(BYTE * plain, BYTE * gcr, int groups);
+int decode_GCR_block_scalar(BYTE * gcr, BYTE * plain, int groups);
+#if defined(GCR_NEON)
+void encode_GCR_block_neon(BYTE * plain, BYTE * gcr, int groups);
+int decode_GCR_block_neon(BYTE * gcr, BYTE * plain, int groups);
+#endif
 int extract_id(BYTE * gcr_track, BYTE * id);
 int extract_cosmetic_id(BYTE * gcr_track, BYTE * id);
 size_t find_track_cycle(BYTE ** cycle_start, BYTE ** cycle_stop, int cap_min,
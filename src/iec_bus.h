@@ -610,6 +610,9 @@ public:
 	static inline bool IsClockSetToOut() { return ClockSetToOut; }
 	static inline bool IsReset() { return Resetting; }
 
+	// The GPIO levels that Emulate1541 has to respond to (the IEC lines, reset and the buttons).
+	static inline u32 ReadInputs() { return read32(ARM_GPIO_GPLEV0) & (PIGPIO_MASK_IN_ATN | PIGPIO_MASK_IN_DATA | PIGPIO_MASK_IN_CLOCK | PIGPIO_MASK_IN_SRQ | PIGPIO_MASK_IN_RESET | PIGPIO_MASK_ANY_BUTTON); }
+
 	static inline void WaitWhileAtnAsserted()
 	{
 		while (IsAtnAsserted())
@@ -2135,13 +2135,19 @@ int IEC_Commands::CreateNewDisk(char* filenameNew, char* ID, bool automount)
 		break;
 	}
 
-	unsigned length = DiskImage::CreateNewDiskInRAM(filenameNew, ID);
+	unsigned char* diskImageData = (unsigned char*)malloc(READBUFFER_SIZE);
+	if (diskImageData == 0)
+		return ERROR_25_WRITE_ERROR;
 
-	return WriteNewDiskInRAM(filenameNew, automount, length);
+	unsigned length = DiskImage::CreateNewDiskInRAM(filenameNew, ID, diskImageData);
+
+	int error = WriteNewDiskInRAM(filenameNew, automount, diskImageData, length);
+	free(diskImageData);
+	return error;
 }
 
 
-int IEC_Commands::WriteNewDiskInRAM(char* filenameNew, bool automount, unsigned length)
+int IEC_Commands::WriteNewDiskInRAM(char* filenameNew, bool automount, unsigned char* diskImageData, unsigned length)
 {
 	FILINFO filInfo;
 	FRESULT res;
@@ -2150,7 +2156,7 @@ int IEC_Commands::WriteNewDiskInRAM(char* filenameNew, bool automount, unsigned
 	if (res == FR_NO_FILE)
 	{
 		DiskImage diskImage;
-		diskImage.OpenD64((const FILINFO*)0, (unsigned char*)DiskImage::readBuffer, length);
+		diskImage.OpenD64((const FILINFO*)0, diskImageData, length);
 
 		switch (newDiskType)
 		{
@@ -172,7 +172,7 @@ protected:
 
 	u8 GetFilenameCharacter(u8 value);
 
-	int WriteNewDiskInRAM(char* filenameNew, bool automount, unsigned length);
+	int WriteNewDiskInRAM(char* filenameNew, bool automount, unsigned char* diskImageData, unsigned length);
 
 	UpdateAction updateAction;
 	u8 commandCode;
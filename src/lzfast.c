@@ -0,0 +1,184 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+// The data is a run of sequences, each a token byte, its literals and a match:
+//   token          - literal count (high nibble) and match length - 4 (low nibble), 15 meaning more follows
+//   [255 ... n]    - the rest of the literal count when it is 15 or more (bytes added until one is not 255)
+//   literals
+//   offset         - 2 bytes little endian, how far back the match is (1 to 65535)
+//   [255 ... n]    - the rest of the match length when it is 19 or more
+// The last sequence is only a token and literals (the data ends after them).
+// The compressor finds matches through a hash table of where each 4 bytes were last seen so only takes one look per byte.
+
+#include <string.h>
+#include "lzfast.h"
+
+#define LZFAST_MIN_MATCH 4
+#define LZFAST_MAX_OFFSET 65535
+#define LZFAST_HASH_BITS 12
+#define LZFAST_LAST_LITERALS 5		// Matches end at least this far from the end so the last sequence is never empty
+
+static inline unsigned int
+LZFast_Read32(const unsigned char* in)
+{
+	unsigned int value;
+	memcpy(&value, in, sizeof(value));
+	return value;
+}
+
+static inline unsigned int
+LZFast_Hash(unsigned int value)
+{
+	return (value * 2654435761U) >> (32 - LZFAST_HASH_BITS);
+}
+
+static unsigned char*
+LZFast_WriteLength(unsigned char* out, unsigned int length)
+{
+	while (length >= 255)
+	{
+		*out++ = 255;
+		length -= 255;
+	}
+	*out++ = (unsigned char)length;
+	return out;
+}
+
+static unsigned char*
+LZFast_WriteSequence(unsigned char* out, const unsigned char* literals, unsigned int literalCount, unsigned int offset, unsigned int matchLength)
+{
+	unsigned char* token = out++;
+	unsigned int matchCode = matchLength ? matchLength - LZFAST_MIN_MATCH : 0;
+
+	*token = (unsigned char)(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+	if (literalCount >= 15)
+		out = LZFast_WriteLength(out, literalCount - 15);
+	memcpy(out, literals, literalCount);
+	out += literalCount;
+	if (matchLength)
+	{
+		*out++ = (unsigned char)offset;
+		*out++ = (unsigned char)(offset >> 8);
+		if (matchCode >= 15)
+			out = LZFast_WriteLength(out, matchCode - 15);
+	}
+	return out;
+}
+
+int
+LZFast_Compress(const unsigned char* in, unsigned char* out, unsigned int insize, unsigned int* work)
+{
+	unsigned char* start = out;
+	unsigned int anchor = 0;
+	unsigned int pos = 0;
+	unsigned int matchLimit = insize > LZFAST_LAST_LITERALS + LZFAST_MIN_MATCH ? insize - LZFAST_LAST_LITERALS - LZFAST_MIN_MATCH : 0;
+
+	memset(work, 0xff, LZFAST_WORK_SIZE * sizeof(unsigned int));
+	while (pos < matchLimit)
+	{
+		unsigned int value = LZFast_Read32(in + pos);
+		unsigned int hash = LZFast_Hash(value);
+		unsigned int candidate = work[hash];
+
+		work[hash] = pos;
+		if (candidate == 0xffffffff || pos - candidate > LZFAST_MAX_OFFSET || LZFast_Read32(in + candidate) != value)
+		{
+			// Step further the longer it has been since a match so that data that will not compress goes by quickly.
+			pos += 1 + ((pos - anchor) >> 6);
+			continue;
+		}
+
+		unsigned int length = LZFAST_MIN_MATCH;
+		unsigned int lengthLimit = insize - LZFAST_LAST_LITERALS - pos;
+		while (length < lengthLimit && in[candidate + length] == in[pos + length])
+			++length;
+
+		out = LZFast_WriteSequence(out, in + anchor, pos - anchor, pos - candidate, length);
+		pos += length;
+		anchor = pos;
+		if (pos < matchLimit)
+			work[LZFast_Hash(LZFast_Read32(in + pos - 2))] = pos - 2;
+	}
+	out = LZFast_WriteSequence(out, in + anchor, insize - anchor, 0, 0);
+	return (int)(out - start);
+}
+
+int
+LZFast_Uncompress(const unsigned char* in, unsigned char* out, unsigned int insize, unsigned int outsize)
+{
+	const unsigned char* inEnd = in + insize;
+	unsigned int outpos = 0;
+
+	while (in < inEnd)
+	{
+		unsigned int token = *in++;
+		unsigned int count = token >> 4;
+		unsigned int extra;
+
+		if (count == 15)
+		{
+			do
+			{
+				if (in >= inEnd)
+					return -1;
+				extra = *in++;
+				count += extra;
+			}
+			while (extra == 255);
+		}
+		if (count > (unsigned int)(inEnd - in) || count > outsize - outpos)
+			return -1;
+		memcpy(out + outpos, in, count);
+		in += count;
+		outpos += count;
+		if (in == inEnd)
+			break;
+
+		if (inEnd - in < 2)
+			return -1;
+		unsigned int offset = in[0] | (in[1] << 8);
+		in += 2;
+		count = (token & 15) + LZFAST_MIN_MATCH;
+		if (count == 15 + LZFAST_MIN_MATCH)
+		{
+			do
+			{
+				if (in >= inEnd)
+					return -1;
+				extra = *in++;
+				count += extra;
+			}
+			while (extra == 255);
+		}
+		if (offset == 0 || offset > outpos || count > outsize - outpos)
+			return -1;
+
+		unsigned char* dest = out + outpos;
+		const unsigned char* source = dest - offset;
+		outpos += count;
+		if (offset >= count)
+			memcpy(dest, source, count);
+		else
+		{
+			// Overlapping (eg a run of one byte) so it has to go a byte at a time.
+			while (count--)
+				*dest++ = *source++;
+		}
+	}
+	return (int)outpos;
+}
@@ -0,0 +1,43 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef LZFAST_H
+#define LZFAST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A byte oriented LZ77 coder for keeping disk images compressed in memory.
+// lz.c gets better ratios (it is used for NBZ files) but takes seconds to compress a disk; this takes milliseconds either way.
+
+// Entries in the hash table LZFast_Compress must be given to work in.
+#define LZFAST_WORK_SIZE 4096
+// The most LZFast_Compress can output for insize bytes.
+#define LZFAST_BOUND(insize) ((insize) + (insize) / 255 + 16)
+
+// Returns the size of the compressed data (out must hold LZFAST_BOUND(insize) bytes).
+int LZFast_Compress(const unsigned char* in, unsigned char* out, unsigned int insize, unsigned int* work);
+// Returns the size of the uncompressed data or -1 if it would not fit in outsize bytes (ie it is not what LZFast_Compress gave).
+int LZFast_Uncompress(const unsigned char* in, unsigned char* out, unsigned int insize, unsigned int outsize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -18,46 +18,46 @@
 
 #include "m6502.h"
 
-M6502::OpcodeCycleFunction M6502::opcodeFunctions[256] =
+const u8 M6502::opcodeOperations[256] =
 {
-//       0           1           2           3           4           5           6           7           8           9           A           B           C           D           E           F
-&M6502::BRK,&M6502::ORA,&M6502::JAM,&M6502::SLO,&M6502::NOP,&M6502::ORA,&M6502::ASL,&M6502::SLO,&M6502::PHP,&M6502::ORA,&M6502::ASL,&M6502::ANC,&M6502::NOP,&M6502::ORA,&M6502::ASL,&M6502::SLO,// 0
-&M6502::BPL,&M6502::ORA,&M6502::JAM,&M6502::SLO,&M6502::NOP,&M6502::ORA,&M6502::ASL,&M6502::SLO,&M6502::CLC,&M6502::ORA,&M6502::NOP,&M6502::SLO,&M6502::NOP,&M6502::ORA,&M6502::ASL,&M6502::SLO,// 1
-&M6502::JSR,&M6502::AND,&M6502::JAM,&M6502::RLA,&M6502::BIT,&M6502::AND,&M6502::ROL,&M6502::RLA,&M6502::PLP,&M6502::AND,&M6502::ROL,&M6502::ANC,&M6502::BIT,&M6502::AND,&M6502::ROL,&M6502::RLA,// 2
-&M6502::BMI,&M6502::AND,&M6502::JAM,&M6502::RLA,&M6502::NOP,&M6502::AND,&M6502::ROL,&M6502::RLA,&M6502::SEC,&M6502::AND,&M6502::NOP,&M6502::RLA,&M6502::NOP,&M6502::AND,&M6502::ROL,&M6502::RLA,// 3
-&M6502::RTI,&M6502::EOR,&M6502::JAM,&M6502::SRE,&M6502::NOP,&M6502::EOR,&M6502::LSR,&M6502::SRE,&M6502::PHA,&M6502::EOR,&M6502::LSR,&M6502::ASR,&M6502::JMP,&M6502::EOR,&M6502::LSR,&M6502::SRE,// 4
-&M6502::BVC,&M6502::EOR,&M6502::JAM,&M6502::SRE,&M6502::NOP,&M6502::EOR,&M6502::LSR,&M6502::SRE,&M6502::CLI,&M6502::EOR,&M6502::NOP,&M6502::SRE,&M6502::NOP,&M6502::EOR,&M6502::LSR,&M6502::SRE,// 5
-&M6502::RTS,&M6502::ADC,&M6502::JAM,&M6502::RRA,&M6502::NOP,&M6502::ADC,&M6502::ROR,&M6502::RRA,&M6502::PLA,&M6502::ADC,&M6502::ROR,&M6502::ARR,&M6502::JMP,&M6502::ADC,&M6502::ROR,&M6502::RRA,// 6
-&M6502::BVS,&M6502::ADC,&M6502::JAM,&M6502::RRA,&M6502::NOP,&M6502::ADC,&M6502::ROR,&M6502::RRA,&M6502::SEI,&M6502::ADC,&M6502::NOP,&M6502::RRA,&M6502::NOP,&M6502::ADC,&M6502::ROR,&M6502::RRA,// 7
-&M6502::NOP,&M6502::STA,&M6502::NOP,&M6502::SAX,&M6502::STY,&M6502::STA,&M6502::STX,&M6502::SAX,&M6502::DEY,&M6502::NOP,&M6502::TXA,&M6502::XAA,&M6502::STY,&M6502::STA,&M6502::STX,&M6502::SAX,// 8
-&M6502::BCC,&M6502::STA,&M6502::JAM,&M6502::SHA,&M6502::STY,&M6502::STA,&M6502::STX,&M6502::SAX,&M6502::TYA,&M6502::STA,&M6502::TXS,&M6502::SHS,&M6502::SHY,&M6502::STA,&M6502::SHX,&M6502::SHA,// 9
-&M6502::LDY,&M6502::LDA,&M6502::LDX,&M6502::LAX,&M6502::LDY,&M6502::LDA,&M6502::LDX,&M6502::LAX,&M6502::TAY,&M6502::LDA,&M6502::TAX,&M6502::LXA,&M6502::LDY,&M6502::LDA,&M6502::LDX,&M6502::LAX,// A
-&M6502::BCS,&M6502::LDA,&M6502::JAM,&M6502::LAX,&M6502::LDY,&M6502::LDA,&M6502::LDX,&M6502::LAX,&M6502::CLV,&M6502::LDA,&M6502::TSX,&M6502::LAS,&M6502::LDY,&M6502::LDA,&M6502::LDX,&M6502::LAX,// B
-&M6502::CPY,&M6502::CMP,&M6502::NOP,&M6502::DCP,&M6502::CPY,&M6502::CMP,&M6502::DEC,&M6502::DCP,&M6502::INY,&M6502::CMP,&M6502::DEX,&M6502::SBX,&M6502::CPY,&M6502::CMP,&M6502::DEC,&M6502::DCP,// C
-&M6502::BNE,&M6502::CMP,&M6502::JAM,&M6502::DCP,&M6502::NOP,&M6502::CMP,&M6502::DEC,&M6502::DCP,&M6502::CLD,&M6502::CMP,&M6502::NOP,&M6502::DCP,&M6502::NOP,&M6502::CMP,&M6502::DEC,&M6502::DCP,// D
-&M6502::CPX,&M6502::SBC,&M6502::NOP,&M6502::ISB,&M6502::CPX,&M6502::SBC,&M6502::INC,&M6502::ISB,&M6502::INX,&M6502::SBC,&M6502::NOP,&M6502::SBC,&M6502::CPX,&M6502::SBC,&M6502::INC,&M6502::ISB,// E
-&M6502::BEQ,&M6502::SBC,&M6502::JAM,&M6502::ISB,&M6502::NOP,&M6502::SBC,&M6502::INC,&M6502::ISB,&M6502::SED,&M6502::SBC,&M6502::NOP,&M6502::ISB,&M6502::NOP,&M6502::SBC,&M6502::INC,&M6502::ISB // F
+//    0      1      2      3      4      5      6      7      8      9      A      B      C      D      E      F
+OP_BRK,OP_ORA,OP_JAM,OP_SLO,OP_NOP,OP_ORA,OP_ASL,OP_SLO,OP_PHP,OP_ORA,OP_ASL,OP_ANC,OP_NOP,OP_ORA,OP_ASL,OP_SLO,// 0
+OP_BPL,OP_ORA,OP_JAM,OP_SLO,OP_NOP,OP_ORA,OP_ASL,OP_SLO,OP_CLC,OP_ORA,OP_NOP,OP_SLO,OP_NOP,OP_ORA,OP_ASL,OP_SLO,// 1
+OP_JSR,OP_AND,OP_JAM,OP_RLA,OP_BIT,OP_AND,OP_ROL,OP_RLA,OP_PLP,OP_AND,OP_ROL,OP_ANC,OP_BIT,OP_AND,OP_ROL,OP_RLA,// 2
+OP_BMI,OP_AND,OP_JAM,OP_RLA,OP_NOP,OP_AND,OP_ROL,OP_RLA,OP_SEC,OP_AND,OP_NOP,OP_RLA,OP_NOP,OP_AND,OP_ROL,OP_RLA,// 3
+OP_RTI,OP_EOR,OP_JAM,OP_SRE,OP_NOP,OP_EOR,OP_LSR,OP_SRE,OP_PHA,OP_EOR,OP_LSR,OP_ASR,OP_JMP,OP_EOR,OP_LSR,OP_SRE,// 4
+OP_BVC,OP_EOR,OP_JAM,OP_SRE,OP_NOP,OP_EOR,OP_LSR,OP_SRE,OP_CLI,OP_EOR,OP_NOP,OP_SRE,OP_NOP,OP_EOR,OP_LSR,OP_SRE,// 5
+OP_RTS,OP_ADC,OP_JAM,OP_RRA,OP_NOP,OP_ADC,OP_ROR,OP_RRA,OP_PLA,OP_ADC,OP_ROR,OP_ARR,OP_JMP,OP_ADC,OP_ROR,OP_RRA,// 6
+OP_BVS,OP_ADC,OP_JAM,OP_RRA,OP_NOP,OP_ADC,OP_ROR,OP_RRA,OP_SEI,OP_ADC,OP_NOP,OP_RRA,OP_NOP,OP_ADC,OP_ROR,OP_RRA,// 7
+OP_NOP,OP_STA,OP_NOP,OP_SAX,OP_STY,OP_STA,OP_STX,OP_SAX,OP_DEY,OP_NOP,OP_TXA,OP_XAA,OP_STY,OP_STA,OP_STX,OP_SAX,// 8
+OP_BCC,OP_STA,OP_JAM,OP_SHA,OP_STY,OP_STA,OP_STX,OP_SAX,OP_TYA,OP_STA,OP_TXS,OP_SHS,OP_SHY,OP_STA,OP_SHX,OP_SHA,// 9
+OP_LDY,OP_LDA,OP_LDX,OP_LAX,OP_LDY,OP_LDA,OP_LDX,OP_LAX,OP_TAY,OP_LDA,OP_TAX,OP_LXA,OP_LDY,OP_LDA,OP_LDX,OP_LAX,// A
+OP_BCS,OP_LDA,OP_JAM,OP_LAX,OP_LDY,OP_LDA,OP_LDX,OP_LAX,OP_CLV,OP_LDA,OP_TSX,OP_LAS,OP_LDY,OP_LDA,OP_LDX,OP_LAX,// B
+OP_CPY,OP_CMP,OP_NOP,OP_DCP,OP_CPY,OP_CMP,OP_DEC,OP_DCP,OP_INY,OP_CMP,OP_DEX,OP_SBX,OP_CPY,OP_CMP,OP_DEC,OP_DCP,// C
+OP_BNE,OP_CMP,OP_JAM,OP_DCP,OP_NOP,OP_CMP,OP_DEC,OP_DCP,OP_CLD,OP_CMP,OP_NOP,OP_DCP,OP_NOP,OP_CMP,OP_DEC,OP_DCP,// D
+OP_CPX,OP_SBC,OP_NOP,OP_ISB,OP_CPX,OP_SBC,OP_INC,OP_ISB,OP_INX,OP_SBC,OP_NOP,OP_SBC,OP_CPX,OP_SBC,OP_INC,OP_ISB,// E
+OP_BEQ,OP_SBC,OP_JAM,OP_ISB,OP_NOP,OP_SBC,OP_INC,OP_ISB,OP_SED,OP_SBC,OP_NOP,OP_ISB,OP_NOP,OP_SBC,OP_INC,OP_ISB // F
 };
 
-M6502::AddressModeCycleFunction M6502::T1AddressModeFunctions[256] =
+const u8 M6502::T1AddressModeCycles[256] =
 {
 //       0                     1                2                       3                4                  5                  6                 7                  8                  9                  A                 B                  C                  D                    E              F
-&M6502::brk_5_4_T1,&M6502::idx_2_4_T1,&M6502::sb_jam_T1, &M6502::idx_Undoc_T1,&M6502::zp_2_1_T1, &M6502::zp_2_1_T1, &M6502::zp_4_1_T1, &M6502::zp_4_1_T1, &M6502::ph_5_1_T1,&M6502::imm_2_1_T1, &M6502::sb_1_T1,&M6502::imm_2_1_T1, &M6502::abs_2_3_T1, &M6502::abs_2_3_T1, &M6502::abs_4_2_T1, &M6502::abs_4_2_T1, //0
-&M6502::rel_5_8_T1,&M6502::idy_2_7_T1,&M6502::sb_jam_T1, &M6502::idy_Undoc_T1,&M6502::zpx_2_6_T1,&M6502::zpx_2_6_T1,&M6502::zpx_4_3_T1,&M6502::zpx_4_3_T1,&M6502::sb_1_T1,  &M6502::absy_2_5_T1,&M6502::sb_1_T1,&M6502::absy_4_4_T1,&M6502::absx_2_5_T1,&M6502::absx_2_5_T1,&M6502::absx_4_4_T1,&M6502::absx_4_4_T1,//1
-&M6502::jsr_5_3_T1,&M6502::idx_2_4_T1,&M6502::sb_jam_T1, &M6502::idx_Undoc_T1,&M6502::zp_2_1_T1, &M6502::zp_2_1_T1, &M6502::zp_4_1_T1, &M6502::zp_4_1_T1, &M6502::pl_5_2_T1,&M6502::imm_2_1_T1, &M6502::sb_1_T1,&M6502::imm_2_1_T1, &M6502::abs_2_3_T1, &M6502::abs_2_3_T1, &M6502::abs_4_2_T1, &M6502::abs_4_2_T1, //2
-&M6502::rel_5_8_T1,&M6502::idy_2_7_T1,&M6502::sb_jam_T1, &M6502::idy_Undoc_T1,&M6502::zpx_2_6_T1,&M6502::zpx_2_6_T1,&M6502::zpx_4_3_T1,&M6502::zpx_4_3_T1,&M6502::sb_1_T1,  &M6502::absy_2_5_T1,&M6502::sb_1_T1,&M6502::absy_4_4_T1,&M6502::absx_2_5_T1,&M6502::absx_2_5_T1,&M6502::absx_4_4_T1,&M6502::absx_4_4_T1,//3
-&M6502::rti_5_5_T1,&M6502::idx_2_4_T1,&M6502::sb_jam_T1, &M6502::idx_Undoc_T1,&M6502::zp_2_1_T1, &M6502::zp_2_1_T1, &M6502::zp_4_1_T1, &M6502::zp_4_1_T1, &M6502::ph_5_1_T1,&M6502::imm_2_1_T1, &M6502::sb_1_T1,&M6502::imm_2_1_T1, &M6502::abs5_6_1_T1,&M6502::abs_2_3_T1, &M6502::abs_4_2_T1, &M6502::abs_4_2_T1, //4
-&M6502::rel_5_8_T1,&M6502::idy_2_7_T1,&M6502::sb_jam_T1, &M6502::idy_Undoc_T1,&M6502::zpx_2_6_T1,&M6502::zpx_2_6_T1,&M6502::zpx_4_3_T1,&M6502::zpx_4_3_T1,&M6502::sb_1_T1,  &M6502::absy_2_5_T1,&M6502::sb_1_T1,&M6502::absy_4_4_T1,&M6502::absx_2_5_T1,&M6502::absx_2_5_T1,&M6502::absx_4_4_T1,&M6502::absx_4_4_T1,//5
-&M6502::rts_5_7_T1,&M6502::idx_2_4_T1,&M6502::sb_jam_T1, &M6502::idx_Undoc_T1,&M6502::zp_2_1_T1, &M6502::zp_2_1_T1, &M6502::zp_4_1_T1, &M6502::zp_4_1_T1, &M6502::pl_5_2_T1,&M6502::imm_2_1_T1, &M6502::sb_1_T1,&M6502::imm_2_1_T1, &M6502::abs5_6_2_T1,&M6502::abs_2_3_T1, &M6502::abs_4_2_T1, &M6502::abs_4_2_T1, //6
-&M6502::rel_5_8_T1,&M6502::idy_2_7_T1,&M6502::sb_jam_T1, &M6502::idy_Undoc_T1,&M6502::zpx_2_6_T1,&M6502::zpx_2_6_T1,&M6502::zpx_4_3_T1,&M6502::zpx_4_3_T1,&M6502::sb_1_T1,  &M6502::absy_2_5_T1,&M6502::sb_1_T1,&M6502::absy_4_4_T1,&M6502::absx_2_5_T1,&M6502::absx_2_5_T1,&M6502::absx_4_4_T1,&M6502::absx_4_4_T1,//7
-&M6502::imm_2_1_T1,&M6502::idx_3_3_T1,&M6502::imm_2_1_T1,&M6502::idx_3_3_T1,  &M6502::zp_3_1_T1, &M6502::zp_3_1_T1, &M6502::zp_2_1_T1, &M6502::zp_3_1_T1, &M6502::sb_1_T1,  &M6502::imm_2_1_T1, &M6502::sb_1_T1,&M6502::imm_2_1_T1, &M6502::abs_3_2_T1, &M6502::abs_3_2_T1, &M6502::abs_3_2_T1, &M6502::abs_3_2_T1, //8
-&M6502::rel_5_8_T1,&M6502::idy_3_6_T1,&M6502::sb_jam_T1, &M6502::idy_3_6_T1,  &M6502::zpx_3_5_T1,&M6502::zpx_3_5_T1,&M6502::zpy_3_5_T1,&M6502::zpy_3_5_T1,&M6502::sb_1_T1,  &M6502::absy_3_4_T1,&M6502::sb_1_T1,&M6502::absy_3_4_T1,&M6502::absx_3_4_T1,&M6502::absx_3_4_T1,&M6502::absy_3_4_T1,&M6502::absy_3_4_T1,//9
-&M6502::imm_2_1_T1,&M6502::idx_2_4_T1,&M6502::imm_2_1_T1,&M6502::idx_2_4_T1,  &M6502::zp_2_1_T1, &M6502::zp_2_1_T1, &M6502::zp_2_1_T1, &M6502::zp_2_1_T1, &M6502::sb_1_T1,  &M6502::imm_2_1_T1, &M6502::sb_1_T1,&M6502::imm_2_1_T1, &M6502::abs_2_3_T1, &M6502::abs_2_3_T1, &M6502::abs_2_3_T1, &M6502::abs_2_3_T1, //A
-&M6502::rel_5_8_T1,&M6502::idy_2_7_T1,&M6502::sb_jam_T1, &M6502::idy_2_7_T1,  &M6502::zpx_2_6_T1,&M6502::zpx_2_6_T1,&M6502::zpy_2_6_T1,&M6502::zpy_2_6_T1,&M6502::sb_1_T1,  &M6502::absy_2_5_T1,&M6502::sb_1_T1,&M6502::absy_4_4_T1,&M6502::absx_2_5_T1,&M6502::absx_2_5_T1,&M6502::absy_2_5_T1,&M6502::absy_2_5_T1,//B
-&M6502::imm_2_1_T1,&M6502::idx_2_4_T1,&M6502::imm_2_1_T1,&M6502::idx_Undoc_T1,&M6502::zp_2_1_T1, &M6502::zp_2_1_T1, &M6502::zp_4_1_T1, &M6502::zp_4_1_T1, &M6502::sb_1_T1,  &M6502::imm_2_1_T1, &M6502::sb_1_T1,&M6502::imm_2_1_T1, &M6502::abs_2_3_T1, &M6502::abs_2_3_T1, &M6502::abs_4_2_T1, &M6502::abs_4_2_T1, //C
-&M6502::rel_5_8_T1,&M6502::idy_2_7_T1,&M6502::sb_jam_T1, &M6502::idy_Undoc_T1,&M6502::zpx_2_6_T1,&M6502::zpx_2_6_T1,&M6502::zpx_4_3_T1,&M6502::zpx_4_3_T1,&M6502::sb_1_T1,  &M6502::absy_2_5_T1,&M6502::sb_1_T1,&M6502::absy_4_4_T1,&M6502::absx_2_5_T1,&M6502::absx_2_5_T1,&M6502::absx_4_4_T1,&M6502::absx_4_4_T1,//D
-&M6502::imm_2_1_T1,&M6502::idx_2_4_T1,&M6502::imm_2_1_T1,&M6502::idx_Undoc_T1,&M6502::zp_2_1_T1, &M6502::zp_2_1_T1, &M6502::zp_4_1_T1, &M6502::zp_4_1_T1, &M6502::sb_1_T1,  &M6502::imm_2_1_T1, &M6502::sb_1_T1,&M6502::imm_2_1_T1, &M6502::abs_2_3_T1, &M6502::abs_2_3_T1, &M6502::abs_4_2_T1, &M6502::abs_4_2_T1, //E
-&M6502::rel_5_8_T1,&M6502::idy_2_7_T1,&M6502::sb_jam_T1, &M6502::idy_Undoc_T1,&M6502::zpx_2_6_T1,&M6502::zpx_2_6_T1,&M6502::zpx_4_3_T1,&M6502::zpx_4_3_T1,&M6502::sb_1_T1,  &M6502::absy_2_5_T1,&M6502::sb_1_T1,&M6502::absy_4_4_T1,&M6502::absx_2_5_T1,&M6502::absx_2_5_T1,&M6502::absx_4_4_T1,&M6502::absx_4_4_T1 //F
+AM_brk_5_4_T1,AM_idx_2_4_T1,AM_sb_jam_T1, AM_idx_Undoc_T1,AM_zp_2_1_T1, AM_zp_2_1_T1, AM_zp_4_1_T1, AM_zp_4_1_T1, AM_ph_5_1_T1,AM_imm_2_1_T1, AM_sb_1_T1,AM_imm_2_1_T1, AM_abs_2_3_T1, AM_abs_2_3_T1, AM_abs_4_2_T1, AM_abs_4_2_T1, //0
+AM_rel_5_8_T1,AM_idy_2_7_T1,AM_sb_jam_T1, AM_idy_Undoc_T1,AM_zpx_2_6_T1,AM_zpx_2_6_T1,AM_zpx_4_3_T1,AM_zpx_4_3_T1,AM_sb_1_T1,  AM_absy_2_5_T1,AM_sb_1_T1,AM_absy_4_4_T1,AM_absx_2_5_T1,AM_absx_2_5_T1,AM_absx_4_4_T1,AM_absx_4_4_T1,//1
+AM_jsr_5_3_T1,AM_idx_2_4_T1,AM_sb_jam_T1, AM_idx_Undoc_T1,AM_zp_2_1_T1, AM_zp_2_1_T1, AM_zp_4_1_T1, AM_zp_4_1_T1, AM_pl_5_2_T1,AM_imm_2_1_T1, AM_sb_1_T1,AM_imm_2_1_T1, AM_abs_2_3_T1, AM_abs_2_3_T1, AM_abs_4_2_T1, AM_abs_4_2_T1, //2
+AM_rel_5_8_T1,AM_idy_2_7_T1,AM_sb_jam_T1, AM_idy_Undoc_T1,AM_zpx_2_6_T1,AM_zpx_2_6_T1,AM_zpx_4_3_T1,AM_zpx_4_3_T1,AM_sb_1_T1,  AM_absy_2_5_T1,AM_sb_1_T1,AM_absy_4_4_T1,AM_absx_2_5_T1,AM_absx_2_5_T1,AM_absx_4_4_T1,AM_absx_4_4_T1,//3
+AM_rti_5_5_T1,AM_idx_2_4_T1,AM_sb_jam_T1, AM_idx_Undoc_T1,AM_zp_2_1_T1, AM_zp_2_1_T1, AM_zp_4_1_T1, AM_zp_4_1_T1, AM_ph_5_1_T1,AM_imm_2_1_T1, AM_sb_1_T1,AM_imm_2_1_T1, AM_abs5_6_1_T1,AM_abs_2_3_T1, AM_abs_4_2_T1, AM_abs_4_2_T1, //4
+AM_rel_5_8_T1,AM_idy_2_7_T1,AM_sb_jam_T1, AM_idy_Undoc_T1,AM_zpx_2_6_T1,AM_zpx_2_6_T1,AM_zpx_4_3_T1,AM_zpx_4_3_T1,AM_sb_1_T1,  AM_absy_2_5_T1,AM_sb_1_T1,AM_absy_4_4_T1,AM_absx_2_5_T1,AM_absx_2_5_T1,AM_absx_4_4_T1,AM_absx_4_4_T1,//5
+AM_rts_5_7_T1,AM_idx_2_4_T1,AM_sb_jam_T1, AM_idx_Undoc_T1,AM_zp_2_1_T1, AM_zp_2_1_T1, AM_zp_4_1_T1, AM_zp_4_1_T1, AM_pl_5_2_T1,AM_imm_2_1_T1, AM_sb_1_T1,AM_imm_2_1_T1, AM_abs5_6_2_T1,AM_abs_2_3_T1, AM_abs_4_2_T1, AM_abs_4_2_T1, //6
+AM_rel_5_8_T1,AM_idy_2_7_T1,AM_sb_jam_T1, AM_idy_Undoc_T1,AM_zpx_2_6_T1,AM_zpx_2_6_T1,AM_zpx_4_3_T1,AM_zpx_4_3_T1,AM_sb_1_T1,  AM_absy_2_5_T1,AM_sb_1_T1,AM_absy_4_4_T1,AM_absx_2_5_T1,AM_absx_2_5_T1,AM_absx_4_4_T1,AM_absx_4_4_T1,//7
+AM_imm_2_1_T1,AM_idx_3_3_T1,AM_imm_2_1_T1,AM_idx_3_3_T1,  AM_zp_3_1_T1, AM_zp_3_1_T1, AM_zp_2_1_T1, AM_zp_3_1_T1, AM_sb_1_T1,  AM_imm_2_1_T1, AM_sb_1_T1,AM_imm_2_1_T1, AM_abs_3_2_T1, AM_abs_3_2_T1, AM_abs_3_2_T1, AM_abs_3_2_T1, //8
+AM_rel_5_8_T1,AM_idy_3_6_T1,AM_sb_jam_T1, AM_idy_3_6_T1,  AM_zpx_3_5_T1,AM_zpx_3_5_T1,AM_zpy_3_5_T1,AM_zpy_3_5_T1,AM_sb_1_T1,  AM_absy_3_4_T1,AM_sb_1_T1,AM_absy_3_4_T1,AM_absx_3_4_T1,AM_absx_3_4_T1,AM_absy_3_4_T1,AM_absy_3_4_T1,//9
+AM_imm_2_1_T1,AM_idx_2_4_T1,AM_imm_2_1_T1,AM_idx_2_4_T1,  AM_zp_2_1_T1, AM_zp_2_1_T1, AM_zp_2_1_T1, AM_zp_2_1_T1, AM_sb_1_T1,  AM_imm_2_1_T1, AM_sb_1_T1,AM_imm_2_1_T1, AM_abs_2_3_T1, AM_abs_2_3_T1, AM_abs_2_3_T1, AM_abs_2_3_T1, //A
+AM_rel_5_8_T1,AM_idy_2_7_T1,AM_sb_jam_T1, AM_idy_2_7_T1,  AM_zpx_2_6_T1,AM_zpx_2_6_T1,AM_zpy_2_6_T1,AM_zpy_2_6_T1,AM_sb_1_T1,  AM_absy_2_5_T1,AM_sb_1_T1,AM_absy_4_4_T1,AM_absx_2_5_T1,AM_absx_2_5_T1,AM_absy_2_5_T1,AM_absy_2_5_T1,//B
+AM_imm_2_1_T1,AM_idx_2_4_T1,AM_imm_2_1_T1,AM_idx_Undoc_T1,AM_zp_2_1_T1, AM_zp_2_1_T1, AM_zp_4_1_T1, AM_zp_4_1_T1, AM_sb_1_T1,  AM_imm_2_1_T1, AM_sb_1_T1,AM_imm_2_1_T1, AM_abs_2_3_T1, AM_abs_2_3_T1, AM_abs_4_2_T1, AM_abs_4_2_T1, //C
+AM_rel_5_8_T1,AM_idy_2_7_T1,AM_sb_jam_T1, AM_idy_Undoc_T1,AM_zpx_2_6_T1,AM_zpx_2_6_T1,AM_zpx_4_3_T1,AM_zpx_4_3_T1,AM_sb_1_T1,  AM_absy_2_5_T1,AM_sb_1_T1,AM_absy_4_4_T1,AM_absx_2_5_T1,AM_absx_2_5_T1,AM_absx_4_4_T1,AM_absx_4_4_T1,//D
+AM_imm_2_1_T1,AM_idx_2_4_T1,AM_imm_2_1_T1,AM_idx_Undoc_T1,AM_zp_2_1_T1, AM_zp_2_1_T1, AM_zp_4_1_T1, AM_zp_4_1_T1, AM_sb_1_T1,  AM_imm_2_1_T1, AM_sb_1_T1,AM_imm_2_1_T1, AM_abs_2_3_T1, AM_abs_2_3_T1, AM_abs_4_2_T1, AM_abs_4_2_T1, //E
+AM_rel_5_8_T1,AM_idy_2_7_T1,AM_sb_jam_T1, AM_idy_Undoc_T1,AM_zpx_2_6_T1,AM_zpx_2_6_T1,AM_zpx_4_3_T1,AM_zpx_4_3_T1,AM_sb_1_T1,  AM_absy_2_5_T1,AM_sb_1_T1,AM_absy_4_4_T1,AM_absx_2_5_T1,AM_absx_2_5_T1,AM_absx_4_4_T1,AM_absx_4_4_T1 //F
 };
 
 void M6502::ADC(void)
@@ -153,7 +153,7 @@ void M6502::absx_2_5_T3(void)
 	if (startpage != (ea & 0xFF00))
 	{
 		BUS_READ(startpage | (ea & 0xff));
-		addressModeCycleFn = &M6502::absx_2_5_T4;
+		addressModeCycle = AM_absx_2_5_T4;
 	}
 	else
 	{
@@ -169,7 +169,7 @@ void M6502::absy_2_5_T3(void)
 	if (startpage != (ea & 0xFF00))
 	{
 		BUS_READ(startpage | (ea & 0xff));
-		addressModeCycleFn = &M6502::absy_2_5_T4;
+		addressModeCycle = AM_absy_2_5_T4;
 	}
 	else
 	{
@@ -185,7 +185,7 @@ void M6502::idy_2_7_T4(void)
 	if (startpage != (ea & 0xFF00))
 	{
 		BUS_READ(startpage | (ea & 0xff));
-		addressModeCycleFn = &M6502::idy_2_7_T5;
+		addressModeCycle = AM_idy_2_7_T5;
 	}
 	else
 	{
@@ -201,11 +201,11 @@ void M6502::rel_5_8_T2(void)
 	if ((oldpc & 0xFF00) == (pc & 0xFF00))
 	{
 		BranchTakenMaskingInterrupt = true;
-		addressModeCycleFn = &M6502::InstructionFetch;	// Opcode has already been executed in T1 so just move on to the next instruction.
+		addressModeCycle = AM_InstructionFetch;	// Opcode has already been executed in T1 so just move on to the next instruction.
 	}
 	else
 	{
-		addressModeCycleFn = &M6502::rel_5_8_T3;
+		addressModeCycle = AM_rel_5_8_T3;
 	}
 }
 
@@ -230,7 +230,7 @@ void M6502::brk_5_4_T4(void)
 	}
 #endif
 	Push(status | FLAG_CONSTANT | FLAG_BREAK);
-	addressModeCycleFn = &M6502::brk_5_4_T5;
+	addressModeCycle = AM_brk_5_4_T5;
 }
 
 // It is possible for a BRK/IRQ to mask a NMI for short burts of NMI assertions.
@@ -252,7 +252,7 @@ void M6502::IRQ_T4(void)
 #endif
 	ClearB();
 	Push(status);
-	addressModeCycleFn = &M6502::IRQ_T5;
+	addressModeCycle = AM_IRQ_T5;
 }
 
 // Interrupts are polled before starting a new instruction
@@ -263,21 +263,21 @@ void M6502::InstructionFetch()
 
 #ifdef  SUPPORT_NMI
 	if (NMIPending)
-		addressModeCycleFn = &M6502::NMI_T1;
+		addressModeCycle = AM_NMI_T1;
 	else
 #endif //  SUPPORT_NMI
 #ifdef  SUPPORT_IRQ
 	if (IRQPending && !IRQDisabled())
 	{
 		IRQPending = 0;
-		addressModeCycleFn = &M6502::IRQ_T1;
+		addressModeCycle = AM_IRQ_T1;
 	}
 	else
 #endif //  SUPPORT_IRQ
 	{
 		pc++;
-		addressModeCycleFn = T1AddressModeFunctions[opcode];
-		opcodeCycleFn = opcodeFunctions[opcode];
+		addressModeCycle = T1AddressModeCycles[opcode];
+		opcodeOperation = opcodeOperations[opcode];
 	}
 }
 
@@ -287,11 +287,32 @@ void M6502::InstructionFetch()
 void M6502::InstructionFetchIRQ()
 {
 	opcode = BUS_READ(pc++);	// T0
-	addressModeCycleFn = T1AddressModeFunctions[opcode];
-	opcodeCycleFn = opcodeFunctions[opcode];
+	addressModeCycle = T1AddressModeCycles[opcode];
+	opcodeOperation = opcodeOperations[opcode];
 }
 #endif
 
+void M6502::ExecuteOperation(void)
+{
+	switch (opcodeOperation)
+	{
+#define M6502_SWITCH_CASE(name) case OP_##name: name(); break;
+		M6502_OPERATIONS(M6502_SWITCH_CASE)
+#undef M6502_SWITCH_CASE
+	}
+}
+
+// GCC will not inline a switch this size on its own and the extra call per cycle costs more than the dispatch saves.
+__attribute__((always_inline)) inline void M6502::ExecuteCycle(void)
+{
+	switch (addressModeCycle)
+	{
+#define M6502_SWITCH_CASE(name) case AM_##name: name(); break;
+		M6502_CYCLES(M6502_SWITCH_CASE)
+#undef M6502_SWITCH_CASE
+	}
+}
+
 // A single step emulates both real 6502 1/2 cycles.
 // On a real 6502, interrupts can be asserted between 1/2 cycles. When this occurs the hardware effectively ignores it for a further 1/2 cycle anyway.
 // Here, interrupts are polled at the start of a cycle (in an instruction fetch cycle) emulating this behaviour.
@@ -320,14 +341,23 @@ void M6502::Step(void)
 	if (BranchTakenMaskingInterrupt)	// If so we have delayed the IRQ long enough for the next instruction to now start.
 		BranchTakenMaskingInterrupt = false;
 
+#if defined(PROFILE6502)
+	if (profiler)
+	{
+		if (SYNC())
+			profiler->Instruction(pc, a, x, y, sp, status);
+		profiler->Cycle();
+	}
+#endif
+
 #ifdef  SUPPORT_RDY_HALTING
 	if (!Halted())
 	{
 		CheckForHalt();
-		(this->*M6502::addressModeCycleFn)();
+		ExecuteCycle();
 	}
 #else
-	(this->*M6502::addressModeCycleFn)();
+	ExecuteCycle();
 #endif //  SUPPORT_RDY_HALTING
 }
 
@@ -374,3 +404,91 @@ u8 M6502::BusRead(u16 address)
 	return dataBusReadFn(address);
 }
 #endif //  SUPPORT_RDY_HALTING
+
+void M6502::SaveState(SaveStateWriter& writer) const
+{
+	writer.Write16(ea);
+	writer.Write16(ia);
+	writer.Write16(value);
+	writer.Write16(pc);
+	writer.Write8(opcode);
+	writer.Write8(a);
+	writer.Write8(x);
+	writer.Write8(y);
+	writer.Write8(status);
+	writer.Write8(sp);
+	writer.Write8(addressModeCycle);
+	writer.Write8(opcodeOperation);
+	writer.WriteBool(CLIMaskingInterrupt);
+	writer.WriteBool(BranchTakenMaskingInterrupt);
+#ifdef  SUPPORT_IRQ
+	writer.WriteBool(IRQPending);
+	writer.WriteBool(IRQ.IsAsserted());
+#endif //  SUPPORT_IRQ
+#ifdef  SUPPORT_NMI
+	writer.WriteBool(NMIPending);
+	writer.WriteBool(NMI.IsAsserted());
+#endif //  SUPPORT_NMI
+#ifdef  SUPPORT_RDY_HALTING
+	writer.Write8(RDYCounter);
+	writer.WriteBool(RDYAsserted);
+	writer.WriteBool(RDYHalted);
+#endif //  SUPPORT_RDY_HALTING
+}
+
+bool M6502::IsSameState(const M6502& other) const
+{
+	return pc == other.pc && sp == other.sp && a == other.a && x == other.x && y == other.y && status == other.status
+		&& addressModeCycle == other.addressModeCycle && opcodeOperation == other.opcodeOperation
+		&& CLIMaskingInterrupt == other.CLIMaskingInterrupt && BranchTakenMaskingInterrupt == other.BranchTakenMaskingInterrupt
+#ifdef  SUPPORT_IRQ
+		&& IRQPending == other.IRQPending && IRQ.IsAsserted() == other.IRQ.IsAsserted()
+#endif //  SUPPORT_IRQ
+#ifdef  SUPPORT_NMI
+		&& NMIPending == other.NMIPending && NMI.IsAsserted() == other.NMI.IsAsserted()
+#endif //  SUPPORT_NMI
+		;
+}
+
+bool M6502::LoadState(SaveStateReader& reader)
+{
+	ea = reader.Read16();
+	ia = reader.Read16();
+	value = reader.Read16();
+	pc = reader.Read16();
+	opcode = reader.Read8();
+	a = reader.Read8();
+	x = reader.Read8();
+	y = reader.Read8();
+	status = reader.Read8();
+	sp = reader.Read8();
+	addressModeCycle = reader.Read8();
+	opcodeOperation = reader.Read8();
+	CLIMaskingInterrupt = reader.ReadBool();
+	BranchTakenMaskingInterrupt = reader.ReadBool();
+#ifdef  SUPPORT_IRQ
+	IRQPending = reader.ReadBool();
+	if (reader.ReadBool())
+		IRQ.Assert();
+	else
+		IRQ.Release();
+#endif //  SUPPORT_IRQ
+#ifdef  SUPPORT_NMI
+	NMIPending = reader.ReadBool();
+	if (reader.ReadBool())
+		NMI.Assert();
+	else
+		NMI.Release();
+#endif //  SUPPORT_NMI
+#ifdef  SUPPORT_RDY_HALTING
+	RDYCounter = reader.Read8();
+	RDYAsserted = reader.ReadBool();
+	RDYHalted = reader.ReadBool();
+#endif //  SUPPORT_RDY_HALTING
+	if (reader.Failed() || addressModeCycle >= AM_COUNT || opcodeOperation >= OP_COUNT)
+	{
+		Reset();
+		return false;
+	}
+	return true;
+}
@@ -32,6 +32,7 @@
 // (This is more than likely the reason why the real 6502 exhibits idiosyncrasies with branch taken and IRQ/NMI assertions (Idiosyncrasies that are also emulated here)).
 //
 // This emulator breaks up instructions into the correct sequence of functions which are called one after another, each taking a cycle. (Just like the real hardware's state machine)
+// The current state is a small integer (see M6502_CYCLES) and Step() switches on it so the cycle functions are inlined into one jump table.
 //
 // To use
 // You need to supply bus read and write functions. These take the form;-
@@ -61,6 +62,10 @@
 #ifndef M6502_H
 #define M6502_H
 #include "types.h"
+#include "SaveState.h"
+#if defined(PROFILE6502)
+#include "Profiler.h"
+#endif
 
 // Turn SUPPORT_RDY_HALTING on if you would like to support the RDY line and halting the CPU. (eg BA from the VIC-II in a C64)
 //#define SUPPORT_RDY_HALTING
@@ -87,9 +92,78 @@
 	{											\
 		oldpc = pc;								\
 		pc = (pc & 0xff00) | ((pc + ra) & 0xff);\
-		addressModeCycleFn = &M6502::rel_5_8_T2;\
+		addressModeCycle = AM_rel_5_8_T2;\
 	}											\
-	else addressModeCycleFn = &M6502::InstructionFetch;
+	else addressModeCycle = AM_InstructionFetch;
+
+// Every cycle the CPU can be in. Each entry X(name) has a matching member function name() that emulates that cycle.
+// Step() is switch threaded over these (AM_name) rather than calling through member function pointers.
+#define M6502_CYCLES(X) \
+	X(InstructionFetch) \
+	X(sb_1_T1) \
+	X(sb_jam_T1) \
+	X(imm_2_1_T1) \
+	X(rel_5_8_T1) X(rel_5_8_T2) X(rel_5_8_T3) \
+	X(zp_2_1_T1) X(zp_2_1_T2) \
+	X(zp_3_1_T1) X(zp_3_1_T2) \
+	X(abs_2_3_T1) X(abs_2_3_T2) X(abs_2_3_T3) \
+	X(abs_3_2_T1) X(abs_3_2_T2) X(abs_3_2_T3) \
+	X(idx_2_4_T1) X(idx_2_4_T2) X(idx_2_4_T3) X(idx_2_4_T4) X(idx_2_4_T5) \
+	X(idx_3_3_T1) X(idx_3_3_T2) X(idx_3_3_T3) X(idx_3_3_T4) X(idx_3_3_T5) \
+	X(idx_Undoc_T1) X(idx_Undoc_T2) X(idx_Undoc_T3) X(idx_Undoc_T4) X(idx_Undoc_T5) X(idx_Undoc_T6) X(idx_Undoc_T7) \
+	X(absx_2_5_T1) X(absx_2_5_T2) X(absx_2_5_T3) X(absx_2_5_T4) \
+	X(absx_3_4_T1) X(absx_3_4_T2) X(absx_3_4_T3) X(absx_3_4_T4) \
+	X(absy_2_5_T1) X(absy_2_5_T2) X(absy_2_5_T3) X(absy_2_5_T4) \
+	X(absy_3_4_T1) X(absy_3_4_T2) X(absy_3_4_T3) X(absy_3_4_T4) \
+	X(zpx_2_6_T1) X(zpx_2_6_T2) X(zpx_2_6_T3) \
+	X(zpx_3_5_T1) X(zpx_3_5_T2) X(zpx_3_5_T3) \
+	X(zpy_2_6_T1) X(zpy_2_6_T2) X(zpy_2_6_T3) \
+	X(zpy_3_5_T1) X(zpy_3_5_T2) X(zpy_3_5_T3) \
+	X(idy_2_7_T1) X(idy_2_7_T2) X(idy_2_7_T3) X(idy_2_7_T4) X(idy_2_7_T5) \
+	X(idy_3_6_T1) X(idy_3_6_T2) X(idy_3_6_T3) X(idy_3_6_T4) X(idy_3_6_T5) \
+	X(idy_Undoc_T1) X(idy_Undoc_T2) X(idy_Undoc_T3) X(idy_Undoc_T4) X(idy_Undoc_T5) X(idy_Undoc_T6) X(idy_Undoc_T7) \
+	X(zp_4_1_T1) X(zp_4_1_T2) X(zp_4_1_T3) X(zp_4_1_T4) \
+	X(abs_4_2_T1) X(abs_4_2_T2) X(abs_4_2_T3) X(abs_4_2_T4) X(abs_4_2_T5) \
+	X(zpx_4_3_T1) X(zpx_4_3_T2) X(zpx_4_3_T3) X(zpx_4_3_T4) X(zpx_4_3_T5) \
+	X(absx_4_4_T1) X(absx_4_4_T2) X(absx_4_4_T3) X(absx_4_4_T4) X(absx_4_4_T5) X(absx_4_4_T6) \
+	X(absy_4_4_T1) X(absy_4_4_T2) X(absy_4_4_T3) X(absy_4_4_T4) X(absy_4_4_T5) X(absy_4_4_T6) \
+	X(ph_5_1_T1) X(ph_5_1_T2) \
+	X(pl_5_2_T1) X(pl_5_2_T2) X(pl_5_2_T3) \
+	X(jsr_5_3_T1) X(jsr_5_3_T2) X(jsr_5_3_T3) X(jsr_5_3_T4) X(jsr_5_3_T5) \
+	X(rti_5_5_T1) X(rti_5_5_T2) X(rti_5_5_T3) X(rti_5_5_T4) X(rti_5_5_T5) \
+	X(abs5_6_1_T1) X(abs5_6_1_T2) \
+	X(abs5_6_2_T1) X(abs5_6_2_T2) X(abs5_6_2_T3) X(abs5_6_2_T4) \
+	X(rts_5_7_T1) X(rts_5_7_T2) X(rts_5_7_T3) X(rts_5_7_T4) X(rts_5_7_T5) \
+	X(brk_5_4_T1) X(brk_5_4_T2) X(brk_5_4_T3) X(brk_5_4_T4) X(brk_5_4_T5) X(brk_5_4_T6) \
+	X(Reset_T0) X(Reset_T1) X(Reset_T2) X(Reset_T3) X(Reset_T4) X(Reset_T5) X(Reset_T6) \
+	M6502_IRQ_CYCLES(X) \
+	M6502_NMI_CYCLES(X)
+
+#ifdef  SUPPORT_IRQ
+#define M6502_IRQ_CYCLES(X) \
+	X(InstructionFetchIRQ) \
+	X(IRQ_T1) X(IRQ_T2) X(IRQ_T3) X(IRQ_T4) X(IRQ_T5) X(IRQ_T6)
+#else
+#define M6502_IRQ_CYCLES(X)
+#endif //  SUPPORT_IRQ
+
+#ifdef  SUPPORT_NMI
+#define M6502_NMI_CYCLES(X) \
+	X(NMI_T1) X(NMI_T2) X(NMI_T3) X(NMI_T4) X(NMI_T5) X(NMI_T6)
+#else
+#define M6502_NMI_CYCLES(X)
+#endif //  SUPPORT_NMI
+
+// Every opcode operation. Each entry X(name) has a matching member function name(). Executed via a switch on OP_name.
+#define M6502_OPERATIONS(X) \
+	X(ADC) X(ANC) X(AND) X(ASL) X(BCC) X(BCS) X(BEQ) X(BIT) X(BMI) X(BNE) \
+	X(BPL) X(BVC) X(BVS) X(BRK) X(CLC) X(CLD) X(CLI) X(CLV) X(CMP) X(CPX) \
+	X(CPY) X(DEC) X(DEX) X(DEY) X(EOR) X(INC) X(INX) X(INY) X(JAM) X(JMP) \
+	X(JSR) X(LDA) X(LDX) X(LDY) X(LSR) X(NOP) X(ORA) X(PHA) X(PHP) X(PLA) \
+	X(PLP) X(ROL) X(ROR) X(RTI) X(RTS) X(SBC) X(SEC) X(SED) X(SEI) X(STA) \
+	X(STX) X(STY) X(TAX) X(TAY) X(TSX) X(TXA) X(TXS) X(TYA) \
+	X(ASR) X(LXA) X(ARR) X(LAX) X(LAS) X(SAX) X(SBX) X(SHA) X(SHY) X(DCP) \
+	X(ISB) X(SLO) X(RLA) X(SRE) X(RRA) X(SHS) X(SHX) X(XAA)
 
 typedef u8(*DataBusReadFn)(u16 address);
 typedef void(*DataBusWriteFn)(u16 address, const u8 value);
@@ -99,7 +173,7 @@ class Interrupt
 {
 public:
 	Interrupt() : asserted(false) { }
-	inline bool IsAsserted() { return asserted; }
+	inline bool IsAsserted() const { return asserted; }
 	inline void Assert()	{ asserted = true; }
 	inline void Release() { asserted = false; }
 	inline void Reset() { Release(); }
@@ -123,10 +197,23 @@ private:
 		FLAG_SIGN = 0x80
 	};
 
-	typedef void (M6502::*AddressModeCycleFunction)(void);	// Member function pointers for the starting cycle of the address mode functions.
-	static AddressModeCycleFunction T1AddressModeFunctions[256];
-	typedef void (M6502::*OpcodeCycleFunction)(void);		// Member function pointers for the opcodes.
-	static OpcodeCycleFunction opcodeFunctions[256];
+#define M6502_ENUM_ENTRY(name) AM_##name,
+	enum AddressModeCycle
+	{
+		M6502_CYCLES(M6502_ENUM_ENTRY)
+		AM_COUNT
+	};
+#undef M6502_ENUM_ENTRY
+#define M6502_ENUM_ENTRY(name) OP_##name,
+	enum OpcodeOperation
+	{
+		M6502_OPERATIONS(M6502_ENUM_ENTRY)
+		OP_COUNT
+	};
+#undef M6502_ENUM_ENTRY
+
+	static const u8 T1AddressModeCycles[256];	// The starting cycle of the address mode for each opcode.
+	static const u8 opcodeOperations[256];		// The operation for each opcode.
 
 	union
 	{
@@ -164,13 +251,19 @@ private:
 	u8 RDYHalted : 1;
 #endif //  SUPPORT_RDY_HALTING
 
+#if defined(PROFILE6502)
+	Profiler* profiler;
+#endif
+
 	DataBusReadFn dataBusReadFn;	// A pointer to the externally supplied Data Bus read function.
 	DataBusWriteFn dataBusWriteFn;	// A pointer to the externally supplied Data Bus write function.
 
-	AddressModeCycleFunction addressModeCycleFn;	// Our pointer to the function that will process the current address mode functionality for the current cycle.
-	OpcodeCycleFunction opcodeCycleFn;				// Our pointer to the function that will be called after (or during) the address mode cycle(s) that execute the actual opcode.
+	u8 addressModeCycle;	// The AddressModeCycle that will process the current address mode functionality for the current cycle.
+	u8 opcodeOperation;		// The OpcodeOperation that will be executed after (or during) the address mode cycle(s).
 
-	inline void ExecuteOpcode(void) { (this->*M6502::opcodeCycleFn)(); addressModeCycleFn = &M6502::InstructionFetch; } // Helper function to call opcodeCycleFn and set up for the next instruction fetch. 
+	inline void ExecuteCycle(void);	// Switch on addressModeCycle.
+	void ExecuteOperation(void);	// Switch on opcodeOperation. Deliberately not inline so there is only one copy of the operation switch.
+	inline void ExecuteOpcode(void) { ExecuteOperation(); addressModeCycle = AM_InstructionFetch; } // Helper function to execute the operation and set up for the next instruction fetch.
 
 	// Stack manipulation helpers.
 	inline void Push(u8 val) { dataBusWriteFn(0x100 + sp--, val); }
@@ -179,7 +272,7 @@ private:
 	// Helper function to write back the results of an instruction (to memory or the A register).
 	inline void WriteValue(u8 byte)
 	{
-		if (addressModeCycleFn == &M6502::sb_1_T1) a = byte;
+		if (addressModeCycle == AM_sb_1_T1) a = byte;
 		else dataBusWriteFn(ea, byte);
 	}
 
@@ -280,199 +373,199 @@ private:
 
 	void imm_2_1_T1(void) { value = BUS_READ(pc++); ExecuteOpcode(); } //2 cycles
 	
-	void rel_5_8_T1(void) { (this->*M6502::opcodeCycleFn)(); } // Branch instructions are the anomaly and execute their opcode in T1.
+	void rel_5_8_T1(void) { ExecuteOperation(); } // Branch instructions are the anomaly and execute their opcode in T1.
 	void rel_5_8_T2(void);
-	void rel_5_8_T3(void) { BUS_READ(pc); addressModeCycleFn = &M6502::InstructionFetch; } // Opcode has already been executed in T1 so just move on to the next instruction.
+	void rel_5_8_T3(void) { BUS_READ(pc); addressModeCycle = AM_InstructionFetch; } // Opcode has already been executed in T1 so just move on to the next instruction.
 
-	void zp_2_1_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::zp_2_1_T2; } //3 cycles
+	void zp_2_1_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_zp_2_1_T2; } //3 cycles
 	void zp_2_1_T2(void) { value = BUS_READ(ea); ExecuteOpcode(); }
 
-	void zp_3_1_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::zp_3_1_T2; } //3 cycles
+	void zp_3_1_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_zp_3_1_T2; } //3 cycles
 	void zp_3_1_T2(void) { ExecuteOpcode(); }
 
-	void abs_2_3_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::abs_2_3_T2; } //4 cycles
-	void abs_2_3_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycleFn = &M6502::abs_2_3_T3; }
+	void abs_2_3_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_abs_2_3_T2; } //4 cycles
+	void abs_2_3_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycle = AM_abs_2_3_T3; }
 	void abs_2_3_T3(void) { value = BUS_READ(ea); ExecuteOpcode(); }
 
-	void abs_3_2_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::abs_3_2_T2; } //4 cycles
-	void abs_3_2_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycleFn = &M6502::abs_3_2_T3; }
+	void abs_3_2_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_abs_3_2_T2; } //4 cycles
+	void abs_3_2_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycle = AM_abs_3_2_T3; }
 	void abs_3_2_T3(void) { ExecuteOpcode(); }
 
-	void idx_2_4_T1(void) { ia = BUS_READ(pc++); addressModeCycleFn = &M6502::idx_2_4_T2; } //6 cycles
-	void idx_2_4_T2(void) { BUS_READ(ia); addressModeCycleFn = &M6502::idx_2_4_T3; }
-	void idx_2_4_T3(void) { ia = (ia + x) & 0xff; ea = BUS_READ(ia++); addressModeCycleFn = &M6502::idx_2_4_T4; }
-	void idx_2_4_T4(void) { ea |= (BUS_READ(ia & 0xff) << 8); addressModeCycleFn = &M6502::idx_2_4_T5; }
+	void idx_2_4_T1(void) { ia = BUS_READ(pc++); addressModeCycle = AM_idx_2_4_T2; } //6 cycles
+	void idx_2_4_T2(void) { BUS_READ(ia); addressModeCycle = AM_idx_2_4_T3; }
+	void idx_2_4_T3(void) { ia = (ia + x) & 0xff; ea = BUS_READ(ia++); addressModeCycle = AM_idx_2_4_T4; }
+	void idx_2_4_T4(void) { ea |= (BUS_READ(ia & 0xff) << 8); addressModeCycle = AM_idx_2_4_T5; }
 	void idx_2_4_T5(void) { value = BUS_READ(ea); ExecuteOpcode(); }
 
-	void idx_3_3_T1(void) { ia = BUS_READ(pc++); addressModeCycleFn = &M6502::idx_3_3_T2; } //6 cycles
-	void idx_3_3_T2(void) { BUS_READ(ia); addressModeCycleFn = &M6502::idx_3_3_T3; }
-	void idx_3_3_T3(void) { ia = (ia + x) & 0xff; ea = BUS_READ(ia++); addressModeCycleFn = &M6502::idx_3_3_T4; }
-	void idx_3_3_T4(void) { ea |= (BUS_READ(ia & 0xff) << 8); addressModeCycleFn = &M6502::idx_3_3_T5; }
+	void idx_3_3_T1(void) { ia = BUS_READ(pc++); addressModeCycle = AM_idx_3_3_T2; } //6 cycles
+	void idx_3_3_T2(void) { BUS_READ(ia); addressModeCycle = AM_idx_3_3_T3; }
+	void idx_3_3_T3(void) { ia = (ia + x) & 0xff; ea = BUS_READ(ia++); addressModeCycle = AM_idx_3_3_T4; }
+	void idx_3_3_T4(void) { ea |= (BUS_READ(ia & 0xff) << 8); addressModeCycle = AM_idx_3_3_T5; }
 	void idx_3_3_T5(void) { ExecuteOpcode(); }
 
 	// idx_Undoc behaviour was determined by capturing bus activity on a real 6502 in a 1541 and confirmed by observing Visual6502.
-	void idx_Undoc_T1(void) { ia = BUS_READ(pc++); addressModeCycleFn = &M6502::idx_Undoc_T2; } //8 cycles
-	void idx_Undoc_T2(void) { BUS_READ(ia); addressModeCycleFn = &M6502::idx_Undoc_T3; }
-	void idx_Undoc_T3(void) { ia = (ia + x) & 0xff; ea = BUS_READ(ia++); addressModeCycleFn = &M6502::idx_Undoc_T4; }
-	void idx_Undoc_T4(void) { ea |= (BUS_READ(ia & 0xff) << 8); addressModeCycleFn = &M6502::idx_Undoc_T5; }
-	void idx_Undoc_T5(void) { value = BUS_READ(ea);  addressModeCycleFn = &M6502::idx_Undoc_T6; }
-	void idx_Undoc_T6(void) { dataBusWriteFn(ea, (u8)value); addressModeCycleFn = &M6502::idx_Undoc_T7; }
+	void idx_Undoc_T1(void) { ia = BUS_READ(pc++); addressModeCycle = AM_idx_Undoc_T2; } //8 cycles
+	void idx_Undoc_T2(void) { BUS_READ(ia); addressModeCycle = AM_idx_Undoc_T3; }
+	void idx_Undoc_T3(void) { ia = (ia + x) & 0xff; ea = BUS_READ(ia++); addressModeCycle = AM_idx_Undoc_T4; }
+	void idx_Undoc_T4(void) { ea |= (BUS_READ(ia & 0xff) << 8); addressModeCycle = AM_idx_Undoc_T5; }
+	void idx_Undoc_T5(void) { value = BUS_READ(ea);  addressModeCycle = AM_idx_Undoc_T6; }
+	void idx_Undoc_T6(void) { dataBusWriteFn(ea, (u8)value); addressModeCycle = AM_idx_Undoc_T7; }
 	void idx_Undoc_T7(void) { ExecuteOpcode(); }
 
-	void absx_2_5_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::absx_2_5_T2; } //4/5 cycles
-	void absx_2_5_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycleFn = &M6502::absx_2_5_T3; }
+	void absx_2_5_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_absx_2_5_T2; } //4/5 cycles
+	void absx_2_5_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycle = AM_absx_2_5_T3; }
 	void absx_2_5_T3(void);
 	void absx_2_5_T4(void) { value = BUS_READ(ea); ExecuteOpcode(); }
 
-	void absx_3_4_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::absx_3_4_T2; } //5 cycles
-	void absx_3_4_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycleFn = &M6502::absx_3_4_T3; }
-	void absx_3_4_T3(void) { BUS_READ(ea); ea += x; addressModeCycleFn = &M6502::absx_3_4_T4; }
+	void absx_3_4_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_absx_3_4_T2; } //5 cycles
+	void absx_3_4_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycle = AM_absx_3_4_T3; }
+	void absx_3_4_T3(void) { BUS_READ(ea); ea += x; addressModeCycle = AM_absx_3_4_T4; }
 	void absx_3_4_T4(void) { ExecuteOpcode(); }
 
-	void absy_2_5_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::absy_2_5_T2; } //4/5 cycles
-	void absy_2_5_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycleFn = &M6502::absy_2_5_T3; }
+	void absy_2_5_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_absy_2_5_T2; } //4/5 cycles
+	void absy_2_5_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycle = AM_absy_2_5_T3; }
 	void absy_2_5_T3(void);
 	void absy_2_5_T4(void) { value = BUS_READ(ea); ExecuteOpcode(); }
 
-	void absy_3_4_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::absy_3_4_T2; } //5 cycles
-	void absy_3_4_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycleFn = &M6502::absy_3_4_T3; }
-	void absy_3_4_T3(void) { BUS_READ(ea); ea += y; addressModeCycleFn = &M6502::absy_3_4_T4; }
+	void absy_3_4_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_absy_3_4_T2; } //5 cycles
+	void absy_3_4_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycle = AM_absy_3_4_T3; }
+	void absy_3_4_T3(void) { BUS_READ(ea); ea += y; addressModeCycle = AM_absy_3_4_T4; }
 	void absy_3_4_T4(void) { ExecuteOpcode(); }
 
-	void zpx_2_6_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::zpx_2_6_T2; } //4 cycles
-	void zpx_2_6_T2(void) { BUS_READ(ea); addressModeCycleFn = &M6502::zpx_2_6_T3; }
+	void zpx_2_6_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_zpx_2_6_T2; } //4 cycles
+	void zpx_2_6_T2(void) { BUS_READ(ea); addressModeCycle = AM_zpx_2_6_T3; }
 	void zpx_2_6_T3(void) { ea = (ea + x) & 0xFF; value = BUS_READ(ea); ExecuteOpcode(); }
 
-	void zpx_3_5_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::zpx_3_5_T2; } //4 cycles
-	void zpx_3_5_T2(void) { BUS_READ(ea); addressModeCycleFn = &M6502::zpx_3_5_T3; }
+	void zpx_3_5_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_zpx_3_5_T2; } //4 cycles
+	void zpx_3_5_T2(void) { BUS_READ(ea); addressModeCycle = AM_zpx_3_5_T3; }
 	void zpx_3_5_T3(void) { ea = (ea + x) & 0xFF; ExecuteOpcode(); }
 
-	void zpy_2_6_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::zpy_2_6_T2; } //4 cycles
-	void zpy_2_6_T2(void) { BUS_READ(ea); addressModeCycleFn = &M6502::zpy_2_6_T3; }
+	void zpy_2_6_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_zpy_2_6_T2; } //4 cycles
+	void zpy_2_6_T2(void) { BUS_READ(ea); addressModeCycle = AM_zpy_2_6_T3; }
 	void zpy_2_6_T3(void) { ea = (ea + y) & 0xFF; value = BUS_READ(ea); ExecuteOpcode(); }
 
-	void zpy_3_5_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::zpy_3_5_T2; } //4 cycles
-	void zpy_3_5_T2(void) { BUS_READ(ea); addressModeCycleFn = &M6502::zpy_3_5_T3; }
+	void zpy_3_5_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_zpy_3_5_T2; } //4 cycles
+	void zpy_3_5_T2(void) { BUS_READ(ea); addressModeCycle = AM_zpy_3_5_T3; }
 	void zpy_3_5_T3(void) { ea = (ea + y) & 0xFF; ExecuteOpcode(); }
 
-	void idy_2_7_T1(void) { ia = BUS_READ(pc++); addressModeCycleFn = &M6502::idy_2_7_T2; } //5/6 cycles
-	void idy_2_7_T2(void) { ea = BUS_READ(ia++); addressModeCycleFn = &M6502::idy_2_7_T3; }
-	void idy_2_7_T3(void) { ea |= (BUS_READ(ia & 0xff) << 8); addressModeCycleFn = &M6502::idy_2_7_T4; }
+	void idy_2_7_T1(void) { ia = BUS_READ(pc++); addressModeCycle = AM_idy_2_7_T2; } //5/6 cycles
+	void idy_2_7_T2(void) { ea = BUS_READ(ia++); addressModeCycle = AM_idy_2_7_T3; }
+	void idy_2_7_T3(void) { ea |= (BUS_READ(ia & 0xff) << 8); addressModeCycle = AM_idy_2_7_T4; }
 	void idy_2_7_T4(void);
 	void idy_2_7_T5(void) { value = BUS_READ(ea); ExecuteOpcode(); }
 
-	void idy_3_6_T1(void) { ia = BUS_READ(pc++); addressModeCycleFn = &M6502::idy_3_6_T2; } //6 cycles
-	void idy_3_6_T2(void) { ea = BUS_READ(ia++); addressModeCycleFn = &M6502::idy_3_6_T3; }
-	void idy_3_6_T3(void) { ea |= (BUS_READ(ia & 0xff) << 8); addressModeCycleFn = &M6502::idy_3_6_T4; }
-	void idy_3_6_T4(void) { ea += y; BUS_READ(ea); addressModeCycleFn = &M6502::idy_3_6_T5; }
+	void idy_3_6_T1(void) { ia = BUS_READ(pc++); addressModeCycle = AM_idy_3_6_T2; } //6 cycles
+	void idy_3_6_T2(void) { ea = BUS_READ(ia++); addressModeCycle = AM_idy_3_6_T3; }
+	void idy_3_6_T3(void) { ea |= (BUS_READ(ia & 0xff) << 8); addressModeCycle = AM_idy_3_6_T4; }
+	void idy_3_6_T4(void) { ea += y; BUS_READ(ea); addressModeCycle = AM_idy_3_6_T5; }
 	void idy_3_6_T5(void) { ExecuteOpcode(); }
 
 	// idy_Undoc behaviour was determined by capturing bus activity on a real 6502 in a 1541 and confirmed by Visual6502.
-	void idy_Undoc_T1(void) { ia = BUS_READ(pc++); addressModeCycleFn = &M6502::idy_Undoc_T2; } //8 cycles
-	void idy_Undoc_T2(void) { ea = BUS_READ(ia++); addressModeCycleFn = &M6502::idy_Undoc_T3; }
-	void idy_Undoc_T3(void) { ea |= (BUS_READ(ia & 0xff) << 8); addressModeCycleFn = &M6502::idy_Undoc_T4; }
-	void idy_Undoc_T4(void) { ea += y; BUS_READ(ea); addressModeCycleFn = &M6502::idy_Undoc_T5; }
-	void idy_Undoc_T5(void) { value = BUS_READ(ea);  addressModeCycleFn = &M6502::idy_Undoc_T6; }
-	void idy_Undoc_T6(void) { dataBusWriteFn(ea, (u8)value); addressModeCycleFn = &M6502::idy_Undoc_T7; }
+	void idy_Undoc_T1(void) { ia = BUS_READ(pc++); addressModeCycle = AM_idy_Undoc_T2; } //8 cycles
+	void idy_Undoc_T2(void) { ea = BUS_READ(ia++); addressModeCycle = AM_idy_Undoc_T3; }
+	void idy_Undoc_T3(void) { ea |= (BUS_READ(ia & 0xff) << 8); addressModeCycle = AM_idy_Undoc_T4; }
+	void idy_Undoc_T4(void) { ea += y; BUS_READ(ea); addressModeCycle = AM_idy_Undoc_T5; }
+	void idy_Undoc_T5(void) { value = BUS_READ(ea);  addressModeCycle = AM_idy_Undoc_T6; }
+	void idy_Undoc_T6(void) { dataBusWriteFn(ea, (u8)value); addressModeCycle = AM_idy_Undoc_T7; }
 	void idy_Undoc_T7(void) { ExecuteOpcode(); }
 
-	void zp_4_1_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::zp_4_1_T2; } //5 cycles
-	void zp_4_1_T2(void) { value = BUS_READ(ea); addressModeCycleFn = &M6502::zp_4_1_T3; }
-	void zp_4_1_T3(void) { dataBusWriteFn(ea, (u8)value); addressModeCycleFn = &M6502::zp_4_1_T4; }
+	void zp_4_1_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_zp_4_1_T2; } //5 cycles
+	void zp_4_1_T2(void) { value = BUS_READ(ea); addressModeCycle = AM_zp_4_1_T3; }
+	void zp_4_1_T3(void) { dataBusWriteFn(ea, (u8)value); addressModeCycle = AM_zp_4_1_T4; }
 	void zp_4_1_T4(void) { ExecuteOpcode(); }
 
-	void abs_4_2_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::abs_4_2_T2; } //6 cycles
-	void abs_4_2_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycleFn = &M6502::abs_4_2_T3; }
-	void abs_4_2_T3(void) { value = BUS_READ(ea); addressModeCycleFn = &M6502::abs_4_2_T4; }
-	void abs_4_2_T4(void) { dataBusWriteFn(ea, (u8)value); addressModeCycleFn = &M6502::abs_4_2_T5; }
+	void abs_4_2_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_abs_4_2_T2; } //6 cycles
+	void abs_4_2_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycle = AM_abs_4_2_T3; }
+	void abs_4_2_T3(void) { value = BUS_READ(ea); addressModeCycle = AM_abs_4_2_T4; }
+	void abs_4_2_T4(void) { dataBusWriteFn(ea, (u8)value); addressModeCycle = AM_abs_4_2_T5; }
 	void abs_4_2_T5(void) { ExecuteOpcode(); }
 
-	void zpx_4_3_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::zpx_4_3_T2; } //6 cycles
-	void zpx_4_3_T2(void) { BUS_READ(ea); addressModeCycleFn = &M6502::zpx_4_3_T3; }
-	void zpx_4_3_T3(void) { ea = (ea + x) & 0xFF; value = BUS_READ(ea); addressModeCycleFn = &M6502::zpx_4_3_T4; }
-	void zpx_4_3_T4(void) { dataBusWriteFn(ea, (u8)value); addressModeCycleFn = &M6502::zpx_4_3_T5; }
+	void zpx_4_3_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_zpx_4_3_T2; } //6 cycles
+	void zpx_4_3_T2(void) { BUS_READ(ea); addressModeCycle = AM_zpx_4_3_T3; }
+	void zpx_4_3_T3(void) { ea = (ea + x) & 0xFF; value = BUS_READ(ea); addressModeCycle = AM_zpx_4_3_T4; }
+	void zpx_4_3_T4(void) { dataBusWriteFn(ea, (u8)value); addressModeCycle = AM_zpx_4_3_T5; }
 	void zpx_4_3_T5(void) { ExecuteOpcode(); }
 
-	void absx_4_4_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::absx_4_4_T2; } //7 cycles
-	void absx_4_4_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycleFn = &M6502::absx_4_4_T3; }
-	void absx_4_4_T3(void) { ea += x; BUS_READ(ea); addressModeCycleFn = &M6502::absx_4_4_T4; }
-	void absx_4_4_T4(void) { value = BUS_READ(ea); addressModeCycleFn = &M6502::absx_4_4_T5; }
-	void absx_4_4_T5(void) { dataBusWriteFn(ea, (u8)value); addressModeCycleFn = &M6502::absx_4_4_T6; }
+	void absx_4_4_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_absx_4_4_T2; } //7 cycles
+	void absx_4_4_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycle = AM_absx_4_4_T3; }
+	void absx_4_4_T3(void) { ea += x; BUS_READ(ea); addressModeCycle = AM_absx_4_4_T4; }
+	void absx_4_4_T4(void) { value = BUS_READ(ea); addressModeCycle = AM_absx_4_4_T5; }
+	void absx_4_4_T5(void) { dataBusWriteFn(ea, (u8)value); addressModeCycle = AM_absx_4_4_T6; }
 	void absx_4_4_T6(void) { ExecuteOpcode(); }
 
-	void absy_4_4_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::absy_4_4_T2; } //7 cycles
-	void absy_4_4_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycleFn = &M6502::absy_4_4_T3; }
-	void absy_4_4_T3(void) { ea += y; BUS_READ(ea); addressModeCycleFn = &M6502::absy_4_4_T4; }
-	void absy_4_4_T4(void) { value = BUS_READ(ea); addressModeCycleFn = &M6502::absy_4_4_T5; }
-	void absy_4_4_T5(void) { dataBusWriteFn(ea, (u8)value); addressModeCycleFn = &M6502::absy_4_4_T6; }
+	void absy_4_4_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_absy_4_4_T2; } //7 cycles
+	void absy_4_4_T2(void) { ea |= (BUS_READ(pc++) << 8); addressModeCycle = AM_absy_4_4_T3; }
+	void absy_4_4_T3(void) { ea += y; BUS_READ(ea); addressModeCycle = AM_absy_4_4_T4; }
+	void absy_4_4_T4(void) { value = BUS_READ(ea); addressModeCycle = AM_absy_4_4_T5; }
+	void absy_4_4_T5(void) { dataBusWriteFn(ea, (u8)value); addressModeCycle = AM_absy_4_4_T6; }
 	void absy_4_4_T6(void) { ExecuteOpcode(); }
 
-	void ph_5_1_T1(void) { BUS_READ(pc); addressModeCycleFn = &M6502::ph_5_1_T2; } //3 cycles
+	void ph_5_1_T1(void) { BUS_READ(pc); addressModeCycle = AM_ph_5_1_T2; } //3 cycles
 	void ph_5_1_T2(void) { ExecuteOpcode(); }
 
-	void pl_5_2_T1(void) { BUS_READ(pc); addressModeCycleFn = &M6502::pl_5_2_T2; } //4 cycles
-	void pl_5_2_T2(void) { BUS_READ(0x100 + sp); addressModeCycleFn = &M6502::pl_5_2_T3; }
+	void pl_5_2_T1(void) { BUS_READ(pc); addressModeCycle = AM_pl_5_2_T2; } //4 cycles
+	void pl_5_2_T2(void) { BUS_READ(0x100 + sp); addressModeCycle = AM_pl_5_2_T3; }
 	void pl_5_2_T3(void) { ExecuteOpcode(); }
 
-	void jsr_5_3_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::jsr_5_3_T2; } //6 cycles
-	void jsr_5_3_T2(void) { BUS_READ(0x100 + sp); addressModeCycleFn = &M6502::jsr_5_3_T3; }
-	void jsr_5_3_T3(void) { Push((u8)((pc) >> 8)); addressModeCycleFn = &M6502::jsr_5_3_T4; }
-	void jsr_5_3_T4(void) { Push(pc & 0xff); addressModeCycleFn = &M6502::jsr_5_3_T5; }
+	void jsr_5_3_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_jsr_5_3_T2; } //6 cycles
+	void jsr_5_3_T2(void) { BUS_READ(0x100 + sp); addressModeCycle = AM_jsr_5_3_T3; }
+	void jsr_5_3_T3(void) { Push((u8)((pc) >> 8)); addressModeCycle = AM_jsr_5_3_T4; }
+	void jsr_5_3_T4(void) { Push(pc & 0xff); addressModeCycle = AM_jsr_5_3_T5; }
 	void jsr_5_3_T5(void) { ea |= (BUS_READ(pc++) << 8); pc = ea; ExecuteOpcode(); }
 
-	void rti_5_5_T1(void) { BUS_READ(pc++); addressModeCycleFn = &M6502::rti_5_5_T2; } //6 cycles
-	void rti_5_5_T2(void) { BUS_READ(0x100 + sp); addressModeCycleFn = &M6502::rti_5_5_T3; }
-	void rti_5_5_T3(void) { status = Pull(); addressModeCycleFn = &M6502::rti_5_5_T4; }
-	void rti_5_5_T4(void) { pc = Pull(); addressModeCycleFn = &M6502::rti_5_5_T5; }
+	void rti_5_5_T1(void) { BUS_READ(pc++); addressModeCycle = AM_rti_5_5_T2; } //6 cycles
+	void rti_5_5_T2(void) { BUS_READ(0x100 + sp); addressModeCycle = AM_rti_5_5_T3; }
+	void rti_5_5_T3(void) { status = Pull(); addressModeCycle = AM_rti_5_5_T4; }
+	void rti_5_5_T4(void) { pc = Pull(); addressModeCycle = AM_rti_5_5_T5; }
 	void rti_5_5_T5(void) { pc |= (Pull() << 8); ExecuteOpcode(); }
 
-	void abs5_6_1_T1(void) { ea = BUS_READ(pc++); addressModeCycleFn = &M6502::abs5_6_1_T2; } //3 cycles
+	void abs5_6_1_T1(void) { ea = BUS_READ(pc++); addressModeCycle = AM_abs5_6_1_T2; } //3 cycles
 	void abs5_6_1_T2(void) { ea |= (BUS_READ(pc++) << 8); ExecuteOpcode(); }
 
-	void abs5_6_2_T1(void) { ia = BUS_READ(pc++); addressModeCycleFn = &M6502::abs5_6_2_T2; } //5 cycles
-	void abs5_6_2_T2(void) { ia |= (BUS_READ(pc++) << 8); addressModeCycleFn = &M6502::abs5_6_2_T3; }
-	void abs5_6_2_T3(void) { ea = BUS_READ(ia++); addressModeCycleFn = &M6502::abs5_6_2_T4; }
+	void abs5_6_2_T1(void) { ia = BUS_READ(pc++); addressModeCycle = AM_abs5_6_2_T2; } //5 cycles
+	void abs5_6_2_T2(void) { ia |= (BUS_READ(pc++) << 8); addressModeCycle = AM_abs5_6_2_T3; }
+	void abs5_6_2_T3(void) { ea = BUS_READ(ia++); addressModeCycle = AM_abs5_6_2_T4; }
 	void abs5_6_2_T4(void) { ea |= (BUS_READ(ia) << 8); ExecuteOpcode(); }
 
-	void rts_5_7_T1(void) { BUS_READ(pc++); addressModeCycleFn = &M6502::rts_5_7_T2; } //6 cycles
-	void rts_5_7_T2(void) { BUS_READ(0x100 + sp); addressModeCycleFn = &M6502::rts_5_7_T3; }
-	void rts_5_7_T3(void) { pc = Pull(); addressModeCycleFn = &M6502::rts_5_7_T4; }
-	void rts_5_7_T4(void) { pc |= (Pull() << 8); addressModeCycleFn = &M6502::rts_5_7_T5; }
+	void rts_5_7_T1(void) { BUS_READ(pc++); addressModeCycle = AM_rts_5_7_T2; } //6 cycles
+	void rts_5_7_T2(void) { BUS_READ(0x100 + sp); addressModeCycle = AM_rts_5_7_T3; }
+	void rts_5_7_T3(void) { pc = Pull(); addressModeCycle = AM_rts_5_7_T4; }
+	void rts_5_7_T4(void) { pc |= (Pull() << 8); addressModeCycle = AM_rts_5_7_T5; }
 	void rts_5_7_T5(void) { BUS_READ(pc); pc++; ExecuteOpcode(); }
 
 	// The BRK, RESET, NMI and IRQ instructions are closely related.
 	// At T4 BRK can morph into one of the interrupts if that interrupt condition has subsequently occurred since the instruction started.
-	void brk_5_4_T1(void) { BUS_READ(pc); pc++; addressModeCycleFn = &M6502::brk_5_4_T2; } //7 cycles
-	void brk_5_4_T2(void) { Push((u8)(pc >> 8)); addressModeCycleFn = &M6502::brk_5_4_T3; }
-	void brk_5_4_T3(void) { Push(pc & 0xff); addressModeCycleFn = &M6502::brk_5_4_T4; }
+	void brk_5_4_T1(void) { BUS_READ(pc); pc++; addressModeCycle = AM_brk_5_4_T2; } //7 cycles
+	void brk_5_4_T2(void) { Push((u8)(pc >> 8)); addressModeCycle = AM_brk_5_4_T3; }
+	void brk_5_4_T3(void) { Push(pc & 0xff); addressModeCycle = AM_brk_5_4_T4; }
 	void brk_5_4_T4(void); // We check here if we continue on executing the BRK or take the interrupt.
-	void brk_5_4_T5(void) { ea = BUS_READ(0xFFFE); addressModeCycleFn = &M6502::brk_5_4_T6; } // Short burts of interrupt assertions will be correctly masked by the BRK in these 2 cycles.
+	void brk_5_4_T5(void) { ea = BUS_READ(0xFFFE); addressModeCycle = AM_brk_5_4_T6; } // Short burts of interrupt assertions will be correctly masked by the BRK in these 2 cycles.
 	void brk_5_4_T6(void) { SetI(); pc = ea | (BUS_READ(0xFFFF) << 8); ExecuteOpcode(); }
 
-	void Reset_T0(void) { sp = 0; BUS_READ(pc);	addressModeCycleFn = &M6502::Reset_T1; } //7 cycles
-	void Reset_T1(void) { BUS_READ(pc); addressModeCycleFn = &M6502::Reset_T2; }
-	void Reset_T2(void) { BUS_READ(0x100 + sp--); addressModeCycleFn = &M6502::Reset_T3; }
-	void Reset_T3(void) { BUS_READ(0x100 + sp--); addressModeCycleFn = &M6502::Reset_T4; }
-	void Reset_T4(void) { ClearB(); BUS_READ(0x100 + sp--); addressModeCycleFn = &M6502::Reset_T5; }
-	void Reset_T5(void) { ea = BUS_READ(0xFFFC); addressModeCycleFn = &M6502::Reset_T6; }
-	void Reset_T6(void) { pc = ea | (BUS_READ(0xFFFD) << 8); addressModeCycleFn = &M6502::InstructionFetch; }
+	void Reset_T0(void) { sp = 0; BUS_READ(pc);	addressModeCycle = AM_Reset_T1; } //7 cycles
+	void Reset_T1(void) { BUS_READ(pc); addressModeCycle = AM_Reset_T2; }
+	void Reset_T2(void) { BUS_READ(0x100 + sp--); addressModeCycle = AM_Reset_T3; }
+	void Reset_T3(void) { BUS_READ(0x100 + sp--); addressModeCycle = AM_Reset_T4; }
+	void Reset_T4(void) { ClearB(); BUS_READ(0x100 + sp--); addressModeCycle = AM_Reset_T5; }
+	void Reset_T5(void) { ea = BUS_READ(0xFFFC); addressModeCycle = AM_Reset_T6; }
+	void Reset_T6(void) { pc = ea | (BUS_READ(0xFFFD) << 8); addressModeCycle = AM_InstructionFetch; }
 
 #ifdef  SUPPORT_NMI
-	void NMI_T1(void) { BUS_READ(pc); addressModeCycleFn = &M6502::NMI_T2; } //7 cycles
-	void NMI_T2(void) { Push((u8)(pc >> 8)); addressModeCycleFn = &M6502::NMI_T3; }
-	void NMI_T3(void) { Push(pc & 0xff); addressModeCycleFn = &M6502::NMI_T4; }
-	void NMI_T4(void) { ClearB(); Push(status); status |= FLAG_INTERRUPT; addressModeCycleFn = &M6502::NMI_T5; }
-	void NMI_T5(void) { ea = BUS_READ(0xFFFA); addressModeCycleFn = &M6502::NMI_T6; }
-	void NMI_T6(void) { SetI(); pc = ea | (BUS_READ(0xFFFB) << 8); NMIPending = false; addressModeCycleFn = &M6502::InstructionFetch; }
+	void NMI_T1(void) { BUS_READ(pc); addressModeCycle = AM_NMI_T2; } //7 cycles
+	void NMI_T2(void) { Push((u8)(pc >> 8)); addressModeCycle = AM_NMI_T3; }
+	void NMI_T3(void) { Push(pc & 0xff); addressModeCycle = AM_NMI_T4; }
+	void NMI_T4(void) { ClearB(); Push(status); status |= FLAG_INTERRUPT; addressModeCycle = AM_NMI_T5; }
+	void NMI_T5(void) { ea = BUS_READ(0xFFFA); addressModeCycle = AM_NMI_T6; }
+	void NMI_T6(void) { SetI(); pc = ea | (BUS_READ(0xFFFB) << 8); NMIPending = false; addressModeCycle = AM_InstructionFetch; }
 #endif //  SUPPORT_NMI
 
 #ifdef  SUPPORT_IRQ
-	void IRQ_T1(void) { BUS_READ(pc); addressModeCycleFn = &M6502::IRQ_T2; } //7 cycles
-	void IRQ_T2(void) { Push((u8)(pc >> 8)); addressModeCycleFn = &M6502::IRQ_T3; }
-	void IRQ_T3(void) { Push(pc & 0xff); addressModeCycleFn = &M6502::IRQ_T4; }
+	void IRQ_T1(void) { BUS_READ(pc); addressModeCycle = AM_IRQ_T2; } //7 cycles
+	void IRQ_T2(void) { Push((u8)(pc >> 8)); addressModeCycle = AM_IRQ_T3; }
+	void IRQ_T3(void) { Push(pc & 0xff); addressModeCycle = AM_IRQ_T4; }
 	void IRQ_T4(void);  // We check here if we continue on executing as IRQ or morph into NMI
-	void IRQ_T5(void) { ea = BUS_READ(0xFFFE); addressModeCycleFn = &M6502::IRQ_T6; } // Short burts of NMI assertions will be correctly masked by the IRQ in these 2 cycles
-	void IRQ_T6(void) { SetI();	pc = ea | (BUS_READ(0xFFFF) << 8); addressModeCycleFn = &M6502::InstructionFetchIRQ; }
+	void IRQ_T5(void) { ea = BUS_READ(0xFFFE); addressModeCycle = AM_IRQ_T6; } // Short burts of NMI assertions will be correctly masked by the IRQ in these 2 cycles
+	void IRQ_T6(void) { SetI();	pc = ea | (BUS_READ(0xFFFF) << 8); addressModeCycle = AM_InstructionFetchIRQ; }
 #endif //  SUPPORT_IRQ
 
 	inline void ClearB() { status &= (~FLAG_BREAK); }
@@ -505,8 +598,19 @@ private:
 #endif //  SUPPORT_RDY_HALTING
 
 public:
-	M6502() : status(FLAG_CONSTANT), dataBusReadFn(0), dataBusWriteFn(0) {}
-	M6502(void* data, DataBusReadFn dataBusReadFn, DataBusWriteFn dataBusWriteFn) { SetBusFunctions(dataBusReadFn, dataBusWriteFn); }
+	M6502() : status(FLAG_CONSTANT), dataBusReadFn(0), dataBusWriteFn(0)
+	{
+#if defined(PROFILE6502)
+		profiler = 0;
+#endif
+	}
+	M6502(void* data, DataBusReadFn dataBusReadFn, DataBusWriteFn dataBusWriteFn)
+	{
+#if defined(PROFILE6502)
+		profiler = 0;
+#endif
+		SetBusFunctions(dataBusReadFn, dataBusWriteFn);
+	}
 	void SetBusFunctions(DataBusReadFn dataBusReadFn, DataBusWriteFn dataBusWriteFn) {this->dataBusReadFn = dataBusReadFn; this->dataBusWriteFn = dataBusWriteFn; status = FLAG_CONSTANT; Reset(); }
 	void Reset(void);
 	void Step(void);
@@ -524,8 +628,18 @@ public:
 	u8 GetX() const { return x;	}
 	u8 GetY() const { return y; }
 	u8 GetStatus() const { return status; }
+
+	// Registers, the current address mode cycle and operation, and the interrupt tracking flags (ie enough to resume mid instruction).
+	void SaveState(SaveStateWriter& writer) const;
+	bool LoadState(SaveStateReader& reader);
+	// True if the registers and everything that decides how the next instruction runs are the same.
+	bool IsSameState(const M6502& other) const;
+#if defined(PROFILE6502)
+	// Counts every cycle Step emulates against the instruction it belongs to. 0 stops profiling.
+	inline void SetProfiler(Profiler* profiler) { this->profiler = profiler; }
+#endif
 	// Emulate the 6502's SYNC signal and pin
-	bool SYNC(void) const { return addressModeCycleFn == &M6502::InstructionFetch; }
+	bool SYNC(void) const { return addressModeCycle == AM_InstructionFetch; }
 
 #ifdef  SUPPORT_IRQ
 	Interrupt IRQ;
@@ -22,13 +22,16 @@
 // A lot of empirical measurements, in the form of bus captures of a real Commodore 1541 VIA were taken to discover the exact behavior of the timers (especially timer 2 and all its idiosyncrasies).
 // Many comments in this file are taken from statements found in the 6522 data sheets.
 
-m6522::m6522()
+m6522::m6522() : irq(0), scheduler(0), slot(0), executed(0), nextEvent(0)
 {
 	Reset();
 }
 
 void m6522::Reset()
 {
+	if (scheduler)
+		executed = scheduler->Now();
+
 	functionControlRegister = 0;
 	auxiliaryControlRegister = 0;
 
@@ -84,6 +87,7 @@ void m6522::Reset()
 	cb1OutputShiftClockPositiveEdge = false;
 	cb2Shift = 0;
 	OutputIRQ();
+	Schedule();
 }
 
 void m6522::InputCA1(bool value)
@@ -102,16 +106,19 @@ void m6522::InputCA1(bool value)
 
 void m6522::InputCA2(bool value)
 {
+	Synchronise();
 	if ((functionControlRegister & FCR_CA2_IO) == 0) // CA2 is an input?
 	{
 		if (ca2 != value && ((functionControlRegister & FCR_CA2_EDGE_TRIGGER_MODE) != 0) == value)
 			SetInterrupt(IR_CA2);	// interrupt if we are tracking edges
 		ca2 = value;
 	}
+	Schedule();
 }
 
 void m6522::InputCB1(bool value)
 {
+	Synchronise();
 	if (cb1 != value && ((functionControlRegister & FCR_CB1) != 0) == value) // CB1 is an input?
 	{
 		unsigned char ddr = portB.GetDirection();
@@ -122,17 +129,20 @@ void m6522::InputCB1(bool value)
 		SetInterrupt(IR_CB1);
 	}
 	cb1 = value;
+	Schedule();
 }
 
 // If CB2 is not set to an output then reads the CB2 line and stores the value in cb2
 void m6522::InputCB2(bool value)
 {
+	Synchronise();
 	if ((functionControlRegister & FCR_CB2_IO) == 0) // CB2 is an input?
 	{
 		if (cb2 != value && ((functionControlRegister & FCR_CB2_EDGE_TRIGGER_MODE) != 0) == value)
 			SetInterrupt(IR_CB2);	// interrupt if we are tracking edges
 		cb2 = value;
 	}
+	Schedule();
 }
 
 // Update for a single cycle
@@ -403,12 +413,156 @@ void m6522::Execute()
 		break;
 	}
 	cb1Old = cb1;
+	executed++;
+}
+
+void m6522::CatchUp()
+{
+	u32 behind = scheduler->Now() - executed;
+	while (behind)
+	{
+		u32 quiet = QuietCycles();
+		if (quiet >= behind)
+		{
+			Skip(behind);
+			executed += behind;
+			break;
+		}
+		Skip(quiet);
+		executed += quiet;
+		Execute();
+		behind -= quiet + 1;
+	}
+	Schedule();
+}
+
+void m6522::Schedule()
+{
+	u32 quiet = QuietCycles();
+	if (quiet > 0x7fffffff)
+		quiet = 0x7fffffff;	// Owners compare the difference as signed
+	nextEvent = executed + quiet + 1;
+	if (scheduler)
+		scheduler->Post(slot, nextEvent);
+}
+
+void m6522::ConnectScheduler(Scheduler* scheduler, unsigned slot)
+{
+	this->scheduler = scheduler;
+	this->slot = slot;
+	if (scheduler)
+		scheduler->Connect(slot, OnEvent, this);
+	Rebase();
+}
+
+// Always posts a new event (even if something else has just brought the VIA up to date) so that the scheduler moves on.
+void m6522::OnEvent(void* context)
+{
+	m6522* VIA = (m6522*)context;
+	if (VIA->executed != VIA->scheduler->Now())
+		VIA->CatchUp();
+	else
+		VIA->Schedule();
+}
+
+void m6522::Rebase()
+{
+	if (scheduler)
+		executed = scheduler->Now();
+	Schedule();
 }
 
+u32 m6522::QuietCycles() const
+{
+	if ((ca2 && pulseCA2) || (cb2 && pulseCB2))
+		return 0;
+	if (auxiliaryControlRegister & ACR_SHIFTREG_CTRL)
+		return 0;	// Not worth modelling, the 1541 ROM never uses the shift register
+	if (t1TimedOut || t1Reload || t2TimedOut || t2Reload || (t2CountingPB6Mode != t2CountingPB6ModeOld))
+		return 0;
+	if (t2CountingDown && t2CountingPB6Mode)
+		return 0;	// Has to look at PB6 every cycle
+
+	u32 quiet = 0xffffffff;
+	if (t1Ticking)
+		quiet = t1c.value;	// Times out on the call after the counter reaches 0
+	if (t2CountingDown && !t2CountingPB6Mode)
+	{
+		u16 cycles = t2c.value - 1;	// Times out on the call that takes the counter to 0
+		if (cycles < quiet)
+			quiet = cycles;
+	}
+	return quiet;
+}
+
+void m6522::Skip(u32 cycles)
+{
+	if (cycles == 0)
+		return;
+
+	if (t1Ticking)
+		t1c.value -= cycles;
+
+	if (t2CountingDown && !t2CountingPB6Mode)
+	{
+		// Execute counts each time the low byte of the counter becomes 0xfe.
+		u32 first = (u8)(t2c.bytes.l + 2);
+		if (first == 0)
+			first = 0x100;
+		if (cycles >= first)
+			t2TimedOutCount += 1 + ((cycles - first) >> 8);
+		t2c.value -= cycles;
+	}
+
+	pb6Old = portB.GetInput() & ~portB.GetDirection() & 0x40;
+	cb1OutputShiftClockPositiveEdge = false;
+	cb1Old = cb1;
+}
+
+bool m6522::IsSameState(const m6522& other) const
+{
+	return functionControlRegister == other.functionControlRegister
+		&& auxiliaryControlRegister == other.auxiliaryControlRegister
+		&& interruptFlagRegister == other.interruptFlagRegister
+		&& interruptEnabledRegister == other.interruptEnabledRegister
+		&& portA.GetInput() == other.portA.GetInput()
+		&& portA.GetOutput() == other.portA.GetOutput()
+		&& portA.GetDirection() == other.portA.GetDirection()
+		&& latchPortA == other.latchPortA
+		&& latchedValueA == other.latchedValueA
+		&& ca1 == other.ca1
+		&& ca2 == other.ca2
+		&& pulseCA2 == other.pulseCA2
+		&& portB.GetInput() == other.portB.GetInput()
+		&& portB.GetOutput() == other.portB.GetOutput()
+		&& portB.GetDirection() == other.portB.GetDirection()
+		&& latchPortB == other.latchPortB
+		&& latchedValueB == other.latchedValueB
+		&& cb1 == other.cb1
+		&& cb2 == other.cb2
+		&& pulseCB2 == other.pulseCB2
+		&& t1l.value == other.t1l.value
+		&& t1Ticking == other.t1Ticking
+		&& t1OutPB7 == other.t1OutPB7
+		&& t1FreeRun == other.t1FreeRun
+		&& t1FreeRunIRQsOn == other.t1FreeRunIRQsOn
+		&& t1_pb7 == other.t1_pb7
+		&& t1OneShotTriggeredIRQ == other.t1OneShotTriggeredIRQ
+		&& t2Latch == other.t2Latch
+		&& t2CountingDown == other.t2CountingDown
+		&& t2CountingPB6Mode == other.t2CountingPB6Mode
+		&& t2OneShotTriggeredIRQ == other.t2OneShotTriggeredIRQ
+		&& shiftRegister == other.shiftRegister
+		&& bitsShiftedSoFar == other.bitsShiftedSoFar;
+}
+
+// Reads can clear flags and restart the shift register but never bring an event forward so there is no need to reschedule.
 unsigned char m6522::Read(unsigned int address)
 {
 	unsigned char value = 0;
 
+	Synchronise();
+
 	switch (address & 0xf)
 	{
 		case ORB:
@@ -483,6 +637,8 @@ unsigned char m6522::Peek(unsigned int address)
 {
 	unsigned char value = 0;
 
+	Synchronise();
+
 	switch (address & 0xf)
 	{
 		case ORB:
@@ -541,6 +697,8 @@ void m6522::Write(unsigned int address, unsigned char value)
 {
 	unsigned char ddr;
 
+	Synchronise();
+
 	switch (address & 0xf)
 	{
 		case ORB:
@@ -712,4 +870,114 @@ void m6522::Write(unsigned int address, unsigned char value)
 			WritePortA(value, false);
 		break;
 	}
+	Schedule();
+}
+
+void m6522::SaveState(SaveStateWriter& writer) const
+{
+	writer.Write8(functionControlRegister);
+	writer.Write8(auxiliaryControlRegister);
+
+	portA.SaveState(writer);
+	writer.WriteBool(latchPortA);
+	writer.Write8(latchedValueA);
+	writer.WriteBool(ca1);
+	writer.WriteBool(ca2);
+	writer.WriteBool(pulseCA2);
+
+	portB.SaveState(writer);
+	writer.WriteBool(latchPortB);
+	writer.Write8(latchedValueB);
+	writer.WriteBool(cb1);
+	writer.WriteBool(cb1Old);
+	writer.WriteBool(cb2);
+	writer.WriteBool(pulseCB2);
+
+	writer.Write16(t1c.value);
+	writer.Write16(t1l.value);
+	writer.WriteBool(t1Ticking);
+	writer.WriteBool(t1Reload);
+	writer.WriteBool(t1OutPB7);
+	writer.WriteBool(t1FreeRun);
+	writer.WriteBool(t1FreeRunIRQsOn);
+	writer.WriteBool(t1TimedOut);
+	writer.WriteBool(t1_pb7);
+	writer.WriteBool(t1OneShotTriggeredIRQ);
+
+	writer.Write16(t2c.value);
+	writer.Write8(t2Latch);
+	writer.WriteBool(t2Reload);
+	writer.WriteBool(t2CountingDown);
+	writer.WriteBool(t2CountingPB6ModeOld);
+	writer.WriteBool(t2CountingPB6Mode);
+	writer.WriteBool(t2TimedOut);
+	writer.WriteBool(t2LowTimedOut);
+	writer.WriteBool(t2OneShotTriggeredIRQ);
+	writer.Write32(t2TimedOutCount);
+	writer.Write8(pb6Old);
+
+	writer.Write8(interruptFlagRegister);
+	writer.Write8(interruptEnabledRegister);
+
+	writer.Write8(shiftRegister);
+	writer.Write32(bitsShiftedSoFar);
+	writer.Write32(cb1OutputShiftClock);
+	writer.Write8(cb2Shift);
+	writer.WriteBool(cb1OutputShiftClockPositiveEdge);
+}
+
+bool m6522::LoadState(SaveStateReader& reader)
+{
+	functionControlRegister = reader.Read8();
+	auxiliaryControlRegister = reader.Read8();
+
+	portA.LoadState(reader);
+	latchPortA = reader.ReadBool();
+	latchedValueA = reader.Read8();
+	ca1 = reader.ReadBool();
+	ca2 = reader.ReadBool();
+	pulseCA2 = reader.ReadBool();
+
+	portB.LoadState(reader);
+	latchPortB = reader.ReadBool();
+	latchedValueB = reader.Read8();
+	cb1 = reader.ReadBool();
+	cb1Old = reader.ReadBool();
+	cb2 = reader.ReadBool();
+	pulseCB2 = reader.ReadBool();
+
+	t1c.value = reader.Read16();
+	t1l.value = reader.Read16();
+	t1Ticking = reader.ReadBool();
+	t1Reload = reader.ReadBool();
+	t1OutPB7 = reader.ReadBool();
+	t1FreeRun = reader.ReadBool();
+	t1FreeRunIRQsOn = reader.ReadBool();
+	t1TimedOut = reader.ReadBool();
+	t1_pb7 = reader.ReadBool();
+	t1OneShotTriggeredIRQ = reader.ReadBool();
+
+	t2c.value = reader.Read16();
+	t2Latch = reader.Read8();
+	t2Reload = reader.ReadBool();
+	t2CountingDown = reader.ReadBool();
+	t2CountingPB6ModeOld = reader.ReadBool();
+	t2CountingPB6Mode = reader.ReadBool();
+	t2TimedOut = reader.ReadBool();
+	t2LowTimedOut = reader.ReadBool();
+	t2OneShotTriggeredIRQ = reader.ReadBool();
+	t2TimedOutCount = reader.Read32();
+	pb6Old = reader.Read8();
+
+	interruptFlagRegister = reader.Read8();
+	interruptEnabledRegister = reader.Read8();
+
+	shiftRegister = reader.Read8();
+	bitsShiftedSoFar = reader.Read32();
+	cb1OutputShiftClock = reader.Read32();
+	cb2Shift = reader.Read8();
+	cb1OutputShiftClockPositiveEdge = reader.ReadBool();
+
+	Rebase();
+	return !reader.Failed();
 }
@@ -20,6 +20,7 @@
 #define M6522_H
 
 #include "IOPort.h"
+#include "Scheduler.h"
 #include "m6502.h"
 
 class m6522
@@ -217,8 +218,21 @@ FCR/PCR
 	inline bool GetCB2() { return cb2; }
 	void InputCB2(bool value);
 
+	// Emulates one cycle. Only for a VIA that is not connected to a scheduler.
 	void Execute();
 
+	// Rather than calling Execute every cycle a VIA can be connected to its owner's Scheduler.
+	// The counters are then only brought up to date when a register is accessed or when the scheduler reaches NextEvent
+	// (the cycle a timer times out or something else happens that Execute has to do on the cycle) which the VIA posts to its slot.
+	void ConnectScheduler(Scheduler* scheduler, unsigned slot);
+	inline u32 NextEvent() const { return nextEvent; }
+	inline void Synchronise() { if (scheduler && executed != scheduler->Now()) CatchUp(); }
+	// The state was copied or loaded from elsewhere and is up to date as of now.
+	void Rebase();
+
+	// Compares everything the CPU can see other than the counters (see Pi1541::IdleLoopCheck).
+	bool IsSameState(const m6522& other) const;
+
 	unsigned char Read(unsigned int address);
 	unsigned char Peek(unsigned int address);
 	void Write(unsigned int address, unsigned char value);
@@ -227,7 +241,19 @@ FCR/PCR
 	{
 		return functionControlRegister;
 	}
+
+	// The IRQ line is not driven when loading; the CPU restores its own view of it.
+	void SaveState(SaveStateWriter& writer) const;
+	bool LoadState(SaveStateReader& reader);
 private:
+	static void OnEvent(void* context);
+	void CatchUp();
+	void Schedule();
+	// How many times Execute can be called before a counter times out or anything else the CPU can see changes.
+	u32 QuietCycles() const;
+	// The same as calling Execute that many times. Must be no more than QuietCycles.
+	void Skip(u32 cycles);
+
 	inline unsigned char ReadPortB()
 	{
 		unsigned char ddr = portB.GetDirection();
@@ -331,6 +357,11 @@ private:
 
 	Interrupt* irq;
 
+	Scheduler* scheduler;
+	unsigned slot;
+	u32 executed;		// The cycle the counters are up to date with
+	u32 nextEvent;
+
 	unsigned char functionControlRegister;
 	unsigned char auxiliaryControlRegister;
 
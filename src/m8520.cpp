@@ -85,13 +85,16 @@ extern u16 pc;
 extern bool bLoggingCYCs;
 
 
-m8520::m8520()
+m8520::m8520() : irq(0), scheduler(0), slot(0), executed(0), nextEvent(0)
 {
 	Reset();
 }
 
 void m8520::Reset()
 {
+	if (scheduler)
+		executed = scheduler->Now();
+
 	// The port pins are set as inputs and port registers to zero(although a read of the ports will return all highs because of passive pullups).
 	portA.SetDirection(0);
 	portB.SetDirection(0);
@@ -146,6 +149,7 @@ void m8520::Reset()
 	ICRMask = 0;
 	ICRData = 0;
 	//OutputIRQ();
+	Schedule();
 }
 
 extern u16 pc;
@@ -341,6 +345,87 @@ void m8520::Execute()
 	CNTPinOld = CNTPin;
 	timerAReloaded = false;
 	timerBReloaded = false;
+	executed++;
+}
+
+void m8520::CatchUp()
+{
+	u32 behind = scheduler->Now() - executed;
+	while (behind)
+	{
+		u32 quiet = QuietCycles();
+		if (quiet >= behind)
+		{
+			Skip(behind);
+			executed += behind;
+			break;
+		}
+		Skip(quiet);
+		executed += quiet;
+		Execute();
+		behind -= quiet + 1;
+	}
+	Schedule();
+}
+
+void m8520::Schedule()
+{
+	u32 quiet = QuietCycles();
+	if (quiet > 0x7fffffff)
+		quiet = 0x7fffffff;	// Owners compare the difference as signed
+	nextEvent = executed + quiet + 1;
+	if (scheduler)
+		scheduler->Post(slot, nextEvent);
+}
+
+void m8520::ConnectScheduler(Scheduler* scheduler, unsigned slot)
+{
+	this->scheduler = scheduler;
+	this->slot = slot;
+	if (scheduler)
+		scheduler->Connect(slot, OnEvent, this);
+	Rebase();
+}
+
+// Always posts a new event (even if something else has just brought the CIA up to date) so that the scheduler moves on.
+void m8520::OnEvent(void* context)
+{
+	m8520* CIA = (m8520*)context;
+	if (CIA->executed != CIA->scheduler->Now())
+		CIA->CatchUp();
+	else
+		CIA->Schedule();
+}
+
+void m8520::Rebase()
+{
+	if (scheduler)
+		executed = scheduler->Now();
+	Schedule();
+}
+
+u32 m8520::QuietCycles() const
+{
+	// A CNT edge is only counted on the cycle after it happens.
+	if (timerAReloaded || timerBReloaded || CNTPin != CNTPinOld)
+		return 0;
+
+	// Counting CNT edges or timer A underflows can only happen on a cycle timer A underflows (in the serial port output mode CNT is driven by timer A).
+	u32 quiet = 0xffffffff;
+	if (timerAActive && timerAMode == TA_MODE_PHI2)
+		quiet = timerACounter;	// Underflows on the call after the counter reaches 0
+	if (timerBActive && timerBMode == TB_MODE_PHI2 && timerBCounter < quiet)
+		quiet = timerBCounter;
+	return quiet;
+}
+
+void m8520::Skip(u32 cycles)
+{
+	if (timerAActive && timerAMode == TA_MODE_PHI2)
+		timerACounter -= cycles;
+	if (timerBActive && timerBMode == TB_MODE_PHI2)
+		timerBCounter -= cycles;
+	PCAsserted = PCAsserted > cycles ? PCAsserted - cycles : 0;
 }
 
 void m8520::SetPinFLAG(bool value)	// Active low
@@ -356,8 +441,9 @@ void m8520::SetPinFLAG(bool value)	// Active low
 
 void m8520::SetPinCNT(bool value)
 {
-	if (serialPortMode == SP_MODE_INPUT)
+	if (serialPortMode == SP_MODE_INPUT && CNTPin != value)
 	{
+		Synchronise();
 		if (!CNTPin && value)	// rising edge?
 		{
 			//DEBUG_LOG("C%d\r\n", serialBitsShiftedSoFar);
@@ -382,6 +468,7 @@ void m8520::SetPinCNT(bool value)
 			}
 		}
 		CNTPin = value;
+		Schedule();
 	}
 }
 
@@ -406,10 +493,13 @@ void m8520::SetPinTOD(bool value)
 	TODPin = value;
 }
 
+// Reads never bring an event forward so there is no need to reschedule.
 unsigned char m8520::Read(unsigned int address)
 {
 	unsigned char value = 0;
 
+	Synchronise();
+
 	switch (address & 0xf)
 	{
 		case ORA:
@@ -491,6 +581,8 @@ unsigned char m8520::Peek(unsigned int address)
 {
 	unsigned char value = 0;
 
+	Synchronise();
+
 	switch (address & 0xf)
 	{
 		case ORA:
@@ -550,6 +642,8 @@ void m8520::Write(unsigned int address, unsigned char value)
 {
 	unsigned char ddr;
 
+	Synchronise();
+
 	switch (address & 0xf)
 	{
 		case ORA:
@@ -861,4 +955,5 @@ void m8520::Write(unsigned int address, unsigned char value)
 			}
 		break;
 	}
+	Schedule();
 }
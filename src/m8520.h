@@ -20,6 +20,7 @@
 #define M8520_H
 
 #include "IOPort.h"
+#include "Scheduler.h"
 #include "m6502.h"
 #include "debug.h"
 
@@ -131,13 +132,22 @@ public:
 	inline IOPort* GetPortA() { return &portA; }
 	inline IOPort* GetPortB() { return &portB; }
 
+	// Emulates one cycle. Only for a CIA that is not connected to a scheduler.
 	void Execute();
 
+	// As with the m6522 the CIA can be connected to a Scheduler instead. The timers (and the serial port and timer B counts that only
+	// move when timer A underflows) are then brought up to date when a register is accessed, when CNT changes or when the counter reaches NextEvent.
+	// TOD only moves on edges of the TOD pin so it is always up to date.
+	void ConnectScheduler(Scheduler* scheduler, unsigned slot);
+	inline u32 NextEvent() const { return nextEvent; }
+	inline void Synchronise() { if (scheduler && executed != scheduler->Now()) CatchUp(); }
+	void Rebase();
+
 	unsigned char Read(unsigned int address);
 	unsigned char Peek(unsigned int address);
 	void Write(unsigned int address, unsigned char value);
 
-	bool IsPCAsserted() const { return PCAsserted; }
+	bool IsPCAsserted() { Synchronise(); return PCAsserted != 0; }
 	void SetPinFLAG(bool value);	// active low
 	void SetPinCNT(bool value);
 	bool GetPinCNT() const { return CNTPin; }
@@ -146,6 +156,14 @@ public:
 	void SetPinTOD(bool value);
 
 //private:
+	static void OnEvent(void* context);
+	void CatchUp();
+	void Schedule();
+	// How many times Execute can be called before a timer underflows or anything else the CPU can see changes.
+	u32 QuietCycles() const;
+	// The same as calling Execute that many times. Must be no more than QuietCycles.
+	void Skip(u32 cycles);
+
 	inline unsigned char ReadPortB()
 	{
 		unsigned char ddr = portB.GetDirection();
@@ -238,6 +256,11 @@ public:
 
 	Interrupt* irq;
 
+	Scheduler* scheduler;
+	unsigned slot;
+	u32 executed;		// The cycle the timers are up to date with
+	u32 nextEvent;
+
 	IOPort portA;
 	IOPort portB;
 
@@ -43,6 +43,9 @@ extern "C"
 #include "FileBrowser.h"
 #include "ScreenLCD.h"
 #include "SpinLock.h"
+#include "WriteBehind.h"
+#include "GCRCache.h"
+#include "Quirks.h"
 
 #include "logo.h"
 #include "sample.h"
@@ -51,11 +54,6 @@ extern "C"
 unsigned versionMajor = 1;
 unsigned versionMinor = 23;
 
-// When the emulated CPU starts we execute the first million odd cycles in non-real-time (ie as fast as possible so the emulated 1541 becomes responsive to CBM-Browser asap)
-// During these cycles the CPU is executing the ROM self test routines (these do not need to be cycle accurate)
-// ***1581*** Skip to AFCA (how many cycles is this?)
-#define FAST_BOOT_CYCLES 1003061
-
 #define COLOUR_BLACK RGBA(0, 0, 0, 0xff)
 #define COLOUR_WHITE RGBA(0xff, 0xff, 0xff, 0xff)
 #define COLOUR_RED RGBA(0xff, 0, 0, 0xff)
@@ -75,6 +73,11 @@ static const u8 snoopBackCommand[] = {
 static int snoopIndex = 0;
 static int snoopPC = 0;
 
+#if defined(PROFILE6502)
+// Where the emulated CPU spent its cycles. Logged and saved to PROFILER_FILE whenever emulation ends.
+static Profiler profiler;
+#endif
+
 enum EmulatingMode
 {
 	IEC_COMMANDS,
@@ -109,6 +112,8 @@ CEMMCDevice	m_EMMC;
 Screen screen;
 ScreenLCD* screenLCD = 0;
 Options options;
+// The images that need the emulation changed for them (from quirks.txt).
+static QuirkTable quirks;
 const char* fileBrowserSelectedName;
 u8 deviceID = 8;
 IEC_Commands m_IEC_Commands;
@@ -127,6 +132,12 @@ u32 clockCycles1MHz;
 #if not defined(EXPERIMENTALZERO)
 SpinLock core0RefreshingScreen;
 #endif
+#if defined(USE_MULTICORE)
+// The sectors written to while emulating are handed over to core0 to be saved while the emulation carries on.
+static WriteBehind writeBehind;
+#endif
+// The tracks extracted from NIBs and NBZs are kept on the SD card between mounts.
+static GCRCache gcrCache;
 unsigned int screenWidth = 1024;
 unsigned int screenHeight = 768;
 
@@ -239,9 +250,7 @@ extern "C"
 DWORD get_fattime() { return 0; }	// If you have hardware RTC return a correct value here. THis can then be reflected in file modification times/dates.
 
 extern u8 read6502(u16 address);
-extern u8 read6502ExtraRAM(u16 address);
 extern void write6502(u16 address, const u8 value);
-extern void write6502ExtraRAM(u16 address, const u8 value);
 extern u8 read6502_1581(u16 address);
 extern void write6502_1581(u16 address, const u8 value);
 
@@ -370,6 +379,8 @@ void UpdateScreen()
 	bool oldSRQ = false;
 
 	u32 oldTrack = 0;
+	u32 oldWriteBehindDepth = ~0;
+	u32 oldWriteBehindLag = ~0;
 	u32 textColour = COLOUR_BLACK;
 	u32 bgColour = COLOUR_WHITE;
 	u32 oldTemp = 0;
@@ -618,10 +629,31 @@ void UpdateScreen()
 //#endif
 		}
 
+#if defined(USE_MULTICORE)
+		// Save what the emulation has queued (the emulation waits for this to be done before it uses the file system again).
+		writeBehind.Service();
+
+		// Get the disks either side of the one in the drive ready to be swapped to.
+		bool prefetched = emulating != IEC_COMMANDS && diskCaddy.Prefetch();
+
+		u32 writeBehindDepth = writeBehind.Depth();
+		u32 writeBehindLag = writeBehind.Lag() / 1000;
+		if (writeBehindDepth != oldWriteBehindDepth || writeBehindLag != oldWriteBehindLag)
+		{
+			oldWriteBehindDepth = writeBehindDepth;
+			oldWriteBehindLag = writeBehindLag;
+			snprintf(tempBuffer, tempBufferSize, "SD %2d %5dms", writeBehindDepth, writeBehindLag);
+			screen.PrintText(false, 49 * 8, y, tempBuffer, textColour, bgColour);
+		}
+#endif
+
 		//if (options.GetSupportUARTInput())
 		//	UpdateUartControls(refreshUartStatusDisplay, oldLED, oldMotor, oldATN, oldDATA, oldCLOCK, oldTrack, romIndex);
 
 		// Go back to sleep. The USB irq will wake us up again.
+#if defined(USE_MULTICORE)
+		if (!prefetched)
+#endif
 		__asm ("WFE");
 	}
 #endif
@@ -650,24 +682,6 @@ static bool Snoop(u8 a)
 	return false;
 }
 
-//--------------------------------------------------------------------------------------
-// This is an implementation of FNV-1a
-// (http://www.isthe.com/chongo/tech/comp/fnv/)
-//--------------------------------------------------------------------------------------
-u32 HashBuffer(const void* pBuffer, u32 length)
-{
-	u8*	pu8Buffer = (u8*)pBuffer;
-	u32	hash = 0x811c9dc5U;
-
-	while (length)
-	{
-		hash ^= *pu8Buffer++;
-		hash *= 16777619U;
-		--length;
-	}
-	return hash;
-}
-
 EmulatingMode BeginEmulating(FileBrowser* fileBrowser, const char* filenameForIcon)
 {
 	DiskImage* diskImage = diskCaddy.SelectFirstImage();
@@ -761,13 +775,143 @@ void CheckAutoMountImage(EXIT_TYPE reset_reason , FileBrowser* fileBrowser)
 	}
 }
 
+// The emulation runs in batches of the cycles owed to the 1MHz clock. Normally that is one but if the checks between batches
+// (or a disk swap) took longer than 1us the cycles that went by are caught up on, up to this many.
+#define MAX_CATCH_UP_CYCLES 8
+// Only waits at least this long (in us) are used to hand a written sector over to be saved.
+#define IDLE_SAVE_MIN_WAIT 1000
+
+static inline unsigned ReadPacingClock()
+{
+#if defined(RPI2)
+	unsigned ct;
+	asm volatile ("mrc p15,0,%0,c9,c13,0" : "=r" (ct));
+	return ct;
+#else
+	return read32(ARM_SYSTIMER_CLO);
+#endif
+}
+
+// Waits for the 1MHz clock to tick past before and returns how many cycles are owed.
+static u32 WaitForCycles(unsigned& before)
+{
+	unsigned after;
+	u32 cycles;
+
+#if defined(RPI2)
+	do  // Sync to the 1MHz clock
+	{
+		asm volatile ("mrc p15,0,%0,c9,c13,0" : "=r" (after));
+	} while ((after - before) < clockCycles1MHz);
+	cycles = (after - before) / clockCycles1MHz;
+	before += cycles * clockCycles1MHz;
+#else
+	do	// Sync to the 1MHz clock
+	{
+		after = read32(ARM_SYSTIMER_CLO);
+	} while (after == before);
+	cycles = after - before;
+	before = after;
+#endif
+	if (cycles > MAX_CATCH_UP_CYCLES)
+	{
+		// If this ever occurs then we have taken far too long and lost cycles.
+		// Cycle accuracy is now in jeopardy. If this occurs during critical communication loops then emulation can fail!
+		//DEBUG_LOG("!");
+		cycles = MAX_CATCH_UP_CYCLES;
+	}
+	return cycles;
+}
+
+// The emulated CPU is paused at the start of an instruction at one of the snoop breakpoints.
+// See if it is executing CD:_ (ie back out of emulated image) and keep the breakpoint on the address being followed.
+static bool SnoopBreakpoint(u16 address, u8 a, const u16* cdAddresses, unsigned cdCount, u16* breakpoints)
+{
+	bool cd = false;
+
+	pc = address;
+	for (unsigned index = 0; index < cdCount; ++index)
+	{
+		if (snoopIndex == 0 && pc == cdAddresses[index])
+			snoopPC = pc;
+	}
+	if (pc == snoopPC)
+		cd = Snoop(a);
+
+	for (unsigned index = 0; index < cdCount; ++index)
+		breakpoints[index] = cdAddresses[index];
+	breakpoints[cdCount] = snoopPC;
+	return cd;
+}
+
+#if defined(RPI3)
+// Have the generic timer send an event every 32 ticks (1.7us at 19.2MHz) so that WFE dozes for no longer than that.
+static void EnableEventStream()
+{
+	u32 cntkctl;
+	asm volatile ("mrc p15,0,%0,c14,c1,0" : "=r" (cntkctl));
+	cntkctl &= ~0xf8;				// EVNTI and EVNTDIR
+	cntkctl |= (4 << 4) | (1 << 2);	// Event on bit 4 of the counter changing, EVNTEN
+	asm volatile ("mcr p15,0,%0,c14,c1,0" :: "r" (cntkctl));
+}
+
+static void DisableEventStream()
+{
+	u32 cntkctl;
+	asm volatile ("mrc p15,0,%0,c14,c1,0" : "=r" (cntkctl));
+	cntkctl &= ~(1 << 2);			// EVNTEN
+	asm volatile ("mcr p15,0,%0,c14,c1,0" :: "r" (cntkctl));
+}
+#endif
+
+// The emulated CPU is at the head of a loop that is known to change nothing but the VIA counters.
+// Instead of emulating the iterations wait for as long as they would take (or until an input changes) then skip the ones that have gone by.
+// On a Pi 3 the core sleeps in WFE between polls which keeps it cool while the drive is idle.
+static void IdleLoopFastForward(u32 iterations)
+{
+	u32 period = pi1541.IdleLoopPeriod();
+	u32 duration = iterations * period;
+	u32 inputs = IEC_Bus::ReadInputs();
+	u32 start = read32(ARM_SYSTIMER_CLO);
+	u32 elapsed;
+
+#if defined(USE_MULTICORE)
+	// Hand a sector that has been written to over to core0 to be saved. An input that changes meanwhile is seen once that is done.
+	DiskImage* diskImage = pi1541.drive.GetDiskImage();
+	if (duration >= IDLE_SAVE_MIN_WAIT && diskImage && diskImage->QueueUnsavedSector(writeBehind))
+		__asm ("SEV");
+#endif
+
+	do
+	{
+#if defined(RPI3)
+		asm volatile ("wfe");
+#endif
+		elapsed = read32(ARM_SYSTIMER_CLO) - start;
+	}
+	while (elapsed < duration && IEC_Bus::ReadInputs() == inputs);
+
+	if (elapsed < duration)
+		iterations = elapsed / period;	// Anything that changed is picked up by the next cycle emulated (at most one iteration late in emulated time, later in real time)
+	if (iterations)
+		pi1541.SkipIdleLoop(iterations);
+}
+
+// Drive::Insert only encodes the track under the head. The rest of the new disk's tracks are encoded here (nothing to do if core 0 has
+// prepared it) while the drive has no disk in it anyway, rather than each time the head steps onto one in the middle of realtime emulation.
+static void SwapDisk(DiskImage* diskImage)
+{
+	pi1541.drive.Insert(diskImage);
+	if (diskImage)
+		diskImage->PrepareAllTracks();
+}
+
 EXIT_TYPE Emulate1541(FileBrowser* fileBrowser)
 {
 	EXIT_TYPE exitReason = EXIT_UNKNOWN;
 	bool oldLED = false;
 	unsigned ctBefore = 0;
-	unsigned ctAfter = 0;
-	int cycleCount = 0;
+	u32 cyclesOwed = 1;
 	unsigned caddyIndex;
 	int headSoundCounter = 0;
 	int headSoundFreqCounter = 0;
@@ -776,6 +920,7 @@ EXIT_TYPE Emulate1541(FileBrowser* fileBrowser)
 	unsigned char oldHeadDir = 0;
 	int resetCount = 0;
 	bool refreshOutsAfterCPUStep = true;
+	bool idleFastForward = options.IdleFastForward() != 0;
 	unsigned numberOfImages = diskCaddy.GetNumberOfImages();
 	unsigned numberOfImagesMax = numberOfImages;
 	if (numberOfImagesMax > 10)
@@ -793,10 +938,9 @@ EXIT_TYPE Emulate1541(FileBrowser* fileBrowser)
 	// Force an update on all the buttons now before we start emulation mode. 
 	IEC_Bus::ReadBrowseMode();
 
-	bool extraRAM = options.GetExtraRAM();
-	DataBusReadFn dataBusRead = extraRAM ? read6502ExtraRAM : read6502;
-	DataBusWriteFn dataBusWrite = extraRAM ? write6502ExtraRAM : write6502;
-	pi1541.m6502.SetBusFunctions(dataBusRead, dataBusWrite);
+	u32 mountTime = read32(ARM_SYSTIMER_CLO);
+	pi1541.BuildMemoryMap(options.GetExtraRAM(), options.GetRAMBOard());
+	pi1541.m6502.SetBusFunctions(read6502, write6502);
 
 	IEC_Bus::VIA = &pi1541.VIA[0];
 	IEC_Bus::port = pi1541.VIA[0].GetPortB();
@@ -807,75 +951,88 @@ EXIT_TYPE Emulate1541(FileBrowser* fileBrowser)
 	//resetWhileEmulating = false;
 	selectedViaIECCommands = false;
 
-	u32 hash = pi1541.drive.GetDiskImage()->GetHash();
-	// 0x42c02586 = maniac_mansion_s1[lucasfilm_1989](ntsc).g64
-	// 0x18651422 = aliens[electric_dreams_1987].g64
-	// 0x2a7f4b77 = zak_mckracken_boot[activision_1988](manual)(!).g64
-	// 0x97732c3e = maniac_mansion_s1[activision_1987](!).g64
-	// 0x63f809d2 = 4x4_offroad_racing_s1[epyx_1988](ntsc)(!).g64
-	if (hash == 0x42c02586 || hash == 0x18651422 || hash == 0x2a7f4b77 || hash == 0x97732c3e || hash == 0x63f809d2)
+	DiskImage* diskImage = pi1541.drive.GetDiskImage();
+	DEBUG_LOG("Image hash %08x\r\n", diskImage->GetHash());
+	u32 imageQuirks = quirks.Find(diskImage->GetHash());
+	if (imageQuirks == 0)
 	{
-		refreshOutsAfterCPUStep = false;
+		imageQuirks = quirks.Find(diskImage->GetLegacyHash(), true);
+		if (imageQuirks)
+			DEBUG_LOG("quirks.txt can have %08x in place of FNV:%08x\r\n", diskImage->GetHash(), diskImage->GetLegacyHash());
 	}
+	if (imageQuirks & QUIRK_REFRESH_BUS_EARLY)
+		refreshOutsAfterCPUStep = false;
+	if (imageQuirks & QUIRK_NO_IDLE_FAST_FORWARD)
+		idleFastForward = false;
 
 	// Quickly get through 1541's self test code.
 	// This will make the emulated 1541 responsive to commands asap.
 	// During this time we don't need to set outputs.
-
-	while (cycleCount < FAST_BOOT_CYCLES)
+	// After the first time the state at the end of the self test is simply restored.
+	if (!pi1541.RestoreBootSnapshot(roms.currentROMIndex, deviceID))
 	{
-		IEC_Bus::ReadEmulationMode1541();
-
-		pi1541.m6502.SYNC();
-
-		pi1541.m6502.Step();
-
-		pi1541.Update();
-
-		cycleCount++;
+		pi1541.RunCycles(FAST_BOOT_CYCLES, RUN_READ_BUS);
+		pi1541.SaveBootSnapshot(roms.currentROMIndex, deviceID);
 	}
+	// Insert only encoded the track under the head. The rest are encoded now so that stepping never has to once emulation runs in realtime.
+	diskImage->PrepareAllTracks();
+	DEBUG_LOG("1541 ready %dus after mounting\r\n", read32(ARM_SYSTIMER_CLO) - mountTime);
 
 	// Self test code done. Begin realtime emulation.
 
-#if defined(RPI2)
-	asm volatile ("mrc p15,0,%0,c9,c13,0" : "=r" (ctBefore));
-#else
-	ctBefore = read32(ARM_SYSTIMER_CLO);
+#if defined(RPI3)
+	if (idleFastForward)
+		EnableEventStream();
 #endif
 
+#if defined(PROFILE6502)
+	profiler.Reset();
+	pi1541.m6502.SetProfiler(&profiler);
+#endif
+
+	static const u16 cdAddresses[] = { SNOOP_CD_CBM, SNOOP_CD_JIFFY_BOTH, SNOOP_CD_JIFFY_DRIVEONLY };
+	const unsigned cdCount = sizeof(cdAddresses) / sizeof(cdAddresses[0]);
+	u16 breakpoints[cdCount + 1];
+	for (unsigned index = 0; index < cdCount; ++index)
+		breakpoints[index] = cdAddresses[index];
+	breakpoints[cdCount] = snoopPC;
+	pi1541.SetBreakpoints(breakpoints, cdCount + 1);
+
+	u32 runFlags = RUN_BREAKPOINTS;
+	if (refreshOutsAfterCPUStep)
+		runFlags |= RUN_READ_BUS | RUN_REFRESH_BUS;
+	else
+		runFlags |= RUN_REFRESH_BUS_EARLY;
+	if (idleFastForward)
+		runFlags |= RUN_IDLE_LOOPS;
+
+	ctBefore = ReadPacingClock();
+
 	while (exitReason == EXIT_UNKNOWN)
 	{
-		if (refreshOutsAfterCPUStep)
-			IEC_Bus::ReadEmulationMode1541();
+		u32 cyclesRun = pi1541.RunCycles(cyclesOwed, runFlags);
+		cyclesOwed -= cyclesRun;
 
-		if (pi1541.m6502.SYNC())	// About to start a new instruction.
+		if (pi1541.IsPaused())	// About to start an instruction at a breakpoint or the head of an idle loop.
 		{
-			pc = pi1541.m6502.GetPC();
-			// See if the emulated cpu is executing CD:_ (ie back out of emulated image)
-			if (snoopIndex == 0 && (pc == SNOOP_CD_CBM || pc == SNOOP_CD_JIFFY_BOTH || pc == SNOOP_CD_JIFFY_DRIVEONLY)) snoopPC = pc;
+			if (SnoopBreakpoint(pi1541.m6502.GetPC(), pi1541.m6502.GetA(), cdAddresses, cdCount, breakpoints))
+			{
+				emulating = IEC_COMMANDS;
+				exitReason = EXIT_CD;
+			}
+			pi1541.SetBreakpoints(breakpoints, cdCount + 1);
 
-			if (pc == snoopPC)
+			if (idleFastForward)
 			{
-				if (Snoop(pi1541.m6502.GetA()))
+				u32 iterations = pi1541.IdleLoopIterations(IDLE_LOOP_MAX_WAIT);
+				if (iterations)
 				{
-					emulating = IEC_COMMANDS;
-					exitReason = EXIT_CD;
+					IdleLoopFastForward(iterations);
+					ctBefore = ReadPacingClock();
 				}
 			}
 		}
 
-		pi1541.m6502.Step();	// If the CPU reads or writes to the VIA then clk and data can change
-
-		//To artificialy delay the outputs later into the phi2's cycle (do this on future Pis that will be faster and perhaps too fast)
-		//read32(ARM_SYSTIMER_CLO);	//Each one of these is > 100ns
-		//read32(ARM_SYSTIMER_CLO);
-		//read32(ARM_SYSTIMER_CLO);
-
-//		IEC_Bus::ReadEmulationMode1541();
-		if (refreshOutsAfterCPUStep)
-			IEC_Bus::RefreshOuts1541();	// Now output all outputs.
-
-		IEC_Bus::OutputLED = pi1541.drive.IsLEDOn();
 #if defined(RPI3)
 		if (IEC_Bus::OutputLED ^ oldLED)
 		{
@@ -915,9 +1072,6 @@ EXIT_TYPE Emulate1541(FileBrowser* fileBrowser)
 		bool exitEmulation = inputMappings->Exit();
 		bool exitDoAutoLoad = inputMappings->AutoLoad();
 
-		// We have now output so HERE is where the next phi2 cycle starts.
-		pi1541.Update();
-
 
 		bool reset = IEC_Bus::IsReset();
 		if (reset)
@@ -935,35 +1089,13 @@ EXIT_TYPE Emulate1541(FileBrowser* fileBrowser)
 				exitReason = EXIT_AUTOLOAD;
 		}
 
-#if defined(RPI2)
-		do  // Sync to the 1MHz clock
-		{
-			asm volatile ("mrc p15,0,%0,c9,c13,0" : "=r" (ctAfter));
-		} while ((ctAfter - ctBefore) < clockCycles1MHz);
-#else
-		do	// Sync to the 1MHz clock
-		{
-			ctAfter = read32(ARM_SYSTIMER_CLO);
-			unsigned ct = ctAfter - ctBefore;
-			if (ct > 1)
-			{
-				// If this ever occurs then we have taken too long (ie >1us) and lost a cycle.
-				// Cycle accuracy is now in jeopardy. If this occurs during critical communication loops then emulation can fail!
-				//DEBUG_LOG("!");
-			}
-		} while (ctAfter == ctBefore);
-#endif
-		ctBefore = ctAfter;
-		
-		if (!refreshOutsAfterCPUStep)
-		{
-			IEC_Bus::ReadEmulationMode1541();
-			IEC_Bus::RefreshOuts1541();	// Now output all outputs.
-		}
+		if (cyclesOwed == 0)
+			cyclesOwed = WaitForCycles(ctBefore);
+
 #if not defined(EXPERIMENTALZERO)
 		if (options.SoundOnGPIO() && headSoundCounter > 0)
 		{
-			headSoundFreqCounter--;		// Continue updating a GPIO non DMA sound.
+			headSoundFreqCounter -= cyclesRun;		// Continue updating a GPIO non DMA sound.
 			if (headSoundFreqCounter <= 0)
 			{
 				headSoundFreqCounter = headSoundFreq;
@@ -979,14 +1111,20 @@ EXIT_TYPE Emulate1541(FileBrowser* fileBrowser)
 			bool prevDisk = inputMappings->PrevDisk();
 			if (nextDisk)
 			{
-				pi1541.drive.Insert(diskCaddy.PrevDisk());
+				SwapDisk(diskCaddy.PrevDisk());
+#if defined(USE_MULTICORE)
+				__asm ("SEV");	// Have core 0 prepare the new neighbours
+#endif
 #if defined(EXPERIMENTALZERO)
 				diskCaddy.Update();
 #endif
 			}
 			else if (prevDisk)
 			{
-				pi1541.drive.Insert(diskCaddy.NextDisk());
+				SwapDisk(diskCaddy.NextDisk());
+#if defined(USE_MULTICORE)
+				__asm ("SEV");	// Have core 0 prepare the new neighbours
+#endif
 #if defined(EXPERIMENTALZERO)
 				diskCaddy.Update();
 #endif
@@ -1001,7 +1139,10 @@ EXIT_TYPE Emulate1541(FileBrowser* fileBrowser)
 						DiskImage* diskImage = diskCaddy.SelectImage(caddyIndex);
 						if (diskImage && diskImage != pi1541.drive.GetDiskImage())
 						{
-							pi1541.drive.Insert(diskImage);
+							SwapDisk(diskImage);
+#if defined(USE_MULTICORE)
+							__asm ("SEV");
+#endif
 							break;
 						}
 					}
@@ -1011,6 +1152,26 @@ EXIT_TYPE Emulate1541(FileBrowser* fileBrowser)
 #endif
 		}
 	}
+
+#if defined(USE_MULTICORE)
+	writeBehind.Drain();
+#endif
+
+#if defined(RPI3)
+	if (idleFastForward)
+		DisableEventStream();
+#endif
+
+#if defined(PROFILE6502)
+	pi1541.m6502.SetProfiler(0);
+	profiler.Log(16, 16);
+	profiler.SaveToFile(PROFILER_FILE);
+#endif
+
+	u64 idleCycles = pi1541.GetIdleCycles();
+	u64 cycles = idleCycles + pi1541.GetBusyCycles();
+	if (cycles)
+		DEBUG_LOG("1541 idle for %d%% of %dms\r\n", (u32)(idleCycles * 100 / cycles), (u32)(cycles / 1000));
 	return exitReason;
 }
 
@@ -1020,8 +1181,7 @@ EXIT_TYPE Emulate1581(FileBrowser* fileBrowser)
 	EXIT_TYPE exitReason = EXIT_UNKNOWN;
 	bool oldLED = false;
 	unsigned ctBefore = 0;
-	unsigned ctAfter = 0;
-	int cycleCount = 0;
+	u32 cyclesOwed = 2;
 	unsigned caddyIndex;
 	int headSoundCounter = 0;
 	int headSoundFreqCounter = 0;
@@ -1047,53 +1207,48 @@ EXIT_TYPE Emulate1581(FileBrowser* fileBrowser)
 	// Force an update on all the buttons now before we start emulation mode. 
 	IEC_Bus::ReadBrowseMode();
 
-	DataBusReadFn dataBusRead = read6502_1581;
-	DataBusWriteFn dataBusWrite = write6502_1581;
-	pi1581.m6502.SetBusFunctions(dataBusRead, dataBusWrite);
+	pi1581.BuildMemoryMap();
+	pi1581.m6502.SetBusFunctions(read6502_1581, write6502_1581);
 
 	IEC_Bus::CIA = &pi1581.CIA;
 	IEC_Bus::port = pi1581.CIA.GetPortB();
 	pi1581.Reset();	// will call IEC_Bus::Reset();
 
-#if defined(RPI2)
-	asm volatile ("mrc p15,0,%0,c9,c13,0" : "=r" (ctBefore));
-#else
-	ctBefore = read32(ARM_SYSTIMER_CLO);
-#endif
-
 	//resetWhileEmulating = false;
 	selectedViaIECCommands = false;
 
 	oldTrack = pi1581.wd177x.GetCurrentTrack();
 
+#if defined(PROFILE6502)
+	profiler.Reset();
+	pi1581.m6502.SetProfiler(&profiler);
+#endif
+
+	static const u16 cdAddresses[] = { SNOOP_CD_CBM1581 };
+	const unsigned cdCount = sizeof(cdAddresses) / sizeof(cdAddresses[0]);
+	u16 breakpoints[cdCount + 1];
+	for (unsigned index = 0; index < cdCount; ++index)
+		breakpoints[index] = cdAddresses[index];
+	breakpoints[cdCount] = snoopPC;
+	pi1581.SetBreakpoints(breakpoints, cdCount + 1);
+
+	ctBefore = ReadPacingClock();
+
 	while (exitReason == EXIT_UNKNOWN)
 	{
-		IEC_Bus::ReadEmulationMode1581();
+		// The 1581's CPU runs at 2MHz so two of its cycles are owed for every tick of the 1MHz clock.
+		cyclesOwed -= pi1581.RunCycles(cyclesOwed, RUN_READ_BUS | RUN_REFRESH_BUS | RUN_BREAKPOINTS);
 
-		for (int cycle2MHz = 0; cycle2MHz < 2; ++cycle2MHz)
+		if (pi1581.IsPaused())	// About to start an instruction at a breakpoint.
 		{
-			if (pi1581.m6502.SYNC())	// About to start a new instruction.
+			if (SnoopBreakpoint(pi1581.m6502.GetPC(), pi1581.m6502.GetA(), cdAddresses, cdCount, breakpoints))
 			{
-				pc = pi1581.m6502.GetPC();
-				// See if the emulated cpu is executing CD:_ (ie back out of emulated image)
-				if (snoopIndex == 0 && (pc == SNOOP_CD_CBM1581)) snoopPC = pc;
-
-				if (pc == snoopPC)
-				{
-					if (Snoop(pi1581.m6502.GetA()))
-					{
-						emulating = IEC_COMMANDS;
-						exitReason = EXIT_CD;
-					}
-				}
+				emulating = IEC_COMMANDS;
+				exitReason = EXIT_CD;
 			}
-			pi1581.m6502.Step();
-			pi1581.Update();
+			pi1581.SetBreakpoints(breakpoints, cdCount + 1);
 		}
 
-		IEC_Bus::RefreshOuts1581();	// Now output all outputs.
-
-		IEC_Bus::OutputLED = pi1581.IsLEDOn();
 #if defined(RPI3)
 		if (IEC_Bus::OutputLED ^ oldLED)
 		{
@@ -1148,30 +1303,23 @@ EXIT_TYPE Emulate1581(FileBrowser* fileBrowser)
 				exitReason = EXIT_AUTOLOAD;
 		}
 
-#if defined(RPI2)
-		do  // Sync to the 1MHz clock
-		{
-			asm volatile ("mrc p15,0,%0,c9,c13,0" : "=r" (ctAfter));
-		} while ((ctAfter - ctBefore) < clockCycles1MHz);
-#else
-		do	// Sync to the 1MHz clock
-		{
-			ctAfter = read32(ARM_SYSTIMER_CLO);
-			unsigned ct = ctAfter - ctBefore;
-			if (ct > 1)
-			{
-				// If this ever occurs then we have taken too long (ie >1us) and lost a cycle.
-				// Cycle accuracy is now in jeopardy. If this occurs during critical communication loops then emulation can fail!
-				//DEBUG_LOG("!");
-			}
-		} while (ctAfter == ctBefore);
+#if defined(USE_MULTICORE)
+		// Copying a sector takes well under a microsecond so while the motor is off one can be handed over to core0 to be saved each time round.
+		if (!pi1581.IsMotorOn() && pi1581.GetDiskImage() && pi1581.GetDiskImage()->QueueUnsavedSector(writeBehind))
+			__asm ("SEV");
 #endif
-		ctBefore = ctAfter;
+
+		u32 ticks = 0;
+		if (cyclesOwed == 0)
+		{
+			ticks = WaitForCycles(ctBefore);
+			cyclesOwed = ticks * 2;
+		}
 
 #if not defined(EXPERIMENTALZERO)
 		if (options.SoundOnGPIO() && headSoundCounter > 0)
 		{
-			headSoundFreqCounter--;		// Continue updating a GPIO non DMA sound.
+			headSoundFreqCounter -= ticks;		// Continue updating a GPIO non DMA sound.
 			if (headSoundFreqCounter <= 0)
 			{
 				headSoundFreqCounter = headSoundFreq;
@@ -1188,6 +1336,9 @@ EXIT_TYPE Emulate1581(FileBrowser* fileBrowser)
 			if (nextDisk)
 			{
 				pi1581.Insert(diskCaddy.PrevDisk());
+#if defined(USE_MULTICORE)
+				__asm ("SEV");	// Have core 0 prepare the new neighbours
+#endif
 #if defined(EXPERIMENTALZERO)
 				diskCaddy.Update();
 #endif
@@ -1195,6 +1346,9 @@ EXIT_TYPE Emulate1581(FileBrowser* fileBrowser)
 			else if (prevDisk)
 			{
 				pi1581.Insert(diskCaddy.NextDisk());
+#if defined(USE_MULTICORE)
+				__asm ("SEV");	// Have core 0 prepare the new neighbours
+#endif
 #if defined(EXPERIMENTALZERO)
 				diskCaddy.Update();
 #endif
@@ -1210,6 +1364,9 @@ EXIT_TYPE Emulate1581(FileBrowser* fileBrowser)
 						if (diskImage && diskImage != pi1581.GetDiskImage())
 						{
 							pi1581.Insert(diskImage);
+#if defined(USE_MULTICORE)
+							__asm ("SEV");
+#endif
 							break;
 						}
 					}
@@ -1220,6 +1377,15 @@ EXIT_TYPE Emulate1581(FileBrowser* fileBrowser)
 		}
 
 	}
+#if defined(USE_MULTICORE)
+	writeBehind.Drain();
+#endif
+#if defined(PROFILE6502)
+	pi1581.m6502.SetProfiler(0);
+	profiler.Log(16, 16);
+	profiler.SaveToFile(PROFILER_FILE);
+#endif
+
 	return exitReason;
 }
 #endif
@@ -1235,6 +1401,11 @@ void emulator()
 	roms.lastManualSelectedROMIndex = 0;
 
 	diskCaddy.SetScreen(&screen, screenLCD, &roms);
+#if defined(USE_MULTICORE)
+	diskCaddy.PrefetchOnOtherCore(true);
+#endif
+	gcrCache.Configure(GCR_CACHE_DIRECTORY, options.GCRCacheSize());
+	DiskImage::SetGCRCache(&gcrCache);
 	fileBrowser = new FileBrowser(inputMappings, &diskCaddy, &roms, &deviceID, options.DisplayPNGIcons(), &screen, screenLCD, options.ScrollHighlightRate());
 	pi1541.Initialise();
 
@@ -1396,6 +1567,7 @@ void emulator()
 #endif
 			if (diskCaddy.Empty())
 				IEC_Bus::WaitMicroSeconds(2 * 1000000);
+			gcrCache.Flush();
 
 			IEC_Bus::WaitUntilReset();
 			emulating = IEC_COMMANDS;
@@ -1431,12 +1603,43 @@ extern "C"
 		DEBUG_LOG("emulator running on core %d\r\n", _get_core());
 		emulator();
 	}
+
+	static volatile u32 helpersStarted = 0;
+
+	// The cores that are otherwise idle sleep here until a NIB is loaded and then help extract its tracks.
+	void run_helper()
+	{
+		enable_MMU_and_IDCaches();
+		_enable_unaligned_access();
+
+		DEBUG_LOG("core %d helping extract NIB tracks\r\n", _get_core());
+		DataMemBarrier();
+		helpersStarted = helpersStarted + 1;
+		while (1)
+		{
+			if (!DiskImage::HelpExtractTracks())
+				__asm ("WFE");
+		}
+	}
 }
 static void start_core(int core, func_ptr func)
 {
 	write32(0x4000008C + 0x10 * core, (unsigned int)func);
 	__asm ("SEV");	// and wake it up.
 }
+
+// Each core is brought up on its own (as enabling its caches invalidates them) before the next is started.
+static void start_helpers(int firstCore)
+{
+	for (int core = firstCore; core < 4; ++core)
+	{
+		u32 started = helpersStarted;
+		start_core(core, _init_helper);
+		while (helpersStarted == started)
+		{
+		}
+	}
+}
 #endif
 
 static bool AttemptToLoadROM(char* ROMName)
@@ -1508,6 +1711,25 @@ static void LoadOptions()
 	}
 }
 
+static void LoadQuirks()
+{
+	FIL fp;
+
+	if (f_open(&fp, "quirks.txt", FA_READ) == FR_OK)
+	{
+		u32 bytesRead;
+		SetACTLed(true);
+		f_read(&fp, s_u8Memory, sizeof(s_u8Memory) - 1, &bytesRead);
+		SetACTLed(false);
+		f_close(&fp);
+		s_u8Memory[bytesRead] = 0;	// What options.txt left there must not be read as well
+
+		quirks.Process((char*)s_u8Memory);
+		DiskImage::SetLegacyHashing(quirks.HasLegacyEntries());
+		DEBUG_LOG("%d images have quirks\r\n", quirks.Entries());
+	}
+}
+
 void DisplayOptions(int y_pos)
 {
 #if not defined(EXPERIMENTALZERO)
@@ -1875,6 +2097,7 @@ extern "C"
 		f_mount(&fileSystemSD, "SD:", 1);
 
 		LoadOptions();
+		LoadQuirks();
 
 		InitialiseHardware();
 		enable_MMU_and_IDCaches();
@@ -1978,14 +2201,13 @@ extern "C"
 			screenLCD->ClearInit(0);
 
 #ifdef HAS_MULTICORE
-		start_core(3, _spin_core);
-		start_core(2, _spin_core);
 #ifdef USE_MULTICORE
+		start_helpers(2);
 		start_core(1, _init_core);
 		UpdateScreen();		// core0 now loops here where it will handle interrupts and passively update the screen.
 		while (1);
 #else
-		start_core(1, _spin_core);
+		start_helpers(1);
 #endif
 #endif
 #ifndef USE_MULTICORE
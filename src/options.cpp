@@ -130,6 +130,8 @@ Options::Options(void)
 	, graphIEC(0)
 	, displayTracks(0)
 	, quickBoot(0)
+	, idleFastForward(0)
+	, gcrCacheSize(32768)
 	, showOptions(0)
 	, displayPNGIcons(0)
 	, soundOnGPIO(0)
@@ -221,6 +223,8 @@ void Options::Process(char* buffer)
 		ELSE_CHECK_DECIMAL_OPTION(graphIEC)
 		ELSE_CHECK_DECIMAL_OPTION(displayTracks)
 		ELSE_CHECK_DECIMAL_OPTION(quickBoot)
+		ELSE_CHECK_DECIMAL_OPTION(idleFastForward)
+		ELSE_CHECK_DECIMAL_OPTION(gcrCacheSize)
 		ELSE_CHECK_DECIMAL_OPTION(showOptions)
 		ELSE_CHECK_DECIMAL_OPTION(displayPNGIcons)
 		ELSE_CHECK_DECIMAL_OPTION(soundOnGPIO)
@@ -62,6 +62,8 @@ public:
 	inline unsigned int GraphIEC() const { return graphIEC; }
 	inline unsigned int DisplayTracks() const { return displayTracks; }
 	inline unsigned int QuickBoot() const { return quickBoot; }
+	inline unsigned int IdleFastForward() const { return idleFastForward; }
+	inline unsigned int GCRCacheSize() const { return gcrCacheSize; }
 	inline unsigned int ShowOptions() const { return showOptions; }
 	inline unsigned int DisplayPNGIcons() const { return displayPNGIcons; }
 #if defined(EXPERIMENTALZERO)
@@ -131,6 +133,8 @@ private:
 	unsigned int graphIEC;
 	unsigned int displayTracks;
 	unsigned int quickBoot;
+	unsigned int idleFastForward;
+	unsigned int gcrCacheSize;
 	unsigned int showOptions;
 	unsigned int displayPNGIcons;
 	unsigned int soundOnGPIO;
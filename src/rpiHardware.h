@@ -136,6 +136,21 @@ extern "C" {
 #endif
 #include "rpi-mailbox-interface.h"
 
+#if defined(HOST_BUILD)
+	// The host build (see host/) has no peripherals so register accesses are routed to a simulated GPIO block and system timer.
+	extern u32 HostRead32(unsigned int nAddress);
+	extern void HostWrite32(unsigned int nAddress, u32 nValue);
+
+	static inline u32 read32(unsigned int nAddress)
+	{
+		return HostRead32(nAddress);
+	}
+
+	static inline void write32(unsigned int nAddress, u32 nValue)
+	{
+		HostWrite32(nAddress, nValue);
+	}
+#else
 	static inline u32 read32(unsigned int nAddress)
 	{
 		return *(u32 volatile *)nAddress;
@@ -145,6 +160,7 @@ extern "C" {
 	{
 		*(u32 volatile *)nAddress = nValue;
 	}
+#endif
 
 	static inline void delay_us(u32 amount)
 	{
@@ -187,7 +203,10 @@ extern "C" {
 //DMB - It prevents reordering of data accesses instructions across itself. All data accesses by this processor / core before the DMB will be visible to all other masters within the specified shareability domain before any of the data accesses after it.
 //		It also ensures that any explicit preceding data(or unified) cache maintenance operations have completed before any subsequent data accesses are executed.
 
-#if defined(RPI2) || defined(RPI3)
+#if defined(HOST_BUILD)
+	#define DataSyncBarrier()	__sync_synchronize()
+	#define DataMemBarrier() 	__sync_synchronize()
+#elif defined(RPI2) || defined(RPI3)
 	#define DataSyncBarrier()	asm volatile ("dsb" ::: "memory")
 	#define DataMemBarrier() 	asm volatile ("dmb" ::: "memory")
 